@@ -741,7 +741,7 @@ static struct i2c_board_info i2c_devs23_emul[] __initdata = {
 #endif	/* GPIO_SUB_PMIC_EN */
 #endif	/* CONFIG_REGULATOR_LP8720 */
 
-#ifdef CONFIG_ANDROID_RAM_CONSOLE
+#if defined(CONFIG_ANDROID_RAM_CONSOLE) || defined(CONFIG_PSTORE_RAM)
 static struct resource ram_console_resource[] = {
 	{
 		.flags = IORESOURCE_MEM,
@@ -1093,7 +1093,7 @@ static struct platform_device *midas_devices[] __initdata = {
 #ifdef CONFIG_SEC_WATCHDOG_RESET
 	&watchdog_reset_device,
 #endif
-#ifdef CONFIG_ANDROID_RAM_CONSOLE
+#if defined(CONFIG_ANDROID_RAM_CONSOLE) || defined(CONFIG_PSTORE_RAM)
 	&ram_console_device,
 #endif
 	/* Samsung Power Domain */
@@ -1457,7 +1457,7 @@ static struct i2c_board_info i2c_devs30[] __initdata = {
 
 #endif /* CONFIG_FELICA */
 
-#ifdef CONFIG_ANDROID_RAM_CONSOLE
+#if defined(CONFIG_ANDROID_RAM_CONSOLE) || defined(CONFIG_PSTORE_RAM)
 static struct resource ram_console_resource[] = {
 	{
 		.flags = IORESOURCE_MEM,
@@ -2146,7 +2146,7 @@ static struct platform_device *midas_devices[] __initdata = {
 #ifdef CONFIG_SEC_WATCHDOG_RESET
 	&watchdog_reset_device,
 #endif
-#ifdef CONFIG_ANDROID_RAM_CONSOLE
+#if defined(CONFIG_ANDROID_RAM_CONSOLE) || defined(CONFIG_PSTORE_RAM)
 	&ram_console_device,
 #endif
 	/* Samsung Power Domain */
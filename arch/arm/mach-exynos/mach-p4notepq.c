@@ -1124,7 +1124,7 @@ static struct i2c_board_info i2c_devs17_emul[] = {
 #endif	/* CONFIG_MOTOR_DRV_ISA1200 */
 #endif
 
-#ifdef CONFIG_ANDROID_RAM_CONSOLE
+#if defined(CONFIG_ANDROID_RAM_CONSOLE) || defined(CONFIG_PSTORE_RAM)
 static struct resource ram_console_resource[] = {
 	{
 		.flags = IORESOURCE_MEM,
@@ -1764,7 +1764,7 @@ static struct platform_device *midas_devices[] __initdata = {
 #ifdef CONFIG_SEC_WATCHDOG_RESET
 	&watchdog_reset_device,
 #endif
-#ifdef CONFIG_ANDROID_RAM_CONSOLE
+#if defined(CONFIG_ANDROID_RAM_CONSOLE) || defined(CONFIG_PSTORE_RAM)
 	&ram_console_device,
 #endif
 	/* Samsung Power Domain */
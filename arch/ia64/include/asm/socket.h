@@ -71,4 +71,6 @@
 
 #define SO_RXQ_OVFL             40
 
+#define SO_ZEROCOPY		60
+
 #endif /* _ASM_IA64_SOCKET_H */
@@ -932,8 +932,9 @@ static int erst_check_table(struct acpi_table_erst *erst_tab)
 static int erst_open_pstore(struct pstore_info *psi);
 static int erst_close_pstore(struct pstore_info *psi);
 static ssize_t erst_reader(u64 *id, enum pstore_type_id *type,
-		       struct timespec *time);
+		       struct timespec *time, char **buf);
 static u64 erst_writer(enum pstore_type_id type, size_t size);
+static int erst_clearer(enum pstore_type_id type, u64 id);
 
 static struct pstore_info erst_info = {
 	.owner		= THIS_MODULE,
@@ -942,7 +943,7 @@ static struct pstore_info erst_info = {
 	.close		= erst_close_pstore,
 	.read		= erst_reader,
 	.write		= erst_writer,
-	.erase		= erst_clear
+	.erase		= erst_clearer
 };
 
 #define CPER_CREATOR_PSTORE						\
@@ -983,7 +984,7 @@ static int erst_close_pstore(struct pstore_info *psi)
 }
 
 static ssize_t erst_reader(u64 *id, enum pstore_type_id *type,
-		       struct timespec *time)
+		       struct timespec *time, char **buf)
 {
 	int rc;
 	ssize_t len = 0;
@@ -1033,8 +1034,12 @@ skip:
 		time->tv_sec = 0;
 	time->tv_nsec = 0;
 
+	len -= sizeof(*rcd);
+	*buf = kmemdup(rcd->data, len, GFP_KERNEL);
+	if (!*buf)
+		rc = -ENOMEM;
 out:
-	return (rc < 0) ? rc : (len - sizeof(*rcd));
+	return (rc < 0) ? rc : len;
 }
 
 static u64 erst_writer(enum pstore_type_id type, size_t size)
@@ -1080,6 +1085,11 @@ static u64 erst_writer(enum pstore_type_id type, size_t size)
 	return rcd->hdr.record_id;
 }
 
+static int erst_clearer(enum pstore_type_id type, u64 id)
+{
+	return erst_clear(id);
+}
+
 static int __init erst_init(void)
 {
 	int rc = 0;
@@ -29,6 +29,8 @@
 #include <linux/async.h>
 #include <linux/suspend.h>
 #include <linux/timer.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "../base.h"
 #include "power.h"
@@ -196,6 +198,40 @@ static void initcall_debug_report(struct device *dev, ktime_t calltime,
 	}
 }
 
+#ifdef CONFIG_PM_DEVICE_TIMING
+static struct dpm_timing dpm_phase_timing[DPM_PHASE_COUNT];
+
+static void dpm_timing_add(struct dpm_timing *t, ktime_t starttime)
+{
+	s64 delta = ktime_us_delta(ktime_get(), starttime);
+	unsigned int usecs = clamp_t(s64, delta, 0, UINT_MAX);
+
+	t->count++;
+	t->total_us += usecs;
+	if (usecs > t->max_us)
+		t->max_us = usecs;
+	t->hist[min((fls(usecs) + 1) / 2, DPM_TIMING_BUCKETS - 1)]++;
+}
+
+/* Account a callback of @dev that was started at @starttime */
+static void dpm_timing_record(struct device *dev, enum dpm_phase phase,
+			      ktime_t starttime)
+{
+	dpm_timing_add(&dev->power.timing[phase], starttime);
+}
+
+/* Account a whole phase, over all devices, that was started at @starttime */
+static void dpm_timing_record_phase(enum dpm_phase phase, ktime_t starttime)
+{
+	dpm_timing_add(&dpm_phase_timing[phase], starttime);
+}
+#else
+static inline void dpm_timing_record(struct device *dev, enum dpm_phase phase,
+				     ktime_t starttime) {}
+static inline void dpm_timing_record_phase(enum dpm_phase phase,
+					   ktime_t starttime) {}
+#endif
+
 /**
  * dpm_wait - Wait for a PM operation to complete.
  * @dev: Device to wait for.
@@ -359,12 +395,14 @@ static void pm_dev_err(struct device *dev, pm_message_t state, char *info,
 		dev_name(dev), pm_verb(state.event), info, error);
 }
 
-static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
+static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info,
+			  enum dpm_phase phase)
 {
 	ktime_t calltime;
 	u64 usecs64;
 	int usecs;
 
+	dpm_timing_record_phase(phase, starttime);
 	calltime = ktime_get();
 	usecs64 = ktime_to_ns(ktime_sub(calltime, starttime));
 	do_div(usecs64, NSEC_PER_USEC);
@@ -377,9 +415,10 @@ static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
 }
 
 static int dpm_run_callback(pm_callback_t cb, struct device *dev,
-			    pm_message_t state, char *info)
+			    pm_message_t state, char *info,
+			    enum dpm_phase phase)
 {
-	ktime_t calltime;
+	ktime_t calltime, starttime;
 	int error;
 
 	if (!cb)
@@ -388,7 +427,9 @@ static int dpm_run_callback(pm_callback_t cb, struct device *dev,
 	calltime = initcall_debug_start(dev);
 
 	pm_dev_dbg(dev, state, info);
+	starttime = ktime_get();
 	error = cb(dev);
+	dpm_timing_record(dev, phase, starttime);
 	suspend_report_result(cb, error);
 
 	initcall_debug_report(dev, calltime, error);
@@ -396,17 +437,25 @@ static int dpm_run_callback(pm_callback_t cb, struct device *dev,
 	return error;
 }
 
+static bool is_async(struct device *dev)
+{
+	return dev->power.async_suspend && pm_async_enabled
+		&& !pm_trace_is_enabled();
+}
+
 /*------------------------- Resume routines -------------------------*/
 
 /**
  * device_resume_noirq - Execute an "early resume" callback for given device.
  * @dev: Device to handle.
  * @state: PM transition of the system being carried out.
+ * @async: If true, the device is being resumed asynchronously.
  *
  * The driver of @dev will not receive interrupts while this function is being
  * executed.
  */
-static int device_resume_noirq(struct device *dev, pm_message_t state)
+static int device_resume_noirq(struct device *dev, pm_message_t state,
+			       bool async)
 {
 	pm_callback_t callback = NULL;
 	char *info = NULL;
@@ -414,6 +463,8 @@ static int device_resume_noirq(struct device *dev, pm_message_t state)
 	struct timer_list timer;
 	struct dpm_drv_wd_data data;
 
+	dpm_wait(dev->parent, async);
+
 	data.dev = dev;
 	data.tsk = get_current();
 	init_timer_on_stack(&timer);
@@ -447,45 +498,74 @@ static int device_resume_noirq(struct device *dev, pm_message_t state)
 	del_timer_sync(&timer);
 	destroy_timer_on_stack(&timer);
 
-	error = dpm_run_callback(callback, dev, state, info);
+	error = dpm_run_callback(callback, dev, state, info, DPM_RESUME_NOIRQ);
+
+	complete_all(&dev->power.completion);
 
 	TRACE_RESUME(error);
 	return error;
 }
 
+static void async_resume_noirq(void *data, async_cookie_t cookie)
+{
+	struct device *dev = (struct device *)data;
+	int error;
+
+	error = device_resume_noirq(dev, pm_transition, true);
+	if (error)
+		pm_dev_err(dev, pm_transition, " async noirq", error);
+	put_device(dev);
+}
+
 /**
  * dpm_resume_noirq - Execute "noirq resume" callbacks for all devices.
  * @state: PM transition of the system being carried out.
  *
  * Call the "noirq" resume handlers for all devices in dpm_noirq_list and
- * enable device drivers to receive interrupts.
+ * enable device drivers to receive interrupts. Devices that allow
+ * asynchronous suspend and resume are handled in parallel with the rest,
+ * each one only waiting for its parent.
  */
 static void dpm_resume_noirq(pm_message_t state)
 {
+	struct device *dev;
 	ktime_t starttime = ktime_get();
 
 	mutex_lock(&dpm_list_mtx);
-	while (!list_empty(&dpm_noirq_list)) {
-		struct device *dev = to_device(dpm_noirq_list.next);
-		int error;
+	pm_transition = state;
 
+	list_for_each_entry(dev, &dpm_noirq_list, power.entry) {
+		INIT_COMPLETION(dev->power.completion);
+		if (is_async(dev)) {
+			get_device(dev);
+			async_schedule(async_resume_noirq, dev);
+		}
+	}
+
+	while (!list_empty(&dpm_noirq_list)) {
+		dev = to_device(dpm_noirq_list.next);
 		get_device(dev);
 		list_move_tail(&dev->power.entry, &dpm_late_early_list);
 		mutex_unlock(&dpm_list_mtx);
 
-		error = device_resume_noirq(dev, state);
-		if (error) {
-			suspend_stats.failed_resume_noirq++;
-			dpm_save_failed_step(SUSPEND_RESUME_NOIRQ);
-			dpm_save_failed_dev(dev_name(dev));
-			pm_dev_err(dev, state, " noirq", error);
+		if (!is_async(dev)) {
+			int error;
+
+			error = device_resume_noirq(dev, state, false);
+			if (error) {
+				suspend_stats.failed_resume_noirq++;
+				dpm_save_failed_step(SUSPEND_RESUME_NOIRQ);
+				dpm_save_failed_dev(dev_name(dev));
+				pm_dev_err(dev, state, " noirq", error);
+			}
 		}
 
 		mutex_lock(&dpm_list_mtx);
 		put_device(dev);
 	}
 	mutex_unlock(&dpm_list_mtx);
-	dpm_show_time(starttime, state, "noirq");
+	async_synchronize_full();
+	dpm_show_time(starttime, state, "noirq", DPM_RESUME_NOIRQ);
 	resume_device_irqs();
 }
 
@@ -493,10 +573,12 @@ static void dpm_resume_noirq(pm_message_t state)
  * device_resume_early - Execute an "early resume" callback for given device.
  * @dev: Device to handle.
  * @state: PM transition of the system being carried out.
+ * @async: If true, the device is being resumed asynchronously.
  *
  * Runtime PM is disabled for @dev while this function is being executed.
  */
-static int device_resume_early(struct device *dev, pm_message_t state)
+static int device_resume_early(struct device *dev, pm_message_t state,
+			       bool async)
 {
 	pm_callback_t callback = NULL;
 	char *info = NULL;
@@ -505,6 +587,8 @@ static int device_resume_early(struct device *dev, pm_message_t state)
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
 
+	dpm_wait(dev->parent, async);
+
 	if (dev->pm_domain) {
 		info = "early power domain ";
 		callback = pm_late_early_op(&dev->pm_domain->ops, state);
@@ -524,44 +608,73 @@ static int device_resume_early(struct device *dev, pm_message_t state)
 		callback = pm_late_early_op(dev->driver->pm, state);
 	}
 
-	error = dpm_run_callback(callback, dev, state, info);
+	error = dpm_run_callback(callback, dev, state, info, DPM_RESUME_EARLY);
 
 	TRACE_RESUME(error);
 
 	pm_runtime_enable(dev);
+
+	complete_all(&dev->power.completion);
 	return error;
 }
 
+static void async_resume_early(void *data, async_cookie_t cookie)
+{
+	struct device *dev = (struct device *)data;
+	int error;
+
+	error = device_resume_early(dev, pm_transition, true);
+	if (error)
+		pm_dev_err(dev, pm_transition, " async early", error);
+	put_device(dev);
+}
+
 /**
  * dpm_resume_early - Execute "early resume" callbacks for all devices.
  * @state: PM transition of the system being carried out.
+ *
+ * As in dpm_resume_noirq(), asynchronous devices are resumed in parallel.
  */
 static void dpm_resume_early(pm_message_t state)
 {
+	struct device *dev;
 	ktime_t starttime = ktime_get();
 
 	mutex_lock(&dpm_list_mtx);
-	while (!list_empty(&dpm_late_early_list)) {
-		struct device *dev = to_device(dpm_late_early_list.next);
-		int error;
+	pm_transition = state;
 
+	list_for_each_entry(dev, &dpm_late_early_list, power.entry) {
+		INIT_COMPLETION(dev->power.completion);
+		if (is_async(dev)) {
+			get_device(dev);
+			async_schedule(async_resume_early, dev);
+		}
+	}
+
+	while (!list_empty(&dpm_late_early_list)) {
+		dev = to_device(dpm_late_early_list.next);
 		get_device(dev);
 		list_move_tail(&dev->power.entry, &dpm_suspended_list);
 		mutex_unlock(&dpm_list_mtx);
 
-		error = device_resume_early(dev, state);
-		if (error) {
-			suspend_stats.failed_resume_early++;
-			dpm_save_failed_step(SUSPEND_RESUME_EARLY);
-			dpm_save_failed_dev(dev_name(dev));
-			pm_dev_err(dev, state, " early", error);
+		if (!is_async(dev)) {
+			int error;
+
+			error = device_resume_early(dev, state, false);
+			if (error) {
+				suspend_stats.failed_resume_early++;
+				dpm_save_failed_step(SUSPEND_RESUME_EARLY);
+				dpm_save_failed_dev(dev_name(dev));
+				pm_dev_err(dev, state, " early", error);
+			}
 		}
 
 		mutex_lock(&dpm_list_mtx);
 		put_device(dev);
 	}
 	mutex_unlock(&dpm_list_mtx);
-	dpm_show_time(starttime, state, "early");
+	async_synchronize_full();
+	dpm_show_time(starttime, state, "early", DPM_RESUME_EARLY);
 }
 
 /**
@@ -655,7 +768,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	}
 
  End:
-	error = dpm_run_callback(callback, dev, state, info);
+	error = dpm_run_callback(callback, dev, state, info, DPM_RESUME);
 	dev->power.is_suspended = false;
 
  Unlock:
@@ -681,12 +794,6 @@ static void async_resume(void *data, async_cookie_t cookie)
 	put_device(dev);
 }
 
-static bool is_async(struct device *dev)
-{
-	return dev->power.async_suspend && pm_async_enabled
-		&& !pm_trace_is_enabled();
-}
-
 /**
  *	dpm_drv_timeout - Driver suspend / resume watchdog handler
  *	@data: struct device which timed out
@@ -761,7 +868,7 @@ void dpm_resume(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
-	dpm_show_time(starttime, state, NULL);
+	dpm_show_time(starttime, state, NULL, DPM_RESUME);
 }
 
 /**
@@ -796,8 +903,11 @@ static void device_complete(struct device *dev, pm_message_t state)
 	}
 
 	if (callback) {
+		ktime_t starttime = ktime_get();
+
 		pm_dev_dbg(dev, state, info);
 		callback(dev);
+		dpm_timing_record(dev, DPM_COMPLETE, starttime);
 	}
 
 	device_unlock(dev);
@@ -813,6 +923,7 @@ static void device_complete(struct device *dev, pm_message_t state)
 void dpm_complete(pm_message_t state)
 {
 	struct list_head list;
+	ktime_t starttime = ktime_get();
 
 	might_sleep();
 
@@ -833,6 +944,7 @@ void dpm_complete(pm_message_t state)
 	}
 	list_splice(&list, &dpm_list);
 	mutex_unlock(&dpm_list_mtx);
+	dpm_timing_record_phase(DPM_COMPLETE, starttime);
 }
 
 /**
@@ -929,7 +1041,7 @@ callback:
 	del_timer_sync(&timer);
 	destroy_timer_on_stack(&timer);
 
-	return dpm_run_callback(callback, dev, state, info);
+	return dpm_run_callback(callback, dev, state, info, DPM_SUSPEND_NOIRQ);
 }
 
 /**
@@ -976,7 +1088,7 @@ static int dpm_suspend_noirq(pm_message_t state)
 	if (error)
 		dpm_resume_noirq(resume_event(state));
 	else
-		dpm_show_time(starttime, state, "noirq");
+		dpm_show_time(starttime, state, "noirq", DPM_SUSPEND_NOIRQ);
 	return error;
 }
 
@@ -1013,7 +1125,7 @@ static int device_suspend_late(struct device *dev, pm_message_t state)
 		callback = pm_late_early_op(dev->driver->pm, state);
 	}
 
-	return dpm_run_callback(callback, dev, state, info);
+	return dpm_run_callback(callback, dev, state, info, DPM_SUSPEND_LATE);
 }
 
 /**
@@ -1056,7 +1168,7 @@ static int dpm_suspend_late(pm_message_t state)
 	if (error)
 		dpm_resume_early(resume_event(state));
 	else
-		dpm_show_time(starttime, state, "late");
+		dpm_show_time(starttime, state, "late", DPM_SUSPEND_LATE);
 
 	return error;
 }
@@ -1091,11 +1203,13 @@ static int legacy_suspend(struct device *dev, pm_message_t state,
 			  int (*cb)(struct device *dev, pm_message_t state))
 {
 	int error;
-	ktime_t calltime;
+	ktime_t calltime, starttime;
 
 	calltime = initcall_debug_start(dev);
 
+	starttime = ktime_get();
 	error = cb(dev, state);
+	dpm_timing_record(dev, DPM_SUSPEND, starttime);
 	suspend_report_result(cb, error);
 
 	initcall_debug_report(dev, calltime, error);
@@ -1180,7 +1294,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 		callback = pm_op(dev->driver->pm, state);
 	}
 
-	error = dpm_run_callback(callback, dev, state, info);
+	error = dpm_run_callback(callback, dev, state, info, DPM_SUSPEND);
 
  End:
 	if (!error) {
@@ -1286,7 +1400,7 @@ int dpm_suspend(pm_message_t state)
 		suspend_stats.failed_suspend++;
 		dpm_save_failed_step(SUSPEND_SUSPEND);
 	} else
-		dpm_show_time(starttime, state, NULL);
+		dpm_show_time(starttime, state, NULL, DPM_SUSPEND);
 	return error;
 }
 
@@ -1328,7 +1442,10 @@ static int device_prepare(struct device *dev, pm_message_t state)
 	}
 
 	if (callback) {
+		ktime_t starttime = ktime_get();
+
 		error = callback(dev);
+		dpm_timing_record(dev, DPM_PREPARE, starttime);
 		suspend_report_result(callback, error);
 	}
 
@@ -1345,6 +1462,7 @@ static int device_prepare(struct device *dev, pm_message_t state)
  */
 int dpm_prepare(pm_message_t state)
 {
+	ktime_t starttime = ktime_get();
 	int error = 0;
 
 	might_sleep();
@@ -1383,6 +1501,8 @@ int dpm_prepare(pm_message_t state)
 		put_device(dev);
 	}
 	mutex_unlock(&dpm_list_mtx);
+	if (!error)
+		dpm_timing_record_phase(DPM_PREPARE, starttime);
 	return error;
 }
 
@@ -1425,3 +1545,113 @@ int device_pm_wait_for_dev(struct device *subordinate, struct device *dev)
 	return async_error;
 }
 EXPORT_SYMBOL_GPL(device_pm_wait_for_dev);
+
+#ifdef CONFIG_PM_DEVICE_TIMING
+static const char * const dpm_phase_names[DPM_PHASE_COUNT] = {
+	[DPM_PREPARE]		= "prepare",
+	[DPM_SUSPEND]		= "suspend",
+	[DPM_SUSPEND_LATE]	= "suspend_late",
+	[DPM_SUSPEND_NOIRQ]	= "suspend_noirq",
+	[DPM_RESUME_NOIRQ]	= "resume_noirq",
+	[DPM_RESUME_EARLY]	= "resume_early",
+	[DPM_RESUME]		= "resume",
+	[DPM_COMPLETE]		= "complete",
+};
+
+static void dpm_timing_show_one(struct seq_file *m, const char *name,
+				struct dpm_timing *timing)
+{
+	int phase, i;
+
+	for (phase = 0; phase < DPM_PHASE_COUNT; phase++) {
+		struct dpm_timing *t = &timing[phase];
+
+		if (!t->count)
+			continue;
+		seq_printf(m, "%s\t%s\t%u\t%llu\t%u", name,
+			   dpm_phase_names[phase], t->count,
+			   (unsigned long long)t->total_us, t->max_us);
+		for (i = 0; i < DPM_TIMING_BUCKETS; i++)
+			seq_printf(m, "\t%u", t->hist[i]);
+		seq_putc(m, '\n');
+	}
+}
+
+/*
+ * Devices move between these lists during a transition, so all of them
+ * are visited; dpm_list_mtx keeps every device on exactly one.
+ */
+static struct list_head *dpm_timing_lists[] = {
+	&dpm_list,
+	&dpm_prepared_list,
+	&dpm_suspended_list,
+	&dpm_late_early_list,
+	&dpm_noirq_list,
+};
+
+/**
+ * dpm_timing_show - Print suspend/resume callback timing.
+ * @m: seq_file to print the statistics into.
+ *
+ * The "all" lines time each phase as a whole, the others the callbacks of
+ * one device. Times are in microseconds; the histogram columns count
+ * callbacks that took under 1, 4, 16, ... 4^10 usecs and the rest.
+ */
+static int dpm_timing_show(struct seq_file *m, void *unused)
+{
+	struct device *dev;
+	int i;
+
+	seq_puts(m, "device\tphase\tcount\ttotal_us\tmax_us\t<1\t<4\t<16\t<64"
+		 "\t<256\t<1k\t<4k\t<16k\t<64k\t<256k\t<1M\t>=1M\n");
+	dpm_timing_show_one(m, "all", dpm_phase_timing);
+
+	mutex_lock(&dpm_list_mtx);
+	for (i = 0; i < ARRAY_SIZE(dpm_timing_lists); i++)
+		list_for_each_entry(dev, dpm_timing_lists[i], power.entry)
+			dpm_timing_show_one(m, dev_name(dev), dev->power.timing);
+	mutex_unlock(&dpm_list_mtx);
+
+	return 0;
+}
+
+static int dpm_timing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_timing_show, NULL);
+}
+
+/* Any write clears the statistics */
+static ssize_t dpm_timing_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct device *dev;
+	int i;
+
+	mutex_lock(&dpm_list_mtx);
+	memset(dpm_phase_timing, 0, sizeof(dpm_phase_timing));
+	for (i = 0; i < ARRAY_SIZE(dpm_timing_lists); i++)
+		list_for_each_entry(dev, dpm_timing_lists[i], power.entry)
+			memset(dev->power.timing, 0, sizeof(dev->power.timing));
+	mutex_unlock(&dpm_list_mtx);
+
+	return count;
+}
+
+static const struct file_operations dpm_timing_fops = {
+	.owner = THIS_MODULE,
+	.open = dpm_timing_open,
+	.read = seq_read,
+	.write = dpm_timing_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init dpm_timing_debugfs_init(void)
+{
+	debugfs_create_file("pm_device_timing", S_IRUGO | S_IWUSR, NULL, NULL,
+			    &dpm_timing_fops);
+	return 0;
+}
+
+late_initcall(dpm_timing_debugfs_init);
+#endif /* CONFIG_PM_DEVICE_TIMING */
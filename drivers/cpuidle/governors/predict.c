@@ -0,0 +1,505 @@
+/*
+ * predict.c - the predict idle governor
+ *
+ * Picks an idle state from a predicted idle duration that combines the
+ * distance to the next timer event, the lengths of the recent idle periods
+ * of the CPU and the IO it is waiting for.
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos.h>
+#include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/module.h>
+
+#include <trace/events/power.h>
+
+#define INTERVALS 8
+#define IOWAIT_MULT 10
+
+/*
+ * Concepts behind the predict governor
+ *
+ * The next timer event bounds how long the CPU can stay idle, but on a
+ * phone most idle periods are cut short by device interrupts (touch,
+ * modem, MMC completions) long before that. Entering a state with a large
+ * exit latency and target residency, such as AFTR or LPA on Exynos, for
+ * such a period costs both energy and wakeup latency.
+ *
+ * For every idle period the governor remembers how long it actually
+ * lasted and whether it ended early, i.e. in less than half of the time
+ * to the next timer. It keeps one such history for idle periods entered
+ * with IO pending on the CPU and one for the others, as IO completions are
+ * a wakeup source of their own.
+ *
+ * If at least half of the remembered idle periods of the current history
+ * ended early and before the next timer, the CPU is likely to be woken
+ * early again and the median of those periods is used as the prediction.
+ * Otherwise the next timer is.
+ *
+ * As in the menu governor, the exit latency of a state multiplied by a
+ * factor that grows with the number of tasks waiting for IO on this CPU
+ * must fit into the predicted duration: a CPU with IO in flight is about
+ * to get work and should not go deep.
+ *
+ * After each idle period the state that was actually entered is compared
+ * with the deepest state the measured residency would have allowed and
+ * counted as a hit, as too deep or as too shallow. The counts are in
+ * /sys/devices/system/cpu/cpuN/cpuidle/predict/stats, one line per state,
+ * along with the number of times the driver entered a shallower state
+ * than the selected one.
+ */
+
+struct predict_history {
+	unsigned int	intervals[INTERVALS];
+	/* bit i is set if intervals[i] ended before the next timer */
+	unsigned int	early;
+	int		ptr;
+};
+
+struct predict_stats {
+	unsigned long	hits;
+	unsigned long	too_deep;
+	unsigned long	too_shallow;
+	unsigned long	demoted;
+};
+
+struct predict_device {
+	int		last_state_idx;
+	int		needs_update;
+
+	unsigned int	timer_us;
+	unsigned int	predicted_us;
+	int		latency_req;
+	int		iowait;
+	struct predict_history history[2];
+	struct predict_stats stats[CPUIDLE_STATE_MAX];
+	struct kobject	*kobj;
+};
+
+enum {
+	PREDICT_HIT,
+	PREDICT_TOO_DEEP,
+	PREDICT_TOO_SHALLOW,
+};
+
+static DEFINE_PER_CPU(struct predict_device, predict_devices);
+
+static void predict_update(struct cpuidle_device *dev);
+
+/*
+ * Median of the idle periods of @h that ended early and would also have
+ * ended before @timer_us, or @timer_us if fewer than half of the history
+ * did so.
+ */
+static unsigned int predict_duration(struct predict_history *h,
+				     unsigned int timer_us)
+{
+	unsigned int early[INTERVALS];
+	int i, j, n = 0;
+
+	for (i = 0; i < INTERVALS; i++) {
+		unsigned int us = h->intervals[i];
+
+		if (!(h->early & (1 << i)) || us >= timer_us)
+			continue;
+		/* insertion sort, there are at most 8 of them */
+		for (j = n; j > 0 && early[j - 1] > us; j--)
+			early[j] = early[j - 1];
+		early[j] = us;
+		n++;
+	}
+
+	if (n * 2 < INTERVALS)
+		return timer_us;
+	return early[(n - 1) / 2];
+}
+
+/* Remember an idle period of @measured_us with the next timer at @timer_us */
+static void predict_history_add(struct predict_history *h,
+				unsigned int measured_us, unsigned int timer_us)
+{
+	h->intervals[h->ptr] = measured_us;
+	if (measured_us * 2 < timer_us)
+		h->early |= 1 << h->ptr;
+	else
+		h->early &= ~(1 << h->ptr);
+	if (++h->ptr >= INTERVALS)
+		h->ptr = 0;
+}
+
+/*
+ * Deepest state whose target residency and exit latency, scaled by
+ * @multiplier, fit @predicted_us and whose exit latency meets @latency_req.
+ */
+static int predict_pick_state(struct cpuidle_device *dev,
+			      unsigned int predicted_us, int latency_req,
+			      unsigned int multiplier)
+{
+	int i, idx = 0;
+
+	/* states are ordered by increasing depth */
+	for (i = CPUIDLE_DRIVER_STATE_START; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+
+		if (s->flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (s->target_residency > predicted_us)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+		if (s->exit_latency * multiplier > predicted_us)
+			continue;
+
+		idx = i;
+	}
+	return idx;
+}
+
+/**
+ * predict_select - selects the next idle state to enter
+ * @dev: the CPU
+ */
+static int predict_select(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &__get_cpu_var(predict_devices);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned long nr_iowait = nr_iowait_cpu(smp_processor_id());
+	unsigned int multiplier;
+	struct timespec t;
+
+	if (data->needs_update) {
+		predict_update(dev);
+		data->needs_update = 0;
+	}
+
+	data->last_state_idx = 0;
+	data->latency_req = latency_req;
+	data->iowait = nr_iowait ? 1 : 0;
+
+	t = ktime_to_timespec(tick_nohz_get_sleep_length());
+	data->timer_us = t.tv_sec * USEC_PER_SEC + t.tv_nsec / NSEC_PER_USEC;
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0)) {
+		data->predicted_us = 0;
+		goto out;
+	}
+
+	data->predicted_us = predict_duration(&data->history[data->iowait],
+					      data->timer_us);
+	multiplier = 1 + IOWAIT_MULT * nr_iowait;
+	data->last_state_idx = predict_pick_state(dev, data->predicted_us,
+						  latency_req, multiplier);
+
+out:
+	trace_cpuidle_select(dev->cpu, data->last_state_idx, data->timer_us,
+			     data->predicted_us, nr_iowait);
+
+	return data->last_state_idx;
+}
+
+/**
+ * predict_reflect - records that data structures need update
+ * @dev: the CPU
+ *
+ * Like menu, the work is deferred to the next predict_select() to keep the
+ * exit path short.
+ */
+static void predict_reflect(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &__get_cpu_var(predict_devices);
+
+	data->needs_update = 1;
+}
+
+/*
+ * Deepest state that @measured_us would have paid for under the latency
+ * constraint @latency_req that was in force when the state was selected.
+ */
+static int predict_ideal_state(struct cpuidle_device *dev, int latency_req,
+			       unsigned int measured_us)
+{
+	int i, idx = 0;
+
+	for (i = CPUIDLE_DRIVER_STATE_START; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+
+		if (s->flags & CPUIDLE_FLAG_IGNORE)
+			continue;
+		if (s->target_residency > measured_us)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+		idx = i;
+	}
+	return idx;
+}
+
+/**
+ * predict_update - accounts the last idle period
+ * @dev: the CPU
+ */
+static void predict_update(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &__get_cpu_var(predict_devices);
+	struct predict_history *h = &data->history[data->iowait];
+	struct cpuidle_state *target = dev->last_state;
+	unsigned int measured_us = cpuidle_get_last_residency(dev);
+	struct predict_stats *stats;
+	int idx, ideal, result;
+
+	if (unlikely(!target))
+		return;
+	idx = target - dev->states;
+
+	/*
+	 * Without a residency measurement, assume we slept until the timer
+	 * as menu does.
+	 */
+	if (unlikely(!(target->flags & CPUIDLE_FLAG_TIME_VALID)))
+		measured_us = data->timer_us;
+
+	/* the exit latency is assumed to follow the wakeup event */
+	if (measured_us > target->exit_latency)
+		measured_us -= target->exit_latency;
+
+	predict_history_add(h, measured_us, data->timer_us);
+
+	/* the driver may have fallen back to a shallower state */
+	stats = &data->stats[idx];
+	if (idx != data->last_state_idx)
+		stats->demoted++;
+
+	ideal = predict_ideal_state(dev, data->latency_req, measured_us);
+	if (idx > ideal) {
+		stats->too_deep++;
+		result = PREDICT_TOO_DEEP;
+	} else if (idx < ideal) {
+		stats->too_shallow++;
+		result = PREDICT_TOO_SHALLOW;
+	} else {
+		stats->hits++;
+		result = PREDICT_HIT;
+	}
+
+	trace_cpuidle_outcome(dev->cpu, idx, measured_us, result);
+}
+
+static ssize_t show_stats(struct kobject *kobj, struct kobj_attribute *attr,
+			  char *buf)
+{
+	struct cpuidle_device *dev =
+		container_of(kobj->parent, struct cpuidle_device, kobj);
+	struct predict_device *data = &per_cpu(predict_devices, dev->cpu);
+	ssize_t len = 0;
+	int i;
+
+	len += sprintf(buf, "%-12s %10s %10s %12s %10s\n",
+		       "state", "hits", "too_deep", "too_shallow", "demoted");
+	for (i = 0; i < dev->state_count; i++) {
+		struct predict_stats *stats = &data->stats[i];
+
+		len += sprintf(buf + len, "%-12s %10lu %10lu %12lu %10lu\n",
+			       dev->states[i].name, stats->hits,
+			       stats->too_deep, stats->too_shallow,
+			       stats->demoted);
+	}
+	return len;
+}
+
+static struct kobj_attribute stats_attr =
+	__ATTR(stats, 0444, show_stats, NULL);
+
+static struct attribute *predict_attrs[] = {
+	&stats_attr.attr,
+	NULL
+};
+
+static struct attribute_group predict_attr_group = {
+	.attrs = predict_attrs,
+};
+
+/**
+ * predict_enable_device - scans a CPU's states and does setup
+ * @dev: the CPU
+ */
+static int predict_enable_device(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &per_cpu(predict_devices, dev->cpu);
+	int ret;
+
+	memset(data, 0, sizeof(struct predict_device));
+
+	data->kobj = kobject_create_and_add("predict", &dev->kobj);
+	if (!data->kobj)
+		return -ENOMEM;
+
+	ret = sysfs_create_group(data->kobj, &predict_attr_group);
+	if (ret) {
+		kobject_put(data->kobj);
+		data->kobj = NULL;
+	}
+	return ret;
+}
+
+/**
+ * predict_disable_device - removes the statistics of a CPU
+ * @dev: the CPU
+ */
+static void predict_disable_device(struct cpuidle_device *dev)
+{
+	struct predict_device *data = &per_cpu(predict_devices, dev->cpu);
+
+	if (data->kobj) {
+		sysfs_remove_group(data->kobj, &predict_attr_group);
+		kobject_put(data->kobj);
+		data->kobj = NULL;
+	}
+}
+
+static struct cpuidle_governor predict_governor = {
+	.name =		"predict",
+	.rating =	30,
+	.enable =	predict_enable_device,
+	.disable =	predict_disable_device,
+	.select =	predict_select,
+	.reflect =	predict_reflect,
+	.owner =	THIS_MODULE,
+};
+
+/**
+ * init_predict - initializes the governor
+ */
+static int __init init_predict(void)
+{
+	return cpuidle_register_governor(&predict_governor);
+}
+
+/**
+ * exit_predict - exits the governor
+ */
+static void __exit exit_predict(void)
+{
+	cpuidle_unregister_governor(&predict_governor);
+}
+
+MODULE_LICENSE("GPL");
+module_init(init_predict);
+module_exit(exit_predict);
+
+#ifdef CONFIG_CPU_IDLE_GOV_PREDICT_SELFTEST
+
+/*
+ * Checks the pure parts of the governor against a simulated state table:
+ * a WFI-like state, an AFTR-like state and an LPA-like state.
+ */
+#define ST(i)		(CPUIDLE_DRIVER_STATE_START + (i))
+#define NO_LATENCY_REQ	(2000 * USEC_PER_SEC)
+
+static struct cpuidle_device predict_test_dev __initdata;
+
+static struct {
+	unsigned int	predicted_us;
+	int		latency_req;
+	unsigned int	multiplier;
+	int		expect;
+} predict_pick_tests[] __initdata = {
+	{ 100,		NO_LATENCY_REQ,	1,	ST(0) },
+	{ 6000,		NO_LATENCY_REQ,	1,	ST(1) },
+	{ 20000,	NO_LATENCY_REQ,	1,	ST(2) },
+	/* exit latency over the PM QoS request */
+	{ 20000,	500,		1,	ST(1) },
+	/* 21 * 1000 us of exit latency does not fit with IO pending */
+	{ 20000,	NO_LATENCY_REQ,	21,	ST(1) },
+	{ 20000,	NO_LATENCY_REQ,	201,	ST(0) },
+};
+
+static int __init predict_selftest(void)
+{
+	struct cpuidle_device *dev = &predict_test_dev;
+	struct predict_history h;
+	unsigned int us;
+	int i, idx;
+
+	dev->state_count = ST(3);
+	dev->states[ST(0)].exit_latency = 1;
+	dev->states[ST(0)].target_residency = 1;
+	dev->states[ST(1)].exit_latency = 300;
+	dev->states[ST(1)].target_residency = 5000;
+	dev->states[ST(2)].exit_latency = 1000;
+	dev->states[ST(2)].target_residency = 10000;
+
+	for (i = 0; i < ARRAY_SIZE(predict_pick_tests); i++) {
+		idx = predict_pick_state(dev, predict_pick_tests[i].predicted_us,
+					 predict_pick_tests[i].latency_req,
+					 predict_pick_tests[i].multiplier);
+		if (idx != predict_pick_tests[i].expect) {
+			printk(KERN_ERR "predict_selftest: error: case %d "
+			       "picked state %d, expected %d\n",
+			       i, idx, predict_pick_tests[i].expect);
+			return -EINVAL;
+		}
+	}
+
+	if (predict_ideal_state(dev, NO_LATENCY_REQ, 50) != ST(0) ||
+	    predict_ideal_state(dev, NO_LATENCY_REQ, 7000) != ST(1) ||
+	    predict_ideal_state(dev, NO_LATENCY_REQ, 50000) != ST(2) ||
+	    predict_ideal_state(dev, 500, 50000) != ST(1)) {
+		printk(KERN_ERR "predict_selftest: error: wrong ideal state\n");
+		return -EINVAL;
+	}
+
+	/*
+	 * Interrupts keep waking the CPU after 150-220 us while the next
+	 * timer is 100 ms away: the prediction must switch from the timer
+	 * to the median of those periods once half of the history is early.
+	 */
+	memset(&h, 0, sizeof(h));
+	for (i = 0; i < INTERVALS; i++) {
+		us = predict_duration(&h, 100000);
+		if (us != (i < INTERVALS / 2 ? 100000 : 150 + (i - 1) / 2 * 10)) {
+			printk(KERN_ERR "predict_selftest: error: after %d "
+			       "early periods predicted %u us\n", i, us);
+			return -EINVAL;
+		}
+		predict_history_add(&h, 150 + i * 10, 100000);
+	}
+	if (predict_pick_state(dev, predict_duration(&h, 100000),
+			       NO_LATENCY_REQ, 1) != ST(0)) {
+		printk(KERN_ERR "predict_selftest: error: deep state picked "
+		       "for early wakeups\n");
+		return -EINVAL;
+	}
+
+	/* early periods that would not beat a closer timer do not count */
+	if (predict_duration(&h, 120) != 120) {
+		printk(KERN_ERR "predict_selftest: error: prediction past "
+		       "the next timer\n");
+		return -EINVAL;
+	}
+
+	/* the CPU now sleeps until its timer: back to the deepest state */
+	for (i = 0; i < INTERVALS / 2 + 1; i++)
+		predict_history_add(&h, 90000, 100000);
+	if (predict_pick_state(dev, predict_duration(&h, 100000),
+			       NO_LATENCY_REQ, 1) != ST(2)) {
+		printk(KERN_ERR "predict_selftest: error: deepest state not "
+		       "picked again after long periods\n");
+		return -EINVAL;
+	}
+
+	printk(KERN_INFO "predict_selftest: passed\n");
+	return 0;
+}
+late_initcall(predict_selftest);
+#endif /* CONFIG_CPU_IDLE_GOV_PREDICT_SELFTEST */
@@ -13,6 +13,7 @@
 #define EVDEV_MINOR_BASE	64
 #define EVDEV_MINORS		32
 #define EVDEV_MIN_BUFFER_SIZE	64U
+#define EVDEV_MAX_BUFFER_SIZE	4096U
 
 #ifdef CONFIG_INPUT_WACOM
 #define EVDEV_BUF_PACKETS	32
@@ -21,6 +22,7 @@
 #endif
 
 #include <linux/poll.h>
+#include <linux/circ_buf.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/module.h>
@@ -30,6 +32,7 @@
 #include <linux/device.h>
 #include <linux/wakelock.h>
 #include <linux/cdev.h>
+#include <trace/events/input.h>
 #include "input-compat.h"
 
 struct evdev {
@@ -45,11 +48,23 @@ struct evdev {
 	bool exist;
 };
 
+/*
+ * The event ring of a client has a single producer, evdev_events(), which
+ * always runs under the input device's event_lock, and is lockless
+ * between it and the readers: head, packet_head and dropping are only
+ * written by the producer, tail only by readers, which serialise on
+ * read_lock. Readers only look at complete packets, up to packet_head.
+ * One slot is kept free for EV_SYN/SYN_DROPPED. With suspend blocking on,
+ * publishing a packet and taking the wake lock, and finding the queue
+ * empty and releasing it, are each done under wakeup_lock.
+ */
 struct evdev_client {
 	unsigned int head;
 	unsigned int tail;
-	unsigned int packet_head; /* [future] position of the first element of next packet */
-	spinlock_t buffer_lock; /* protects access to buffer, head and tail */
+	unsigned int packet_head; /* position of the first element of next packet */
+	bool dropping;		/* discarding events after an overflow */
+	spinlock_t read_lock;	/* serialises readers */
+	spinlock_t wakeup_lock;	/* orders wake_lock against packet_head */
 	struct wake_lock wake_lock;
 	bool use_wake_lock;
 	char name[28];
@@ -58,95 +73,153 @@ struct evdev_client {
 	struct list_head node;
 	int clkid;
 	unsigned int bufsize;
-	struct input_event buffer[];
+	struct input_event *buffer;
 };
 
-static void __pass_event(struct evdev_client *client,
+/* Make the events up to head visible to readers */
+static void evdev_publish_packet(struct evdev_client *client)
+{
+	/* Make the events visible before the new packet_head */
+	smp_wmb();
+	if (client->use_wake_lock) {
+		spin_lock(&client->wakeup_lock);
+		ACCESS_ONCE(client->packet_head) = client->head;
+		wake_lock(&client->wake_lock);
+		spin_unlock(&client->wakeup_lock);
+	} else {
+		ACCESS_ONCE(client->packet_head) = client->head;
+	}
+}
+
+/*
+ * Queue one event, returns true if it completed a packet and readers can
+ * see new events.
+ */
+static bool __pass_event(struct evdev_client *client,
 			 const struct input_event *event)
 {
-	client->buffer[client->head++] = *event;
-	client->head &= client->bufsize - 1;
+	unsigned int tail = ACCESS_ONCE(client->tail);
+	unsigned int head = client->head;
+	bool report = event->type == EV_SYN && event->code == SYN_REPORT;
 
-	if (unlikely(client->head == client->tail)) {
+	if (unlikely(client->dropping)) {
+		/*
+		 * Resume once readers made room, with the SYN_REPORT that
+		 * ends the dropped packet: clients skip up to it after
+		 * SYN_DROPPED.
+		 */
+		if (!report || CIRC_SPACE(head, tail, client->bufsize) <= 1)
+			return false;
+		client->dropping = false;
+	} else if (unlikely(CIRC_SPACE(head, tail, client->bufsize) <= 1)) {
 		/*
-		 * This effectively "drops" all unconsumed events, leaving
-		 * EV_SYN/SYN_DROPPED plus the newest event in the queue.
+		 * Readers are behind: throw away the incomplete packet and
+		 * the rest of it, and end the queue with EV_SYN/SYN_DROPPED
+		 * in the slot kept free for it.
 		 */
-		client->tail = (client->head - 2) & (client->bufsize - 1);
+		head = client->packet_head;
+		client->buffer[head].time = event->time;
+		client->buffer[head].type = EV_SYN;
+		client->buffer[head].code = SYN_DROPPED;
+		client->buffer[head].value = 0;
+		head = client->head = (head + 1) & (client->bufsize - 1);
+		if (!report || CIRC_SPACE(head, tail, client->bufsize) <= 1) {
+			client->dropping = true;
+			evdev_publish_packet(client);
+			return true;
+		}
+	}
 
-		client->buffer[client->tail].time = event->time;
-		client->buffer[client->tail].type = EV_SYN;
-		client->buffer[client->tail].code = SYN_DROPPED;
-		client->buffer[client->tail].value = 0;
+	client->buffer[head] = *event;
+	client->head = (head + 1) & (client->bufsize - 1);
 
-		client->packet_head = client->tail;
-		if (client->use_wake_lock)
-			wake_unlock(&client->wake_lock);
-	}
+	if (report)
+		evdev_publish_packet(client);
 
-	if (event->type == EV_SYN && event->code == SYN_REPORT) {
-		client->packet_head = client->head;
-		if (client->use_wake_lock)
-			wake_lock(&client->wake_lock);
-		kill_fasync(&client->fasync, SIGIO, POLL_IN);
-	}
+	return report;
 }
 
-static void evdev_pass_values(struct evdev_client *client,
+enum evdev_clock_type {
+	EV_CLK_REAL,
+	EV_CLK_MONO,
+	EV_CLK_BOOT,
+	EV_CLK_MAX
+};
+
+static bool evdev_pass_values(struct evdev_client *client,
 			const struct input_value *vals, unsigned int count,
-			ktime_t mono, ktime_t real)
+			const ktime_t *ev_time)
 {
-	struct evdev *evdev = client->evdev;
 	const struct input_value *v;
 	struct input_event event;
 	bool wakeup = false;
 
-	event.time = ktime_to_timeval(client->clkid == CLOCK_MONOTONIC ?
-				      mono : real);
-
-	/* Interrupts are disabled, just acquire the lock. */
-	spin_lock(&client->buffer_lock);
+	switch (client->clkid) {
+	case CLOCK_MONOTONIC:
+		event.time = ktime_to_timeval(ev_time[EV_CLK_MONO]);
+		break;
+	case CLOCK_BOOTTIME:
+		event.time = ktime_to_timeval(ev_time[EV_CLK_BOOT]);
+		break;
+	default:
+		event.time = ktime_to_timeval(ev_time[EV_CLK_REAL]);
+		break;
+	}
 
 	for (v = vals; v != vals + count; v++) {
 		event.type = v->type;
 		event.code = v->code;
 		event.value = v->value;
-		__pass_event(client, &event);
-		if (v->type == EV_SYN && v->code == SYN_REPORT)
+		if (__pass_event(client, &event))
 			wakeup = true;
 	}
 
-	spin_unlock(&client->buffer_lock);
-
 	if (wakeup)
-		wake_up_interruptible(&evdev->wait);
+		kill_fasync(&client->fasync, SIGIO, POLL_IN);
+
+	return wakeup;
 }
 
 /*
- * Pass incoming events to all connected clients.
+ * Pass incoming events to all connected clients. Called with the input
+ * device's event_lock held, which makes this the only producer of the
+ * client rings. Readers are woken up once per batch, not once per client
+ * and packet.
+ *
+ * Events are stamped with the time the driver recorded for the packet,
+ * normally in its interrupt handler, converted to each client's clock.
  */
 static void evdev_events(struct input_handle *handle,
 			 const struct input_value *vals, unsigned int count)
 {
 	struct evdev *evdev = handle->private;
 	struct evdev_client *client;
-	ktime_t time_mono, time_real;
+	ktime_t ev_time[EV_CLK_MAX];
+	struct timespec ts;
+	bool wakeup = false;
 
-	time_mono = ktime_get();
-	time_real = ktime_sub(time_mono, ktime_get_monotonic_offset());
+	ev_time[EV_CLK_MONO] = input_get_timestamp(handle->dev);
+	ev_time[EV_CLK_REAL] = ktime_sub(ev_time[EV_CLK_MONO],
+					 ktime_get_monotonic_offset());
+	ts = ktime_to_timespec(ev_time[EV_CLK_MONO]);
+	monotonic_to_bootbased(&ts);
+	ev_time[EV_CLK_BOOT] = timespec_to_ktime(ts);
 
 	rcu_read_lock();
 
 	client = rcu_dereference(evdev->grab);
 
 	if (client)
-		evdev_pass_values(client, vals, count, time_mono, time_real);
+		wakeup = evdev_pass_values(client, vals, count, ev_time);
 	else
 		list_for_each_entry_rcu(client, &evdev->client_list, node)
-			evdev_pass_values(client, vals, count,
-					  time_mono, time_real);
+			wakeup |= evdev_pass_values(client, vals, count,
+						    ev_time);
 
 	rcu_read_unlock();
+
+	if (wakeup)
+		wake_up_interruptible(&evdev->wait);
 }
 
 /*
@@ -304,6 +377,7 @@ static int evdev_release(struct inode *inode, struct file *file)
 	evdev_detach_client(evdev, client);
 	if (client->use_wake_lock)
 		wake_lock_destroy(&client->wake_lock);
+	kfree(client->buffer);
 	kfree(client);
 
 	evdev_close_device(evdev);
@@ -327,14 +401,20 @@ static int evdev_open(struct inode *inode, struct file *file)
 	struct evdev_client *client;
 	int error;
 
-	client = kzalloc(sizeof(struct evdev_client) +
-				bufsize * sizeof(struct input_event),
-			 GFP_KERNEL);
+	client = kzalloc(sizeof(struct evdev_client), GFP_KERNEL);
 	if (!client)
 		return -ENOMEM;
 
+	client->buffer = kcalloc(bufsize, sizeof(struct input_event),
+				 GFP_KERNEL);
+	if (!client->buffer) {
+		kfree(client);
+		return -ENOMEM;
+	}
+
 	client->bufsize = bufsize;
-	spin_lock_init(&client->buffer_lock);
+	spin_lock_init(&client->read_lock);
+	spin_lock_init(&client->wakeup_lock);
 	snprintf(client->name, sizeof(client->name), "%s-%d",
 			dev_name(&evdev->dev), task_tgid_vnr(current));
 	client->evdev = evdev;
@@ -351,6 +431,7 @@ static int evdev_open(struct inode *inode, struct file *file)
 
  err_free_client:
 	evdev_detach_client(evdev, client);
+	kfree(client->buffer);
 	kfree(client);
 	return error;
 }
@@ -395,20 +476,35 @@ static ssize_t evdev_write(struct file *file, const char __user *buffer,
 static int evdev_fetch_next_event(struct evdev_client *client,
 				  struct input_event *event)
 {
+	unsigned int packet_head, tail;
 	int have_event;
 
-	spin_lock_irq(&client->buffer_lock);
+	spin_lock(&client->read_lock);
 
-	have_event = client->packet_head != client->tail;
+	packet_head = ACCESS_ONCE(client->packet_head);
+	tail = client->tail;
+	have_event = packet_head != tail;
 	if (have_event) {
-		*event = client->buffer[client->tail++];
-		client->tail &= client->bufsize - 1;
-		if (client->use_wake_lock &&
-		    client->packet_head == client->tail)
-			wake_unlock(&client->wake_lock);
+		/* Pairs with the smp_wmb() in __pass_event() */
+		smp_rmb();
+		*event = client->buffer[tail];
+		/* Done with the slot before handing it back */
+		smp_mb();
+		tail = (tail + 1) & (client->bufsize - 1);
+		ACCESS_ONCE(client->tail) = tail;
+
+		if (client->use_wake_lock && packet_head == tail) {
+			unsigned long flags;
+
+			/* Unless a packet was published in the meantime */
+			spin_lock_irqsave(&client->wakeup_lock, flags);
+			if (ACCESS_ONCE(client->packet_head) == tail)
+				wake_unlock(&client->wake_lock);
+			spin_unlock_irqrestore(&client->wakeup_lock, flags);
+		}
 	}
 
-	spin_unlock_irq(&client->buffer_lock);
+	spin_unlock(&client->read_lock);
 
 	return have_event;
 }
@@ -419,6 +515,7 @@ static ssize_t evdev_read(struct file *file, char __user *buffer,
 	struct evdev_client *client = file->private_data;
 	struct evdev *evdev = client->evdev;
 	struct input_event event;
+	struct timeval first;
 	size_t read = 0;
 	int error;
 
@@ -446,11 +543,18 @@ static ssize_t evdev_read(struct file *file, char __user *buffer,
 			if (input_event_to_user(buffer + read, &event))
 				return -EFAULT;
 
+			if (!read)
+				first = event.time;
 			read += input_event_size();
 		}
 
-		if (read)
+		if (read) {
+			trace_input_read(evdev->handle.dev,
+					 read / input_event_size(),
+					 timeval_to_ktime(first),
+					 client->clkid);
 			break;
+		}
 
 		if (!(file->f_flags & O_NONBLOCK)) {
 			error = wait_event_interruptible(evdev->wait,
@@ -670,18 +774,36 @@ static int evdev_handle_set_keycode_v2(struct input_dev *dev, void __user *p)
 	return input_set_keycode(dev, &ke);
 }
 
+/*
+ * The producer only runs under the device's event_lock, so taking it
+ * together with read_lock stops all access to the client's ring.
+ */
+static void evdev_lock_client(struct evdev *evdev,
+			      struct evdev_client *client)
+{
+	spin_lock(&client->read_lock);
+	spin_lock_irq(&evdev->handle.dev->event_lock);
+}
+
+static void evdev_unlock_client(struct evdev *evdev,
+				struct evdev_client *client)
+{
+	spin_unlock_irq(&evdev->handle.dev->event_lock);
+	spin_unlock(&client->read_lock);
+}
+
 static int evdev_enable_suspend_block(struct evdev *evdev,
 				      struct evdev_client *client)
 {
 	if (client->use_wake_lock)
 		return 0;
 
-	spin_lock_irq(&client->buffer_lock);
+	evdev_lock_client(evdev, client);
 	wake_lock_init(&client->wake_lock, WAKE_LOCK_SUSPEND, client->name);
 	client->use_wake_lock = true;
 	if (client->packet_head != client->tail)
 		wake_lock(&client->wake_lock);
-	spin_unlock_irq(&client->buffer_lock);
+	evdev_unlock_client(evdev, client);
 	return 0;
 }
 
@@ -691,14 +813,61 @@ static int evdev_disable_suspend_block(struct evdev *evdev,
 	if (!client->use_wake_lock)
 		return 0;
 
-	spin_lock_irq(&client->buffer_lock);
+	evdev_lock_client(evdev, client);
 	client->use_wake_lock = false;
-	spin_unlock_irq(&client->buffer_lock);
+	evdev_unlock_client(evdev, client);
 	wake_lock_destroy(&client->wake_lock);
 
 	return 0;
 }
 
+/*
+ * Replace the client's ring with one of the given size. Queued events
+ * are kept if they fit, otherwise they are replaced by SYN_DROPPED.
+ */
+static int evdev_set_bufsize(struct evdev *evdev,
+			     struct evdev_client *client, unsigned int size)
+{
+	struct input_event *buffer, *old;
+	unsigned int i, n;
+
+	if (size < EVDEV_MIN_BUFFER_SIZE || size > EVDEV_MAX_BUFFER_SIZE)
+		return -EINVAL;
+	size = roundup_pow_of_two(size);
+
+	buffer = kcalloc(size, sizeof(struct input_event), GFP_KERNEL);
+	if (!buffer)
+		return -ENOMEM;
+
+	evdev_lock_client(evdev, client);
+
+	old = client->buffer;
+	n = CIRC_CNT(client->head, client->tail, client->bufsize);
+	if (n < size - 1) {
+		for (i = 0; i < n; i++)
+			buffer[i] = old[(client->tail + i) &
+					(client->bufsize - 1)];
+		client->packet_head = CIRC_CNT(client->packet_head,
+					       client->tail, client->bufsize);
+	} else {
+		do_gettimeofday(&buffer[0].time);
+		buffer[0].type = EV_SYN;
+		buffer[0].code = SYN_DROPPED;
+		buffer[0].value = 0;
+		n = client->packet_head = 1;
+		client->dropping = true;
+	}
+	client->buffer = buffer;
+	client->bufsize = size;
+	client->tail = 0;
+	client->head = n;
+
+	evdev_unlock_client(evdev, client);
+
+	kfree(old);
+	return 0;
+}
+
 static int evdev_handle_mt_request(struct input_dev *dev,
 				   unsigned int size,
 				   int __user *ip)
@@ -788,11 +957,20 @@ static long evdev_do_ioctl(struct file *file, unsigned int cmd,
 	case EVIOCSCLOCKID:
 		if (copy_from_user(&i, p, sizeof(unsigned int)))
 			return -EFAULT;
-		if (i != CLOCK_MONOTONIC && i != CLOCK_REALTIME)
+		if (i != CLOCK_MONOTONIC && i != CLOCK_REALTIME &&
+		    i != CLOCK_BOOTTIME)
 			return -EINVAL;
 		client->clkid = i;
 		return 0;
 
+	case EVIOCGBUFSIZE:
+		return put_user(client->bufsize, ip);
+
+	case EVIOCSBUFSIZE:
+		if (get_user(u, ip))
+			return -EFAULT;
+		return evdev_set_bufsize(evdev, client, u);
+
 	case EVIOCGKEYCODE:
 		return evdev_handle_get_keycode(dev, p);
 
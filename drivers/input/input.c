@@ -29,6 +29,11 @@
 #include <linux/rcupdate.h>
 #include "input-compat.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/input.h>
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(input_read);
+
 MODULE_AUTHOR("Vojtech Pavlik <vojtech@suse.cz>");
 MODULE_DESCRIPTION("Input core");
 MODULE_LICENSE("GPL");
@@ -149,6 +154,10 @@ static void input_pass_values(struct input_dev *dev,
 
 	rcu_read_unlock();
 
+	trace_input_deliver(dev, count);
+	/* every caller passes whole packets, the next one is timed anew */
+	dev->timestamp = ktime_set(0, 0);
+
 	add_input_randomness(vals->type, vals->code, vals->value);
 
 	/* trigger auto repeat for key events */
@@ -393,10 +402,15 @@ static void input_handle_event(struct input_dev *dev,
 		if (dev->num_vals >= 2)
 			input_pass_values(dev, dev->vals, dev->num_vals);
 		dev->num_vals = 0;
+		dev->timestamp = ktime_set(0, 0);
 	} else if (dev->num_vals >= dev->max_vals - 2) {
+		ktime_t timestamp = dev->timestamp;
+
 		dev->vals[dev->num_vals++] = input_value_sync;
 		input_pass_values(dev, dev->vals, dev->num_vals);
 		dev->num_vals = 0;
+		/* the rest of the packet still belongs to the same interrupt */
+		dev->timestamp = timestamp;
 	}
 
 }
@@ -464,6 +478,43 @@ void input_inject_event(struct input_handle *handle,
 }
 EXPORT_SYMBOL(input_inject_event);
 
+/**
+ * input_set_timestamp - set the time the hardware produced the next packet
+ * @dev: input device
+ * @timestamp: CLOCK_MONOTONIC time, normally taken with ktime_get() in
+ *	the hard interrupt handler
+ *
+ * Drivers that read their hardware from a threaded interrupt handler
+ * should call this before reporting events, so that the events carry the
+ * time of the interrupt instead of the time they were passed on, after
+ * the thread was scheduled and the bus transfer completed. The timestamp
+ * applies up to and including the next SYN_REPORT.
+ */
+void input_set_timestamp(struct input_dev *dev, ktime_t timestamp)
+{
+	dev->timestamp = timestamp;
+	trace_input_timestamp(dev, timestamp);
+}
+EXPORT_SYMBOL(input_set_timestamp);
+
+/**
+ * input_get_timestamp - get the timestamp of the current packet
+ * @dev: input device
+ *
+ * Returns the timestamp set with input_set_timestamp(), or the current
+ * CLOCK_MONOTONIC time if the driver did not set one; that time is then
+ * used for the rest of the packet. Must be called with dev->event_lock
+ * held.
+ */
+ktime_t input_get_timestamp(struct input_dev *dev)
+{
+	if (!dev->timestamp.tv64)
+		dev->timestamp = ktime_get();
+
+	return dev->timestamp;
+}
+EXPORT_SYMBOL(input_get_timestamp);
+
 /**
  * input_alloc_absinfo - allocates array of input_absinfo structs
  * @dev: the input device emitting absolute events
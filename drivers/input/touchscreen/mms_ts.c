@@ -281,6 +281,7 @@ struct mms_ts_info {
 	bool invert_y;
 	const u8			*config_fw_version;
 	int irq;
+	ktime_t irq_time;
 	int (*power) (bool on);
 
 	struct melfas_tsi_platform_data *pdata;
@@ -610,6 +611,15 @@ static void melfas_ta_cb(struct tsp_callbacks *cb, bool ta_status)
 	}
 }
 
+/* Record when the touch happened, before the thread is scheduled */
+static irqreturn_t mms_ts_hardirq(int irq, void *dev_id)
+{
+	struct mms_ts_info *info = dev_id;
+
+	info->irq_time = ktime_get();
+	return IRQ_WAKE_THREAD;
+}
+
 static irqreturn_t mms_ts_interrupt(int irq, void *dev_id)
 {
 	struct mms_ts_info *info = dev_id;
@@ -640,6 +650,8 @@ static irqreturn_t mms_ts_interrupt(int irq, void *dev_id)
 	unsigned long flags;
 #endif
 
+	input_set_timestamp(info->input_dev, info->irq_time);
+
 	sz = i2c_smbus_read_byte_data(client, MMS_INPUT_EVENT_PKT_SZ);
 
 	if (sz < 0) {
@@ -1976,7 +1988,8 @@ static int mms_ts_finish_config(struct mms_ts_info *info)
 	struct i2c_client *client = info->client;
 	int ret;
 
-	ret = request_threaded_irq(client->irq, NULL, mms_ts_interrupt,
+	ret = request_threaded_irq(client->irq, mms_ts_hardirq,
+				   mms_ts_interrupt,
 				   IRQF_TRIGGER_LOW  | IRQF_ONESHOT,
 				   MELFAS_TS_NAME, info);
 
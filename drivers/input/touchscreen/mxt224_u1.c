@@ -206,6 +206,7 @@ struct mxt224_data {
 	struct completion	init_done;
 	struct mutex	lock;
 	bool enabled;
+	ktime_t irq_time;
 };
 
 #ifdef CONFIG_TOUCHSCREEN_GESTURES
@@ -1995,6 +1996,15 @@ static void median_err_setting(void)
 }
 #endif
 
+/* Record when the touch happened, before the thread is scheduled */
+static irqreturn_t mxt224_irq(int irq, void *ptr)
+{
+	struct mxt224_data *data = ptr;
+
+	data->irq_time = ktime_get();
+	return IRQ_WAKE_THREAD;
+}
+
 static irqreturn_t mxt224_irq_thread(int irq, void *ptr)
 {
 	struct mxt224_data *data = ptr;
@@ -2006,6 +2016,8 @@ static irqreturn_t mxt224_irq_thread(int irq, void *ptr)
 	u16 obj_address = 0;
 	int ta_status_check;
 
+	input_set_timestamp(data->input_dev, data->irq_time);
+
 	if ((copy_data->palm_chk_flag == 2) && (copy_data->family_id == 0x80))
 		palm_recovery();
 
@@ -4364,7 +4376,8 @@ static int __devinit mxt224_probe(struct i2c_client *client,
 	copy_data->freq_table.freq_for_fherr4[3] = 49;
 	copy_data->freq_table.freq_for_fherr4[4] = 58;
 
-	ret = request_threaded_irq(client->irq, NULL, mxt224_irq_thread,
+	ret = request_threaded_irq(client->irq, mxt224_irq,
+			mxt224_irq_thread,
 			IRQF_TRIGGER_LOW | IRQF_ONESHOT, "mxt224_ts",
 			data);
 
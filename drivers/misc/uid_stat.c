@@ -16,25 +16,58 @@
 #include <asm/atomic.h>
 
 #include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
 #include <linux/proc_fs.h>
+#include <linux/rwsem.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/stat.h>
+#include <linux/task_io_accounting_ops.h>
+#include <linux/uaccess.h>
 #include <linux/uid_stat.h>
+#include <linux/vmalloc.h>
 #include <net/activity_stats.h>
 
 static DEFINE_SPINLOCK(uid_lock);
 static LIST_HEAD(uid_list);
 static struct proc_dir_entry *parent;
 
+/*
+ * Held for reading while the totals of a thread group move to its uid, and
+ * for writing by a batch snapshot, so that the snapshot sees every group
+ * either live or in the totals of its uid, never in both or neither.
+ */
+static DECLARE_RWSEM(uid_exit_sem);
+
+/*
+ * Bumped by every batch snapshot. Tasks record the value when they are
+ * switched out, so a task whose stamp is at least the generation returned
+ * by a snapshot has run, and may have used CPU, IO or woken up, since.
+ * It is 32 bits wide, like the generation in the batch header; 0 is never
+ * handed out since it asks for everything.
+ */
+atomic_t uid_stat_generation = ATOMIC_INIT(1);
+
 struct uid_stat {
 	struct list_head link;
 	uid_t uid;
 	atomic_t tcp_rcv;
 	atomic_t tcp_snd;
+	/* totals of exited thread groups, protected by uid_lock */
+	u64 utime_us;
+	u64 stime_us;
+	u64 read_bytes;
+	u64 write_bytes;
+	u64 wakeups;
+	/* generation of the last change */
+	u32 gen;
 };
 
 static struct uid_stat *find_uid_stat(uid_t uid) {
@@ -96,7 +129,7 @@ static struct uid_stat *create_stat(uid_t uid) {
 	struct proc_dir_entry *entry;
 
 	/* Create the uid stat struct and append it to the list. */
-	if ((new_uid = kmalloc(sizeof(struct uid_stat), GFP_KERNEL)) == NULL)
+	if ((new_uid = kzalloc(sizeof(struct uid_stat), GFP_KERNEL)) == NULL)
 		return NULL;
 
 	new_uid->uid = uid;
@@ -129,6 +162,7 @@ int uid_stat_tcp_snd(uid_t uid, int size) {
 			return -1;
 	}
 	atomic_add(size, &entry->tcp_snd);
+	entry->gen = atomic_read(&uid_stat_generation);
 	return 0;
 }
 
@@ -140,9 +174,357 @@ int uid_stat_tcp_rcv(uid_t uid, int size) {
 			return -1;
 	}
 	atomic_add(size, &entry->tcp_rcv);
+	entry->gen = atomic_read(&uid_stat_generation);
 	return 0;
 }
 
+static u64 cputime_to_us(cputime_t ct)
+{
+	struct timespec ts;
+
+	cputime_to_timespec(ct, &ts);
+	return (u64)ts.tv_sec * USEC_PER_SEC + ts.tv_nsec / NSEC_PER_USEC;
+}
+
+/* Totals of the thread group of @p, called with its sighand lock held. */
+static void group_totals(struct task_struct *p,
+			 struct uid_stat_batch_proc *rec)
+{
+	struct task_io_accounting ioac = p->signal->ioac;
+	unsigned long wakeups = p->signal->nvcsw;
+	struct task_struct *t = p;
+	cputime_t utime, stime;
+
+	thread_group_cputime_adjusted(p, &utime, &stime);
+	do {
+		task_io_accounting_add(&ioac, &t->ioac);
+		wakeups += t->nvcsw;
+	} while_each_thread(p, t);
+
+	rec->utime_us = cputime_to_us(utime);
+	rec->stime_us = cputime_to_us(stime);
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+	rec->read_bytes = ioac.read_bytes;
+	rec->write_bytes = ioac.write_bytes > ioac.cancelled_write_bytes ?
+		ioac.write_bytes - ioac.cancelled_write_bytes : 0;
+#else
+	rec->read_bytes = 0;
+	rec->write_bytes = 0;
+#endif
+	rec->wakeups = wakeups;
+}
+
+/*
+ * Called from do_exit() right before exit_notify(). The totals of a thread
+ * group move to its uid once its last thread gets here. CPU time used
+ * after that, in exit_notify() and the final schedule() of the thread or
+ * by other threads of the group still finishing their own do_exit(), is
+ * not accounted; it is a few microseconds per group.
+ */
+void uid_stat_task_exit(struct task_struct *tsk, int group_dead)
+{
+	u32 gen = atomic_read(&uid_stat_generation);
+	struct uid_stat_batch_proc rec;
+	struct uid_stat *entry;
+	unsigned long flags;
+	uid_t uid;
+
+	/* the stamp of this thread goes away with it */
+	tsk->group_leader->uid_stat_gen = gen;
+	if (!group_dead)
+		return;
+
+	uid = task_uid(tsk);
+	if ((entry = find_uid_stat(uid)) == NULL &&
+		((entry = create_stat(uid)) == NULL))
+			return;
+
+	down_read(&uid_exit_sem);
+	if (!lock_task_sighand(tsk, &flags))
+		goto out;
+	group_totals(tsk, &rec);
+	unlock_task_sighand(tsk, &flags);
+
+	spin_lock_irqsave(&uid_lock, flags);
+	entry->utime_us += rec.utime_us;
+	entry->stime_us += rec.stime_us;
+	entry->read_bytes += rec.read_bytes;
+	entry->write_bytes += rec.write_bytes;
+	entry->wakeups += rec.wakeups;
+	entry->gen = atomic_read(&uid_stat_generation);
+	tsk->signal->uid_stat_exited = 1;
+	spin_unlock_irqrestore(&uid_lock, flags);
+out:
+	up_read(&uid_exit_sem);
+}
+
+/*
+ * /proc/uid_stat/batch
+ *
+ * A read at offset 0 takes a snapshot of every uid and thread group that
+ * changed since the generation of the previous snapshot on the same file,
+ * or of everything for the first one. Writing a generation number, e.g.
+ * the one of the last snapshot before the file was reopened, sets where
+ * the next snapshot starts and rewinds the file.
+ */
+struct uid_batch {
+	struct mutex lock;
+	u32 since;
+	char *buf;
+	size_t len;
+};
+
+struct uid_batch_slot {
+	struct uid_stat_batch_uid rec;
+	bool used;
+	bool changed;
+};
+
+static bool gen_changed(u32 gen, u32 since)
+{
+	return !since || (s32)(gen - since) >= 0;
+}
+
+static bool group_changed(struct task_struct *p, u32 since)
+{
+	struct task_struct *t = p;
+
+	do {
+		if (gen_changed(t->uid_stat_gen, since) || task_curr(t))
+			return true;
+	} while_each_thread(p, t);
+	return false;
+}
+
+/* Open addressed, the table has at least twice as many slots as uids. */
+static struct uid_batch_slot *batch_slot(struct uid_batch_slot *slots,
+					 unsigned int bits, uid_t uid)
+{
+	unsigned int mask = (1U << bits) - 1;
+	unsigned int i = hash_32(uid, bits);
+	unsigned int n;
+
+	for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		if (!slots[i].used) {
+			slots[i].used = true;
+			slots[i].rec.uid = uid;
+			return &slots[i];
+		}
+		if (slots[i].rec.uid == uid)
+			return &slots[i];
+	}
+	return NULL;
+}
+
+static int uid_batch_snapshot(struct uid_batch *batch)
+{
+	struct uid_stat_batch_proc *procs = NULL;
+	struct uid_batch_slot *slots = NULL, *slot;
+	struct uid_stat_batch_hdr *hdr;
+	struct uid_stat_batch_uid *urec;
+	struct uid_stat *entry;
+	struct task_struct *p;
+	unsigned int nr_entries = 0, max_procs, nr_procs = 0, nr_uids = 0;
+	unsigned long flags;
+	unsigned int bits, i;
+	u32 since = batch->since, gen;
+	int ret = 0;
+
+	/* no thread group moves its totals to its uid until this is done */
+	down_write(&uid_exit_sem);
+
+	/* anything that changes from here on is reported again next time */
+	gen = atomic_inc_return(&uid_stat_generation);
+	if (!gen)
+		gen = atomic_inc_return(&uid_stat_generation);
+
+	spin_lock_irqsave(&uid_lock, flags);
+	list_for_each_entry(entry, &uid_list, link)
+		nr_entries++;
+	spin_unlock_irqrestore(&uid_lock, flags);
+
+	/*
+	 * Nothing forks while tasklist_lock is held, so there are at most
+	 * nr_threads groups to walk, and every uid of theirs and of the
+	 * entries counted above fits in a table twice that size.
+	 */
+	for (;;) {
+		max_procs = nr_threads;
+		bits = ilog2(roundup_pow_of_two(2 * (nr_entries + max_procs)));
+		procs = vmalloc(sizeof(*procs) * max_procs);
+		slots = vzalloc(sizeof(*slots) << bits);
+		if (!procs || !slots) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		read_lock(&tasklist_lock);
+		if (nr_threads <= max_procs)
+			break;
+		read_unlock(&tasklist_lock);
+		vfree(slots);
+		vfree(procs);
+	}
+
+	for_each_process(p) {
+		struct uid_stat_batch_proc rec;
+		bool changed;
+
+		/* these are already in the totals of their uid */
+		if (p->signal->uid_stat_exited)
+			continue;
+		if (!lock_task_sighand(p, &flags))
+			continue;
+		changed = !since || group_changed(p, since);
+		group_totals(p, &rec);
+		unlock_task_sighand(p, &flags);
+
+		rec.pid = task_tgid_vnr(p);
+		rec.uid = task_uid(p);
+
+		slot = batch_slot(slots, bits, rec.uid);
+		if (WARN_ON_ONCE(!slot || nr_procs == max_procs))
+			break;
+		slot->rec.utime_us += rec.utime_us;
+		slot->rec.stime_us += rec.stime_us;
+		slot->rec.read_bytes += rec.read_bytes;
+		slot->rec.write_bytes += rec.write_bytes;
+		slot->rec.wakeups += rec.wakeups;
+		if (changed) {
+			slot->changed = true;
+			procs[nr_procs++] = rec;
+		}
+	}
+	read_unlock(&tasklist_lock);
+
+	/*
+	 * The list only grows at its tail. Entries added since it was counted
+	 * carry a generation of at least gen and come with the next snapshot.
+	 */
+	i = 0;
+	spin_lock_irqsave(&uid_lock, flags);
+	list_for_each_entry(entry, &uid_list, link) {
+		if (i++ == nr_entries)
+			break;
+		slot = batch_slot(slots, bits, entry->uid);
+		if (WARN_ON_ONCE(!slot))
+			break;
+		slot->rec.utime_us += entry->utime_us;
+		slot->rec.stime_us += entry->stime_us;
+		slot->rec.read_bytes += entry->read_bytes;
+		slot->rec.write_bytes += entry->write_bytes;
+		slot->rec.wakeups += entry->wakeups;
+		slot->rec.tcp_snd = (unsigned int)
+			(atomic_read(&entry->tcp_snd) + INT_MIN);
+		slot->rec.tcp_rcv = (unsigned int)
+			(atomic_read(&entry->tcp_rcv) + INT_MIN);
+		if (gen_changed(entry->gen, since))
+			slot->changed = true;
+	}
+	spin_unlock_irqrestore(&uid_lock, flags);
+	up_write(&uid_exit_sem);
+
+	for (i = 0; i < (1U << bits); i++)
+		if (slots[i].changed)
+			nr_uids++;
+
+	vfree(batch->buf);
+	batch->len = sizeof(*hdr) + sizeof(*urec) * nr_uids +
+		sizeof(*procs) * nr_procs;
+	batch->buf = vmalloc(batch->len);
+	if (!batch->buf) {
+		batch->len = 0;
+		ret = -ENOMEM;
+		goto free;
+	}
+
+	hdr = (struct uid_stat_batch_hdr *)batch->buf;
+	hdr->version = UID_STAT_BATCH_VERSION;
+	hdr->gen = gen;
+	hdr->nr_uids = nr_uids;
+	hdr->nr_procs = nr_procs;
+
+	urec = (struct uid_stat_batch_uid *)(hdr + 1);
+	for (i = 0; i < (1U << bits); i++)
+		if (slots[i].changed)
+			*urec++ = slots[i].rec;
+	memcpy(urec, procs, sizeof(*procs) * nr_procs);
+
+	batch->since = gen;
+	goto free;
+out:
+	up_write(&uid_exit_sem);
+free:
+	vfree(slots);
+	vfree(procs);
+	return ret;
+}
+
+static int uid_batch_open(struct inode *inode, struct file *file)
+{
+	struct uid_batch *batch;
+
+	batch = kzalloc(sizeof(*batch), GFP_KERNEL);
+	if (!batch)
+		return -ENOMEM;
+	mutex_init(&batch->lock);
+	file->private_data = batch;
+	return 0;
+}
+
+static ssize_t uid_batch_read(struct file *file, char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct uid_batch *batch = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&batch->lock);
+	if (*ppos == 0) {
+		ret = uid_batch_snapshot(batch);
+		if (ret)
+			goto out;
+	}
+	ret = simple_read_from_buffer(buf, count, ppos, batch->buf,
+				      batch->len);
+out:
+	mutex_unlock(&batch->lock);
+	return ret;
+}
+
+static ssize_t uid_batch_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct uid_batch *batch = file->private_data;
+	u32 since;
+	int ret;
+
+	ret = kstrtou32_from_user(buf, count, 0, &since);
+	if (ret)
+		return ret;
+
+	mutex_lock(&batch->lock);
+	batch->since = since;
+	*ppos = 0;
+	mutex_unlock(&batch->lock);
+	return count;
+}
+
+static int uid_batch_release(struct inode *inode, struct file *file)
+{
+	struct uid_batch *batch = file->private_data;
+
+	vfree(batch->buf);
+	kfree(batch);
+	return 0;
+}
+
+static const struct file_operations uid_batch_fops = {
+	.open		= uid_batch_open,
+	.read		= uid_batch_read,
+	.write		= uid_batch_write,
+	.llseek		= default_llseek,
+	.release	= uid_batch_release,
+};
+
 static int __init uid_stat_init(void)
 {
 	parent = proc_mkdir("uid_stat", NULL);
@@ -150,6 +532,9 @@ static int __init uid_stat_init(void)
 		pr_err("uid_stat: failed to create proc entry\n");
 		return -1;
 	}
+	if (!proc_create("batch", S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP,
+			 parent, &uid_batch_fops))
+		pr_err("uid_stat: failed to create batch entry\n");
 	return 0;
 }
 
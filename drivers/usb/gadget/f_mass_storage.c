@@ -317,6 +317,22 @@ static const char fsg_string_interface[] = "Mass Storage";
 
 #include "storage_common.c"
 
+/*
+ * Write-behind: every write_behind_kb of sequentially written data is
+ * submitted for writeback right away, and at most write_behind_depth such
+ * ranges are left in flight before waiting for the oldest one. This keeps
+ * the disk busy while the host sends more data, and bounds the dirty page
+ * cache a large copy can pile up (which SYNCHRONIZE CACHE or an eject
+ * would then have to wait for).
+ */
+static unsigned int fsg_wb_kb = 1024;
+module_param_named(write_behind_kb, fsg_wb_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(write_behind_kb, "Write-behind chunk in KB, 0 to disable");
+
+static unsigned int fsg_wb_depth = 4;
+module_param_named(write_behind_depth, fsg_wb_depth, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(write_behind_depth, "Write-behind chunks in flight");
+
 
 /*-------------------------------------------------------------------------*/
 
@@ -1039,7 +1055,63 @@ static int do_read_cd(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
-static int do_read(struct fsg_common *common)
+/*
+ * Start reading the whole command at once, so that the following
+ * buffers are read from the medium while the first ones are on the wire
+ * instead of one FSG_BUFLEN vfs_read() at a time.
+ */
+static void fsg_lun_readahead(struct fsg_lun *curlun, loff_t offset,
+			      u32 amount)
+{
+	struct file	*filp = curlun->filp;
+	pgoff_t		index, last;
+
+	amount = min_t(loff_t, amount, curlun->file_length - offset);
+	if (amount <= FSG_BUFLEN)
+		return;
+
+	index = offset >> PAGE_CACHE_SHIFT;
+	last = (offset + amount - 1) >> PAGE_CACHE_SHIFT;
+	page_cache_sync_readahead(filp->f_mapping, &filp->f_ra, filp,
+				  index, last - index + 1);
+}
+
+static void fsg_write_behind(struct fsg_lun *curlun, loff_t offset,
+			     unsigned int amount)
+{
+	struct address_space	*mapping = curlun->filp->f_mapping;
+	unsigned int		depth, slot;
+
+	depth = min_t(unsigned int, fsg_wb_depth, FSG_WB_DEPTH_MAX);
+	if (!fsg_wb_kb || !depth)
+		return;
+
+	/* Only sequential writes are worth it; otherwise start over */
+	if (offset != curlun->wb_end)
+		curlun->wb_start = offset;
+	curlun->wb_end = offset + amount;
+	if (curlun->wb_end - curlun->wb_start < (loff_t)fsg_wb_kb << 10)
+		return;
+
+	while (curlun->wb_count >= depth) {
+		slot = curlun->wb_head;
+		filemap_fdatawait_range(mapping,
+					curlun->wb_ranges[slot].start,
+					curlun->wb_ranges[slot].end - 1);
+		curlun->wb_head = (slot + 1) % FSG_WB_DEPTH_MAX;
+		--curlun->wb_count;
+	}
+
+	filemap_fdatawrite_range(mapping, curlun->wb_start,
+				 curlun->wb_end - 1);
+	slot = (curlun->wb_head + curlun->wb_count) % FSG_WB_DEPTH_MAX;
+	curlun->wb_ranges[slot].start = curlun->wb_start;
+	curlun->wb_ranges[slot].end = curlun->wb_end;
+	++curlun->wb_count;
+	curlun->wb_start = curlun->wb_end;
+}
+
+static int __do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = common->curlun;
 	u32			lba;
@@ -1050,6 +1122,7 @@ static int do_read(struct fsg_common *common)
 	unsigned int		amount;
 	unsigned int		partial_page;
 	ssize_t			nread;
+	ktime_t			io_start;
 
 	/*
 	 * Get the starting Logical Block Address and check that it's
@@ -1078,6 +1151,7 @@ static int do_read(struct fsg_common *common)
 
 	/* Carry out the file reads */
 	amount_left = common->data_size_from_cmnd;
+	fsg_lun_readahead(curlun, file_offset, amount_left);
 	if (unlikely(amount_left == 0)) {
 		/* Wait for the next buffer to become available */
 		bh = common->next_buffhd_to_fill;
@@ -1146,9 +1220,12 @@ static int do_read(struct fsg_common *common)
 
 		/* Perform the read */
 		file_offset_tmp = file_offset;
+		io_start = ktime_get();
 		nread = vfs_read(curlun->filp,
 				 (char __user *)bh->buf,
 				 amount, &file_offset_tmp);
+		curlun->read_stats.file_ns +=
+			ktime_to_ns(ktime_sub(ktime_get(), io_start));
 		VLDBG(curlun, "file read %u @ %llu -> %d\n", amount,
 		      (unsigned long long)file_offset, (int)nread);
 		if (signal_pending(current))
@@ -1165,6 +1242,7 @@ static int do_read(struct fsg_common *common)
 		file_offset  += nread;
 		amount_left  -= nread;
 		common->residue -= nread;
+		curlun->read_stats.bytes += nread;
 		bh->inreq->length = nread;
 		bh->state = BUF_STATE_FULL;
 
@@ -1193,7 +1271,7 @@ static int do_read(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
-static int do_write(struct fsg_common *common)
+static int __do_write(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = common->curlun;
 	u32			lba;
@@ -1204,6 +1282,7 @@ static int do_write(struct fsg_common *common)
 	unsigned int		amount, diff;
 	unsigned int		partial_page;
 	ssize_t			nwritten;
+	ktime_t			io_start;
 	int			rc;
 
 	if (curlun->ro) {
@@ -1363,9 +1442,12 @@ static int do_write(struct fsg_common *common)
 
 			/* Perform the write */
 			file_offset_tmp = file_offset;
+			io_start = ktime_get();
 			nwritten = vfs_write(curlun->filp,
 					     (char __user *)bh->buf,
 					     amount, &file_offset_tmp);
+			curlun->write_stats.file_ns +=
+				ktime_to_ns(ktime_sub(ktime_get(), io_start));
 			VLDBG(curlun, "file write %u @ %llu -> %d\n", amount,
 			      (unsigned long long)file_offset, (int)nwritten);
 			if (signal_pending(current))
@@ -1381,9 +1463,12 @@ static int do_write(struct fsg_common *common)
 				nwritten -= (nwritten & 511);
 				/* Round down to a block */
 			}
+			if (nwritten > 0)
+				fsg_write_behind(curlun, file_offset, nwritten);
 			file_offset += nwritten;
 			amount_left_to_write -= nwritten;
 			common->residue -= nwritten;
+			curlun->write_stats.bytes += nwritten;
 
 			if (diff) {
 				LDBG(curlun, "host sent too much data: %d\n", diff);
@@ -1419,6 +1504,31 @@ static int do_write(struct fsg_common *common)
 	return -EIO;		/* No default reply */
 }
 
+/* Time whole READ and WRITE commands, see the stats attribute */
+static void fsg_stats_cmd(struct fsg_lun_stats *stats, ktime_t start)
+{
+	stats->cmds++;
+	stats->busy_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int do_read(struct fsg_common *common)
+{
+	ktime_t	start = ktime_get();
+	int	rc = __do_read(common);
+
+	fsg_stats_cmd(&common->curlun->read_stats, start);
+	return rc;
+}
+
+static int do_write(struct fsg_common *common)
+{
+	ktime_t	start = ktime_get();
+	int	rc = __do_write(common);
+
+	fsg_stats_cmd(&common->curlun->write_stats, start);
+	return rc;
+}
+
 
 /*-------------------------------------------------------------------------*/
 
@@ -3141,10 +3251,55 @@ static int fsg_main_thread(void *common_)
 
 /*************************** DEVICE ATTRIBUTES ***************************/
 
+static int fsg_print_stats(char *buf, const char *name,
+			   const struct fsg_lun_stats *stats)
+{
+	u64 busy_us = div_u64(stats->busy_ns, NSEC_PER_USEC);
+	u64 kbps = 0;
+
+	if (busy_us)
+		kbps = div64_u64((stats->bytes >> 10) * USEC_PER_SEC, busy_us);
+
+	return sprintf(buf, "%s %llu %llu %llu %llu %llu\n", name,
+		       (unsigned long long)stats->bytes,
+		       (unsigned long long)stats->cmds,
+		       (unsigned long long)div_u64(stats->file_ns,
+						   NSEC_PER_USEC),
+		       (unsigned long long)busy_us,
+		       (unsigned long long)kbps);
+}
+
+/*
+ * One line per direction: bytes, commands, usecs in file IO, usecs in
+ * the commands and KB/s over the latter. Writing anything resets them.
+ */
+static ssize_t fsg_show_stats(struct device *dev, struct device_attribute *attr,
+			      char *buf)
+{
+	struct fsg_lun	*curlun = fsg_lun_from_dev(dev);
+	int		len;
+
+	len = fsg_print_stats(buf, "read", &curlun->read_stats);
+	len += fsg_print_stats(buf + len, "write", &curlun->write_stats);
+	return len;
+}
+
+static ssize_t fsg_store_stats(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct fsg_lun	*curlun = fsg_lun_from_dev(dev);
+
+	memset(&curlun->read_stats, 0, sizeof(curlun->read_stats));
+	memset(&curlun->write_stats, 0, sizeof(curlun->write_stats));
+	return count;
+}
+
 /* Write permission is checked per LUN in store_*() functions. */
 static DEVICE_ATTR(ro, 0644, fsg_show_ro, fsg_store_ro);
 static DEVICE_ATTR(nofua, 0644, fsg_show_nofua, fsg_store_nofua);
 static DEVICE_ATTR(file, 0644, fsg_show_file, fsg_store_file);
+static DEVICE_ATTR(stats, 0644, fsg_show_stats, fsg_store_stats);
 
 
 /****************************** FSG COMMON ******************************/
@@ -3270,6 +3425,9 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 		if (rc)
 			goto error_luns;
 		rc = device_create_file(&curlun->dev, &dev_attr_nofua);
+		if (rc)
+			goto error_luns;
+		rc = device_create_file(&curlun->dev, &dev_attr_stats);
 		if (rc)
 			goto error_luns;
 
@@ -3410,6 +3568,7 @@ static void fsg_common_release(struct kref *ref)
 
 		/* In error recovery common->nluns may be zero. */
 		for (; i; --i, ++lun) {
+			device_remove_file(&lun->dev, &dev_attr_stats);
 			device_remove_file(&lun->dev, &dev_attr_nofua);
 			device_remove_file(&lun->dev, &dev_attr_ro);
 			device_remove_file(&lun->dev, &dev_attr_file);
@@ -28,6 +28,9 @@
 
 #include <linux/types.h>
 #include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/log2.h>
+#include <linux/backing-dev.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
 
@@ -37,6 +40,7 @@
 #include <linux/usb/f_mtp.h>
 
 #define MTP_BULK_BUFFER_SIZE       16384
+#define MTP_BULK_BUFFER_MAX        1048576
 #define INTR_BUFFER_SIZE           28
 
 /* String IDs */
@@ -49,9 +53,9 @@
 #define STATE_CANCELED              3   /* transaction canceled by host */
 #define STATE_ERROR                 4   /* error from completion routine */
 
-/* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+/* limits for the number of tx and rx requests to allocate */
+#define MTP_TX_REQ_MAX 16
+#define MTP_RX_REQ_MAX 8
 #define INTR_REQ_MAX 5
 
 /* ID for Microsoft MTP OS String */
@@ -69,6 +73,27 @@
 
 static const char mtp_shortname[] = "mtp_usb";
 
+/*
+ * Bulk request sizes and queue depths, used when the function is bound.
+ * Sizes are rounded down to a power of two and halved down to
+ * MTP_BULK_BUFFER_SIZE if memory is too fragmented to allocate them.
+ */
+static unsigned int mtp_tx_req_len = 131072;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_req_len, "MTP bulk IN request size in bytes");
+
+static unsigned int mtp_rx_req_len = 131072;
+module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_req_len, "MTP bulk OUT request size in bytes");
+
+static unsigned int mtp_tx_reqs = 8;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_reqs, "number of MTP bulk IN requests");
+
+static unsigned int mtp_rx_reqs = 4;
+module_param(mtp_rx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_reqs, "number of MTP bulk OUT requests");
+
 struct mtp_dev {
 	struct usb_function function;
 	struct usb_composite_dev *cdev;
@@ -91,8 +116,16 @@ struct mtp_dev {
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
-	struct usb_request *rx_req[RX_REQ_MAX];
+	struct usb_request *rx_req[MTP_RX_REQ_MAX];
 	int rx_done;
+	/* rx requests completed so far, they complete in queue order */
+	atomic_t rx_completed;
+
+	/* what mtp_create_bulk_endpoints() managed to allocate */
+	unsigned tx_req_len;
+	unsigned rx_req_len;
+	unsigned tx_reqs;
+	unsigned rx_reqs;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -420,9 +453,12 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 	struct mtp_dev *dev = _mtp_dev;
 
 	dev->rx_done = 1;
-	if (req->status != 0)
+	/* requests we dequeued ourselves are not an error */
+	if (req->status != 0 && req->status != -ECONNRESET)
 		dev->state = STATE_ERROR;
 
+	smp_wmb();
+	atomic_inc(&dev->rx_completed);
 	wake_up(&dev->read_wq);
 }
 
@@ -438,6 +474,58 @@ static void mtp_complete_intr(struct usb_ep *ep, struct usb_request *req)
 	wake_up(&dev->intr_wq);
 }
 
+static int mtp_alloc_bulk_requests(struct mtp_dev *dev)
+{
+	struct usb_request *req;
+	unsigned tx_len, rx_len;
+	int i;
+
+	tx_len = rounddown_pow_of_two(clamp_t(unsigned, mtp_tx_req_len,
+				MTP_BULK_BUFFER_SIZE, MTP_BULK_BUFFER_MAX));
+	rx_len = rounddown_pow_of_two(clamp_t(unsigned, mtp_rx_req_len,
+				MTP_BULK_BUFFER_SIZE, MTP_BULK_BUFFER_MAX));
+	dev->tx_reqs = clamp_t(unsigned, mtp_tx_reqs, 2, MTP_TX_REQ_MAX);
+	dev->rx_reqs = clamp_t(unsigned, mtp_rx_reqs, 2, MTP_RX_REQ_MAX);
+
+retry_tx:
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, tx_len);
+		if (!req) {
+			while ((req = mtp_req_get(dev, &dev->tx_idle)))
+				mtp_request_free(req, dev->ep_in);
+			if (tx_len <= MTP_BULK_BUFFER_SIZE)
+				return -ENOMEM;
+			tx_len /= 2;
+			goto retry_tx;
+		}
+		req->complete = mtp_complete_in;
+		mtp_req_put(dev, &dev->tx_idle, req);
+	}
+	dev->tx_req_len = tx_len;
+
+retry_rx:
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, rx_len);
+		if (!req) {
+			while (i--) {
+				mtp_request_free(dev->rx_req[i], dev->ep_out);
+				dev->rx_req[i] = NULL;
+			}
+			if (rx_len <= MTP_BULK_BUFFER_SIZE)
+				return -ENOMEM;
+			rx_len /= 2;
+			goto retry_rx;
+		}
+		req->complete = mtp_complete_out;
+		dev->rx_req[i] = req;
+	}
+	dev->rx_req_len = rx_len;
+
+	DBG(dev->cdev, "%u tx requests of %u bytes, %u rx requests of %u bytes\n",
+		dev->tx_reqs, tx_len, dev->rx_reqs, rx_len);
+	return 0;
+}
+
 static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 				struct usb_endpoint_descriptor *in_desc,
 				struct usb_endpoint_descriptor *out_desc,
@@ -487,20 +575,8 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	dev->ep_intr = ep;
 
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
-		req->complete = mtp_complete_in;
-		mtp_req_put(dev, &dev->tx_idle, req);
-	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
-		req->complete = mtp_complete_out;
-		dev->rx_req[i] = req;
-	}
+	if (mtp_alloc_bulk_requests(dev))
+		goto fail;
 	for (i = 0; i < INTR_REQ_MAX; i++) {
 		req = mtp_request_new(dev->ep_intr, INTR_BUFFER_SIZE);
 		if (!req)
@@ -527,7 +603,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > MTP_BULK_BUFFER_SIZE)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -646,8 +722,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -684,6 +760,27 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+/*
+ * Same as POSIX_FADV_SEQUENTIAL, with a readahead window of at least all
+ * tx request buffers, so vfs_read() finds the next chunk in the page
+ * cache while the previous ones are still on the wire.
+ */
+static void mtp_file_sequential(struct mtp_dev *dev, struct file *filp)
+{
+	struct backing_dev_info *bdi = filp->f_mapping->backing_dev_info;
+	unsigned long ra_pages;
+
+	if (!bdi || !bdi->ra_pages)
+		return;
+
+	ra_pages = max_t(unsigned long, bdi->ra_pages * 2,
+			(dev->tx_reqs * dev->tx_req_len) >> PAGE_CACHE_SHIFT);
+	filp->f_ra.ra_pages = ra_pages;
+	spin_lock(&filp->f_lock);
+	filp->f_mode &= ~FMODE_RANDOM;
+	spin_unlock(&filp->f_lock);
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data) {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, send_file_work);
@@ -718,6 +815,8 @@ static void send_file_work(struct work_struct *data) {
 	if ((count & (dev->zlp_maxpacket - 1)) == 0)
 		sendZLP = 1;
 
+	mtp_file_sequential(dev, filp);
+
 	while (count > 0 || sendZLP) {
 		/* so we exit after sending ZLP */
 		if (count == 0)
@@ -737,8 +836,8 @@ static void send_file_work(struct work_struct *data) {
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -783,16 +882,23 @@ static void send_file_work(struct work_struct *data) {
 	smp_wmb();
 }
 
-/* read from USB and write to a local file */
+/*
+ * read from USB and write to a local file
+ *
+ * Up to rx_reqs reads are kept queued on the endpoint. They complete in
+ * order, so rx_completed tells which ones are done, and each is written
+ * out while the following ones are still being filled by the host.
+ */
 static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
 	int64_t count;
-	int ret, cur_buf = 0;
+	unsigned queued = 0, done = 0, start;
+	int ret;
 	int r = 0;
 
 	/* read our parameters */
@@ -803,62 +909,79 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+	start = atomic_read(&dev->rx_completed);
 
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+	for (;;) {
+		/* keep the endpoint busy */
+		while (count > 0 && queued - done < dev->rx_reqs) {
+			req = dev->rx_req[queued % dev->rx_reqs];
+			req->length = (count > dev->rx_req_len
+					? dev->rx_req_len : count);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				dev->state = STATE_ERROR;
-				break;
-			}
-		}
-
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
-		}
-
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
+				goto out;
 			}
+			queued++;
 			/* if xfer_file_length is 0xFFFFFFFF, then we read until
 			 * we get a zero length packet
 			 */
 			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/* short packet is used to signal EOF for sizes > 4 gig */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+				count -= req->length;
+		}
+
+		if (done == queued)
+			break;
+
+		/* wait for the oldest read to complete */
+		req = dev->rx_req[done % dev->rx_reqs];
+		ret = wait_event_interruptible(dev->read_wq,
+			atomic_read(&dev->rx_completed) - start != done
+			|| dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED) {
+			r = -ECANCELED;
+			break;
+		}
+		if (dev->state != STATE_BUSY) {
+			r = -EIO;
+			break;
+		}
+		if (ret < 0) {
+			r = ret;
+			break;
+		}
+		smp_rmb();
+		done++;
 
-			write_req = read_req;
-			read_req = NULL;
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			dev->state = STATE_ERROR;
+			break;
+		}
+
+		if (req->actual < req->length) {
+			/* short packet is used to signal EOF for sizes > 4 gig */
+			DBG(cdev, "got short packet\n");
+			count = 0;
+			break;
 		}
 	}
 
+out:
+	/* take back reads queued past the end of the transfer or an error */
+	if (done != queued) {
+		unsigned i;
+
+		for (i = done; i != queued; i++)
+			usb_ep_dequeue(dev->ep_out, dev->rx_req[i % dev->rx_reqs]);
+		wait_event(dev->read_wq,
+			atomic_read(&dev->rx_completed) - start == queued);
+	}
+
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1203,8 +1326,11 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < dev->rx_reqs; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
+	dev->rx_reqs = 0;
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	dev->state = STATE_OFFLINE;
@@ -1321,6 +1447,7 @@ static int mtp_setup(void)
 	init_waitqueue_head(&dev->intr_wq);
 	atomic_set(&dev->open_excl, 0);
 	atomic_set(&dev->ioctl_excl, 0);
+	atomic_set(&dev->rx_completed, 0);
 	INIT_LIST_HEAD(&dev->tx_idle);
 	INIT_LIST_HEAD(&dev->intr_idle);
 
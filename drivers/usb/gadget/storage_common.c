@@ -239,6 +239,17 @@ struct interrupt_data {
 /*-------------------------------------------------------------------------*/
 
 
+/* Maximum number of write-behind ranges in flight per LUN */
+#define FSG_WB_DEPTH_MAX	16
+
+/* Throughput counters of the READ or WRITE commands of a LUN */
+struct fsg_lun_stats {
+	u64		bytes;
+	u64		cmds;
+	u64		file_ns;	/* spent in vfs_read() or vfs_write() */
+	u64		busy_ns;	/* spent in the commands as a whole */
+};
+
 struct fsg_lun {
 	struct file	*filp;
 	loff_t		file_length;
@@ -257,6 +268,19 @@ struct fsg_lun {
 	u32		sense_data_info;
 	u32		unit_attention_data;
 
+	/* write-behind ranges submitted but not waited for yet */
+	loff_t		wb_start;
+	loff_t		wb_end;
+	unsigned	wb_head;
+	unsigned	wb_count;
+	struct {
+		loff_t	start;
+		loff_t	end;
+	}		wb_ranges[FSG_WB_DEPTH_MAX];
+
+	struct fsg_lun_stats	read_stats;
+	struct fsg_lun_stats	write_stats;
+
 	struct device	dev;
 };
 
@@ -292,10 +316,10 @@ MODULE_PARM_DESC(num_buffers, "Number of pipeline buffers");
 /* check if fsg_num_buffers is within a valid range */
 static inline int fsg_num_buffers_validate(void)
 {
-	if (fsg_num_buffers >= 2 && fsg_num_buffers <= 4)
+	if (fsg_num_buffers >= 2 && fsg_num_buffers <= 32)
 		return 0;
 	pr_err("fsg_num_buffers %u is out of range (%d to %d)\n",
-	       fsg_num_buffers, 2 ,4);
+	       fsg_num_buffers, 2 ,32);
 	return -EINVAL;
 }
 
@@ -744,11 +768,18 @@ static int fsg_lun_open(struct fsg_lun *curlun, const char *filename)
 		goto out;
 	}
 
+	/* Hosts mostly stream, read ahead as POSIX_FADV_SEQUENTIAL does */
+	if (inode->i_mapping->backing_dev_info)
+		filp->f_ra.ra_pages =
+			inode->i_mapping->backing_dev_info->ra_pages * 2;
+
 	get_file(filp);
 	curlun->ro = ro;
 	curlun->filp = filp;
 	curlun->file_length = size;
 	curlun->num_sectors = num_sectors;
+	curlun->wb_start = curlun->wb_end = 0;
+	curlun->wb_count = 0;
 	LDBG(curlun, "open backing file: %s\n", filename);
 	rc = 0;
 
@@ -780,6 +811,8 @@ static int fsg_lun_fsync_sub(struct fsg_lun *curlun)
 
 	if (curlun->ro || !filp)
 		return 0;
+	/* this waits for the write-behind ranges as well */
+	curlun->wb_count = 0;
 	return vfs_fsync(filp, 1);
 }
 
@@ -23,6 +23,7 @@
 #include <linux/poll.h>
 #include <linux/string.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/hash.h>
 #include <linux/spinlock.h>
 #include <linux/syscalls.h>
@@ -41,18 +42,19 @@
 
 /*
  * LOCKING:
- * There are three level of locking required by epoll :
+ * There are two level of locking required by epoll :
  *
  * 1) epmutex (mutex)
  * 2) ep->mtx (mutex)
- * 3) ep->lock (spinlock)
  *
- * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
- * from inside the poll callback, that might be triggered from
- * a wake_up() that in turn might be called from IRQ context.
- * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
+ * The acquire order is the one listed above, from 1 to 2.
+ * The poll callback, that might be triggered from a wake_up() that
+ * in turn might be called from IRQ context, takes no epoll lock at
+ * all: it marks the item as queued and pushes it on the lockless
+ * ep->rdllq list. Everything else, including moving the queued items
+ * to the ready list, runs under ep->mtx, so the ready list needs no
+ * spinlock. Sleepers in epoll_wait() are serialized by the lock of
+ * ep->wq itself. During the event transfer loop (from kernel to
  * user space) we could end up sleeping due a copy_to_user(), so
  * we need a lock that will allow us to sleep. This lock is a
  * mutex (ep->mtx). It is acquired during the event transfer loop,
@@ -80,8 +82,8 @@
  * of epoll file descriptors, we use the current recursion depth as
  * the lockdep subkey.
  * It is possible to drop the "ep->mtx" and to use the global
- * mutex "epmutex" (together with "ep->lock") to have it working,
- * but having "ep->mtx" will make the interface more scalable.
+ * mutex "epmutex" to have it working, but having "ep->mtx" will
+ * make the interface more scalable.
  * Events that require holding "epmutex" are very rare, while for
  * normal operations the epoll private "ep->mtx" will guarantee
  * a better scalability.
@@ -95,7 +97,8 @@
 
 #define EP_MAX_EVENTS (INT_MAX / sizeof(struct epoll_event))
 
-#define EP_UNACTIVE_PTR ((void *) -1L)
+/* Bit of epitem->state set while the item sits on ep->rdllq */
+#define EPI_QUEUED 0
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
@@ -134,11 +137,11 @@ struct epitem {
 	/* List header used to link this structure to the eventpoll ready list */
 	struct list_head rdllink;
 
-	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
-	 */
-	struct epitem *next;
+	/* Lockless link used by the poll callback to queue the item on ->rdllq */
+	struct llist_node rdlnode;
+
+	/* EPI_QUEUED */
+	unsigned long state;
 
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
@@ -165,9 +168,6 @@ struct epitem {
  * interface.
  */
 struct eventpoll {
-	/* Protect the access to this structure */
-	spinlock_t lock;
-
 	/*
 	 * This mutex is used to ensure that files are not removed
 	 * while epoll is using them. This is held during the event
@@ -182,18 +182,17 @@ struct eventpoll {
 	/* Wait queue used by file->poll() */
 	wait_queue_head_t poll_wait;
 
-	/* List of ready file descriptors */
+	/* List of ready file descriptors, protected by "mtx" */
 	struct list_head rdllist;
 
-	/* RB tree root used to store monitored fd structs */
-	struct rb_root rbr;
-
 	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transferring ready events to userspace w/out
-	 * holding ->lock.
+	 * Items reported ready by the poll callback and not yet moved to
+	 * rdllist, newest first.
 	 */
-	struct epitem *ovflist;
+	struct llist_head rdllq;
+
+	/* RB tree root used to store monitored fd structs */
+	struct rb_root rbr;
 
 	/* The user that created the eventpoll descriptor */
 	struct user_struct *user;
@@ -355,7 +354,7 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	return !list_empty(&ep->rdllist) || !llist_empty(&ep->rdllq);
 }
 
 /**
@@ -498,6 +497,66 @@ static void ep_unregister_pollwait(struct eventpoll *ep, struct epitem *epi)
 	}
 }
 
+/*
+ * Wake up (if active) both the eventpoll wait list and the ->poll() wait
+ * list, after items have been queued.
+ */
+static void ep_wakeup(struct eventpoll *ep)
+{
+	/* Pairs with set_current_state() in ep_poll() */
+	smp_mb();
+	if (waitqueue_active(&ep->wq))
+		wake_up(&ep->wq);
+	if (waitqueue_active(&ep->poll_wait))
+		ep_poll_safewake(&ep->poll_wait);
+}
+
+/*
+ * Moves the items queued by the poll callback to the tail of @list, in
+ * the order they were reported. Items already linked on a ready list
+ * stay where they are. Must be called with "mtx" held (or "epmutex" if
+ * called from ep_free), which makes us the only consumer of ->rdllq.
+ */
+static void ep_harvest_ready(struct eventpoll *ep, struct list_head *list)
+{
+	struct llist_node *node, *next, *fifo = NULL;
+	struct epitem *epi;
+
+	/* ->rdllq is newest first, reverse it in one pass */
+	for (node = llist_del_all(&ep->rdllq); node; node = next) {
+		next = node->next;
+		node->next = fifo;
+		fifo = node;
+	}
+
+	for (node = fifo; node; node = next) {
+		epi = llist_entry(node, struct epitem, rdlnode);
+		next = node->next;
+
+		/*
+		 * Once the bit is clear the poll callback may queue the item
+		 * again and overwrite ->rdlnode, which we are done with.
+		 */
+		smp_mb__before_clear_bit();
+		clear_bit(EPI_QUEUED, &epi->state);
+
+		if (!ep_is_linked(&epi->rdllink))
+			list_add_tail(&epi->rdllink, list);
+	}
+}
+
+/*
+ * Takes @epi off the ready lists. Its poll hooks must be gone already, so
+ * that the poll callback cannot queue it again.
+ */
+static void ep_unlink_ready(struct eventpoll *ep, struct epitem *epi)
+{
+	if (test_bit(EPI_QUEUED, &epi->state))
+		ep_harvest_ready(ep, &ep->rdllist);
+	if (ep_is_linked(&epi->rdllink))
+		list_del_init(&epi->rdllink);
+}
+
 /**
  * ep_scan_ready_list - Scans the ready list in a way that makes possible for
  *                      the scan code, to call f_op->poll(). Also allows for
@@ -516,9 +575,7 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 			      void *priv,
 			      int depth)
 {
-	int error, pwake = 0;
-	unsigned long flags;
-	struct epitem *epi, *nepi;
+	int error, wake;
 	LIST_HEAD(txlist);
 
 	/*
@@ -528,69 +585,38 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	mutex_lock_nested(&ep->mtx, depth);
 
 	/*
-	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
-	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
-	 * because we want the "sproc" callback to be able to do it
-	 * in a lockless way.
+	 * Steal the ready list, together with everything the poll callback
+	 * queued so far, in a single batch. Events happening while "sproc"
+	 * runs keep piling up on ep->rdllq without any lock, and are
+	 * picked up below.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	ep_harvest_ready(ep, &ep->rdllist);
 	list_splice_init(&ep->rdllist, &txlist);
-	ep->ovflist = NULL;
-	spin_unlock_irqrestore(&ep->lock, flags);
 
 	/*
 	 * Now call the callback function.
 	 */
 	error = (*sproc)(ep, &txlist, priv);
 
-	spin_lock_irqsave(&ep->lock, flags);
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
-	 * We re-insert them inside the main ready-list here.
+	 * We re-insert them inside the main ready-list here, skipping
+	 * those still on "txlist", which the list_splice() below takes
+	 * care of.
 	 */
-	for (nepi = ep->ovflist; (epi = nepi) != NULL;
-	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		/*
-		 * We need to check if the item is already in the list.
-		 * During the "sproc" callback execution time, items are
-		 * queued into ->ovflist but the "txlist" might already
-		 * contain them, and the list_splice() below takes care of them.
-		 */
-		if (!ep_is_linked(&epi->rdllink))
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-	}
-	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
-	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
-	 */
-	ep->ovflist = EP_UNACTIVE_PTR;
+	ep_harvest_ready(ep, &ep->rdllist);
 
 	/*
 	 * Quickly re-inject items left on "txlist".
 	 */
 	list_splice(&txlist, &ep->rdllist);
-
-	if (!list_empty(&ep->rdllist)) {
-		/*
-		 * Wake up (if active) both the eventpoll wait list and
-		 * the ->poll() wait list (delayed after we release the lock).
-		 */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
-		if (waitqueue_active(&ep->poll_wait))
-			pwake++;
-	}
-	spin_unlock_irqrestore(&ep->lock, flags);
+	wake = !list_empty(&ep->rdllist);
 
 	mutex_unlock(&ep->mtx);
 
-	/* We have to call this outside the lock */
-	if (pwake)
-		ep_poll_safewake(&ep->poll_wait);
+	if (wake)
+		ep_wakeup(ep);
 
 	return error;
 }
@@ -601,16 +627,11 @@ static int ep_scan_ready_list(struct eventpoll *ep,
  */
 static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 {
-	unsigned long flags;
 	struct file *file = epi->ffd.file;
 
 	/*
-	 * Removes poll wait queue hooks. We _have_ to do this without holding
-	 * the "ep->lock" otherwise a deadlock might occur. This because of the
-	 * sequence of the lock acquisition. Here we do "ep->lock" then the wait
-	 * queue head lock when unregistering the wait queue. The wakeup callback
-	 * will run by holding the wait queue head lock and will call our callback
-	 * that will try to get "ep->lock".
+	 * Removes poll wait queue hooks. Once this returns the poll callback
+	 * cannot queue the item anymore.
 	 */
 	ep_unregister_pollwait(ep, epi);
 
@@ -622,10 +643,7 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase(&epi->rbn, &ep->rbr);
 
-	spin_lock_irqsave(&ep->lock, flags);
-	if (ep_is_linked(&epi->rdllink))
-		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	ep_unlink_ready(ep, epi);
 
 	/* At this point it is safe to free the eventpoll item */
 	kmem_cache_free(epi_cache, epi);
@@ -667,7 +685,7 @@ static void ep_free(struct eventpoll *ep)
 	 * Walks through the whole tree by freeing each "struct epitem". At this
 	 * point we are sure no poll callbacks will be lingering around, and also by
 	 * holding "epmutex" we can be sure that no file cleanup code will hit
-	 * us during this operation. So we can avoid the lock on "ep->lock".
+	 * us during this operation. So we can avoid the lock on "ep->mtx".
 	 */
 	while ((rbp = rb_first(&ep->rbr)) != NULL) {
 		epi = rb_entry(rbp, struct epitem, rbn);
@@ -801,13 +819,12 @@ static int ep_alloc(struct eventpoll **pep)
 	if (unlikely(!ep))
 		goto free_uid;
 
-	spin_lock_init(&ep->lock);
 	mutex_init(&ep->mtx);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
+	init_llist_head(&ep->rdllq);
 	ep->rbr = RB_ROOT;
-	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
 
 	*pep = ep;
@@ -855,8 +872,6 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
-	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 
@@ -871,8 +886,6 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 		list_del_init(&wait->task_list);
 	}
 
-	spin_lock_irqsave(&ep->lock, flags);
-
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
 	 * descriptor to be disabled. This condition is likely the effect of the
@@ -880,7 +893,7 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
 	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+		return 1;
 
 	/*
 	 * Check the events coming with the callback. At this stage, not
@@ -889,41 +902,20 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * test for "key" != NULL before the event match test.
 	 */
 	if (key && !((unsigned long) key & epi->event.events))
-		goto out_unlock;
+		return 1;
 
 	/*
-	 * If we are transferring events to userspace, we can hold no locks
-	 * (because we're accessing user memory, and because of linux f_op->poll()
-	 * semantics). All the events that happen during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * Queue the item unless it is queued already, in which case whoever
+	 * queued it also did the wakeup. This takes no lock shared with other
+	 * wakeup sources or with the task harvesting the events; an item that
+	 * is also on the ready list, or on a list being transferred to user
+	 * space, is sorted out when the queue is harvested.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-		}
-		goto out_unlock;
-	}
+	if (test_and_set_bit(EPI_QUEUED, &epi->state))
+		return 1;
+	llist_add(&epi->rdlnode, &ep->rdllq);
 
-	/* If this file is already in the ready list we exit soon */
-	if (!ep_is_linked(&epi->rdllink))
-		list_add_tail(&epi->rdllink, &ep->rdllist);
-
-	/*
-	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
-	 * wait list.
-	 */
-	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
-	if (waitqueue_active(&ep->poll_wait))
-		pwake++;
-
-out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
-	if (pwake)
-		ep_poll_safewake(&ep->poll_wait);
+	ep_wakeup(ep);
 
 	return 1;
 }
@@ -1073,8 +1065,7 @@ static int reverse_path_check(void)
 static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		     struct file *tfile, int fd)
 {
-	int error, revents, pwake = 0;
-	unsigned long flags;
+	int error, revents, wake = 0;
 	long user_watches;
 	struct epitem *epi;
 	struct ep_pqueue epq;
@@ -1093,7 +1084,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	ep_set_ffd(&epi->ffd, tfile, fd);
 	epi->event = *event;
 	epi->nwait = 0;
-	epi->next = EP_UNACTIVE_PTR;
+	epi->state = 0;
 
 	/* Initialize the poll table using the queue callback */
 	epq.epi = epi;
@@ -1133,27 +1124,17 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	if (reverse_path_check())
 		goto error_remove_epi;
 
-	/* We have to drop the new item inside our item list to keep track of it */
-	spin_lock_irqsave(&ep->lock, flags);
-
 	/* If the file is already "ready" we drop it inside the ready list */
 	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
 		list_add_tail(&epi->rdllink, &ep->rdllist);
-
-		/* Notify waiting tasks that events are available */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
-		if (waitqueue_active(&ep->poll_wait))
-			pwake++;
+		wake = 1;
 	}
 
-	spin_unlock_irqrestore(&ep->lock, flags);
-
 	atomic_long_inc(&ep->user->epoll_watches);
 
-	/* We have to call this outside the lock */
-	if (pwake)
-		ep_poll_safewake(&ep->poll_wait);
+	/* Notify waiting tasks that events are available */
+	if (wake)
+		ep_wakeup(ep);
 
 	return 0;
 
@@ -1170,14 +1151,9 @@ error_unregister:
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
-	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * allocated wait queue. ep_insert() is called with "mtx" held.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
-	if (ep_is_linked(&epi->rdllink))
-		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	ep_unlink_ready(ep, epi);
 
 	kmem_cache_free(epi_cache, epi);
 
@@ -1190,7 +1166,6 @@ error_unregister:
  */
 static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_event *event)
 {
-	int pwake = 0;
 	unsigned int revents;
 
 	/*
@@ -1207,9 +1182,8 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * 1) Flush epi changes above to other CPUs.  This ensures
 	 *    we do not miss events from ep_poll_callback if an
 	 *    event occurs immediately after we call f_op->poll().
-	 *    We need this because we did not take ep->lock while
-	 *    changing epi above (but ep_poll_callback does take
-	 *    ep->lock).
+	 *    We need this because ep_poll_callback reads the
+	 *    event mask without any lock.
 	 *
 	 * 2) We also need to ensure we do not miss _past_ events
 	 *    when calling f_op->poll().  This barrier also
@@ -1229,25 +1203,14 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 
 	/*
 	 * If the item is "hot" and it is not registered inside the ready
-	 * list, push it inside.
+	 * list, push it inside. The ready list is protected by "mtx".
 	 */
-	if (revents & event->events) {
-		spin_lock_irq(&ep->lock);
-		if (!ep_is_linked(&epi->rdllink)) {
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-
-			/* Notify waiting tasks that events are available */
-			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
-			if (waitqueue_active(&ep->poll_wait))
-				pwake++;
-		}
-		spin_unlock_irq(&ep->lock);
-	}
+	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
+		list_add_tail(&epi->rdllink, &ep->rdllist);
 
-	/* We have to call this outside the lock */
-	if (pwake)
-		ep_poll_safewake(&ep->poll_wait);
+		/* Notify waiting tasks that events are available */
+		ep_wakeup(ep);
+	}
 
 	return 0;
 }
@@ -1301,7 +1264,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 				 * into ep->rdllist besides us. The epoll_ctl()
 				 * callers are locked out by
 				 * ep_scan_ready_list() holding "mtx" and the
-				 * poll callback will queue them in ep->ovflist.
+				 * poll callback will queue them in ep->rdllq.
 				 */
 				list_add_tail(&epi->rdllink, &ep->rdllist);
 			}
@@ -1371,12 +1334,12 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
-		spin_lock_irqsave(&ep->lock, flags);
+		spin_lock_irqsave(&ep->wq.lock, flags);
 		goto check_events;
 	}
 
 fetch_events:
-	spin_lock_irqsave(&ep->lock, flags);
+	spin_lock_irqsave(&ep->wq.lock, flags);
 
 	if (!ep_events_available(ep)) {
 		/*
@@ -1401,11 +1364,11 @@ fetch_events:
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
+			spin_unlock_irqrestore(&ep->wq.lock, flags);
 			if (!schedule_hrtimeout_range(to, slack, HRTIMER_MODE_ABS))
 				timed_out = 1;
 
-			spin_lock_irqsave(&ep->lock, flags);
+			spin_lock_irqsave(&ep->wq.lock, flags);
 		}
 		__remove_wait_queue(&ep->wq, &wait);
 
@@ -1415,7 +1378,7 @@ check_events:
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
-	spin_unlock_irqrestore(&ep->lock, flags);
+	spin_unlock_irqrestore(&ep->wq.lock, flags);
 
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
@@ -195,18 +195,38 @@ static void iov_fault_in_pages_read(struct iovec *iov, unsigned long len)
 	}
 }
 
+/*
+ * A reader draining a full pipe releases its pages just before the writer
+ * needs them again, so keep a few of them around instead of going back to
+ * the page allocator for every buffer. Both sides run under i_mutex.
+ */
+static struct page *pipe_get_tmp_page(struct pipe_inode_info *pipe)
+{
+	if (pipe->nr_tmp_pages)
+		return pipe->tmp_page[--pipe->nr_tmp_pages];
+	return alloc_page(GFP_HIGHUSER);
+}
+
+static void pipe_put_tmp_page(struct pipe_inode_info *pipe, struct page *page)
+{
+	if (pipe->nr_tmp_pages < PIPE_TMP_PAGES)
+		pipe->tmp_page[pipe->nr_tmp_pages++] = page;
+	else
+		__free_page(page);
+}
+
 static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
 	struct page *page = buf->page;
 
 	/*
-	 * If nobody else uses this page, and we don't already have a
-	 * temporary page, let's keep track of it as a one-deep
-	 * allocation cache. (Otherwise just release our reference to it)
+	 * If nobody else uses this page, and the cache of temporary pages
+	 * is not full, keep it for the next write. (Otherwise just release
+	 * our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
-		pipe->tmp_page = page;
+	if (page_count(page) == 1 && pipe->nr_tmp_pages < PIPE_TMP_PAGES)
+		pipe->tmp_page[pipe->nr_tmp_pages++] = page;
 	else
 		page_cache_release(page);
 }
@@ -518,7 +538,16 @@ pipe_write(struct kiocb *iocb, const struct iovec *_iov,
 		const struct pipe_buf_operations *ops = buf->ops;
 		int offset = buf->offset + buf->len;
 
-		if (ops->can_merge && offset + chars <= PAGE_SIZE) {
+		/*
+		 * If the tail does not fit, a short write can still top up
+		 * the last buffer and put the rest in a new one, as long as
+		 * that does not make us sleep half way through it.
+		 */
+		if (ops->can_merge && offset + chars > PAGE_SIZE &&
+		    total_len <= PIPE_BUF && pipe->nrbufs < pipe->buffers)
+			chars = PAGE_SIZE - offset;
+
+		if (ops->can_merge && chars && offset + chars <= PAGE_SIZE) {
 			int error, atomic = 1;
 			void *addr;
 
@@ -562,17 +591,14 @@ redo1:
 		if (bufs < pipe->buffers) {
 			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers-1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
-			struct page *page = pipe->tmp_page;
+			struct page *page;
 			char *src;
 			int error, atomic = 1;
 
-			if (!page) {
-				page = alloc_page(GFP_HIGHUSER);
-				if (unlikely(!page)) {
-					ret = ret ? : -ENOMEM;
-					break;
-				}
-				pipe->tmp_page = page;
+			page = pipe_get_tmp_page(pipe);
+			if (unlikely(!page)) {
+				ret = ret ? : -ENOMEM;
+				break;
 			}
 			/* Always wake up, even if the copy fails. Otherwise
 			 * we lock up (O_NONBLOCK-)readers that sleep due to
@@ -603,6 +629,7 @@ redo2:
 					atomic = 0;
 					goto redo2;
 				}
+				pipe_put_tmp_page(pipe, page);
 				if (!ret)
 					ret = error;
 				break;
@@ -620,7 +647,6 @@ redo2:
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			}
 			pipe->nrbufs = ++bufs;
-			pipe->tmp_page = NULL;
 
 			total_len -= chars;
 			if (!total_len)
@@ -952,8 +978,8 @@ void __free_pipe_info(struct pipe_inode_info *pipe)
 		if (buf->ops)
 			buf->ops->release(pipe, buf);
 	}
-	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+	for (i = 0; i < pipe->nr_tmp_pages; i++)
+		__free_page(pipe->tmp_page[i]);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
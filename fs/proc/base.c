@@ -351,6 +351,27 @@ static int proc_pid_schedstat(struct task_struct *task, char *buffer)
 			(unsigned long long)task->sched_info.run_delay,
 			task->sched_info.pcount);
 }
+
+/*
+ * Provides /proc/PID/sched_latency: how long the task waited for a cpu
+ * after being woken up and after being preempted, as histograms of
+ * SCHED_LAT_BUCKETS log2 nanosecond buckets (see struct sched_lat_hist).
+ */
+static int proc_pid_sched_latency(struct task_struct *task, char *buffer)
+{
+	const struct sched_lat_hist *hist = &task->sched_info.lat_hist;
+	int i, len;
+
+	len = sprintf(buffer, "wakeup");
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		len += sprintf(buffer + len, " %u", hist->wakeup[i]);
+	len += sprintf(buffer + len, "\npreempt");
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		len += sprintf(buffer + len, " %u", hist->preempt[i]);
+	len += sprintf(buffer + len, "\n");
+
+	return len;
+}
 #endif
 
 #ifdef CONFIG_LATENCYTOP
@@ -2858,6 +2879,7 @@ static const struct pid_entry tgid_base_stuff[] = {
 #endif
 #ifdef CONFIG_SCHEDSTATS
 	INF("schedstat",  S_IRUGO, proc_pid_schedstat),
+	INF("sched_latency", S_IRUGO, proc_pid_sched_latency),
 #endif
 #ifdef CONFIG_LATENCYTOP
 	REG("latency",  S_IRUGO, proc_lstats_operations),
@@ -3211,6 +3233,7 @@ static const struct pid_entry tid_base_stuff[] = {
 #endif
 #ifdef CONFIG_SCHEDSTATS
 	INF("schedstat", S_IRUGO, proc_pid_schedstat),
+	INF("sched_latency", S_IRUGO, proc_pid_sched_latency),
 #endif
 #ifdef CONFIG_LATENCYTOP
 	REG("latency",  S_IRUGO, proc_lstats_operations),
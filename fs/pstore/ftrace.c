@@ -0,0 +1,233 @@
+/*
+ * Persistent Storage - function trace recording.
+ *
+ * Writing 1 to <debugfs>/pstore/record_ftrace sends every traced
+ * function call to the backend's ftrace zones, and record_events does
+ * the same for context switches and interrupt handlers, so the last
+ * events before a hang or a watchdog reset can be read back from the
+ * pstore file system on the next boot. Records go to a zone of the CPU
+ * they were made on, so a CPU that locks up keeps its own history. The
+ * functions recorded follow the tracing set_ftrace_filter.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/irqflags.h>
+#include <linux/interrupt.h>
+#include <linux/percpu.h>
+#include <linux/smp.h>
+#include <linux/mutex.h>
+#include <linux/ftrace.h>
+#include <linux/trace_clock.h>
+#include <linux/tracepoint.h>
+#include <linux/fs.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+#include <trace/events/sched.h>
+#include <trace/events/irq.h>
+
+#include "internal.h"
+
+/* The backend may call traceable code, don't record that */
+static DEFINE_PER_CPU(int, pstore_ftrace_nesting);
+
+static void notrace pstore_ftrace_write(enum pstore_ftrace_type type,
+					unsigned long ip,
+					unsigned long parent_ip)
+{
+	struct pstore_ftrace_record rec;
+	unsigned long flags;
+	int *nesting;
+
+	/* keep what led up to the oops rather than the oops itself */
+	if (unlikely(oops_in_progress))
+		return;
+
+	raw_local_irq_save(flags);
+	nesting = &__get_cpu_var(pstore_ftrace_nesting);
+	if (likely(!(*nesting)++)) {
+		rec.ts_type = trace_clock_local() << PSTORE_FTRACE_TYPE_BITS |
+			      type;
+		rec.ip = ip;
+		rec.parent_ip = parent_ip;
+		psinfo->write_buf(PSTORE_TYPE_FTRACE, (const char *)&rec,
+				  sizeof(rec));
+	}
+	(*nesting)--;
+	raw_local_irq_restore(flags);
+}
+
+static void notrace pstore_ftrace_call(unsigned long ip,
+				       unsigned long parent_ip)
+{
+	pstore_ftrace_write(PSTORE_FTRACE_FUNC, ip, parent_ip);
+}
+
+static struct ftrace_ops pstore_ftrace_ops __read_mostly = {
+	.func	= pstore_ftrace_call,
+	.flags	= FTRACE_OPS_FL_GLOBAL,
+};
+
+static int pstore_ftrace_register(void)
+{
+	return register_ftrace_function(&pstore_ftrace_ops);
+}
+
+static int pstore_ftrace_unregister(void)
+{
+	return unregister_ftrace_function(&pstore_ftrace_ops);
+}
+
+static void notrace pstore_probe_sched_switch(void *ignore,
+					      struct task_struct *prev,
+					      struct task_struct *next)
+{
+	pstore_ftrace_write(PSTORE_FTRACE_SCHED_SWITCH, prev->pid, next->pid);
+}
+
+static void notrace pstore_probe_irq_entry(void *ignore, int irq,
+					   struct irqaction *action)
+{
+	pstore_ftrace_write(PSTORE_FTRACE_IRQ_ENTRY, irq,
+			    (unsigned long)action->handler);
+}
+
+static void notrace pstore_probe_irq_exit(void *ignore, int irq,
+					  struct irqaction *action, int ret)
+{
+	pstore_ftrace_write(PSTORE_FTRACE_IRQ_EXIT, irq, ret);
+}
+
+static int pstore_events_register(void)
+{
+	int ret;
+
+	ret = register_trace_sched_switch(pstore_probe_sched_switch, NULL);
+	if (ret)
+		return ret;
+	ret = register_trace_irq_handler_entry(pstore_probe_irq_entry, NULL);
+	if (ret)
+		goto fail_entry;
+	ret = register_trace_irq_handler_exit(pstore_probe_irq_exit, NULL);
+	if (ret)
+		goto fail_exit;
+	return 0;
+
+fail_exit:
+	unregister_trace_irq_handler_entry(pstore_probe_irq_entry, NULL);
+fail_entry:
+	unregister_trace_sched_switch(pstore_probe_sched_switch, NULL);
+	return ret;
+}
+
+static int pstore_events_unregister(void)
+{
+	unregister_trace_irq_handler_exit(pstore_probe_irq_exit, NULL);
+	unregister_trace_irq_handler_entry(pstore_probe_irq_entry, NULL);
+	unregister_trace_sched_switch(pstore_probe_sched_switch, NULL);
+	tracepoint_synchronize_unregister();
+	return 0;
+}
+
+struct pstore_ftrace_knob {
+	const char *name;
+	bool enabled;
+	int (*enable)(void);
+	int (*disable)(void);
+};
+
+static struct pstore_ftrace_knob pstore_ftrace_knobs[] = {
+	{
+		.name		= "record_ftrace",
+		.enable		= pstore_ftrace_register,
+		.disable	= pstore_ftrace_unregister,
+	},
+	{
+		.name		= "record_events",
+		.enable		= pstore_events_register,
+		.disable	= pstore_events_unregister,
+	},
+};
+
+static DEFINE_MUTEX(pstore_ftrace_lock);
+
+static ssize_t pstore_ftrace_knob_write(struct file *f, const char __user *buf,
+					size_t count, loff_t *ppos)
+{
+	struct pstore_ftrace_knob *knob = f->f_dentry->d_inode->i_private;
+	u8 on;
+	ssize_t ret;
+
+	ret = kstrtou8_from_user(buf, count, 2, &on);
+	if (ret)
+		return ret;
+
+	mutex_lock(&pstore_ftrace_lock);
+
+	if (!on == !knob->enabled)
+		goto out;
+
+	if (on)
+		ret = knob->enable();
+	else
+		ret = knob->disable();
+	if (ret) {
+		pr_err("%s: unable to %s %s: %zd\n", __func__,
+		       on ? "enable" : "disable", knob->name, ret);
+		goto err;
+	}
+
+	knob->enabled = on;
+out:
+	ret = count;
+err:
+	mutex_unlock(&pstore_ftrace_lock);
+
+	return ret;
+}
+
+static ssize_t pstore_ftrace_knob_read(struct file *f, char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	struct pstore_ftrace_knob *knob = f->f_dentry->d_inode->i_private;
+	char val[] = { '0' + knob->enabled, '\n' };
+
+	return simple_read_from_buffer(buf, count, ppos, val, sizeof(val));
+}
+
+static const struct file_operations pstore_knob_fops = {
+	.read	= pstore_ftrace_knob_read,
+	.write	= pstore_ftrace_knob_write,
+	.llseek	= default_llseek,
+};
+
+void pstore_register_ftrace(void)
+{
+	struct pstore_ftrace_knob *knob;
+	struct dentry *dir;
+	struct dentry *file;
+
+	dir = debugfs_create_dir("pstore", NULL);
+	if (IS_ERR_OR_NULL(dir)) {
+		pr_err("%s: unable to create pstore directory\n", __func__);
+		return;
+	}
+
+	for (knob = pstore_ftrace_knobs;
+	     knob < pstore_ftrace_knobs + ARRAY_SIZE(pstore_ftrace_knobs);
+	     knob++) {
+		file = debugfs_create_file(knob->name, 0600, dir, knob,
+					   &pstore_knob_fops);
+		if (IS_ERR_OR_NULL(file))
+			pr_err("%s: unable to create %s file\n", __func__,
+			       knob->name);
+	}
+}
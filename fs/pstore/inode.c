@@ -32,6 +32,7 @@
 #include <linux/magic.h>
 #include <linux/pstore.h>
 #include <linux/slab.h>
+#include <linux/seq_file.h>
 #include <linux/uaccess.h>
 
 #include "internal.h"
@@ -39,30 +40,139 @@
 #define	PSTORE_NAMELEN	64
 
 struct pstore_private {
+	enum pstore_type_id type;
 	u64	id;
-	int	(*erase)(u64);
+	int	(*erase)(enum pstore_type_id, u64);
 	ssize_t	size;
 	char	data[];
 };
 
+/*
+ * Function trace records are decoded on read, one file per CPU. The
+ * oldest record may have been cut in half when the ring wrapped, so
+ * start at the first complete one counted back from the end. Raw
+ * addresses are printed too: the symbols are looked up in the running
+ * kernel, which need not be the one that wrote the records.
+ */
+#define FTRACE_REC_SIZE	sizeof(struct pstore_ftrace_record)
+
+static void *pstore_ftrace_seq_start(struct seq_file *s, loff_t *pos)
+{
+	struct pstore_private *ps = s->private;
+	size_t off = ps->size % FTRACE_REC_SIZE + *pos * FTRACE_REC_SIZE;
+
+	if (off + FTRACE_REC_SIZE > ps->size)
+		return NULL;
+	return ps->data + off;
+}
+
+static void *pstore_ftrace_seq_next(struct seq_file *s, void *v, loff_t *pos)
+{
+	(*pos)++;
+	return pstore_ftrace_seq_start(s, pos);
+}
+
+static void pstore_ftrace_seq_stop(struct seq_file *s, void *v)
+{
+}
+
+static int pstore_ftrace_seq_show(struct seq_file *s, void *v)
+{
+	struct pstore_private *ps = s->private;
+	struct pstore_ftrace_record rec;
+	unsigned long rem_nsec;
+	u64 ts;
+
+	/* records are not aligned in the file */
+	memcpy(&rec, v, sizeof(rec));
+	ts = rec.ts_type >> PSTORE_FTRACE_TYPE_BITS;
+	rem_nsec = do_div(ts, NSEC_PER_SEC);
+	seq_printf(s, "[%5lu.%06lu] cpu%llu ", (unsigned long)ts,
+		   rem_nsec / NSEC_PER_USEC, (unsigned long long)ps->id);
+
+	switch (rec.ts_type & PSTORE_FTRACE_TYPE_MASK) {
+	case PSTORE_FTRACE_FUNC:
+		seq_printf(s, "%08lx %08lx %pf <- %pF\n",
+			   rec.ip, rec.parent_ip,
+			   (void *)rec.ip, (void *)rec.parent_ip);
+		break;
+	case PSTORE_FTRACE_SCHED_SWITCH:
+		seq_printf(s, "sched_switch: prev_pid=%lu next_pid=%lu\n",
+			   rec.ip, rec.parent_ip);
+		break;
+	case PSTORE_FTRACE_IRQ_ENTRY:
+		seq_printf(s, "irq_handler_entry: irq=%lu handler=%08lx %pf\n",
+			   rec.ip, rec.parent_ip, (void *)rec.parent_ip);
+		break;
+	case PSTORE_FTRACE_IRQ_EXIT:
+		seq_printf(s, "irq_handler_exit: irq=%lu ret=%ld\n",
+			   rec.ip, (long)rec.parent_ip);
+		break;
+	default:
+		seq_printf(s, "unknown record %llu\n",
+			   rec.ts_type & PSTORE_FTRACE_TYPE_MASK);
+		break;
+	}
+	return 0;
+}
+
+static const struct seq_operations pstore_ftrace_seq_ops = {
+	.start	= pstore_ftrace_seq_start,
+	.next	= pstore_ftrace_seq_next,
+	.stop	= pstore_ftrace_seq_stop,
+	.show	= pstore_ftrace_seq_show,
+};
+
 static int pstore_file_open(struct inode *inode, struct file *file)
 {
-	file->private_data = inode->i_private;
+	struct pstore_private *ps = inode->i_private;
+	int err;
+
+	if (ps->type != PSTORE_TYPE_FTRACE) {
+		file->private_data = ps;
+		return 0;
+	}
+
+	err = seq_open(file, &pstore_ftrace_seq_ops);
+	if (err)
+		return err;
+	((struct seq_file *)file->private_data)->private = ps;
 	return 0;
 }
 
 static ssize_t pstore_file_read(struct file *file, char __user *userbuf,
 						size_t count, loff_t *ppos)
 {
-	struct pstore_private *ps = file->private_data;
+	struct pstore_private *ps = file->f_dentry->d_inode->i_private;
 
+	if (ps->type == PSTORE_TYPE_FTRACE)
+		return seq_read(file, userbuf, count, ppos);
 	return simple_read_from_buffer(userbuf, count, ppos, ps->data, ps->size);
 }
 
+static loff_t pstore_file_llseek(struct file *file, loff_t off, int origin)
+{
+	struct pstore_private *ps = file->f_dentry->d_inode->i_private;
+
+	if (ps->type == PSTORE_TYPE_FTRACE)
+		return seq_lseek(file, off, origin);
+	return default_llseek(file, off, origin);
+}
+
+static int pstore_file_release(struct inode *inode, struct file *file)
+{
+	struct pstore_private *ps = inode->i_private;
+
+	if (ps->type == PSTORE_TYPE_FTRACE)
+		return seq_release(inode, file);
+	return 0;
+}
+
 static const struct file_operations pstore_file_operations = {
-	.open	= pstore_file_open,
-	.read	= pstore_file_read,
-	.llseek	= default_llseek,
+	.open		= pstore_file_open,
+	.read		= pstore_file_read,
+	.llseek		= pstore_file_llseek,
+	.release	= pstore_file_release,
 };
 
 /*
@@ -73,7 +183,7 @@ static int pstore_unlink(struct inode *dir, struct dentry *dentry)
 {
 	struct pstore_private *p = dentry->d_inode->i_private;
 
-	p->erase(p->id);
+	p->erase(p->type, p->id);
 
 	return simple_unlink(dir, dentry);
 }
@@ -175,8 +285,8 @@ int pstore_is_mounted(void)
  * Set the mtime & ctime to the date that this record was originally stored.
  */
 int pstore_mkfile(enum pstore_type_id type, char *psname, u64 id,
-			      char *data, size_t size,
-			      struct timespec time, int (*erase)(u64))
+			      char *data, size_t size, struct timespec time,
+			      int (*erase)(enum pstore_type_id, u64))
 {
 	struct dentry		*root = pstore_sb->s_root;
 	struct dentry		*dentry;
@@ -192,6 +302,7 @@ int pstore_mkfile(enum pstore_type_id type, char *psname, u64 id,
 	private = kmalloc(sizeof *private + size, GFP_KERNEL);
 	if (!private)
 		goto fail_alloc;
+	private->type = type;
 	private->id = id;
 	private->erase = erase;
 
@@ -202,6 +313,12 @@ int pstore_mkfile(enum pstore_type_id type, char *psname, u64 id,
 	case PSTORE_TYPE_MCE:
 		sprintf(name, "mce-%s-%lld", psname, id);
 		break;
+	case PSTORE_TYPE_CONSOLE:
+		sprintf(name, "console-%s", psname);
+		break;
+	case PSTORE_TYPE_FTRACE:
+		sprintf(name, "ftrace-%s-%lld", psname, id);
+		break;
 	case PSTORE_TYPE_UNKNOWN:
 		sprintf(name, "unknown-%s-%lld", psname, id);
 		break;
@@ -1,6 +1,44 @@
+#ifndef __PSTORE_INTERNAL_H__
+#define __PSTORE_INTERNAL_H__
+
+#include <linux/pstore.h>
+
+enum pstore_ftrace_type {
+	PSTORE_FTRACE_FUNC,
+	PSTORE_FTRACE_SCHED_SWITCH,
+	PSTORE_FTRACE_IRQ_ENTRY,
+	PSTORE_FTRACE_IRQ_EXIT,
+};
+
+#define PSTORE_FTRACE_TYPE_BITS	8
+#define PSTORE_FTRACE_TYPE_MASK	((1 << PSTORE_FTRACE_TYPE_BITS) - 1)
+
+/*
+ * A function call or an event, as stored in the per-CPU ftrace zones.
+ * Events keep their arguments in ip and parent_ip.
+ */
+struct pstore_ftrace_record {
+	u64 ts_type;		/* trace_clock_local() << 8 | type */
+	unsigned long ip;
+	unsigned long parent_ip;
+};
+
+#ifdef CONFIG_PSTORE_FTRACE
+extern void pstore_register_ftrace(void);
+#else
+static inline void pstore_register_ftrace(void) {}
+#endif
+
+extern struct pstore_info *psinfo;
+
+/* Longest "<reason>#<oopscount> Part1\n" that heads a dump record */
+#define PSTORE_DUMP_HDR_MAX	32
+
 extern void	pstore_set_kmsg_bytes(int);
 extern void	pstore_get_records(void);
 extern int	pstore_mkfile(enum pstore_type_id, char *psname, u64 id,
-			      char *data, size_t size,
-			      struct timespec time, int (*erase)(u64));
+			      char *data, size_t size, struct timespec time,
+			      int (*erase)(enum pstore_type_id, u64));
 extern int	pstore_is_mounted(void);
+
+#endif
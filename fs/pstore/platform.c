@@ -19,6 +19,7 @@
 
 #include <linux/atomic.h>
 #include <linux/types.h>
+#include <linux/console.h>
 #include <linux/errno.h>
 #include <linux/init.h>
 #include <linux/kmsg_dump.h>
@@ -35,7 +36,7 @@
  * calls to pstore_register()
  */
 static DEFINE_SPINLOCK(pstore_lock);
-static struct pstore_info *psinfo;
+struct pstore_info *psinfo;
 
 /* How much of the console log to snapshot */
 static unsigned long kmsg_bytes = 10240;
@@ -69,6 +70,11 @@ static void pstore_dump(struct kmsg_dumper *dumper,
 	u64		id;
 	int		hsize, part = 1;
 
+	if ((psinfo->flags & PSTORE_FLAGS_CRASH_ONLY) &&
+	    reason != KMSG_DUMP_OOPS && reason != KMSG_DUMP_PANIC &&
+	    reason != KMSG_DUMP_EMERG)
+		return;
+
 	if (reason < ARRAY_SIZE(reason_str))
 		why = reason_str[reason];
 	else
@@ -110,6 +116,19 @@ static struct kmsg_dumper pstore_dumper = {
 	.dump = pstore_dump,
 };
 
+static void pstore_console_write(struct console *con, const char *s,
+				 unsigned int count)
+{
+	psinfo->write_buf(PSTORE_TYPE_CONSOLE, s, count);
+}
+
+static struct console pstore_console = {
+	.name	= "pstore",
+	.write	= pstore_console_write,
+	.flags	= CON_PRINTBUFFER | CON_ENABLED | CON_ANYTIME | CON_MEMORY,
+	.index	= -1,
+};
+
 /*
  * platform specific persistent storage driver registers with
  * us here. If pstore is already mounted, call the platform
@@ -117,7 +136,8 @@ static struct kmsg_dumper pstore_dumper = {
  * then the pstore mount code will call us later to fill out
  * the file system.
  *
- * Register with kmsg_dump to save last part of console log on panic.
+ * Register with kmsg_dump to save last part of console log on panic,
+ * and as a console and function trace sink if the backend can store them.
  */
 int pstore_register(struct pstore_info *psi)
 {
@@ -141,6 +161,11 @@ int pstore_register(struct pstore_info *psi)
 
 	kmsg_dump_register(&pstore_dumper);
 
+	if (psi->write_buf && (psi->flags & PSTORE_FLAGS_CONSOLE))
+		register_console(&pstore_console);
+	if (psi->write_buf && (psi->flags & PSTORE_FLAGS_FTRACE))
+		pstore_register_ftrace();
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(pstore_register);
@@ -152,6 +177,7 @@ EXPORT_SYMBOL_GPL(pstore_register);
 void pstore_get_records(void)
 {
 	struct pstore_info *psi = psinfo;
+	char			*buf = NULL;
 	ssize_t			size;
 	u64			id;
 	enum pstore_type_id	type;
@@ -166,10 +192,12 @@ void pstore_get_records(void)
 	if (rc)
 		goto out;
 
-	while ((size = psi->read(&id, &type, &time)) > 0) {
-		if (pstore_mkfile(type, psi->name, id, psi->buf, (size_t)size,
+	while ((size = psi->read(&id, &type, &time, &buf)) > 0) {
+		if (pstore_mkfile(type, psi->name, id, buf, (size_t)size,
 				  time, psi->erase))
 			failed++;
+		kfree(buf);
+		buf = NULL;
 	}
 	psi->close(psi);
 out:
@@ -198,7 +226,7 @@ int pstore_write(enum pstore_type_id type, char *buf, size_t size)
 	memcpy(psinfo->buf, buf, size);
 	id = psinfo->write(type, size);
 	if (pstore_is_mounted())
-		pstore_mkfile(PSTORE_TYPE_DMESG, psinfo->name, id, psinfo->buf,
+		pstore_mkfile(type, psinfo->name, id, psinfo->buf,
 			      size, CURRENT_TIME, psinfo->erase);
 	mutex_unlock(&psinfo->buf_mutex);
 
@@ -0,0 +1,796 @@
+/*
+ * RAM Oops/Panic logger
+ *
+ * A pstore backend for a region of RAM that survives a warm reset. The
+ * region is split into zones:
+ *
+ *   - record_size slots holding the last oops/panic dumps, compressed
+ *     when the compressed text fits, so a slot keeps several times its
+ *     size of kernel log;
+ *   - a ring mirroring the console, shown as console-ramoops (and as
+ *     /proc/last_kmsg when the Android RAM console is not built);
+ *   - a ring of function trace and event records per CPU, see
+ *     fs/pstore/ftrace.c.
+ *
+ * Every zone can carry Reed-Solomon parity so that bit flips in
+ * self-refreshed memory are corrected when the data is read back.
+ *
+ * The region comes from a "ramoops" platform device, from the
+ * mem_address/mem_size parameters, or from the "ram_console" device the
+ * boards already reserve memory for.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/err.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+#include <linux/time.h>
+#include <linux/smp.h>
+#include <linux/cpumask.h>
+#include <linux/proc_fs.h>
+#include <linux/uaccess.h>
+#include <linux/platform_device.h>
+#include <linux/pstore.h>
+#include <linux/pstore_ram.h>
+#include <linux/zlib.h>
+#include <linux/lzo.h>
+
+#include "internal.h"
+
+#define RAMOOPS_KERNMSG_HDR	"===="
+#define MIN_MEM_SIZE		4096UL
+#define MIN_FTRACE_SIZE		1024UL
+
+static ulong record_size = MIN_MEM_SIZE;
+module_param(record_size, ulong, 0400);
+MODULE_PARM_DESC(record_size,
+		"size of each dump done on oops/panic");
+
+static ulong console_size;
+module_param(console_size, ulong, 0400);
+MODULE_PARM_DESC(console_size,
+		"size of the console log, 0 for half of the region");
+
+static ulong ftrace_size;
+module_param(ftrace_size, ulong, 0400);
+MODULE_PARM_DESC(ftrace_size,
+		"size of the function trace log, 0 for a quarter of the region");
+
+static ulong mem_address;
+module_param(mem_address, ulong, 0400);
+MODULE_PARM_DESC(mem_address,
+		"start of reserved RAM used to store oops/panic logs");
+
+static ulong mem_size;
+module_param(mem_size, ulong, 0400);
+MODULE_PARM_DESC(mem_size,
+		"size of reserved RAM used to store oops/panic logs");
+
+static int ramoops_ecc;
+module_param_named(ecc, ramoops_ecc, int, 0400);
+MODULE_PARM_DESC(ramoops_ecc,
+		"number of ECC parity bytes per 128 data bytes, 0 to disable");
+
+struct ramoops_context {
+	struct persistent_ram_zone **przs;
+	struct persistent_ram_zone *cprz;
+	struct persistent_ram_zone **fprzs;
+	phys_addr_t phys_addr;
+	unsigned long size;
+	size_t record_size;
+	size_t console_size;
+	size_t ftrace_size;
+	int ecc_size;
+	unsigned int max_dump_cnt;
+	unsigned int max_ftrace_cnt;
+	/* ids below max_dump_cnt are the records found at boot */
+	u64 dump_write_cnt;
+	unsigned int dump_read_cnt;
+	unsigned int console_read_cnt;
+	unsigned int ftrace_read_cnt;
+	char *cmpr_buf;
+	size_t cmpr_size;
+	struct pstore_info pstore;
+};
+
+static struct ramoops_context oops_cxt = {
+	.pstore = {
+		.owner	= THIS_MODULE,
+		.name	= "ramoops",
+	},
+};
+
+/*
+ * Dumps are compressed into cmpr_buf before being stored. The text
+ * buffer handed to pstore is COMPRESS_RATIO times the record size, which
+ * is about what kernel logs shrink by.
+ */
+#if defined(CONFIG_PSTORE_RAM_DEFLATE)
+
+#define COMPRESS_RATIO		3
+#define COMPRESS_LEVEL		6
+#define COMPRESS_WBITS		12
+#define COMPRESS_MEMLEVEL	4
+
+static struct z_stream_s ramoops_zstream;
+
+static size_t ramoops_compress_bound(size_t size)
+{
+	return size;
+}
+
+static int ramoops_compress_init(void)
+{
+	ramoops_zstream.workspace =
+		vmalloc(zlib_deflate_workspacesize(COMPRESS_WBITS,
+						   COMPRESS_MEMLEVEL));
+	return ramoops_zstream.workspace ? 0 : -ENOMEM;
+}
+
+static int ramoops_compress(const void *in, size_t inlen, void *out,
+			    size_t outlen)
+{
+	struct z_stream_s *stream = &ramoops_zstream;
+
+	if (zlib_deflateInit2(stream, COMPRESS_LEVEL, Z_DEFLATED,
+			      COMPRESS_WBITS, COMPRESS_MEMLEVEL,
+			      Z_DEFAULT_STRATEGY) != Z_OK)
+		return -EIO;
+
+	stream->next_in = in;
+	stream->avail_in = inlen;
+	stream->total_in = 0;
+	stream->next_out = out;
+	stream->avail_out = outlen;
+	stream->total_out = 0;
+
+	if (zlib_deflate(stream, Z_FINISH) != Z_STREAM_END) {
+		zlib_deflateEnd(stream);
+		return -EIO;
+	}
+	if (zlib_deflateEnd(stream) != Z_OK)
+		return -EIO;
+
+	return stream->total_out;
+}
+
+static int ramoops_decompress(const void *in, size_t inlen, void *out,
+			      size_t outlen)
+{
+	struct z_stream_s stream;
+	int ret = -EIO;
+
+	stream.workspace = vmalloc(zlib_inflate_workspacesize());
+	if (!stream.workspace)
+		return -ENOMEM;
+
+	if (zlib_inflateInit2(&stream, COMPRESS_WBITS) != Z_OK)
+		goto out;
+
+	stream.next_in = in;
+	stream.avail_in = inlen;
+	stream.total_in = 0;
+	stream.next_out = out;
+	stream.avail_out = outlen;
+	stream.total_out = 0;
+
+	if (zlib_inflate(&stream, Z_FINISH) == Z_STREAM_END)
+		ret = stream.total_out;
+	zlib_inflateEnd(&stream);
+out:
+	vfree(stream.workspace);
+	return ret;
+}
+
+#elif defined(CONFIG_PSTORE_RAM_LZO)
+
+#define COMPRESS_RATIO		2
+
+static void *ramoops_lzo_wrkmem;
+
+/* lzo1x_1_compress() does not bound its output */
+static size_t ramoops_compress_bound(size_t size)
+{
+	return lzo1x_worst_compress(size);
+}
+
+static int ramoops_compress_init(void)
+{
+	ramoops_lzo_wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+	return ramoops_lzo_wrkmem ? 0 : -ENOMEM;
+}
+
+static int ramoops_compress(const void *in, size_t inlen, void *out,
+			    size_t outlen)
+{
+	size_t len = outlen;
+
+	if (lzo1x_1_compress(in, inlen, out, &len,
+			     ramoops_lzo_wrkmem) != LZO_E_OK)
+		return -EIO;
+	return len;
+}
+
+static int ramoops_decompress(const void *in, size_t inlen, void *out,
+			      size_t outlen)
+{
+	size_t len = outlen;
+
+	if (lzo1x_decompress_safe(in, inlen, out, &len) != LZO_E_OK)
+		return -EIO;
+	return len;
+}
+
+#else
+
+#define COMPRESS_RATIO		1
+
+static size_t ramoops_compress_bound(size_t size)
+{
+	return 0;
+}
+
+static int ramoops_compress_init(void)
+{
+	return 0;
+}
+
+static int ramoops_compress(const void *in, size_t inlen, void *out,
+			    size_t outlen)
+{
+	return -EINVAL;
+}
+
+static int ramoops_decompress(const void *in, size_t inlen, void *out,
+			      size_t outlen)
+{
+	return -EINVAL;
+}
+
+#endif
+
+static int ramoops_pstore_open(struct pstore_info *psi)
+{
+	struct ramoops_context *cxt = &oops_cxt;
+
+	cxt->dump_read_cnt = 0;
+	cxt->console_read_cnt = 0;
+	cxt->ftrace_read_cnt = 0;
+	return 0;
+}
+
+static int ramoops_pstore_close(struct pstore_info *psi)
+{
+	return 0;
+}
+
+/* room for the ECC summary appended to console and dump records */
+#define ECC_STRING_SIZE		80
+
+static ssize_t ramoops_read_dump(struct ramoops_context *cxt,
+				 struct persistent_ram_zone *prz,
+				 struct timespec *time, char **buf)
+{
+	char *old = persistent_ram_old(prz);
+	size_t size = persistent_ram_old_size(prz);
+	unsigned long sec, usec;
+	char mode = 'D';
+	int hlen = 0;
+	int len = -EINVAL;
+
+	if (sscanf(old, RAMOOPS_KERNMSG_HDR "%lu.%lu-%c\n%n",
+		   &sec, &usec, &mode, &hlen) == 3 && hlen) {
+		time->tv_sec = sec;
+		time->tv_nsec = usec * NSEC_PER_USEC;
+	} else {
+		time->tv_sec = 0;
+		time->tv_nsec = 0;
+		hlen = 0;
+	}
+	old += hlen;
+	size -= hlen;
+
+	*buf = kmalloc(max(size, cxt->pstore.bufsize) + ECC_STRING_SIZE,
+		       GFP_KERNEL);
+	if (!*buf)
+		return -ENOMEM;
+
+	if (mode == 'C') {
+		len = ramoops_decompress(old, size, *buf, cxt->pstore.bufsize);
+		if (len < 0)
+			pr_err("ramoops: failed to decompress record: %d\n",
+			       len);
+	}
+	/* plain text, or handed back as is if it cannot be decompressed */
+	if (len < 0) {
+		memcpy(*buf, old, size);
+		len = size;
+	}
+
+	return len + persistent_ram_ecc_string(prz, *buf + len,
+					       ECC_STRING_SIZE);
+}
+
+static ssize_t ramoops_read_ring(struct persistent_ram_zone *prz, char **buf,
+				 bool ecc_string)
+{
+	size_t size = persistent_ram_old_size(prz);
+
+	*buf = kmalloc(size + ECC_STRING_SIZE, GFP_KERNEL);
+	if (!*buf)
+		return -ENOMEM;
+
+	memcpy(*buf, persistent_ram_old(prz), size);
+	if (ecc_string)
+		size += persistent_ram_ecc_string(prz, *buf + size,
+						  ECC_STRING_SIZE);
+	return size;
+}
+
+static ssize_t ramoops_pstore_read(u64 *id, enum pstore_type_id *type,
+				   struct timespec *time, char **buf)
+{
+	struct ramoops_context *cxt = &oops_cxt;
+	struct persistent_ram_zone *prz;
+
+	while (cxt->dump_read_cnt < cxt->max_dump_cnt) {
+		prz = cxt->przs[cxt->dump_read_cnt];
+		*id = cxt->dump_read_cnt++;
+		*type = PSTORE_TYPE_DMESG;
+		if (persistent_ram_old_size(prz))
+			return ramoops_read_dump(cxt, prz, time, buf);
+	}
+
+	time->tv_sec = 0;
+	time->tv_nsec = 0;
+	*id = 0;
+
+	prz = cxt->cprz;
+	if (!cxt->console_read_cnt++ && prz && persistent_ram_old_size(prz)) {
+		*type = PSTORE_TYPE_CONSOLE;
+		return ramoops_read_ring(prz, buf, true);
+	}
+
+	/* an ECC summary would break the record stream */
+	while (cxt->ftrace_read_cnt < cxt->max_ftrace_cnt) {
+		prz = cxt->fprzs[cxt->ftrace_read_cnt];
+		*id = cxt->ftrace_read_cnt++;
+		*type = PSTORE_TYPE_FTRACE;
+		if (persistent_ram_old_size(prz))
+			return ramoops_read_ring(prz, buf, false);
+	}
+
+	return 0;
+}
+
+static u64 ramoops_pstore_write(enum pstore_type_id type, size_t size)
+{
+	struct ramoops_context *cxt = &oops_cxt;
+	struct persistent_ram_zone *prz;
+	const char *data = cxt->pstore.buf;
+	char hdr[48];
+	char mode = 'D';
+	size_t room;
+	struct timeval timestamp;
+	int hlen;
+	int len;
+	u32 slot;
+	u64 id;
+
+	if (type != PSTORE_TYPE_DMESG || !cxt->max_dump_cnt)
+		return 0;
+
+	id = cxt->dump_write_cnt++;
+	div_u64_rem(id, cxt->max_dump_cnt, &slot);
+	prz = cxt->przs[slot];
+
+	do_gettimeofday(&timestamp);
+	hlen = snprintf(hdr, sizeof(hdr), RAMOOPS_KERNMSG_HDR "%lu.%lu-%c\n",
+			(unsigned long)timestamp.tv_sec,
+			(unsigned long)timestamp.tv_usec, mode);
+	room = prz->buffer_size - hlen;
+
+	len = ramoops_compress(data, size, cxt->cmpr_buf, cxt->cmpr_size);
+	if (len > 0 && len <= room) {
+		hdr[hlen - 2] = 'C';
+		data = cxt->cmpr_buf;
+		size = len;
+	} else if (size > room) {
+		/* keep the newest text that fits */
+		data += size - room;
+		size = room;
+	}
+
+	persistent_ram_zap(prz);
+	persistent_ram_write(prz, hdr, hlen);
+	persistent_ram_write(prz, data, size);
+
+	return id;
+}
+
+static int notrace ramoops_pstore_write_buf(enum pstore_type_id type,
+					    const char *buf, size_t size)
+{
+	struct ramoops_context *cxt = &oops_cxt;
+
+	if (type == PSTORE_TYPE_CONSOLE && cxt->cprz)
+		return persistent_ram_write(cxt->cprz, buf, size);
+	/* called with interrupts off, see pstore_ftrace_write() */
+	if (type == PSTORE_TYPE_FTRACE && cxt->max_ftrace_cnt)
+		return persistent_ram_write(
+				cxt->fprzs[raw_smp_processor_id()], buf, size);
+	return -EINVAL;
+}
+
+static int ramoops_pstore_erase(enum pstore_type_id type, u64 id)
+{
+	struct ramoops_context *cxt = &oops_cxt;
+	struct persistent_ram_zone *prz;
+	u32 slot;
+
+	mutex_lock(&cxt->pstore.buf_mutex);
+	switch (type) {
+	case PSTORE_TYPE_DMESG:
+		if (!cxt->max_dump_cnt)
+			break;
+		div_u64_rem(id, cxt->max_dump_cnt, &slot);
+		prz = cxt->przs[slot];
+		if (id < cxt->max_dump_cnt)
+			persistent_ram_free_old(prz);
+		else if (id + cxt->max_dump_cnt >= cxt->dump_write_cnt)
+			persistent_ram_zap(prz);
+		break;
+	case PSTORE_TYPE_CONSOLE:
+		if (cxt->cprz)
+			persistent_ram_free_old(cxt->cprz);
+		break;
+	case PSTORE_TYPE_FTRACE:
+		if (id < cxt->max_ftrace_cnt)
+			persistent_ram_free_old(cxt->fprzs[id]);
+		break;
+	default:
+		break;
+	}
+	mutex_unlock(&cxt->pstore.buf_mutex);
+
+	return 0;
+}
+
+#ifndef CONFIG_ANDROID_RAM_CONSOLE
+/* Android userspace collects the previous boot's console from here */
+static ssize_t ramoops_last_kmsg_read(struct file *file, char __user *buf,
+				      size_t len, loff_t *offset)
+{
+	struct ramoops_context *cxt = &oops_cxt;
+	struct persistent_ram_zone *prz = cxt->cprz;
+	ssize_t count;
+
+	mutex_lock(&cxt->pstore.buf_mutex);
+	count = simple_read_from_buffer(buf, len, offset,
+					persistent_ram_old(prz),
+					persistent_ram_old_size(prz));
+	mutex_unlock(&cxt->pstore.buf_mutex);
+
+	return count;
+}
+
+static const struct file_operations ramoops_last_kmsg_fops = {
+	.owner	= THIS_MODULE,
+	.read	= ramoops_last_kmsg_read,
+	.llseek	= default_llseek,
+};
+
+static void ramoops_create_last_kmsg(struct ramoops_context *cxt)
+{
+	struct proc_dir_entry *entry;
+
+	if (!cxt->cprz || !persistent_ram_old_size(cxt->cprz))
+		return;
+
+	entry = proc_create("last_kmsg", S_IFREG | S_IRUGO, NULL,
+			    &ramoops_last_kmsg_fops);
+	if (!entry) {
+		pr_err("ramoops: failed to create proc entry\n");
+		return;
+	}
+	entry->size = persistent_ram_old_size(cxt->cprz);
+}
+#else
+static inline void ramoops_create_last_kmsg(struct ramoops_context *cxt) {}
+#endif
+
+static struct persistent_ram_zone *
+ramoops_init_zone(struct ramoops_context *cxt, phys_addr_t *paddr,
+		  size_t size, enum pstore_type_id type, int ecc_size,
+		  unsigned int flags)
+{
+	struct persistent_ram_zone *prz;
+
+	prz = persistent_ram_new(*paddr, size, type, ecc_size, flags);
+	if (IS_ERR(prz)) {
+		pr_err("ramoops: failed to initialize a %zu bytes zone at "
+		       "0x%llx: %ld\n", size, (unsigned long long)*paddr,
+		       PTR_ERR(prz));
+		return NULL;
+	}
+	*paddr += size;
+
+	if (prz->corrected_bytes || prz->bad_blocks)
+		pr_info("ramoops: zone at 0x%llx: %d corrected bytes, "
+			"%d unrecoverable blocks\n",
+			(unsigned long long)prz->paddr,
+			prz->corrected_bytes, prz->bad_blocks);
+	return prz;
+}
+
+static void ramoops_free_zones(struct ramoops_context *cxt)
+{
+	int i;
+
+	if (cxt->fprzs)
+		for (i = 0; i < cxt->max_ftrace_cnt; i++)
+			persistent_ram_free(cxt->fprzs[i]);
+	kfree(cxt->fprzs);
+	cxt->fprzs = NULL;
+	cxt->max_ftrace_cnt = 0;
+	persistent_ram_free(cxt->cprz);
+	cxt->cprz = NULL;
+	if (cxt->przs)
+		for (i = 0; i < cxt->max_dump_cnt; i++)
+			persistent_ram_free(cxt->przs[i]);
+	kfree(cxt->przs);
+	cxt->przs = NULL;
+	cxt->max_dump_cnt = 0;
+}
+
+static int ramoops_init_zones(struct ramoops_context *cxt)
+{
+	phys_addr_t paddr = cxt->phys_addr;
+	unsigned long dump_size;
+	size_t ftrace_cpu_size;
+	int i;
+
+	dump_size = cxt->size - cxt->console_size - cxt->ftrace_size;
+	cxt->max_dump_cnt = dump_size / cxt->record_size;
+	if (cxt->max_dump_cnt) {
+		cxt->przs = kcalloc(cxt->max_dump_cnt, sizeof(*cxt->przs),
+				    GFP_KERNEL);
+		if (!cxt->przs)
+			goto fail;
+	}
+
+	for (i = 0; i < cxt->max_dump_cnt; i++) {
+		cxt->przs[i] = ramoops_init_zone(cxt, &paddr,
+						 cxt->record_size,
+						 PSTORE_TYPE_DMESG,
+						 cxt->ecc_size, 0);
+		if (!cxt->przs[i])
+			goto fail;
+	}
+	/* the dump slots may not fill their part of the region */
+	paddr = cxt->phys_addr + dump_size;
+
+	if (cxt->console_size) {
+		cxt->cprz = ramoops_init_zone(cxt, &paddr, cxt->console_size,
+					      PSTORE_TYPE_CONSOLE,
+					      cxt->ecc_size, 0);
+		if (!cxt->cprz)
+			goto fail;
+	}
+
+	/*
+	 * One function trace ring per CPU: writers neither share a lock
+	 * nor evict each other's records, and parity is not updated on
+	 * every call.
+	 */
+	ftrace_cpu_size = cxt->ftrace_size / nr_cpu_ids;
+	if (ftrace_cpu_size >= MIN_FTRACE_SIZE) {
+		cxt->fprzs = kcalloc(nr_cpu_ids, sizeof(*cxt->fprzs),
+				     GFP_KERNEL);
+		if (!cxt->fprzs)
+			goto fail;
+		cxt->max_ftrace_cnt = nr_cpu_ids;
+	} else if (cxt->ftrace_size) {
+		pr_info("ramoops: %zu bytes are too few for function traces\n",
+			cxt->ftrace_size);
+	}
+
+	for (i = 0; i < cxt->max_ftrace_cnt; i++) {
+		cxt->fprzs[i] = ramoops_init_zone(cxt, &paddr,
+						  ftrace_cpu_size,
+						  PSTORE_TYPE_FTRACE, 0,
+						  PRZ_FLAG_NO_LOCK);
+		if (!cxt->fprzs[i])
+			goto fail;
+	}
+
+	return 0;
+fail:
+	ramoops_free_zones(cxt);
+	return -ENOMEM;
+}
+
+/* Board reservations made for ram_console carry no layout */
+static void ramoops_default_layout(struct ramoops_platform_data *pdata,
+				   unsigned long start, unsigned long size)
+{
+	pdata->mem_address = start;
+	pdata->mem_size = size;
+	pdata->record_size = record_size;
+	pdata->console_size = console_size ? console_size : size / 2;
+	pdata->ftrace_size = ftrace_size ? ftrace_size : size / 4;
+	pdata->ecc_size = ramoops_ecc;
+}
+
+static int __devinit ramoops_probe(struct platform_device *pdev)
+{
+	struct ramoops_platform_data *pdata = pdev->dev.platform_data;
+	struct ramoops_platform_data layout;
+	struct ramoops_context *cxt = &oops_cxt;
+	struct resource *res;
+	int err = -EINVAL;
+
+	/* Only a single ramoops region is supported */
+	if (cxt->size)
+		return -EEXIST;
+
+	if (!pdata) {
+		res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+		if (!res || !res->start) {
+			pr_err("ramoops: no memory region\n");
+			return -ENXIO;
+		}
+		ramoops_default_layout(&layout, res->start,
+				       resource_size(res));
+		pdata = &layout;
+	}
+
+	if (pdata->mem_size < MIN_MEM_SIZE ||
+	    pdata->record_size < MIN_MEM_SIZE ||
+	    pdata->console_size + pdata->ftrace_size > pdata->mem_size) {
+		pr_err("ramoops: invalid layout, %lu bytes with %lu bytes "
+		       "records, %lu bytes console and %lu bytes ftrace\n",
+		       pdata->mem_size, pdata->record_size,
+		       pdata->console_size, pdata->ftrace_size);
+		return -EINVAL;
+	}
+
+	cxt->phys_addr = pdata->mem_address;
+	cxt->size = pdata->mem_size;
+	cxt->record_size = pdata->record_size;
+	cxt->console_size = pdata->console_size;
+	cxt->ftrace_size = pdata->ftrace_size;
+	cxt->ecc_size = pdata->ecc_size;
+	cxt->dump_write_cnt = 0;
+
+	err = ramoops_init_zones(cxt);
+	if (err)
+		goto fail_zones;
+	cxt->dump_write_cnt = cxt->max_dump_cnt;
+
+	cxt->pstore.flags = PSTORE_FLAGS_CRASH_ONLY;
+	if (cxt->cprz)
+		cxt->pstore.flags |= PSTORE_FLAGS_CONSOLE;
+	if (cxt->max_ftrace_cnt)
+		cxt->pstore.flags |= PSTORE_FLAGS_FTRACE;
+	cxt->pstore.open = ramoops_pstore_open;
+	cxt->pstore.close = ramoops_pstore_close;
+	cxt->pstore.read = ramoops_pstore_read;
+	cxt->pstore.write = ramoops_pstore_write;
+	cxt->pstore.write_buf = ramoops_pstore_write_buf;
+	cxt->pstore.erase = ramoops_pstore_erase;
+	mutex_init(&cxt->pstore.buf_mutex);
+
+	if (cxt->max_dump_cnt) {
+		size_t room = cxt->przs[0]->buffer_size;
+
+		err = ramoops_compress_init();
+		if (err)
+			goto fail_buf;
+
+		cxt->pstore.bufsize = room * COMPRESS_RATIO;
+		cxt->cmpr_size = ramoops_compress_bound(cxt->pstore.bufsize);
+		if (cxt->cmpr_size) {
+			cxt->cmpr_buf = vmalloc(cxt->cmpr_size);
+			if (!cxt->cmpr_buf) {
+				err = -ENOMEM;
+				goto fail_buf;
+			}
+		}
+	} else {
+		/* console and ftrace only, dumps are rejected */
+		cxt->pstore.bufsize = 1024;
+	}
+	cxt->pstore.buf = vmalloc(cxt->pstore.bufsize);
+	if (!cxt->pstore.buf) {
+		err = -ENOMEM;
+		goto fail_buf;
+	}
+
+	err = pstore_register(&cxt->pstore);
+	if (err) {
+		pr_err("ramoops: registering with pstore failed\n");
+		goto fail_buf;
+	}
+	/*
+	 * pstore_dump() writes parts until kmsg_bytes of the log are saved.
+	 * Leave room for the part header so that one dump is one record.
+	 */
+	pstore_set_kmsg_bytes(cxt->pstore.bufsize - PSTORE_DUMP_HDR_MAX);
+
+	ramoops_create_last_kmsg(cxt);
+
+	pr_info("ramoops: attached 0x%lx@0x%llx: %u dumps of %zu bytes, "
+		"%zu bytes console, %zu bytes ftrace on %u cpus, ecc %d\n",
+		cxt->size, (unsigned long long)cxt->phys_addr,
+		cxt->max_dump_cnt, cxt->record_size, cxt->console_size,
+		cxt->ftrace_size, cxt->max_ftrace_cnt, cxt->ecc_size);
+
+	return 0;
+
+fail_buf:
+	vfree(cxt->pstore.buf);
+	cxt->pstore.buf = NULL;
+	vfree(cxt->cmpr_buf);
+	cxt->cmpr_buf = NULL;
+	ramoops_free_zones(cxt);
+fail_zones:
+	cxt->size = 0;
+	return err;
+}
+
+static const struct platform_device_id ramoops_id_table[] = {
+	{ "ramoops", 0 },
+#ifndef CONFIG_ANDROID_RAM_CONSOLE
+	/* take over the board's ram_console reservation */
+	{ "ram_console", 0 },
+#endif
+	{ }
+};
+
+static struct platform_driver ramoops_driver = {
+	.probe		= ramoops_probe,
+	.id_table	= ramoops_id_table,
+	.driver		= {
+		.name	= "ramoops",
+		.owner	= THIS_MODULE,
+	},
+};
+
+static struct ramoops_platform_data ramoops_param_data;
+
+static struct platform_device ramoops_param_device = {
+	.name	= "ramoops",
+	.id	= -1,
+	.dev	= {
+		.platform_data	= &ramoops_param_data,
+	},
+};
+
+static int __init ramoops_init(void)
+{
+	if (mem_address && mem_size) {
+		ramoops_default_layout(&ramoops_param_data,
+				       mem_address, mem_size);
+		if (platform_device_register(&ramoops_param_device))
+			pr_err("ramoops: could not create platform device\n");
+	}
+
+	return platform_driver_register(&ramoops_driver);
+}
+postcore_initcall(ramoops_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("RAM Oops/Panic logger/driver");
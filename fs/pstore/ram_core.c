@@ -0,0 +1,437 @@
+/*
+ * Persistent RAM zones, based on drivers/staging/android/ram_console.c
+ *
+ * Copyright (C) 2007-2008 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/err.h>
+#include <linux/errno.h>
+#include <linux/io.h>
+#include <linux/ioport.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/rslib.h>
+#include <linux/pstore_ram.h>
+#include <asm/page.h>
+
+struct persistent_ram_buffer {
+	uint32_t    sig;
+	uint32_t    start;
+	uint32_t    size;
+	uint8_t     data[0];
+};
+
+#define PERSISTENT_RAM_SIG	(0x43474244) /* DBGC */
+
+#define ECC_BLOCK_SIZE		128
+#define ECC_SYMSIZE		8
+#define ECC_POLY		0x11d
+#define ECC_MAX_SIZE		32
+
+/* advance the write position by a, returning the old one */
+static size_t notrace buffer_start_add(struct persistent_ram_zone *prz,
+				       size_t a)
+{
+	struct persistent_ram_buffer *buffer = prz->buffer;
+	unsigned long flags = 0;
+	size_t old, new;
+
+	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
+		raw_spin_lock_irqsave(&prz->buffer_lock, flags);
+	old = buffer->start;
+	new = old + a;
+	while (unlikely(new >= prz->buffer_size))
+		new -= prz->buffer_size;
+	buffer->start = new;
+	if (buffer->size < prz->buffer_size)
+		buffer->size = min_t(size_t, buffer->size + a,
+				     prz->buffer_size);
+	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
+		raw_spin_unlock_irqrestore(&prz->buffer_lock, flags);
+
+	return old;
+}
+
+static void notrace persistent_ram_encode_rs8(struct persistent_ram_zone *prz,
+					      uint8_t *data, size_t len,
+					      uint8_t *ecc)
+{
+	uint16_t par[ECC_MAX_SIZE];
+	int i;
+
+	memset(par, 0, sizeof(par));
+	encode_rs8(prz->rs_decoder, data, len, par, 0);
+	for (i = 0; i < prz->ecc_size; i++)
+		ecc[i] = par[i];
+}
+
+static int persistent_ram_decode_rs8(struct persistent_ram_zone *prz,
+				     void *data, size_t len, uint8_t *ecc)
+{
+	uint16_t par[ECC_MAX_SIZE];
+	int i;
+
+	for (i = 0; i < prz->ecc_size; i++)
+		par[i] = ecc[i];
+	return decode_rs8(prz->rs_decoder, data, par, len,
+			  NULL, 0, NULL, 0, NULL);
+}
+
+static void notrace persistent_ram_update_ecc(struct persistent_ram_zone *prz,
+					      size_t start, size_t count)
+{
+	struct persistent_ram_buffer *buffer = prz->buffer;
+	uint8_t *buffer_end = buffer->data + prz->buffer_size;
+	uint8_t *block;
+	uint8_t *par;
+	int size = ECC_BLOCK_SIZE;
+
+	if (!prz->ecc_size)
+		return;
+
+	block = buffer->data + (start & ~(ECC_BLOCK_SIZE - 1));
+	par = prz->par_buffer + (start / ECC_BLOCK_SIZE) * prz->ecc_size;
+	do {
+		if (block + ECC_BLOCK_SIZE > buffer_end)
+			size = buffer_end - block;
+		persistent_ram_encode_rs8(prz, block, size, par);
+		block += ECC_BLOCK_SIZE;
+		par += prz->ecc_size;
+	} while (block < buffer->data + start + count);
+}
+
+static void notrace persistent_ram_update_header_ecc(
+					struct persistent_ram_zone *prz)
+{
+	if (!prz->ecc_size)
+		return;
+
+	persistent_ram_encode_rs8(prz, (uint8_t *)prz->buffer,
+				  sizeof(*prz->buffer), prz->par_header);
+}
+
+static void notrace persistent_ram_update(struct persistent_ram_zone *prz,
+					  const void *s, size_t start,
+					  size_t count)
+{
+	memcpy(prz->buffer->data + start, s, count);
+	persistent_ram_update_ecc(prz, start, count);
+}
+
+static void persistent_ram_ecc_old(struct persistent_ram_zone *prz)
+{
+	struct persistent_ram_buffer *buffer = prz->buffer;
+	uint8_t *block;
+	uint8_t *par;
+
+	if (!prz->ecc_size)
+		return;
+
+	block = buffer->data;
+	par = prz->par_buffer;
+	while (block < buffer->data + buffer->size) {
+		int numerr;
+		int size = ECC_BLOCK_SIZE;
+
+		if (block + size > buffer->data + prz->buffer_size)
+			size = buffer->data + prz->buffer_size - block;
+		numerr = persistent_ram_decode_rs8(prz, block, size, par);
+		if (numerr > 0)
+			prz->corrected_bytes += numerr;
+		else if (numerr < 0)
+			prz->bad_blocks++;
+		block += ECC_BLOCK_SIZE;
+		par += prz->ecc_size;
+	}
+}
+
+static int persistent_ram_init_ecc(struct persistent_ram_zone *prz,
+				   int ecc_size)
+{
+	struct persistent_ram_buffer *buffer = prz->buffer;
+	size_t ecc_total;
+	int ecc_blocks;
+	int numerr;
+
+	if (!ecc_size)
+		return 0;
+
+	if (ecc_size < 0 || ecc_size > ECC_MAX_SIZE) {
+		pr_err("persistent_ram: invalid ecc size %d\n", ecc_size);
+		return -EINVAL;
+	}
+
+	ecc_blocks = DIV_ROUND_UP(prz->buffer_size, ECC_BLOCK_SIZE);
+	ecc_total = (ecc_blocks + 1) * ecc_size;
+	if (ecc_total >= prz->buffer_size) {
+		pr_err("persistent_ram: buffer of %zu bytes too small for "
+		       "ecc\n", prz->buffer_size);
+		return -EINVAL;
+	}
+
+	prz->ecc_size = ecc_size;
+	prz->buffer_size -= ecc_total;
+	prz->par_buffer = buffer->data + prz->buffer_size;
+	prz->par_header = prz->par_buffer + ecc_blocks * ecc_size;
+
+	/*
+	 * first consecutive root is 0
+	 * primitive element to generate roots = 1
+	 */
+	prz->rs_decoder = init_rs(ECC_SYMSIZE, ECC_POLY, 0, 1, ecc_size);
+	if (prz->rs_decoder == NULL) {
+		pr_err("persistent_ram: init_rs failed\n");
+		return -ENOMEM;
+	}
+
+	numerr = persistent_ram_decode_rs8(prz, buffer, sizeof(*buffer),
+					   prz->par_header);
+	if (numerr > 0) {
+		pr_info("persistent_ram: error in header, %d\n", numerr);
+		prz->corrected_bytes += numerr;
+	} else if (numerr < 0) {
+		pr_info("persistent_ram: uncorrectable error in header\n");
+		prz->bad_blocks++;
+	}
+
+	return 0;
+}
+
+ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
+				  char *str, size_t len)
+{
+	ssize_t ret;
+
+	if (!prz->ecc_size)
+		return 0;
+
+	if (prz->corrected_bytes || prz->bad_blocks)
+		ret = snprintf(str, len,
+			"\n%d Corrected bytes, %d unrecoverable blocks\n",
+			prz->corrected_bytes, prz->bad_blocks);
+	else
+		ret = snprintf(str, len, "\nNo errors detected\n");
+
+	return min_t(ssize_t, ret, len ? len - 1 : 0);
+}
+
+static void persistent_ram_save_old(struct persistent_ram_zone *prz)
+{
+	struct persistent_ram_buffer *buffer = prz->buffer;
+	size_t size = buffer->size;
+	size_t start = buffer->start;
+
+	persistent_ram_ecc_old(prz);
+
+	/* NUL terminated so that records can be parsed as strings */
+	prz->old_log = kmalloc(size + 1, GFP_KERNEL);
+	if (!prz->old_log) {
+		pr_err("persistent_ram: failed to allocate buffer\n");
+		return;
+	}
+
+	prz->old_log_size = size;
+	memcpy(prz->old_log, &buffer->data[start], size - start);
+	memcpy(prz->old_log + size - start, &buffer->data[0], start);
+	prz->old_log[size] = '\0';
+}
+
+int notrace persistent_ram_write(struct persistent_ram_zone *prz,
+				 const void *s, unsigned int count)
+{
+	size_t c = count;
+	size_t start;
+	size_t rem;
+
+	if (unlikely(c > prz->buffer_size)) {
+		s += c - prz->buffer_size;
+		c = prz->buffer_size;
+	}
+
+	start = buffer_start_add(prz, c);
+
+	rem = prz->buffer_size - start;
+	if (unlikely(rem < c)) {
+		persistent_ram_update(prz, s, start, rem);
+		s += rem;
+		c -= rem;
+		start = 0;
+	}
+	persistent_ram_update(prz, s, start, c);
+
+	persistent_ram_update_header_ecc(prz);
+
+	return count;
+}
+
+size_t persistent_ram_old_size(struct persistent_ram_zone *prz)
+{
+	return prz->old_log_size;
+}
+
+void *persistent_ram_old(struct persistent_ram_zone *prz)
+{
+	return prz->old_log;
+}
+
+void persistent_ram_free_old(struct persistent_ram_zone *prz)
+{
+	kfree(prz->old_log);
+	prz->old_log = NULL;
+	prz->old_log_size = 0;
+}
+
+void persistent_ram_zap(struct persistent_ram_zone *prz)
+{
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&prz->buffer_lock, flags);
+	prz->buffer->start = 0;
+	prz->buffer->size = 0;
+	persistent_ram_update_header_ecc(prz);
+	raw_spin_unlock_irqrestore(&prz->buffer_lock, flags);
+}
+
+/*
+ * Map write-combined so that stores reach memory without waiting for a
+ * cache flush that a watchdog reset would never do.
+ */
+static void *persistent_ram_vmap(phys_addr_t start, size_t size)
+{
+	struct page **pages;
+	phys_addr_t page_start;
+	unsigned int page_count;
+	unsigned int i;
+	void *vaddr;
+
+	page_start = start - offset_in_page(start);
+	page_count = DIV_ROUND_UP(size + offset_in_page(start), PAGE_SIZE);
+
+	pages = kmalloc(sizeof(struct page *) * page_count, GFP_KERNEL);
+	if (!pages)
+		return NULL;
+
+	for (i = 0; i < page_count; i++)
+		pages[i] = pfn_to_page((page_start >> PAGE_SHIFT) + i);
+	vaddr = vmap(pages, page_count, VM_MAP,
+		     pgprot_writecombine(PAGE_KERNEL));
+	kfree(pages);
+
+	return vaddr;
+}
+
+static void *persistent_ram_iomap(phys_addr_t start, size_t size)
+{
+	if (!request_mem_region(start, size, "persistent_ram")) {
+		pr_err("persistent_ram: request mem region (0x%llx@0x%llx) "
+		       "failed\n", (unsigned long long)size,
+		       (unsigned long long)start);
+		return NULL;
+	}
+
+	return ioremap_wc(start, size);
+}
+
+static int persistent_ram_buffer_map(phys_addr_t start, phys_addr_t size,
+				     struct persistent_ram_zone *prz)
+{
+	prz->paddr = start;
+	prz->size = size;
+
+	if (pfn_valid(start >> PAGE_SHIFT))
+		prz->vaddr = persistent_ram_vmap(start, size);
+	else
+		prz->vaddr = persistent_ram_iomap(start, size);
+
+	if (!prz->vaddr) {
+		pr_err("persistent_ram: failed to map 0x%llx bytes at "
+		       "0x%llx\n", (unsigned long long)size,
+		       (unsigned long long)start);
+		return -ENOMEM;
+	}
+
+	prz->buffer = prz->vaddr + offset_in_page(start);
+	prz->buffer_size = size - sizeof(struct persistent_ram_buffer);
+
+	return 0;
+}
+
+void persistent_ram_free(struct persistent_ram_zone *prz)
+{
+	if (IS_ERR_OR_NULL(prz))
+		return;
+
+	if (prz->vaddr) {
+		if (pfn_valid(prz->paddr >> PAGE_SHIFT)) {
+			vunmap(prz->vaddr);
+		} else {
+			iounmap(prz->vaddr);
+			release_mem_region(prz->paddr, prz->size);
+		}
+	}
+	if (prz->rs_decoder)
+		free_rs(prz->rs_decoder);
+	persistent_ram_free_old(prz);
+	kfree(prz);
+}
+
+struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
+					       u32 sig, int ecc_size,
+					       unsigned int flags)
+{
+	struct persistent_ram_buffer *buffer;
+	struct persistent_ram_zone *prz;
+	int ret = -ENOMEM;
+
+	if (size <= sizeof(struct persistent_ram_buffer))
+		return ERR_PTR(-EINVAL);
+
+	prz = kzalloc(sizeof(struct persistent_ram_zone), GFP_KERNEL);
+	if (!prz) {
+		pr_err("persistent_ram: failed to allocate zone\n");
+		return ERR_PTR(-ENOMEM);
+	}
+	raw_spin_lock_init(&prz->buffer_lock);
+	prz->flags = flags;
+
+	ret = persistent_ram_buffer_map(start, size, prz);
+	if (ret)
+		goto err;
+
+	ret = persistent_ram_init_ecc(prz, ecc_size);
+	if (ret)
+		goto err;
+
+	buffer = prz->buffer;
+	sig ^= PERSISTENT_RAM_SIG;
+	if (buffer->sig == sig) {
+		if (buffer->size > prz->buffer_size ||
+		    buffer->start > buffer->size)
+			pr_info("persistent_ram: found existing invalid "
+				"buffer, size %u, start %u\n",
+				buffer->size, buffer->start);
+		else
+			persistent_ram_save_old(prz);
+	}
+
+	buffer->sig = sig;
+	persistent_ram_zap(prz);
+
+	return prz;
+err:
+	persistent_ram_free(prz);
+	return ERR_PTR(ret);
+}
@@ -622,6 +622,10 @@
 		*(.initcall##level##.init)				\
 		*(.initcall##level##s.init)				\
 
+#define INIT_CALLS_PARALLEL_LEVEL(level)				\
+		VMLINUX_SYMBOL(__initcall##level##p_start) = .;		\
+		*(.initcall##level##p.init)				\
+
 #define INIT_CALLS							\
 		VMLINUX_SYMBOL(__initcall_start) = .;			\
 		*(.initcallearly.init)					\
@@ -634,7 +638,17 @@
 		INIT_CALLS_LEVEL(rootfs)				\
 		INIT_CALLS_LEVEL(6)					\
 		INIT_CALLS_LEVEL(7)					\
-		VMLINUX_SYMBOL(__initcall_end) = .;
+		VMLINUX_SYMBOL(__initcall_end) = .;			\
+		. = ALIGN(8);						\
+		INIT_CALLS_PARALLEL_LEVEL(0)				\
+		INIT_CALLS_PARALLEL_LEVEL(1)				\
+		INIT_CALLS_PARALLEL_LEVEL(2)				\
+		INIT_CALLS_PARALLEL_LEVEL(3)				\
+		INIT_CALLS_PARALLEL_LEVEL(4)				\
+		INIT_CALLS_PARALLEL_LEVEL(5)				\
+		INIT_CALLS_PARALLEL_LEVEL(6)				\
+		INIT_CALLS_PARALLEL_LEVEL(7)				\
+		VMLINUX_SYMBOL(__initcallp_end) = .;
 
 #define CON_INITCALL							\
 		VMLINUX_SYMBOL(__con_initcall_start) = .;		\
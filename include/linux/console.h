@@ -112,6 +112,7 @@ int con_debug_leave(void);
 #define CON_BOOT	(8)
 #define CON_ANYTIME	(16) /* Safe to call when cpu is offline */
 #define CON_BRL		(32) /* Used for a braille device */
+#define CON_MEMORY	(64) /* Writes to memory kept across a reset */
 
 struct console {
 	char	name[16];
@@ -174,6 +174,9 @@ enum  hrtimer_base_type {
  * @nr_retries:		Total number of hrtimer interrupt retries
  * @nr_hangs:		Total number of hrtimer interrupt hangs
  * @max_hang_time:	Maximum time spent in hrtimer_interrupt
+ * @nr_idle_wakeups:	Number of hrtimer interrupts which woke the cpu from idle
+ * @nr_idle_timers:	Number of timers expired by those interrupts
+ * @nr_coalesced:	Number of timers moved onto a coalescing boundary
  * @clock_base:		array of clock bases for this cpu
  */
 struct hrtimer_cpu_base {
@@ -188,6 +191,9 @@ struct hrtimer_cpu_base {
 	unsigned long			nr_retries;
 	unsigned long			nr_hangs;
 	ktime_t				max_hang_time;
+	unsigned long			nr_idle_wakeups;
+	unsigned long			nr_idle_timers;
+	unsigned long			nr_coalesced;
 #endif
 	struct hrtimer_clock_base	clock_base[HRTIMER_MAX_CLOCK_BASES];
 };
@@ -145,8 +145,22 @@ extern initcall_t __security_initcall_start[], __security_initcall_end[];
 /* Used for contructor calls. */
 typedef void (*ctor_fn_t)(void);
 
+/*
+ * An initcall that may run concurrently with the other parallel initcalls
+ * of its level, once those named in @deps have returned.
+ */
+struct parallel_initcall {
+	initcall_t fn;
+	const char *name;
+	const char *const *deps;
+	unsigned int ndeps;
+};
+
 /* Defined in init/main.c */
 extern int do_one_initcall(initcall_t fn);
+
+/* Defined in init/parallel_initcall.c */
+extern void do_parallel_initcalls(int level, const char *name);
 extern char __initdata boot_command_line[];
 extern char *saved_command_line;
 extern unsigned int reset_devices;
@@ -228,6 +242,41 @@ extern bool initcall_debug;
 	static initcall_t __initcall_##fn \
 	__used __section(.security_initcall.init) = fn
 
+/*
+ * Parallel initcalls are run after all sequential initcalls of their
+ * level, on a pool of worker threads. The optional arguments name other
+ * parallel initcalls of the same level that must have returned first:
+ *
+ *	device_initcall_parallel(panel_init, "pmic_regulator_init");
+ *
+ * Dependencies on earlier levels are always satisfied. Only use these for
+ * code that does not rely on the link order of its level.
+ */
+#define __define_parallel_initcall(level, fn, ...)			\
+	static const char *const __pinitcall_deps_##fn[] __initconst =	\
+		{ __VA_ARGS__ };					\
+	static struct parallel_initcall __pinitcall_##fn __used		\
+	__attribute__((__section__(".initcall" level "p.init")))	\
+	__attribute__((aligned((sizeof(long))))) = {			\
+		fn, #fn, __pinitcall_deps_##fn,				\
+		sizeof(__pinitcall_deps_##fn) / sizeof(const char *)	\
+	}
+
+#define core_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall("1", fn, ##__VA_ARGS__)
+#define postcore_initcall_parallel(fn, ...)	\
+	__define_parallel_initcall("2", fn, ##__VA_ARGS__)
+#define arch_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall("3", fn, ##__VA_ARGS__)
+#define subsys_initcall_parallel(fn, ...)	\
+	__define_parallel_initcall("4", fn, ##__VA_ARGS__)
+#define fs_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall("5", fn, ##__VA_ARGS__)
+#define device_initcall_parallel(fn, ...)	\
+	__define_parallel_initcall("6", fn, ##__VA_ARGS__)
+#define late_initcall_parallel(fn, ...)		\
+	__define_parallel_initcall("7", fn, ##__VA_ARGS__)
+
 struct obs_kernel_param {
 	const char *str;
 	int (*setup_func)(char *);
@@ -295,6 +344,14 @@ void __init parse_early_options(char *cmdline);
 #define device_initcall(fn)		module_init(fn)
 #define late_initcall(fn)		module_init(fn)
 
+#define core_initcall_parallel(fn, ...)		module_init(fn)
+#define postcore_initcall_parallel(fn, ...)	module_init(fn)
+#define arch_initcall_parallel(fn, ...)		module_init(fn)
+#define subsys_initcall_parallel(fn, ...)	module_init(fn)
+#define fs_initcall_parallel(fn, ...)		module_init(fn)
+#define device_initcall_parallel(fn, ...)	module_init(fn)
+#define late_initcall_parallel(fn, ...)		module_init(fn)
+
 #define security_initcall(fn)		module_init(fn)
 
 /* Each module must use one module_init(). */
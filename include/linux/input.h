@@ -159,6 +159,9 @@ struct input_keymap_entry {
 
 #define EVIOCSCLOCKID		_IOW('E', 0xa0, int)			/* Set clockid to be used for timestamps */
 
+#define EVIOCGBUFSIZE		_IOR('E', 0xa1, int)			/* get event queue size */
+#define EVIOCSBUFSIZE		_IOW('E', 0xa1, int)			/* set event queue size, rounded up to a power of 2 */
+
 /*
  * Device properties and quirks
  */
@@ -1184,6 +1187,7 @@ struct ff_effect {
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/timer.h>
+#include <linux/ktime.h>
 #include <linux/mod_devicetable.h>
 
 /**
@@ -1276,6 +1280,9 @@ struct input_value {
  * @node: used to place the device onto input_dev_list
  * @devres_managed: indicates that devices is managed with devres framework
  *	and needs not be explicitly unregistered or freed.
+ * @timestamp: CLOCK_MONOTONIC time at which the hardware produced the
+ *	current packet, set with input_set_timestamp(), usually from the
+ *	hard interrupt handler. Cleared at every SYN_REPORT.
  */
 struct input_dev {
 	const char *name;
@@ -1346,6 +1353,8 @@ struct input_dev {
 	struct input_value *vals;
 
 	bool devres_managed;
+
+	ktime_t timestamp;
 };
 #define to_input_dev(d) container_of(d, struct input_dev, dev)
 
@@ -1543,6 +1552,9 @@ int input_flush_device(struct input_handle *handle, struct file *file);
 void input_event(struct input_dev *dev, unsigned int type, unsigned int code, int value);
 void input_inject_event(struct input_handle *handle, unsigned int type, unsigned int code, int value);
 
+void input_set_timestamp(struct input_dev *dev, ktime_t timestamp);
+ktime_t input_get_timestamp(struct input_dev *dev);
+
 static inline void input_report_key(struct input_dev *dev, unsigned int code, int value)
 {
 	input_event(dev, EV_KEY, code, !!value);
@@ -1076,6 +1076,7 @@ struct net_device {
 #define NETIF_F_TSO_ECN		(SKB_GSO_TCP_ECN << NETIF_F_GSO_SHIFT)
 #define NETIF_F_TSO6		(SKB_GSO_TCPV6 << NETIF_F_GSO_SHIFT)
 #define NETIF_F_FSO		(SKB_GSO_FCOE << NETIF_F_GSO_SHIFT)
+#define NETIF_F_GSO_UDP_L4	(SKB_GSO_UDP_L4 << NETIF_F_GSO_SHIFT)
 
 	/* Features valid for ethtool to change */
 	/* = all defined minus driver/device-class-related */
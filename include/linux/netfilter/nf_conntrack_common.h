@@ -83,6 +83,10 @@ enum ip_conntrack_status {
 	/* Conntrack is a fake untracked entry */
 	IPS_UNTRACKED_BIT = 12,
 	IPS_UNTRACKED = (1 << IPS_UNTRACKED_BIT),
+
+	/* Conntrack is forwarded by the flow table fast path */
+	IPS_OFFLOAD_BIT = 13,
+	IPS_OFFLOAD = (1 << IPS_OFFLOAD_BIT),
 };
 
 /* Connection tracking event types */
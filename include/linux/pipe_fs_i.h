@@ -4,6 +4,7 @@
 #define PIPEFS_MAGIC 0x50495045
 
 #define PIPE_DEF_BUFFERS	16
+#define PIPE_TMP_PAGES		4
 
 #define PIPE_BUF_FLAG_LRU	0x01	/* page is on the LRU */
 #define PIPE_BUF_FLAG_ATOMIC	0x02	/* was atomically mapped */
@@ -33,7 +34,8 @@ struct pipe_buffer {
  *	@nrbufs: the number of non-empty pipe buffers in this pipe
  *	@buffers: total number of buffers (should be a power of 2)
  *	@curbuf: the current pipe buffer entry
- *	@tmp_page: cached released page
+ *	@tmp_page: cache of released pages, reused by the next writes
+ *	@nr_tmp_pages: number of pages in @tmp_page
  *	@readers: number of current readers of this pipe
  *	@writers: number of current writers of this pipe
  *	@waiting_writers: number of writers blocked waiting for room
@@ -52,7 +54,8 @@ struct pipe_inode_info {
 	unsigned int waiting_writers;
 	unsigned int r_counter;
 	unsigned int w_counter;
-	struct page *tmp_page;
+	unsigned int nr_tmp_pages;
+	struct page *tmp_page[PIPE_TMP_PAGES];
 	struct fasync_struct *fasync_readers;
 	struct fasync_struct *fasync_writers;
 	struct inode *inode;
@@ -448,6 +448,34 @@ enum rpm_request {
 
 struct wakeup_source;
 
+/* Device callback phases of a system sleep transition, in execution order */
+enum dpm_phase {
+	DPM_PREPARE,
+	DPM_SUSPEND,
+	DPM_SUSPEND_LATE,
+	DPM_SUSPEND_NOIRQ,
+	DPM_RESUME_NOIRQ,
+	DPM_RESUME_EARLY,
+	DPM_RESUME,
+	DPM_COMPLETE,
+	DPM_PHASE_COUNT
+};
+
+#ifdef CONFIG_PM_DEVICE_TIMING
+/*
+ * Callback durations for one phase: bucket 0 counts calls under 1 us,
+ * bucket n > 0 those from 4^(n-1) up to 4^n us, the last one the rest.
+ */
+#define DPM_TIMING_BUCKETS	12
+
+struct dpm_timing {
+	unsigned int		count;
+	unsigned int		max_us;
+	u64			total_us;
+	unsigned int		hist[DPM_TIMING_BUCKETS];
+};
+#endif
+
 struct pm_domain_data {
 	struct list_head list_node;
 	struct device *dev;
@@ -477,6 +505,9 @@ struct dev_pm_info {
 	struct completion	completion;
 	struct wakeup_source	*wakeup;
 	bool			wakeup_path:1;
+#ifdef CONFIG_PM_DEVICE_TIMING
+	struct dpm_timing	timing[DPM_PHASE_COUNT];
+#endif
 #else
 	unsigned int		should_wakeup:1;
 #endif
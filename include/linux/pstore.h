@@ -22,25 +22,44 @@
 #ifndef _LINUX_PSTORE_H
 #define _LINUX_PSTORE_H
 
+#include <linux/time.h>
+#include <linux/types.h>
+#include <linux/mutex.h>
+
 /* types */
 enum pstore_type_id {
 	PSTORE_TYPE_DMESG	= 0,
 	PSTORE_TYPE_MCE		= 1,
+	PSTORE_TYPE_CONSOLE	= 2,
+	PSTORE_TYPE_FTRACE	= 3,
 	PSTORE_TYPE_UNKNOWN	= 255
 };
 
+/* pstore_info.flags */
+#define PSTORE_FLAGS_CONSOLE	(1 << 0)	/* mirror the console */
+#define PSTORE_FLAGS_FTRACE	(1 << 1)	/* can record function traces */
+#define PSTORE_FLAGS_CRASH_ONLY	(1 << 2)	/* no dumps on clean reboot */
+
+/*
+ * read() hands back a kmalloc()ed buffer in *buf that the caller frees.
+ * write_buf() is called from any context, including the console and
+ * the function tracer, and must neither sleep nor take buf_mutex.
+ */
 struct pstore_info {
 	struct module	*owner;
 	char		*name;
+	unsigned int	flags;
 	struct mutex	buf_mutex;	/* serialize access to 'buf' */
 	char		*buf;
 	size_t		bufsize;
 	int		(*open)(struct pstore_info *psi);
 	int		(*close)(struct pstore_info *psi);
 	ssize_t		(*read)(u64 *id, enum pstore_type_id *type,
-			struct timespec *time);
+			struct timespec *time, char **buf);
 	u64		(*write)(enum pstore_type_id type, size_t size);
-	int		(*erase)(u64 id);
+	int		(*write_buf)(enum pstore_type_id type,
+			const char *buf, size_t size);
+	int		(*erase)(enum pstore_type_id type, u64 id);
 };
 
 #ifdef CONFIG_PSTORE
@@ -0,0 +1,84 @@
+/*
+ * Persistent RAM zones and the pstore RAM backend ("ramoops").
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef __LINUX_PSTORE_RAM_H__
+#define __LINUX_PSTORE_RAM_H__
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+
+struct persistent_ram_buffer;
+struct rs_control;
+
+/* the zone is only written by one CPU at a time, with interrupts off */
+#define PRZ_FLAG_NO_LOCK	(1 << 0)
+
+/*
+ * A ring buffer in memory that survives a warm reset, optionally
+ * protected by Reed-Solomon codes. Whatever a zone held at boot is moved
+ * to old_log by persistent_ram_new() before the zone is reused.
+ */
+struct persistent_ram_zone {
+	phys_addr_t paddr;
+	size_t size;
+	void *vaddr;
+	struct persistent_ram_buffer *buffer;
+	size_t buffer_size;
+	unsigned int flags;
+	raw_spinlock_t buffer_lock;
+
+	/* ECC */
+	int ecc_size;
+	uint8_t *par_buffer;
+	uint8_t *par_header;
+	struct rs_control *rs_decoder;
+	int corrected_bytes;
+	int bad_blocks;
+
+	char *old_log;
+	size_t old_log_size;
+};
+
+struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
+					       u32 sig, int ecc_size,
+					       unsigned int flags);
+void persistent_ram_free(struct persistent_ram_zone *prz);
+void persistent_ram_zap(struct persistent_ram_zone *prz);
+
+int persistent_ram_write(struct persistent_ram_zone *prz, const void *s,
+			 unsigned int count);
+
+size_t persistent_ram_old_size(struct persistent_ram_zone *prz);
+void *persistent_ram_old(struct persistent_ram_zone *prz);
+void persistent_ram_free_old(struct persistent_ram_zone *prz);
+ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
+				  char *str, size_t len);
+
+/*
+ * Layout of the "ramoops" region: console_size bytes of console log,
+ * ftrace_size bytes of function trace split evenly between the CPUs,
+ * and the rest split into record_size slots for oops/panic dumps.
+ * ecc_size is the number of Reed-Solomon parity bytes per 128 data
+ * bytes, 0 disables ECC. The function trace is never ECC protected.
+ */
+struct ramoops_platform_data {
+	unsigned long	mem_size;
+	unsigned long	mem_address;
+	unsigned long	record_size;
+	unsigned long	console_size;
+	unsigned long	ftrace_size;
+	int		ecc_size;
+};
+
+#endif
@@ -639,6 +639,9 @@ struct signal_struct {
 	unsigned long inblock, oublock, cinblock, coublock;
 	unsigned long maxrss, cmaxrss;
 	struct task_io_accounting ioac;
+#ifdef CONFIG_UID_STAT
+	int uid_stat_exited;	/* totals moved to the uid by uid_stat */
+#endif
 
 	/*
 	 * Cumulative ns of schedule CPU time fo dead threads in the
@@ -769,6 +772,21 @@ extern struct user_struct root_user;
 struct backing_dev_info;
 struct reclaim_state;
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * Log2 histograms of the time spent runnable before getting a cpu, split
+ * by whether the wait started with a wakeup or with being preempted.
+ * Bucket 0 counts waits under 1024ns, bucket n those in
+ * [2^(n+9), 2^(n+10)) ns, and the last bucket everything longer.
+ */
+#define SCHED_LAT_BUCKETS	20
+
+struct sched_lat_hist {
+	u32 wakeup[SCHED_LAT_BUCKETS];
+	u32 preempt[SCHED_LAT_BUCKETS];
+};
+#endif
+
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
 struct sched_info {
 	/* cumulative counters */
@@ -778,6 +796,13 @@ struct sched_info {
 	/* timestamps */
 	unsigned long long last_arrival,/* when we last ran on a cpu */
 			   last_queued;	/* when we were last queued to run */
+#ifdef CONFIG_SCHEDSTATS
+	/* wait of the current runnable period spent on other cpus */
+	unsigned long long wait_sum;
+	/* the current wait started with a preemption, not a wakeup */
+	int preempted;
+	struct sched_lat_hist lat_hist;
+#endif
 };
 #endif /* defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT) */
 
@@ -1536,6 +1561,9 @@ struct task_struct {
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
 	struct task_io_accounting ioac;
+#ifdef CONFIG_UID_STAT
+	u32 uid_stat_gen;	/* uid_stat generation it last ran in */
+#endif
 #if defined(CONFIG_TASK_XACCT)
 	u64 acct_rss_mem1;	/* accumulated rss usage */
 	u64 acct_vm_mem1;	/* accumulated virtual memory usage */
@@ -196,12 +196,19 @@ enum {
 /*
  * The callback notifies userspace to release buffers when skb DMA is done in
  * lower device, the skb last reference should be 0 when calling this.
+ * zerocopy_success is false if the data had to be copied after all.
  * The desc is used to track userspace buffer index.
+ *
+ * MSG_ZEROCOPY sends use id as the notification id reported on the
+ * socket error queue, and refcnt counts the skb heads sharing the pages.
  */
 struct ubuf_info {
-	void (*callback)(void *);
-	void *arg;
+	void (*callback)(struct ubuf_info *, bool zerocopy_success);
+	void *ctx;
 	unsigned long desc;
+	u32 id;
+	u16 zerocopy:1;
+	atomic_t refcnt;
 };
 
 /* This data is invariant across clones and lives at
@@ -265,6 +272,9 @@ enum {
 	SKB_GSO_TCPV6 = 1 << 4,
 
 	SKB_GSO_FCOE = 1 << 5,
+
+	/* UDP datagrams cut at gso_size, each with its own UDP header */
+	SKB_GSO_UDP_L4 = 1 << 6,
 };
 
 #if BITS_PER_LONG > 32
@@ -601,6 +611,72 @@ static inline struct skb_shared_hwtstamps *skb_hwtstamps(struct sk_buff *skb)
 	return &skb_shinfo(skb)->hwtstamps;
 }
 
+extern struct ubuf_info *sock_zerocopy_alloc(struct sock *sk);
+extern void sock_zerocopy_callback(struct ubuf_info *uarg, bool success);
+extern void sock_zerocopy_put(struct ubuf_info *uarg);
+extern void sock_zerocopy_put_abort(struct ubuf_info *uarg);
+extern int skb_zerocopy_iter_stream(struct sock *sk, struct sk_buff *skb,
+				    unsigned char __user *from, int len,
+				    struct ubuf_info *uarg);
+
+static inline bool skb_zcopy(const struct sk_buff *skb)
+{
+	return skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY;
+}
+
+static inline struct ubuf_info *skb_zcopy_uarg(const struct sk_buff *skb)
+{
+	return skb_zcopy(skb) ? skb_shinfo(skb)->destructor_arg : NULL;
+}
+
+/* Make the frags of this skb head pin the user buffers of @uarg */
+static inline void skb_zcopy_set(struct sk_buff *skb, struct ubuf_info *uarg)
+{
+	if (uarg) {
+		atomic_inc(&uarg->refcnt);
+		skb_shinfo(skb)->destructor_arg = uarg;
+		skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
+	}
+}
+
+/* This skb head no longer refers to user pages */
+static inline void skb_zcopy_clear(struct sk_buff *skb, bool zerocopy)
+{
+	struct ubuf_info *uarg = skb_zcopy_uarg(skb);
+
+	if (uarg) {
+		if (uarg->callback == sock_zerocopy_callback) {
+			uarg->zerocopy = uarg->zerocopy && zerocopy;
+			sock_zerocopy_put(uarg);
+		} else {
+			uarg->callback(uarg, zerocopy);
+		}
+		skb_shinfo(skb)->tx_flags &= ~SKBTX_DEV_ZEROCOPY;
+	}
+}
+
+/*
+ * Copy user frags before the skb is duplicated or held somewhere that
+ * cannot release them on time. MSG_ZEROCOPY heads are refcounted, so
+ * they may be shared along the transmit path.
+ */
+static inline int skb_orphan_frags(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!skb_zcopy(skb)))
+		return 0;
+	if (skb_zcopy_uarg(skb)->callback == sock_zerocopy_callback)
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
+/* Received skbs may be queued indefinitely: always copy */
+static inline int skb_orphan_frags_rx(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!skb_zcopy(skb)))
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
 /**
  *	skb_queue_empty - check if a queue is empty
  *	@list: queue head
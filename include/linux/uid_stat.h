@@ -16,14 +16,68 @@
 #ifndef __uid_stat_h
 #define __uid_stat_h
 
+#include <linux/types.h>
+
 /* Contains definitions for resource tracking per uid. */
 
+/*
+ * Binary records read from /proc/uid_stat/batch: a header, nr_uids uid
+ * records, then nr_procs process records. Times are in microseconds,
+ * wakeups count voluntary context switches.
+ */
+#define UID_STAT_BATCH_VERSION	1
+
+struct uid_stat_batch_hdr {
+	__u32	version;
+	/* write this back to get only what changed after this read */
+	__u32	gen;
+	__u32	nr_uids;
+	__u32	nr_procs;
+};
+
+struct uid_stat_batch_uid {
+	__u32	uid;
+	__u32	pad;
+	__u64	utime_us;
+	__u64	stime_us;
+	__u64	read_bytes;
+	__u64	write_bytes;
+	__u64	wakeups;
+	__u64	tcp_snd;
+	__u64	tcp_rcv;
+};
+
+struct uid_stat_batch_proc {
+	__u32	pid;
+	__u32	uid;
+	__u64	utime_us;
+	__u64	stime_us;
+	__u64	read_bytes;
+	__u64	write_bytes;
+	__u64	wakeups;
+};
+
+#ifdef __KERNEL__
 #ifdef CONFIG_UID_STAT
+#include <linux/sched.h>
+
+extern atomic_t uid_stat_generation;
+
+/* Called by the scheduler when @prev is switched out */
+static inline void uid_stat_task_switch(struct task_struct *prev)
+{
+	prev->uid_stat_gen = atomic_read(&uid_stat_generation);
+}
+
 int uid_stat_tcp_snd(uid_t uid, int size);
 int uid_stat_tcp_rcv(uid_t uid, int size);
+void uid_stat_task_exit(struct task_struct *tsk, int group_dead);
 #else
 #define uid_stat_tcp_snd(uid, size) do {} while (0);
 #define uid_stat_tcp_rcv(uid, size) do {} while (0);
+#define uid_stat_task_switch(prev) do {} while (0)
+#define uid_stat_task_exit(tsk, group_dead) do {} while (0)
 #endif
+#endif /* __KERNEL__ */
 
 #endif /* _LINUX_UID_STAT_H */
@@ -17,6 +17,7 @@
 #define _LINUX_WAKELOCK_H
 
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/ktime.h>
 
 /* A wake_lock prevents the system from entering suspend or other low power
@@ -35,6 +36,7 @@ enum {
 struct wake_lock {
 #ifdef CONFIG_HAS_WAKELOCK
 	struct list_head    link;
+	struct rb_node      expire_node;
 	int                 flags;
 	const char         *name;
 	unsigned long       expires;
@@ -45,6 +47,7 @@ struct wake_lock {
 		int             wakeup_count;
 		ktime_t         total_time;
 		ktime_t         prevent_suspend_time;
+		ktime_t         prevent_suspend_start;
 		ktime_t         max_time;
 		ktime_t         last_time;
 	} stat;
@@ -54,6 +57,7 @@ struct wake_lock {
 		int             wakeup_count;
 		ktime_t         total_time;
 		ktime_t         prevent_suspend_time;
+		ktime_t         prevent_suspend_start;
 		ktime_t         max_time;
 		ktime_t         last_time;
 	} discrete_stat;
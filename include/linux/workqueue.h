@@ -97,6 +97,9 @@ struct work_struct {
 	atomic_long_t data;
 	struct list_head entry;
 	work_func_t func;
+#ifdef CONFIG_WORKQUEUE_STATS
+	u64 queued_at;
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
@@ -54,6 +54,7 @@ struct ipcm_cookie {
 	int			oif;
 	struct ip_options_rcu	*opt;
 	__u8			tx_flags;
+	__u16			gso_size;	/* only read by ip_make_skb() */
 };
 
 #define IPCB(skb) ((struct inet_skb_parm*)((skb)->cb))
@@ -96,6 +97,9 @@ extern int		ip_build_and_send_pkt(struct sk_buff *skb, struct sock *sk,
 extern int		ip_rcv(struct sk_buff *skb, struct net_device *dev,
 			       struct packet_type *pt, struct net_device *orig_dev);
 extern int		ip_local_deliver(struct sk_buff *skb);
+extern void		ip_protocol_deliver_rcu(struct net *net,
+						struct sk_buff *skb,
+						int protocol);
 extern int		ip_mr_input(struct sk_buff *skb);
 extern int		ip_output(struct sk_buff *skb);
 extern int		ip_mc_output(struct sk_buff *skb);
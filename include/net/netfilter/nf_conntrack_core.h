@@ -13,6 +13,7 @@
 #define _NF_CONNTRACK_CORE_H
 
 #include <linux/netfilter.h>
+#include <linux/seqlock.h>
 #include <net/netfilter/nf_conntrack_l3proto.h>
 #include <net/netfilter/nf_conntrack_l4proto.h>
 #include <net/netfilter/nf_conntrack_ecache.h>
@@ -76,4 +77,13 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
 
 extern spinlock_t nf_conntrack_lock ;
 
+/* Hash chains are protected by one of these, picked by bucket number */
+#define CONNTRACK_LOCKS 1024
+
+extern spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
+extern void nf_conntrack_bucket_lock(spinlock_t *lock);
+
+/* Bumped whenever the hash table is resized */
+extern seqcount_t nf_conntrack_generation;
+
 #endif /* _NF_CONNTRACK_CORE_H */
@@ -0,0 +1,93 @@
+#ifndef _NF_FLOW_TABLE_H
+#define _NF_FLOW_TABLE_H
+
+/*
+ * Software flow table: established, NATed conntracks whose packets are
+ * forwarded straight from PRE_ROUTING, bypassing routing, ip_tables and
+ * the NAT hooks.
+ */
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/rcupdate.h>
+#include <linux/percpu.h>
+#include <linux/netdevice.h>
+#include <net/dst.h>
+#include <net/netfilter/nf_conntrack.h>
+
+enum flow_offload_tuple_dir {
+	FLOW_OFFLOAD_DIR_ORIGINAL = IP_CT_DIR_ORIGINAL,
+	FLOW_OFFLOAD_DIR_REPLY = IP_CT_DIR_REPLY,
+	FLOW_OFFLOAD_DIR_MAX = IP_CT_DIR_MAX
+};
+
+/* Lookup key, as seen on the wire before NAT. Zero it before filling. */
+struct flow_offload_tuple {
+	__be32			src_v4;
+	__be32			dst_v4;
+	__be16			src_port;
+	__be16			dst_port;
+	int			iifidx;
+	u8			l3proto;
+	u8			l4proto;
+	u16			__pad;
+};
+
+struct flow_offload_tuple_hash {
+	struct hlist_node		node;
+	struct flow_offload_tuple	tuple;
+	u8				dir;
+	u16				mtu;
+	/* route the packets of this direction leave through */
+	struct dst_entry		*dst;
+};
+
+enum flow_offload_flags {
+	FLOW_OFFLOAD_TEARDOWN_BIT,
+	FLOW_OFFLOAD_DYING_BIT,
+};
+
+struct flow_offload {
+	struct flow_offload_tuple_hash	tuplehash[FLOW_OFFLOAD_DIR_MAX];
+	struct nf_conn			*ct;
+	unsigned long			flags;
+	unsigned long			timeout;
+	struct rcu_head			rcu_head;
+};
+
+/* idle time after which a flow goes back to the slow path */
+#define NF_FLOW_TIMEOUT		(30 * HZ)
+
+struct nf_flow_table_stat {
+	unsigned int found;
+	unsigned int added;
+	unsigned int add_failed;
+	unsigned int removed;
+	unsigned int teardown;
+	unsigned int slowpath;
+};
+
+DECLARE_PER_CPU(struct nf_flow_table_stat, nf_flow_table_stat);
+#define NF_FLOW_STAT_INC(count)	__this_cpu_inc(nf_flow_table_stat.count)
+
+extern struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+				struct dst_entry *dst[FLOW_OFFLOAD_DIR_MAX],
+				const int iifidx[FLOW_OFFLOAD_DIR_MAX]);
+extern void flow_offload_free(struct flow_offload *flow);
+extern int flow_offload_add(struct flow_offload *flow);
+extern void flow_offload_teardown(struct flow_offload *flow);
+extern struct flow_offload_tuple_hash *
+flow_offload_lookup(struct net *net, const struct flow_offload_tuple *tuple);
+
+static inline struct flow_offload *
+flow_offload_from_tuplehash(struct flow_offload_tuple_hash *th)
+{
+	return container_of(th, struct flow_offload, tuplehash[th->dir]);
+}
+
+static inline void flow_offload_refresh(struct flow_offload *flow)
+{
+	flow->timeout = jiffies + NF_FLOW_TIMEOUT;
+}
+
+#endif /* _NF_FLOW_TABLE_H */
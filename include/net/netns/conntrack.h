@@ -4,10 +4,18 @@
 #include <linux/list.h>
 #include <linux/list_nulls.h>
 #include <linux/atomic.h>
+#include <linux/spinlock.h>
 
 struct ctl_table_header;
 struct nf_conntrack_ecache;
 
+/* Lists of conntracks not (or no longer) in the hash, one set per cpu */
+struct ct_pcpu {
+	spinlock_t		lock;
+	struct hlist_nulls_head	unconfirmed;
+	struct hlist_nulls_head	dying;
+};
+
 struct netns_ct {
 	atomic_t		count;
 	unsigned int		expect_count;
@@ -15,8 +23,7 @@ struct netns_ct {
 	struct kmem_cache	*nf_conntrack_cachep;
 	struct hlist_nulls_head	*hash;
 	struct hlist_head	*expect_hash;
-	struct hlist_nulls_head	unconfirmed;
-	struct hlist_nulls_head	dying;
+	struct ct_pcpu __percpu	*pcpu_lists;
 	struct ip_conntrack_stat __percpu *stat;
 	int			sysctl_events;
 	unsigned int		sysctl_events_retry_timeout;
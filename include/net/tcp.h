@@ -55,6 +55,9 @@ extern void tcp_time_wait(struct sock *sk, int state, int timeo);
 #define MAX_TCP_HEADER	(128 + MAX_HEADER)
 #define MAX_TCP_OPTION_SPACE 40
 
+/* MSG_ZEROCOPY sends below this size are copied: pinning costs more */
+#define TCP_ZEROCOPY_MIN_SIZE	(10 * 1024)
+
 /* 
  * Never offer a window over 32767 without using window scaling. Some
  * poor stacks do signed 16bit maths! 
@@ -258,4 +258,7 @@ extern void udp_init(void);
 
 extern int udp4_ufo_send_check(struct sk_buff *skb);
 extern struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features);
+extern struct sk_buff **udp4_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb);
+extern int udp4_gro_complete(struct sk_buff *skb);
 #endif	/* _UDP_H */
@@ -0,0 +1,121 @@
+/*
+ *  compress_params.h - codec types and parameters for compressed data
+ *  streaming interface
+ *
+ *  Copyright (C) 2011 Intel Corporation
+ *  Authors:	Vinod Koul <vinod.koul@linux.intel.com>
+ *		Pierre-Louis Bossart <pierre-louis.bossart@linux.intel.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; version 2 of the License.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ */
+#ifndef __SND_COMPRESS_PARAMS_H
+#define __SND_COMPRESS_PARAMS_H
+
+#include <linux/types.h>
+
+/* Maximum PCM channels */
+#define MAX_PCM_DECODE_CHANNELS		32
+#define MAX_PCM_ENCODE_CHANNELS		32
+
+/* Maximum number of codecs, codec descriptors and bit rates in a list */
+#define MAX_NUM_CODECS			32
+#define MAX_NUM_CODEC_DESCRIPTORS	32
+#define MAX_NUM_BITRATES		32
+
+/* Codecs, some of which the hardware or firmware may not support */
+#define SND_AUDIOCODEC_PCM		((__u32) 0x00000001)
+#define SND_AUDIOCODEC_MP3		((__u32) 0x00000002)
+#define SND_AUDIOCODEC_AMR		((__u32) 0x00000003)
+#define SND_AUDIOCODEC_AMRWB		((__u32) 0x00000004)
+#define SND_AUDIOCODEC_AMRWBPLUS	((__u32) 0x00000005)
+#define SND_AUDIOCODEC_AAC		((__u32) 0x00000006)
+#define SND_AUDIOCODEC_WMA		((__u32) 0x00000007)
+#define SND_AUDIOCODEC_REAL		((__u32) 0x00000008)
+#define SND_AUDIOCODEC_VORBIS		((__u32) 0x00000009)
+#define SND_AUDIOCODEC_FLAC		((__u32) 0x0000000A)
+#define SND_AUDIOCODEC_IEC61937		((__u32) 0x0000000B)
+#define SND_AUDIOCODEC_G723_1		((__u32) 0x0000000C)
+#define SND_AUDIOCODEC_G729		((__u32) 0x0000000D)
+#define SND_AUDIOCODEC_MAX		SND_AUDIOCODEC_G729
+
+/* Rate control modes */
+#define SND_RATECONTROLMODE_CONSTANTBITRATE	((__u32) 0x00000001)
+#define SND_RATECONTROLMODE_VARIABLEBITRATE	((__u32) 0x00000002)
+
+/* Channel modes */
+#define SND_AUDIOCHANMODE_MONO		((__u32) 0x00000001)
+#define SND_AUDIOCHANMODE_STEREO	((__u32) 0x00000002)
+#define SND_AUDIOCHANMODE_JOINTSTEREO	((__u32) 0x00000004)
+#define SND_AUDIOCHANMODE_DUAL		((__u32) 0x00000008)
+
+/**
+ * struct snd_codec_desc - description of codec capabilities
+ * @max_ch: Maximum number of audio channels
+ * @sample_rates: Sampling rates in Hz, 0 terminated
+ * @bit_rate: Indexed array containing supported bit rates
+ * @num_bitrates: Number of valid values in bit_rate array
+ * @rate_control: value is specified by SND_RATECONTROLMODE defines.
+ * @profiles: Supported profiles, codec specific bitmask
+ * @modes: Supported modes, codec specific bitmask
+ * @formats: Supported container formats, codec specific bitmask
+ *
+ * A codec may report several descriptors, e.g. one per profile.
+ */
+struct snd_codec_desc {
+	__u32 max_ch;
+	__u32 sample_rates[MAX_NUM_BITRATES];
+	__u32 bit_rate[MAX_NUM_BITRATES];
+	__u32 num_bitrates;
+	__u32 rate_control;
+	__u32 profiles;
+	__u32 modes;
+	__u32 formats;
+	__u32 reserved[16];
+};
+
+/**
+ * struct snd_codec - codec parameters of a stream
+ * @id: Identifies the supported audio encoder/decoder, SND_AUDIOCODEC_xxx
+ * @ch_in: Number of input audio channels
+ * @ch_out: Number of output channels. In case of contradiction between
+ *	this field and the channelMode field, the channelMode field
+ *	overrides.
+ * @sample_rate: Audio sample rate of input data in Hz
+ * @bit_rate: Bitrate of encoded data, 0 if unknown or variable
+ * @rate_control: Encoding rate control, SND_RATECONTROLMODE_xxx
+ * @profile: Profile of the codec, codec specific
+ * @level: Level of the codec, codec specific
+ * @ch_mode: Channel mode, SND_AUDIOCHANMODE_xxx
+ * @format: Format of the encoded data, codec specific; for
+ *	SND_AUDIOCODEC_PCM a SNDRV_PCM_FORMAT_xxx value
+ * @align: Block alignment in bytes of an audio sample, only required
+ *	for PCM or IEC formats
+ */
+struct snd_codec {
+	__u32 id;
+	__u32 ch_in;
+	__u32 ch_out;
+	__u32 sample_rate;
+	__u32 bit_rate;
+	__u32 rate_control;
+	__u32 profile;
+	__u32 level;
+	__u32 ch_mode;
+	__u32 format;
+	__u32 align;
+	__u32 reserved[29];
+};
+
+#endif
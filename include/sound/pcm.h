@@ -30,6 +30,7 @@
 #include <linux/mm.h>
 #include <linux/bitops.h>
 #include <linux/pm_qos.h>
+#include <linux/hrtimer.h>
 
 #define snd_pcm_substream_chip(substream) ((substream)->private_data)
 #define snd_pcm_chip(pcm) ((pcm)->private_data)
@@ -385,6 +386,9 @@ struct snd_pcm_substream {
         /* -- timer section -- */
 	struct snd_timer *timer;		/* timer */
 	unsigned timer_running: 1;	/* time is running */
+	/* -- wakeups between period interrupts -- */
+	struct hrtimer wakeup_timer;	/* polls the hw pointer */
+	ktime_t wakeup_interval;	/* zero = period interrupts only */
 	/* -- next substream -- */
 	struct snd_pcm_substream *next;
 	/* -- linked substreams -- */
@@ -853,6 +857,10 @@ int snd_pcm_lib_ioctl(struct snd_pcm_substream *substream,
 int snd_pcm_update_state(struct snd_pcm_substream *substream,
 			 struct snd_pcm_runtime *runtime);
 int snd_pcm_update_hw_ptr(struct snd_pcm_substream *substream);
+void snd_pcm_wakeup_timer_init(struct snd_pcm_substream *substream);
+void snd_pcm_wakeup_timer_setup(struct snd_pcm_substream *substream);
+void snd_pcm_wakeup_timer_start(struct snd_pcm_substream *substream);
+void snd_pcm_wakeup_timer_stop(struct snd_pcm_substream *substream);
 int snd_pcm_playback_xrun_check(struct snd_pcm_substream *substream);
 int snd_pcm_capture_xrun_check(struct snd_pcm_substream *substream);
 int snd_pcm_playback_xrun_asap(struct snd_pcm_substream *substream);
@@ -0,0 +1,91 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM input
+
+#if !defined(_TRACE_INPUT_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_INPUT_H
+
+#include <linux/input.h>
+#include <linux/hrtimer.h>
+#include <linux/tracepoint.h>
+
+/*
+ * Latency of an input packet through the kernel: from the hardware
+ * interrupt to the driver reporting it, to the handlers and to the read()
+ * that hands it to user space. All latencies are in nanoseconds and
+ * relative to the timestamp of the packet.
+ */
+
+TRACE_EVENT(input_timestamp,
+
+	TP_PROTO(struct input_dev *dev, ktime_t timestamp),
+
+	TP_ARGS(dev, timestamp),
+
+	TP_STRUCT__entry(
+		__string(name, dev->name)
+		__field(s64, latency)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev->name);
+		__entry->latency = ktime_to_ns(ktime_sub(ktime_get(), timestamp));
+	),
+
+	TP_printk("dev=%s irq_to_report=%lld", __get_str(name),
+		  __entry->latency)
+);
+
+TRACE_EVENT(input_deliver,
+
+	TP_PROTO(struct input_dev *dev, unsigned int count),
+
+	TP_ARGS(dev, count),
+
+	TP_STRUCT__entry(
+		__string(name, dev->name)
+		__field(unsigned int, count)
+		__field(s64, latency)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev->name);
+		__entry->count = count;
+		__entry->latency = dev->timestamp.tv64 ?
+			ktime_to_ns(ktime_sub(ktime_get(), dev->timestamp)) : 0;
+	),
+
+	TP_printk("dev=%s events=%u irq_to_handlers=%lld", __get_str(name),
+		  __entry->count, __entry->latency)
+);
+
+/* @timestamp is the time of the oldest event read, in @clkid */
+TRACE_EVENT(input_read,
+
+	TP_PROTO(struct input_dev *dev, unsigned int count, ktime_t timestamp,
+		 int clkid),
+
+	TP_ARGS(dev, count, timestamp, clkid),
+
+	TP_STRUCT__entry(
+		__string(name, dev->name)
+		__field(unsigned int, count)
+		__field(s64, latency)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev->name);
+		__entry->count = count;
+		__entry->latency = ktime_to_ns(ktime_sub(
+			clkid == CLOCK_REALTIME ? ktime_get_real() :
+			clkid == CLOCK_BOOTTIME ? ktime_get_boottime() :
+						  ktime_get(), timestamp));
+	),
+
+	TP_printk("dev=%s events=%u irq_to_read=%lld", __get_str(name),
+		  __entry->count, __entry->latency)
+);
+
+#endif /* _TRACE_INPUT_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
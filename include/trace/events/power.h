@@ -34,6 +34,66 @@ DEFINE_EVENT(cpu, cpu_idle,
 	TP_ARGS(state, cpu_id)
 );
 
+TRACE_EVENT(cpuidle_select,
+
+	TP_PROTO(unsigned int cpu_id, int state, unsigned int timer_us,
+		 unsigned int predicted_us, unsigned long nr_iowait),
+
+	TP_ARGS(cpu_id, state, timer_us, predicted_us, nr_iowait),
+
+	TP_STRUCT__entry(
+		__field(	u32,		cpu_id		)
+		__field(	int,		state		)
+		__field(	u32,		timer_us	)
+		__field(	u32,		predicted_us	)
+		__field(	u32,		nr_iowait	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = cpu_id;
+		__entry->state = state;
+		__entry->timer_us = timer_us;
+		__entry->predicted_us = predicted_us;
+		__entry->nr_iowait = nr_iowait;
+	),
+
+	TP_printk("cpu_id=%lu state=%d timer_us=%lu predicted_us=%lu "
+		  "nr_iowait=%lu", (unsigned long)__entry->cpu_id,
+		  __entry->state, (unsigned long)__entry->timer_us,
+		  (unsigned long)__entry->predicted_us,
+		  (unsigned long)__entry->nr_iowait)
+);
+
+TRACE_EVENT(cpuidle_outcome,
+
+	TP_PROTO(unsigned int cpu_id, int state, unsigned int measured_us,
+		 int result),
+
+	TP_ARGS(cpu_id, state, measured_us, result),
+
+	TP_STRUCT__entry(
+		__field(	u32,		cpu_id		)
+		__field(	int,		state		)
+		__field(	u32,		measured_us	)
+		__field(	int,		result		)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = cpu_id;
+		__entry->state = state;
+		__entry->measured_us = measured_us;
+		__entry->result = result;
+	),
+
+	TP_printk("cpu_id=%lu state=%d measured_us=%lu %s",
+		  (unsigned long)__entry->cpu_id, __entry->state,
+		  (unsigned long)__entry->measured_us,
+		  __print_symbolic(__entry->result,
+				   { 0, "hit" },
+				   { 1, "too_deep" },
+				   { 2, "too_shallow" }))
+);
+
 /* This file can get included multiple times, TRACE_HEADER_MULTI_READ at top */
 #ifndef _PWR_EVENT_AVOID_DOUBLE_DEFINING
 #define _PWR_EVENT_AVOID_DOUBLE_DEFINING
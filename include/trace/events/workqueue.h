@@ -115,6 +115,47 @@ DEFINE_EVENT(workqueue_work, workqueue_execute_end,
 	TP_ARGS(work)
 );
 
+#ifdef CONFIG_WORKQUEUE_STATS
+/**
+ * workqueue_execute_latency - called after a work item has been executed
+ * @pwq:	pointer to struct pool_workqueue
+ * @function:	the work function which has been executed
+ * @delay_ns:	time between queueing and the start of execution
+ * @exec_ns:	time spent executing the work function
+ *
+ * The work item may have been freed by its function, so only the
+ * function is recorded.
+ */
+TRACE_EVENT(workqueue_execute_latency,
+
+	TP_PROTO(struct pool_workqueue *pwq, work_func_t function,
+		 u64 delay_ns, u64 exec_ns),
+
+	TP_ARGS(pwq, function, delay_ns, exec_ns),
+
+	TP_STRUCT__entry(
+		__string( workqueue,	pwq->wq->name	)
+		__field( void *,	function	)
+		__field( unsigned int,	cpu		)
+		__field( u64,		delay_ns	)
+		__field( u64,		exec_ns		)
+	),
+
+	TP_fast_assign(
+		__assign_str(workqueue, pwq->wq->name);
+		__entry->function	= function;
+		__entry->cpu		= pwq->pool->cpu;
+		__entry->delay_ns	= delay_ns;
+		__entry->exec_ns	= exec_ns;
+	),
+
+	TP_printk("workqueue=%s function=%pf cpu=%u delay=%llu ns exec=%llu ns",
+		  __get_str(workqueue), __entry->function, __entry->cpu,
+		  (unsigned long long)__entry->delay_ns,
+		  (unsigned long long)__entry->exec_ns)
+);
+#endif
+
 #endif /*  _TRACE_WORKQUEUE_H */
 
 /* This part must be outside protection */
@@ -649,8 +649,6 @@ static void __init do_ctors(void)
 bool initcall_debug;
 core_param(initcall_debug, initcall_debug, bool, 0644);
 
-static char msgbuf[64];
-
 static int __init_or_module do_one_initcall_debug(initcall_t fn)
 {
 	ktime_t calltime, delta, rettime;
@@ -672,6 +670,8 @@ static int __init_or_module do_one_initcall_debug(initcall_t fn)
 int __init_or_module do_one_initcall(initcall_t fn)
 {
 	int count = preempt_count();
+	/* on the stack: parallel initcalls get here concurrently */
+	char msgbuf[64];
 	int ret;
 
 	if (initcall_debug)
@@ -754,6 +754,8 @@ static void __init do_initcall_level(int level)
 
 	for (fn = initcall_levels[level]; fn < initcall_levels[level+1]; fn++)
 		do_one_initcall(*fn);
+
+	do_parallel_initcalls(level, initcall_level_names[level]);
 }
 
 static void __init do_initcalls(void)
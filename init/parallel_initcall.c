@@ -0,0 +1,296 @@
+/*
+ * Parallel initcalls
+ *
+ * Initcalls declared with the *_initcall_parallel() macros run once all
+ * sequential initcalls of their level have returned. Each of them is
+ * queued on the unbound workqueue as soon as the parallel initcalls it
+ * depends on are done, and the level only completes when all of them
+ * are, so later levels see exactly the same state as with sequential
+ * execution.
+ *
+ * With initcall_debug, every call reports its wall time as usual and
+ * each level reports its critical path: the dependency chain with the
+ * largest total run time, which bounds how fast the level can finish no
+ * matter how many CPUs are available.
+ *
+ * "initcall_parallel=0" on the command line runs the same calls one by
+ * one, in dependency order, for comparison.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
+#include <linux/hrtimer.h>
+
+extern struct parallel_initcall __initcall0p_start[];
+extern struct parallel_initcall __initcall1p_start[];
+extern struct parallel_initcall __initcall2p_start[];
+extern struct parallel_initcall __initcall3p_start[];
+extern struct parallel_initcall __initcall4p_start[];
+extern struct parallel_initcall __initcall5p_start[];
+extern struct parallel_initcall __initcall6p_start[];
+extern struct parallel_initcall __initcall7p_start[];
+extern struct parallel_initcall __initcallp_end[];
+
+static struct parallel_initcall *parallel_initcall_levels[] __initdata = {
+	__initcall0p_start,
+	__initcall1p_start,
+	__initcall2p_start,
+	__initcall3p_start,
+	__initcall4p_start,
+	__initcall5p_start,
+	__initcall6p_start,
+	__initcall7p_start,
+	__initcallp_end,
+};
+
+static bool initcall_parallel __initdata = true;
+
+static int __init initcall_parallel_setup(char *str)
+{
+	return strtobool(str, &initcall_parallel) == 0;
+}
+__setup("initcall_parallel=", initcall_parallel_setup);
+
+struct pinitcall_level;
+
+struct pinitcall_node {
+	struct work_struct work;
+	const struct parallel_initcall *call;
+	struct pinitcall_level *level;
+	/* indices of the nodes of the level this one waits for */
+	int *deps;
+	int ndeps;
+	/* dependencies that have not returned yet */
+	atomic_t pending;
+	s64 run_us;
+	/* longest chain of run times ending with this node */
+	s64 path_us;
+	struct pinitcall_node *path_prev;
+};
+
+struct pinitcall_level {
+	struct pinitcall_node *nodes;
+	int n;
+	/* topological order, computed up front */
+	int *order;
+	atomic_t remaining;
+	struct completion done;
+};
+
+static void __init pinitcall_run(struct pinitcall_node *node)
+{
+	ktime_t start = ktime_get();
+
+	do_one_initcall(node->call->fn);
+	node->run_us = ktime_to_us(ktime_sub(ktime_get(), start));
+}
+
+static bool __init pinitcall_waits_for(const struct pinitcall_node *node,
+				       int idx)
+{
+	int i;
+
+	for (i = 0; i < node->ndeps; i++)
+		if (node->deps[i] == idx)
+			return true;
+	return false;
+}
+
+static void __init pinitcall_work(struct work_struct *work)
+{
+	struct pinitcall_node *node =
+		container_of(work, struct pinitcall_node, work);
+	struct pinitcall_level *level = node->level;
+	int idx = node - level->nodes;
+	int i;
+
+	pinitcall_run(node);
+
+	for (i = 0; i < level->n; i++) {
+		struct pinitcall_node *next = &level->nodes[i];
+
+		if (pinitcall_waits_for(next, idx) &&
+		    atomic_dec_and_test(&next->pending))
+			queue_work(system_unbound_wq, &next->work);
+	}
+
+	if (atomic_dec_and_test(&level->remaining))
+		complete(&level->done);
+}
+
+static int __init pinitcall_find(const struct parallel_initcall *start,
+				 const struct parallel_initcall *end,
+				 const char *name)
+{
+	const struct parallel_initcall *call;
+
+	for (call = start; call < end; call++)
+		if (strcmp(call->name, name) == 0)
+			return call - start;
+	return -1;
+}
+
+/*
+ * Turn dependency names into node indices. Names of parallel initcalls
+ * of earlier levels are dropped, they have already returned.
+ */
+static int __init pinitcall_resolve(struct pinitcall_level *level, int lvl)
+{
+	struct parallel_initcall *start = parallel_initcall_levels[lvl];
+	struct parallel_initcall *end = parallel_initcall_levels[lvl + 1];
+	int i, j;
+
+	for (i = 0; i < level->n; i++) {
+		struct pinitcall_node *node = &level->nodes[i];
+		const struct parallel_initcall *call = node->call;
+
+		node->deps = kcalloc(call->ndeps, sizeof(int), GFP_KERNEL);
+		if (call->ndeps && !node->deps)
+			return -ENOMEM;
+
+		for (j = 0; j < call->ndeps; j++) {
+			const char *dep = call->deps[j];
+			int idx = pinitcall_find(start, end, dep);
+
+			if (idx < 0) {
+				if (pinitcall_find(parallel_initcall_levels[0],
+						   start, dep) < 0)
+					pr_warn("initcall %s: unknown dependency %s\n",
+						call->name, dep);
+				continue;
+			}
+			if (idx == i || pinitcall_waits_for(node, idx))
+				continue;
+			node->deps[node->ndeps++] = idx;
+		}
+		atomic_set(&node->pending, node->ndeps);
+	}
+	return 0;
+}
+
+/* Kahn's algorithm; fails if the dependencies have a cycle */
+static int __init pinitcall_sort(struct pinitcall_level *level)
+{
+	int *pending;
+	int i, j, head = 0, tail = 0;
+
+	pending = kcalloc(level->n, sizeof(int), GFP_KERNEL);
+	if (!pending)
+		return -ENOMEM;
+
+	for (i = 0; i < level->n; i++) {
+		pending[i] = level->nodes[i].ndeps;
+		if (!pending[i])
+			level->order[tail++] = i;
+	}
+	while (head < tail) {
+		int idx = level->order[head++];
+
+		for (j = 0; j < level->n; j++)
+			if (pinitcall_waits_for(&level->nodes[j], idx) &&
+			    --pending[j] == 0)
+				level->order[tail++] = j;
+	}
+	kfree(pending);
+
+	return tail == level->n ? 0 : -ELOOP;
+}
+
+static void __init pinitcall_report(struct pinitcall_level *level,
+				    const char *name, s64 wall_us)
+{
+	struct pinitcall_node *node, *last = NULL;
+	s64 total_us = 0;
+	int i, j;
+
+	for (i = 0; i < level->n; i++) {
+		node = &level->nodes[level->order[i]];
+		node->path_prev = NULL;
+		node->path_us = 0;
+		for (j = 0; j < node->ndeps; j++) {
+			struct pinitcall_node *dep = &level->nodes[node->deps[j]];
+
+			if (dep->path_us > node->path_us) {
+				node->path_us = dep->path_us;
+				node->path_prev = dep;
+			}
+		}
+		node->path_us += node->run_us;
+		total_us += node->run_us;
+		if (!last || node->path_us > last->path_us)
+			last = node;
+	}
+
+	printk(KERN_DEBUG "initcall level %s: %d parallel initcalls, "
+	       "%lld usecs wall, %lld usecs total, critical path %lld usecs\n",
+	       name, level->n, wall_us, total_us, last->path_us);
+	for (node = last; node; node = node->path_prev)
+		printk(KERN_DEBUG "  critical path: %pF %lld usecs\n",
+		       node->call->fn, node->run_us);
+}
+
+void __init do_parallel_initcalls(int lvl, const char *name)
+{
+	struct parallel_initcall *start = parallel_initcall_levels[lvl];
+	struct parallel_initcall *end = parallel_initcall_levels[lvl + 1];
+	struct pinitcall_level level;
+	ktime_t calltime;
+	int i;
+
+	level.n = end - start;
+	if (!level.n)
+		return;
+
+	level.nodes = kcalloc(level.n, sizeof(*level.nodes), GFP_KERNEL);
+	level.order = kcalloc(level.n, sizeof(int), GFP_KERNEL);
+	if (!level.nodes || !level.order)
+		goto fallback;
+
+	for (i = 0; i < level.n; i++) {
+		level.nodes[i].call = &start[i];
+		level.nodes[i].level = &level;
+		INIT_WORK(&level.nodes[i].work, pinitcall_work);
+	}
+
+	if (pinitcall_resolve(&level, lvl))
+		goto fallback;
+	if (pinitcall_sort(&level)) {
+		pr_err("initcall level %s: dependency cycle, running "
+		       "parallel initcalls in link order\n", name);
+		goto fallback;
+	}
+
+	calltime = ktime_get();
+	if (initcall_parallel) {
+		atomic_set(&level.remaining, level.n);
+		init_completion(&level.done);
+		for (i = 0; i < level.n; i++)
+			if (!level.nodes[i].ndeps)
+				queue_work(system_unbound_wq,
+					   &level.nodes[i].work);
+		wait_for_completion(&level.done);
+	} else {
+		for (i = 0; i < level.n; i++)
+			pinitcall_run(&level.nodes[level.order[i]]);
+	}
+
+	if (initcall_debug)
+		pinitcall_report(&level, name,
+				 ktime_to_us(ktime_sub(ktime_get(), calltime)));
+	goto out;
+
+fallback:
+	for (i = 0; i < level.n; i++)
+		do_one_initcall(start[i].fn);
+out:
+	if (level.nodes)
+		for (i = 0; i < level.n; i++)
+			kfree(level.nodes[i].deps);
+	kfree(level.nodes);
+	kfree(level.order);
+}
@@ -52,6 +52,7 @@
 #include <linux/hw_breakpoint.h>
 #include <linux/oom.h>
 #include <linux/writeback.h>
+#include <linux/uid_stat.h>
 
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
@@ -1014,6 +1015,8 @@ NORET_TYPE void do_exit(long code)
 	 */
 	ptrace_put_breakpoints(tsk);
 
+	uid_stat_task_exit(tsk, group_dead);
+
 	exit_notify(tsk, group_dead);
 #ifdef CONFIG_NUMA
 	task_lock(tsk);
@@ -99,6 +99,12 @@ static inline int hrtimer_clockid_to_base(clockid_t clock_id)
 	return hrtimer_clock_to_base_table[clock_id];
 }
 
+/*
+ * Coalescing granularity for timers which can be delayed: hrtimers with
+ * slack and deferrable timer_list timers. 0 disables coalescing.
+ */
+unsigned int sysctl_timer_coalesce_us __read_mostly;
+
 
 /*
  * Get the coarse grained time at the softirq based on xtime and
@@ -719,6 +725,44 @@ void clock_was_set_delayed(void)
 	__raise_softirq_irqoff(HRTIMER_SOFTIRQ);
 }
 
+/*
+ * Timer coalescing: pull the hard expiry of a timer with slack back to
+ * the last multiple of sysctl_timer_coalesce_us inside its range. The
+ * boundaries are the same on all cpus, so timers with overlapping
+ * ranges end up expiring in the same interrupt instead of each waking
+ * the cpu on its own.
+ *
+ * Called with the cpu_base->lock of @base held.
+ */
+static void hrtimer_coalesce(struct hrtimer *timer,
+			     struct hrtimer_clock_base *base)
+{
+	u32 granule = sysctl_timer_coalesce_us * NSEC_PER_USEC;
+	s64 range;
+	ktime_t expires;
+	u32 rem;
+
+	if (!granule)
+		return;
+
+	range = hrtimer_get_expires_tv64(timer) -
+		hrtimer_get_softexpires_tv64(timer);
+	if (range <= 0 || hrtimer_get_expires_tv64(timer) == KTIME_MAX)
+		return;
+
+	/* align in CLOCK_MONOTONIC, which all bases have in common */
+	expires = ktime_sub(hrtimer_get_expires(timer), base->offset);
+	if (expires.tv64 <= 0)
+		return;
+
+	div_u64_rem(expires.tv64, granule, &rem);
+	if (!rem || rem > range)
+		return;
+
+	timer->node.expires = ktime_sub_ns(hrtimer_get_expires(timer), rem);
+	base->cpu_base->nr_coalesced++;
+}
+
 #else
 
 static inline int hrtimer_hres_active(void) { return 0; }
@@ -733,6 +777,8 @@ static inline int hrtimer_enqueue_reprogram(struct hrtimer *timer,
 }
 static inline void hrtimer_init_hres(struct hrtimer_cpu_base *base) { }
 static inline void retrigger_next_event(void *arg) { }
+static inline void hrtimer_coalesce(struct hrtimer *timer,
+				    struct hrtimer_clock_base *base) { }
 
 #endif /* CONFIG_HIGH_RES_TIMERS */
 
@@ -975,6 +1021,7 @@ int __hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 	}
 
 	hrtimer_set_expires_range_ns(timer, tim, delta_ns);
+	hrtimer_coalesce(timer, new_base);
 
 	timer_stats_hrtimer_set_start_info(timer);
 
@@ -1260,10 +1307,13 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 {
 	struct hrtimer_cpu_base *cpu_base = &__get_cpu_var(hrtimer_bases);
 	ktime_t expires_next, now, entry_time, delta;
-	int i, retries = 0;
+	int i, retries = 0, expired = 0;
+	bool idle = is_idle_task(current);
 
 	BUG_ON(!cpu_base->hres_active);
 	cpu_base->nr_events++;
+	if (idle)
+		cpu_base->nr_idle_wakeups++;
 	dev->next_event.tv64 = KTIME_MAX;
 
 	raw_spin_lock(&cpu_base->lock);
@@ -1319,6 +1369,7 @@ retry:
 			}
 
 			__run_hrtimer(timer, &basenow);
+			expired++;
 		}
 	}
 
@@ -1327,6 +1378,9 @@ retry:
 	 * against it.
 	 */
 	cpu_base->expires_next = expires_next;
+	if (idle)
+		cpu_base->nr_idle_timers += expired;
+	expired = 0;
 	raw_spin_unlock(&cpu_base->lock);
 
 	/* Reprogramming necessary ? */
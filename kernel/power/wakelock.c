@@ -21,6 +21,7 @@
 #include <linux/wakelock.h>
 #ifdef CONFIG_WAKELOCK_STAT
 #include <linux/proc_fs.h>
+#include <linux/debugfs.h>
 #endif
 #ifdef CONFIG_FAST_BOOT
 #include <linux/delay.h>
@@ -41,12 +42,17 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 #define WAKE_LOCK_INITIALIZED            (1U << 8)
 #define WAKE_LOCK_ACTIVE                 (1U << 9)
 #define WAKE_LOCK_AUTO_EXPIRE            (1U << 10)
-#define WAKE_LOCK_PREVENTING_SUSPEND     (1U << 11)
 #define WAKE_LOCK_AWAKE_CULPRIT          (1U << 12)
 
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
+/*
+ * Active locks without a timeout sit on active_wake_locks[], newest first.
+ * Active locks with a timeout sit in expire_tree[] instead, ordered by
+ * expiry, so the next and the last expiry are found without a list walk.
+ */
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+static struct rb_root expire_tree[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct workqueue_struct *sync_work_queue;
@@ -61,7 +67,46 @@ static struct wake_lock suspend_backoff_lock;
 
 static unsigned suspend_short_count;
 
+static struct wake_lock *expire_tree_entry(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct wake_lock, expire_node) : NULL;
+}
+
+static void expire_tree_insert_locked(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &expire_tree[type].rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		parent = *p;
+		if (time_before(lock->expires, expire_tree_entry(parent)->expires))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&lock->expire_node, parent, p);
+	rb_insert_color(&lock->expire_node, &expire_tree[type]);
+}
+
+/* Take the lock off whichever active list, tree or inactive list holds it */
+static void wake_lock_unlink_locked(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if ((lock->flags & WAKE_LOCK_ACTIVE) &&
+	    (lock->flags & WAKE_LOCK_AUTO_EXPIRE))
+		rb_erase(&lock->expire_node, &expire_tree[type]);
+	else
+		list_del(&lock->link);
+}
+
 #ifdef CONFIG_WAKELOCK_STAT
+static int no_active_locks(int type)
+{
+	return list_empty(&active_wake_locks[type]) &&
+		RB_EMPTY_ROOT(&expire_tree[type]);
+}
+
 static struct wake_lock deleted_wake_locks;
 #define MAX_DELETED_WAKE_LOCK_NAME 48
 static struct wake_lock deleted_wake_lock1;
@@ -69,6 +114,13 @@ static char deleted_wake_lock1_name[MAX_DELETED_WAKE_LOCK_NAME];
 static struct wake_lock deleted_wake_lock2;
 static char deleted_wake_lock2_name[MAX_DELETED_WAKE_LOCK_NAME];
 static ktime_t last_sleep_time_update;
+/*
+ * Total time spent with main unlocked, that is with the system kept awake
+ * only by other suspend locks, up to last_sleep_time_update. An active
+ * suspend lock is charged the growth of this clock between its lock and
+ * unlock, so main changing state does not have to visit every lock.
+ */
+static ktime_t sleep_wait_time;
 static int wait_for_wakeup;
 
 static int default_stats = 0; // 0 - total; 1 - discrete
@@ -97,6 +149,48 @@ int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 }
 
 
+static ktime_t sleep_wait_clock(ktime_t now)
+{
+	if (wake_lock_active(&main_wake_lock) ||
+	    now.tv64 < last_sleep_time_update.tv64)
+		return sleep_wait_time;
+	return ktime_add(sleep_wait_time,
+			 ktime_sub(now, last_sleep_time_update));
+}
+
+/* Must be called before main_wake_lock changes state */
+static void update_sleep_wait_stats_locked(void)
+{
+	ktime_t now = ktime_get();
+
+	sleep_wait_time = sleep_wait_clock(now);
+	last_sleep_time_update = now;
+}
+
+static void start_prevent_suspend_locked(struct wake_lock *lock, int discrete)
+{
+	ktime_t start = sleep_wait_clock(ktime_get());
+
+	if (discrete)
+		lock->discrete_stat.prevent_suspend_start = start;
+	else
+		lock->stat.prevent_suspend_start = start;
+}
+
+/* prevent_suspend_time of an active lock, including its running interval */
+static ktime_t prevent_suspend_time_at(struct wake_lock *lock, int discrete,
+				       ktime_t now)
+{
+	ktime_t total = discrete ? lock->discrete_stat.prevent_suspend_time
+				 : lock->stat.prevent_suspend_time;
+	ktime_t start = discrete ? lock->discrete_stat.prevent_suspend_start
+				 : lock->stat.prevent_suspend_start;
+
+	if ((lock->flags & WAKE_LOCK_TYPE_MASK) != WAKE_LOCK_SUSPEND)
+		return total;
+	return ktime_add(total, ktime_sub(sleep_wait_clock(now), start));
+}
+
 static int print_lock_stat(struct seq_file *m, struct wake_lock *lock, int stats_type)
 {
 	int lock_count = stats_type ? lock->discrete_stat.count : lock->stat.count;
@@ -121,9 +215,7 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock, int stats
 		else
 			expire_count++;
 		total_time = ktime_add(total_time, add_time);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
-			prevent_suspend_time = ktime_add(prevent_suspend_time,
-					ktime_sub(now, last_sleep_time_update));
+		prevent_suspend_time = prevent_suspend_time_at(lock, stats_type, now);
 		if (add_time.tv64 > max_time.tv64)
 			max_time = add_time;
 	}
@@ -137,23 +229,33 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock, int stats
 		     ktime_to_ns(stats_type ? lock->discrete_stat.last_time : lock->stat.last_time));
 }
 
-static int wakelock_stats_show_total(struct seq_file *m, void *unused)
+/* Caller must acquire the list_lock spinlock */
+static void for_each_wake_lock_locked(struct seq_file *m, int arg,
+		int (*show)(struct seq_file *m, struct wake_lock *lock, int arg))
 {
-	unsigned long irqflags;
 	struct wake_lock *lock;
-	int ret;
+	struct rb_node *node;
 	int type;
 
-	spin_lock_irqsave(&list_lock, irqflags);
-
-	ret = seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
-			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
 	list_for_each_entry(lock, &inactive_locks, link)
-		ret = print_lock_stat(m, lock, 0);
+		show(m, lock, arg);
 	for (type = 0; type < WAKE_LOCK_TYPE_COUNT; type++) {
 		list_for_each_entry(lock, &active_wake_locks[type], link)
-			ret = print_lock_stat(m, lock, 0);
+			show(m, lock, arg);
+		for (node = rb_first(&expire_tree[type]); node; node = rb_next(node))
+			show(m, expire_tree_entry(node), arg);
 	}
+}
+
+static int wakelock_stats_show_total(struct seq_file *m, void *unused)
+{
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+
+	seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
+			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
+	for_each_wake_lock_locked(m, 0, print_lock_stat);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 	return 0;
 }
@@ -161,20 +263,60 @@ static int wakelock_stats_show_total(struct seq_file *m, void *unused)
 static int wakelock_stats_show_discrete(struct seq_file *m, void *unused)
 {
 	unsigned long irqflags;
-	struct wake_lock *lock;
-	int ret;
-	int type;
 
 	spin_lock_irqsave(&list_lock, irqflags);
 
-	ret = seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
+	seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
 			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
-	list_for_each_entry(lock, &inactive_locks, link)
-		ret = print_lock_stat(m, lock, 1);
-	for (type = 0; type < WAKE_LOCK_TYPE_COUNT; type++) {
-		list_for_each_entry(lock, &active_wake_locks[type], link)
-			ret = print_lock_stat(m, lock, 1);
+	for_each_wake_lock_locked(m, 1, print_lock_stat);
+	spin_unlock_irqrestore(&list_lock, irqflags);
+	return 0;
+}
+
+/*
+ * One line per lock for the debugfs file: how often it woke the system
+ * and how long it kept it awake, in total and while it was the culprit.
+ */
+static int print_lock_wakeup_source(struct seq_file *m, struct wake_lock *lock,
+				    int unused)
+{
+	ktime_t prevent_suspend_time = lock->stat.prevent_suspend_time;
+	ktime_t culprit_time = lock->discrete_stat.prevent_suspend_time;
+	long expires_in = 0;
+
+	if (lock->flags & WAKE_LOCK_ACTIVE) {
+		ktime_t now;
+
+		if (!get_expired_time(lock, &now))
+			now = ktime_get();
+		prevent_suspend_time = prevent_suspend_time_at(lock, 0, now);
+		if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT)
+			culprit_time = prevent_suspend_time_at(lock, 1, now);
+		if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
+		    (long)(lock->expires - jiffies) > 0)
+			expires_in = jiffies_to_msecs(lock->expires - jiffies);
 	}
+
+	return seq_printf(m, "\"%s\"\t%s\t%d\t%d\t%d\t%d\t%lld\t%lld\t%ld\n",
+			  lock->name,
+			  (lock->flags & WAKE_LOCK_TYPE_MASK) == WAKE_LOCK_IDLE ?
+			  "idle" : "suspend",
+			  !!(lock->flags & WAKE_LOCK_ACTIVE),
+			  lock->stat.count, lock->stat.wakeup_count,
+			  lock->discrete_stat.wakeup_count,
+			  ktime_to_ns(prevent_suspend_time),
+			  ktime_to_ns(culprit_time), expires_in);
+}
+
+static int wakeup_sources_show(struct seq_file *m, void *unused)
+{
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	seq_puts(m, "name\ttype\tactive\tcount\twakeup_count"
+			"\tculprit_wakeup_count\tprevent_suspend_time"
+			"\tculprit_prevent_suspend_time\texpires_in_ms\n");
+	for_each_wake_lock_locked(m, 0, print_lock_wakeup_source);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 	return 0;
 }
@@ -199,6 +341,7 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
 	lock->stat.last_time = ktime_get();
+	lock->stat.prevent_suspend_time = prevent_suspend_time_at(lock, 0, now);
 	if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT) {
 		lock->discrete_stat.count++;
 		if (expired)
@@ -207,90 +350,30 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 		if (ktime_to_ns(discrete_duration) > ktime_to_ns(lock->discrete_stat.max_time))
 			lock->discrete_stat.max_time = discrete_duration;
 		lock->discrete_stat.last_time = ktime_get();
-	}
-	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
-		lock->stat.prevent_suspend_time = ktime_add(
-			lock->stat.prevent_suspend_time, duration);
-		if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT) {
-			discrete_duration = ktime_sub(now, last_sleep_time_update);
-			lock->discrete_stat.prevent_suspend_time = ktime_add(
-				lock->discrete_stat.prevent_suspend_time, discrete_duration);
-		}
-		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
+		lock->discrete_stat.prevent_suspend_time =
+			prevent_suspend_time_at(lock, 1, now);
 	}
 }
 
-static void update_sleep_wait_stats_locked(int done)
-{
-	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
-	int expired;
-
-	now = ktime_get();
-	elapsed = ktime_sub(now, last_sleep_time_update);
-	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
-		expired = get_expired_time(lock, &etime);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-			if (expired)
-				add = ktime_sub(etime, last_sleep_time_update);
-			else
-				add = elapsed;
-			lock->stat.prevent_suspend_time = ktime_add(
-				lock->stat.prevent_suspend_time, add);
-			if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT) {
-				lock->discrete_stat.prevent_suspend_time = ktime_add(
-					lock->discrete_stat.prevent_suspend_time, add);
-			}
-		}
-		if (done || expired)
-			lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-		else
-			lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
-	}
-	last_sleep_time_update = now;
-}
-
 static void assign_next_awake_culprit_locked(void)
 {
-	struct wake_lock *lock;
+	struct list_head *active = &active_wake_locks[WAKE_LOCK_SUSPEND];
 	struct wake_lock *candidate_lock;
-	long timeout;
-	long max_timeout;
-
-	candidate_lock = NULL;
-	max_timeout = 0;
-	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
-		if (!(lock->flags & WAKE_LOCK_AUTO_EXPIRE)) {
-			// Out of the non-expiring locks, prefer the oldest inserted ones (further in the list)
-			candidate_lock = lock;
-			max_timeout = -1;
-		} else {
-			if (candidate_lock && (max_timeout < 0))
-				// Already chose the 1st non-expiring lock, use it
-				break;
-
-			// For the expiring locks, select the one with a greater expiration timeout
-			timeout = lock->expires - jiffies;
-			if ((timeout > 0) && (timeout > max_timeout)) {
-				max_timeout = timeout;
-				candidate_lock = lock;
-				// Continue searching for a lock with greater expiration timeout
-			}
-		}
-	}
+
+	// Out of the non-expiring locks, prefer the oldest inserted one (tail of the list),
+	// otherwise take the expiring lock with the greatest expiration timeout
+	if (!list_empty(active))
+		candidate_lock = list_entry(active->prev, struct wake_lock, link);
+	else
+		candidate_lock = expire_tree_entry(rb_last(&expire_tree[WAKE_LOCK_SUSPEND]));
+	if (candidate_lock && (candidate_lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
+	    (long)(candidate_lock->expires - jiffies) <= 0)
+		candidate_lock = NULL;
+
 	if (candidate_lock) {
-		// Account PREVENTING_SUSPEND time before assigning new culprit
-		if (wake_lock_active(&main_wake_lock)) {
-			// Update times but keep all active locks as *not* PREVENTING_SUSPEND, "main" is active
-			update_sleep_wait_stats_locked(1);
-		} else {
-			// Update times and set all active locks as PREVENTING_SUSPEND, "main" is not active and the device
-			// could be sleeping
-			update_sleep_wait_stats_locked(0);
-		}
 		// Set now as the last_time of the culprit
 		candidate_lock->discrete_stat.last_time = ktime_get();
+		start_prevent_suspend_locked(candidate_lock, 1);
 		// Assign new culprit
 		candidate_lock->flags |= WAKE_LOCK_AWAKE_CULPRIT;
 		if (debug_mask & DEBUG_WAKE_LOCK)
@@ -305,8 +388,8 @@ static void expire_wake_lock(struct wake_lock *lock)
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
+	wake_lock_unlink_locked(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
 	if (debug_mask & (DEBUG_WAKE_LOCK | DEBUG_EXPIRE))
 		pr_info("expired wake lock %s\n", lock->name);
@@ -322,55 +405,42 @@ static void expire_wake_lock(struct wake_lock *lock)
 static void print_active_locks(int type)
 {
 	struct wake_lock *lock;
+	struct rb_node *node;
 	bool print_expired = true;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
 	list_for_each_entry(lock, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout > 0)
-				pr_info("active wake lock %s, time left %ld\n",
-					lock->name, timeout);
-			else if (print_expired)
-				pr_info("wake lock %s, expired\n", lock->name);
-		} else {
-			pr_info("active wake lock %s\n", lock->name);
-			if (!(debug_mask & DEBUG_EXPIRE))
-				print_expired = false;
-		}
+		pr_info("active wake lock %s\n", lock->name);
+		if (!(debug_mask & DEBUG_EXPIRE))
+			print_expired = false;
+	}
+	for (node = rb_first(&expire_tree[type]); node; node = rb_next(node)) {
+		long timeout;
+
+		lock = expire_tree_entry(node);
+		timeout = lock->expires - jiffies;
+		if (timeout > 0)
+			pr_info("active wake lock %s, time left %ld\n",
+				lock->name, timeout);
+		else if (print_expired)
+			pr_info("wake lock %s, expired\n", lock->name);
 	}
 }
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct wake_lock *lock;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			max_timeout = -1;
+	while ((lock = expire_tree_entry(rb_first(&expire_tree[type])))) {
+		if ((long)(lock->expires - jiffies) > 0)
 			break;
+		expire_wake_lock(lock);
 	}
-#ifdef CONFIG_WAKELOCK_STAT
-	// Remove the AWAKE_CULPRIT ownership from any expired wake lock
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) && (lock->flags & WAKE_LOCK_AWAKE_CULPRIT)) {
-			if ((lock->expires - jiffies) <= 0) {
-				// Mark the culprit as expired (and select a new one in the process)
-				expire_wake_lock(lock);
-				break;
-			}
-		}
-	}
-#endif
-	return max_timeout;
+	if (!list_empty(&active_wake_locks[type]))
+		return -1;
+	lock = expire_tree_entry(rb_last(&expire_tree[type]));
+	return lock ? lock->expires - jiffies : 0;
 }
 #ifdef CONFIG_FAST_BOOT
 extern bool fake_shut_down;
@@ -457,6 +527,41 @@ static void suspend(struct work_struct *work)
 }
 static DECLARE_WORK(suspend_work, suspend);
 
+static void expire_wake_locks(unsigned long data);
+static DEFINE_TIMER(expire_timer, expire_wake_locks, 0, 0);
+
+/*
+ * Expire the suspend locks that are due, point the timer at the next
+ * expiry and queue a suspend if nothing is left. While a lock without
+ * timeout is held the timer stays off: the timed locks behind it are
+ * expired when it goes, and their statistics are only charged up to
+ * their expiry anyway. Returns has_wake_lock_locked().
+ */
+static long update_expire_timer_locked(const char *caller,
+				       struct wake_lock *lock)
+{
+	long has_lock = has_wake_lock_locked(WAKE_LOCK_SUSPEND);
+	struct wake_lock *next = NULL;
+
+	if (has_lock > 0)
+		next = expire_tree_entry(
+			rb_first(&expire_tree[WAKE_LOCK_SUSPEND]));
+	if (next) {
+		if (debug_mask & DEBUG_EXPIRE)
+			pr_info("%s: %s, start expire timer, %ld\n", caller,
+				lock->name, (long)(next->expires - jiffies));
+		mod_timer(&expire_timer, next->expires);
+	} else {
+		if (del_timer(&expire_timer))
+			if (debug_mask & DEBUG_EXPIRE)
+				pr_info("%s: %s, stop expire timer\n", caller,
+					lock->name);
+	}
+	if (has_lock == 0)
+		queue_work(suspend_work_queue, &suspend_work);
+	return has_lock;
+}
+
 static void expire_wake_locks(unsigned long data)
 {
 	long has_lock;
@@ -466,14 +571,12 @@ static void expire_wake_locks(unsigned long data)
 	spin_lock_irqsave(&list_lock, irqflags);
 	if (debug_mask & DEBUG_SUSPEND)
 		print_active_locks(WAKE_LOCK_SUSPEND);
-	has_lock = has_wake_lock_locked(WAKE_LOCK_SUSPEND);
+	has_lock = update_expire_timer_locked("expire_wake_locks",
+					      &main_wake_lock);
 	if (debug_mask & DEBUG_EXPIRE)
 		pr_info("expire_wake_locks: done, has_lock %ld\n", has_lock);
-	if (has_lock == 0)
-		queue_work(suspend_work_queue, &suspend_work);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
-static DEFINE_TIMER(expire_timer, expire_wake_locks, 0, 0);
 
 static int power_suspend_late(struct device *dev)
 {
@@ -514,6 +617,7 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->stat.wakeup_count = 0;
 	lock->stat.total_time = ktime_set(0, 0);
 	lock->stat.prevent_suspend_time = ktime_set(0, 0);
+	lock->stat.prevent_suspend_start = ktime_set(0, 0);
 	lock->stat.max_time = ktime_set(0, 0);
 	lock->stat.last_time = ktime_set(0, 0);
 	lock->discrete_stat.count = 0;
@@ -521,6 +625,7 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->discrete_stat.wakeup_count = 0;
 	lock->discrete_stat.total_time = ktime_set(0, 0);
 	lock->discrete_stat.prevent_suspend_time = ktime_set(0, 0);
+	lock->discrete_stat.prevent_suspend_start = ktime_set(0, 0);
 	lock->discrete_stat.max_time = ktime_set(0, 0);
 	lock->discrete_stat.last_time = ktime_set(0, 0);
 #endif
@@ -536,15 +641,18 @@ EXPORT_SYMBOL(wake_lock_init);
 void wake_lock_destroy(struct wake_lock *lock)
 {
 	unsigned long irqflags;
+	int active_suspend;
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
 	lock->flags &= ~WAKE_LOCK_INITIALIZED;
+	active_suspend = (lock->flags & WAKE_LOCK_ACTIVE) &&
+		(lock->flags & WAKE_LOCK_TYPE_MASK) == WAKE_LOCK_SUSPEND;
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT) {
 		lock->flags &= ~WAKE_LOCK_AWAKE_CULPRIT;
+		wake_lock_unlink_locked(lock);
 		lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-		list_del(&lock->link);
 		list_add(&lock->link, &inactive_locks);
 		assign_next_awake_culprit_locked();
 	}
@@ -624,7 +732,10 @@ void wake_lock_destroy(struct wake_lock *lock)
 		deleted_wake_lock1.discrete_stat.max_time = ktime_add(zero_time, lock->discrete_stat.max_time);
 	}
 #endif
-	list_del(&lock->link);
+	wake_lock_unlink_locked(lock);
+	/* it may have been the last lock keeping the expire timer off */
+	if (active_suspend)
+		update_expire_timer_locked("wake_lock_destroy", lock);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 EXPORT_SYMBOL(wake_lock_destroy);
@@ -634,14 +745,16 @@ static void wake_lock_internal(
 {
 	int type;
 	unsigned long irqflags;
-	long expire_in;
 
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
 	BUG_ON(!(lock->flags & WAKE_LOCK_INITIALIZED));
+	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
+	    (long)(lock->expires - jiffies) <= 0)
+		expire_wake_lock(lock);
 #ifdef CONFIG_WAKELOCK_STAT
-	if ((type == WAKE_LOCK_SUSPEND) && list_empty(&active_wake_locks[type])) {
+	if ((type == WAKE_LOCK_SUSPEND) && no_active_locks(type)) {
 		lock->flags |= WAKE_LOCK_AWAKE_CULPRIT;
 	}
 	if (type == WAKE_LOCK_SUSPEND && wait_for_wakeup) {
@@ -652,23 +765,21 @@ static void wake_lock_internal(
 		if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT)
 			lock->discrete_stat.wakeup_count++;
 	}
-	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
-	    (long)(lock->expires - jiffies) <= 0) {
-		wake_unlock_stat_locked(lock, 0);
-		lock->stat.last_time = ktime_get();
-		if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT)
-			lock->discrete_stat.last_time = ktime_get();
-	}
+	if (lock == &main_wake_lock)
+		update_sleep_wait_stats_locked();
 #endif
+	wake_lock_unlink_locked(lock);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
 		lock->stat.last_time = ktime_get();
-		if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT)
+		start_prevent_suspend_locked(lock, 0);
+		if (lock->flags & WAKE_LOCK_AWAKE_CULPRIT) {
 			lock->discrete_stat.last_time = ktime_get();
+			start_prevent_suspend_locked(lock, 1);
+		}
 #endif
 	}
-	list_del(&lock->link);
 	if (has_timeout) {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d, timeout %ld.%03lu\n",
@@ -676,7 +787,7 @@ static void wake_lock_internal(
 				(timeout % HZ) * MSEC_PER_SEC / HZ);
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
-		list_add_tail(&lock->link, &active_wake_locks[type]);
+		expire_tree_insert_locked(lock, type);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
@@ -686,29 +797,7 @@ static void wake_lock_internal(
 	}
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
-#ifdef CONFIG_WAKELOCK_STAT
-		if (lock == &main_wake_lock)
-			update_sleep_wait_stats_locked(1);
-		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
-#endif
-		if (has_timeout)
-			expire_in = has_wake_lock_locked(type);
-		else
-			expire_in = -1;
-		if (expire_in > 0) {
-			if (debug_mask & DEBUG_EXPIRE)
-				pr_info("wake_lock: %s, start expire timer, "
-					"%ld\n", lock->name, expire_in);
-			mod_timer(&expire_timer, jiffies + expire_in);
-		} else {
-			if (del_timer(&expire_timer))
-				if (debug_mask & DEBUG_EXPIRE)
-					pr_info("wake_lock: %s, stop expire timer\n",
-						lock->name);
-			if (expire_in == 0)
-				queue_work(suspend_work_queue, &suspend_work);
-		}
+		update_expire_timer_locked("wake_lock", lock);
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
@@ -729,44 +818,40 @@ void wake_unlock(struct wake_lock *lock)
 {
 	int type;
 	unsigned long irqflags;
+
+	if (debug_mask & DEBUG_WAKE_LOCK)
+		pr_info("wake_unlock: %s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
+	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
+		/*
+		 * Nothing to account, but suspend is still re-evaluated as
+		 * it always was: this is also how expired locks get noticed.
+		 */
+		if (type == WAKE_LOCK_SUSPEND)
+			update_expire_timer_locked("wake_unlock", lock);
+		goto out;
+	}
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 0);
+	if (lock == &main_wake_lock)
+		update_sleep_wait_stats_locked();
 #endif
-	if (debug_mask & DEBUG_WAKE_LOCK)
-		pr_info("wake_unlock: %s\n", lock->name);
+	wake_lock_unlink_locked(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
 	if (type == WAKE_LOCK_SUSPEND) {
-		long has_lock = has_wake_lock_locked(type);
-		if (has_lock > 0) {
-			if (debug_mask & DEBUG_EXPIRE)
-				pr_info("wake_unlock: %s, start expire timer, "
-					"%ld\n", lock->name, has_lock);
-			mod_timer(&expire_timer, jiffies + has_lock);
-		} else {
-			if (del_timer(&expire_timer))
-				if (debug_mask & DEBUG_EXPIRE)
-					pr_info("wake_unlock: %s, stop expire "
-						"timer\n", lock->name);
-			if (has_lock == 0)
-				queue_work(suspend_work_queue, &suspend_work);
-		}
-		if (lock == &main_wake_lock) {
-			if (debug_mask & DEBUG_SUSPEND)
-				print_active_locks(WAKE_LOCK_SUSPEND);
-#ifdef CONFIG_WAKELOCK_STAT
-			update_sleep_wait_stats_locked(0);
-#endif
-		}
+		long has_lock = update_expire_timer_locked("wake_unlock", lock);
+
+		if (lock == &main_wake_lock && (debug_mask & DEBUG_SUSPEND))
+			print_active_locks(WAKE_LOCK_SUSPEND);
 #ifdef CONFIG_WAKELOCK_STAT
 		if (has_lock && (lock->flags & WAKE_LOCK_AWAKE_CULPRIT))
 			assign_next_awake_culprit_locked();
 		lock->flags &= ~WAKE_LOCK_AWAKE_CULPRIT;
 #endif
 	}
+out:
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 EXPORT_SYMBOL(wake_unlock);
@@ -839,13 +924,30 @@ static const struct file_operations wakelock_discrete_stats_fops = {
 	.release = single_release,
 };
 
+static int wakeup_sources_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wakeup_sources_show, NULL);
+}
+
+static const struct file_operations wakeup_sources_fops = {
+	.owner = THIS_MODULE,
+	.open = wakeup_sources_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct dentry *wakeup_sources_dentry;
+
 static int __init wakelocks_init(void)
 {
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		expire_tree[i] = RB_ROOT;
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -889,6 +991,8 @@ static int __init wakelocks_init(void)
 	proc_create("wakelocks", S_IRUGO, NULL, &wakelock_stats_fops);
 	proc_create("wakelocks_total", S_IRUGO, NULL, &wakelock_total_stats_fops);
 	proc_create("wakelocks_discrete", S_IRUGO, NULL, &wakelock_discrete_stats_fops);
+	wakeup_sources_dentry = debugfs_create_file("wakelocks", S_IRUGO, NULL,
+						    NULL, &wakeup_sources_fops);
 #endif
 
 	return 0;
@@ -915,6 +1019,7 @@ err_platform_device_register:
 static void  __exit wakelocks_exit(void)
 {
 #ifdef CONFIG_WAKELOCK_STAT
+	debugfs_remove(wakeup_sources_dentry);
 	remove_proc_entry("wakelocks_discrete", NULL);
 	remove_proc_entry("wakelocks_total", NULL);
 	remove_proc_entry("wakelocks", NULL);
@@ -41,6 +41,8 @@
 #include <linux/cpu.h>
 #include <linux/notifier.h>
 #include <linux/rculist.h>
+#include <linux/kthread.h>
+#include <linux/kallsyms.h>
 
 #include <asm/uaccess.h>
 #include <mach/sec_debug.h>
@@ -101,12 +103,16 @@ EXPORT_SYMBOL_GPL(console_drivers);
 static int console_locked, console_suspended;
 
 /*
- * logbuf_lock protects log_buf, log_start, log_end, con_start and logged_chars
+ * logbuf_lock protects log_buf, log_start, log_end, con_start, memory_con_start
+ * and logged_chars
  * It is also used in interesting ways to provide interlocking in
  * console_unlock();.
  */
 static DEFINE_RAW_SPINLOCK(logbuf_lock);
 
+/* Move messages printk() left in its record ring into log_buf */
+static void printk_rec_drain(void);
+
 #define LOG_BUF_MASK (log_buf_len-1)
 #define LOG_BUF(idx) (log_buf[(idx) & LOG_BUF_MASK])
 
@@ -116,8 +122,16 @@ static DEFINE_RAW_SPINLOCK(logbuf_lock);
  */
 static unsigned log_start;	/* Index into log_buf: next char to be read by syslog() */
 static unsigned con_start;	/* Index into log_buf: next char to be sent to consoles */
+static unsigned memory_con_start; /* Same, for CON_MEMORY consoles */
 static unsigned log_end;	/* Index into log_buf: most-recently-written-char + 1 */
 
+static int memory_consoles;	/* Number of registered CON_MEMORY consoles */
+/* Set by the console_sem holder for console_unlock() to skip the others */
+static int console_memory_only;
+
+/* Most chars handed to the other consoles at once by console_unlock() */
+#define CONSOLE_CHUNK	512
+
 /*
  * If exclusive_console is non-NULL then only this console is to be printed to.
  */
@@ -147,6 +161,21 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/*
+ * Delayed printk facility, for scheduler-internal messages:
+ */
+#define PRINTK_BUF_SIZE		512
+
+#define PRINTK_PENDING_WAKEUP	0x01
+#define PRINTK_PENDING_SCHED	0x02
+#define PRINTK_PENDING_CONSOLE	0x04
+
+static DEFINE_PER_CPU(int, printk_pending);
+static DEFINE_PER_CPU(char [PRINTK_BUF_SIZE], printk_sched_buf);
+
+/* the console thread waits here for deferred console output */
+static DECLARE_WAIT_QUEUE_HEAD(printk_console_wait);
+
 #ifdef CONFIG_PRINTK
 
 static char __log_buf[__LOG_BUF_LEN] __nosavedata;
@@ -230,7 +259,7 @@ void __init setup_log_buf(int early)
 	new_log_buf_len = 0;
 	free = __LOG_BUF_LEN - log_end;
 
-	offset = start = min(con_start, log_start);
+	offset = start = min(min(con_start, memory_con_start), log_start);
 	dest_idx = 0;
 	while (start != log_end) {
 		unsigned log_idx_mask = start & (__LOG_BUF_LEN - 1);
@@ -241,6 +270,7 @@ void __init setup_log_buf(int early)
 	}
 	log_start -= offset;
 	con_start -= offset;
+	memory_con_start -= offset;
 	log_end -= offset;
 	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
 
@@ -336,6 +366,7 @@ int log_buf_copy(char *dest, int idx, int len)
 		sec_debug_aux_log(SEC_DEBUG_AUXLOG_LOGBUF_LOCK_CHANGE,
 			"- %s: spin_lock_irq logbuf_lock", __func__);
 #endif
+		printk_rec_drain();
 		took_lock = true;
 	}
 
@@ -441,6 +472,7 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 		sec_debug_aux_log(SEC_DEBUG_AUXLOG_LOGBUF_LOCK_CHANGE,
 			"- %s: spin_lock_irq logbuf_lock", __func__);
 #endif
+		printk_rec_drain();
 		while (!error && (log_start != log_end) && i < len) {
 			c = LOG_BUF(log_start);
 			log_start++;
@@ -491,6 +523,7 @@ int do_syslog(int type, char __user *buf, int len, bool from_file)
 		sec_debug_aux_log(SEC_DEBUG_AUXLOG_LOGBUF_LOCK_CHANGE,
 			"- %s: spin_lock_irq logbuf_lock", __func__);
 #endif
+		printk_rec_drain();
 		if (count > logged_chars)
 			count = logged_chars;
 		if (do_clear)
@@ -604,14 +637,18 @@ void kdb_syslog_data(char *syslog_data[4])
 #endif	/* CONFIG_KGDB_KDB */
 
 /*
- * Call the console drivers on a range of log_buf
+ * Call the console drivers on a range of log_buf. CON_MEMORY consoles
+ * (ram_console, pstore) have a pass of their own, see console_unlock().
  */
-static void __call_console_drivers(unsigned start, unsigned end)
+static void __call_console_drivers(unsigned start, unsigned end, bool memory)
 {
 	struct console *con;
 
 	for_each_console(con) {
-		if (exclusive_console && con != exclusive_console)
+		if (!!(con->flags & CON_MEMORY) != memory)
+			continue;
+		if (exclusive_console && con != exclusive_console &&
+		    !!(exclusive_console->flags & CON_MEMORY) == memory)
 			continue;
 		if ((con->flags & CON_ENABLED) && con->write &&
 				(cpu_online(smp_processor_id()) ||
@@ -636,17 +673,17 @@ early_param("ignore_loglevel", ignore_loglevel_setup);
  * Write out chars from start to end - 1 inclusive
  */
 static void _call_console_drivers(unsigned start,
-				unsigned end, int msg_log_level)
+				unsigned end, int msg_log_level, bool memory)
 {
 	if ((msg_log_level < console_loglevel || ignore_loglevel) &&
 			console_drivers && start != end) {
 		if ((start & LOG_BUF_MASK) > (end & LOG_BUF_MASK)) {
 			/* wrapped write */
 			__call_console_drivers(start & LOG_BUF_MASK,
-						log_buf_len);
-			__call_console_drivers(0, end & LOG_BUF_MASK);
+						log_buf_len, memory);
+			__call_console_drivers(0, end & LOG_BUF_MASK, memory);
 		} else {
-			__call_console_drivers(start, end);
+			__call_console_drivers(start, end, memory);
 		}
 	}
 }
@@ -721,10 +758,11 @@ static size_t log_prefix(const char *p, unsigned int *level, char *special)
  * log_buf[start] to log_buf[end - 1].
  * The console_lock must be held.
  */
-static void call_console_drivers(unsigned start, unsigned end)
+static void call_console_drivers(unsigned start, unsigned end, bool memory)
 {
 	unsigned cur_index, start_print;
-	static int msg_level = -1;
+	static int msg_levels[2] = { -1, -1 };
+	int msg_level = msg_levels[memory];
 
 	BUG_ON(((int)(start - end)) > 0);
 
@@ -761,14 +799,16 @@ static void call_console_drivers(unsigned start, unsigned end)
 					 */
 					msg_level = default_message_loglevel;
 				}
-				_call_console_drivers(start_print, cur_index, msg_level);
+				_call_console_drivers(start_print, cur_index,
+						      msg_level, memory);
 				msg_level = -1;
 				start_print = cur_index;
 				break;
 			}
 		}
 	}
-	_call_console_drivers(start_print, end, msg_level);
+	_call_console_drivers(start_print, end, msg_level, memory);
+	msg_levels[memory] = msg_level;
 }
 
 #ifdef CONFIG_SEC_LOG
@@ -808,6 +848,8 @@ static void emit_log_char(char c)
 		log_start = log_end - log_buf_len;
 	if (log_end - con_start > log_buf_len)
 		con_start = log_end - log_buf_len;
+	if (log_end - memory_con_start > log_buf_len)
+		memory_con_start = log_end - log_buf_len;
 	if (logged_chars < log_buf_len)
 		logged_chars++;
 
@@ -859,6 +901,9 @@ static bool printk_pid;
 #endif
 module_param_named(pid, printk_pid, bool, S_IRUGO | S_IWUSR);
 
+static bool printk_caller;
+module_param_named(caller, printk_caller, bool, S_IRUGO | S_IWUSR);
+
 
 /* Check if we have any console registered that can be called early in boot. */
 static int have_callable_console(void)
@@ -884,6 +929,9 @@ static int have_callable_console(void)
  * notice the new output in console_unlock(); and will send it to the
  * consoles before releasing the lock.
  *
+ * Once the "kconsole" thread is up, console output is left to it instead,
+ * unless oopsing, going down or booted with printk.synchronous=1.
+ *
  * One effect of this deferred printing is that code which calls printk() and
  * then changes console_loglevel may break. This is because console_loglevel
  * is inspected when the actual printing occurs.
@@ -894,6 +942,8 @@ static int have_callable_console(void)
  * See the vsnprintf() documentation for format string extensions over C99.
  */
 
+static int vprintk_emit(const char *fmt, va_list args, unsigned long caller);
+
 asmlinkage int printk(const char *fmt, ...)
 {
 	va_list args;
@@ -908,15 +958,12 @@ asmlinkage int printk(const char *fmt, ...)
 	}
 #endif
 	va_start(args, fmt);
-	r = vprintk(fmt, args);
+	r = vprintk_emit(fmt, args, _RET_IP_);
 	va_end(args);
 
 	return r;
 }
 
-/* cpu currently holding logbuf_lock */
-static volatile unsigned int printk_cpu = UINT_MAX;
-
 /*
  * Can we actually use the console at this time on this cpu?
  *
@@ -936,12 +983,9 @@ static inline int can_use_console(unsigned int cpu)
  * console_lock held, and 'console_locked' set) if it
  * is successful, false otherwise.
  *
- * This gets called with the 'logbuf_lock' spinlock held and
- * interrupts disabled. It should return with 'lockbuf_lock'
- * released but interrupts still disabled.
+ * This gets called with interrupts disabled.
  */
 static int console_trylock_for_printk(unsigned int cpu)
-	__releases(&logbuf_lock)
 {
 	int retval = 0, wake = 0;
 
@@ -960,8 +1004,6 @@ static int console_trylock_for_printk(unsigned int cpu)
 			retval = 0;
 		}
 	}
-	printk_cpu = UINT_MAX;
-	raw_spin_unlock(&logbuf_lock);
 	if (wake)
 		up(&console_sem);
 	return retval;
@@ -970,91 +1012,228 @@ static const char recursion_bug_msg [] =
 		KERN_CRIT "BUG: recent printk recursion!\n";
 static int recursion_bug;
 static int new_text_line = 1;
-static char printk_buf[1024];
 
-int printk_delay_msec __read_mostly;
+#define PRINTK_LINE_MAX		1024
 
-static inline void printk_delay(void)
+/* formatting buffer of vprintk(), and its recursion guard */
+static DEFINE_PER_CPU(char [PRINTK_LINE_MAX], printk_buf);
+static DEFINE_PER_CPU(int, printk_nested);
+
+/*
+ * printk records
+ *
+ * vprintk() does not take logbuf_lock. The formatted message is published
+ * with its timestamp, cpu, pid, level and caller in a ring of fixed size
+ * slots, claimed with cmpxchg on printk_rec_tail: a slot is free for
+ * position p when its seq is p and holds a committed record for p when
+ * it is p + 1 (seq is stored minus the slot index, so that the zeroed
+ * ring starts out free). Messages longer than a slot take consecutive
+ * slots, claimed at once.
+ *
+ * printk() itself never takes logbuf_lock for that. Committed records
+ * are moved, in order, into log_buf by console_unlock() and by syslog()
+ * readers, both of which take logbuf_lock anyway, and by a producer that
+ * finds the ring full. Whoever goes on to print to the consoles drains
+ * the ring first, so console output keeps its order.
+ */
+#define PRINTK_REC_SLOTS	128
+#define PRINTK_REC_MASK		(PRINTK_REC_SLOTS - 1)
+#define PRINTK_REC_TEXT		216
+
+#define PRINTK_REC_MORE		0x01	/* text continues in the next slot */
+
+struct printk_info {
+	u64		ts_nsec;
+	unsigned long	caller;
+	pid_t		pid;
+	u16		cpu;
+	u8		level;		/* without facility */
+	u8		prefix_len;	/* length of a leading "<N>" */
+	char		special;	/* 'c' or 'd' of a special prefix */
+};
+
+struct printk_record {
+	atomic_t		seq;
+	struct printk_info	info;
+	u16			len;	/* of text in this slot */
+	u8			flags;
+	char			text[PRINTK_REC_TEXT];
+};
+
+static struct printk_record printk_rec[PRINTK_REC_SLOTS];
+static atomic_t printk_rec_tail;	/* next position to claim */
+static unsigned printk_rec_head;	/* next position to drain, logbuf_lock */
+static atomic_t printk_rec_dropped;
+
+/* logbuf_lock */
+static char printk_drain_buf[PRINTK_LINE_MAX];
+static char printk_prefix_buf[KSYM_SYMBOL_LEN + 2];
+
+static inline unsigned printk_rec_seq(unsigned pos)
 {
-	if (unlikely(printk_delay_msec)) {
-		int m = printk_delay_msec;
+	return atomic_read(&printk_rec[pos & PRINTK_REC_MASK].seq) +
+		(pos & PRINTK_REC_MASK);
+}
 
-		while (m--) {
-			mdelay(1);
-			touch_nmi_watchdog();
-		}
-	}
+static inline void printk_rec_set_seq(unsigned pos, unsigned seq)
+{
+	atomic_set(&printk_rec[pos & PRINTK_REC_MASK].seq,
+		   seq - (pos & PRINTK_REC_MASK));
 }
 
-asmlinkage int vprintk(const char *fmt, va_list args)
+/* Claim @n consecutive slots, returns the first position or -1 if full */
+static int printk_rec_claim(unsigned n, unsigned *pos)
 {
-	int printed_len = 0;
-	int current_log_level = default_message_loglevel;
-	unsigned long flags;
-	int this_cpu;
-	char *p;
-	size_t plen;
-	char special;
+	unsigned tail;
 
-	boot_delay_msec();
-	printk_delay();
+	do {
+		tail = atomic_read(&printk_rec_tail);
+		/* slots are freed in order: the last one free means all are */
+		if (printk_rec_seq(tail + n - 1) != tail + n - 1)
+			return -1;
+	} while (atomic_cmpxchg(&printk_rec_tail, tail, tail + n) != tail);
 
-	preempt_disable();
-	/* This stops the holder of console_sem just where we want him */
-	raw_local_irq_save(flags);
-	this_cpu = smp_processor_id();
+	*pos = tail;
+	return 0;
+}
 
-	/*
-	 * Ouch, printk recursed into itself!
-	 */
-	if (unlikely(printk_cpu == this_cpu)) {
-		/*
-		 * If a crash is occurring during printk() on this CPU,
-		 * then try to get the crash message out but make sure
-		 * we can't deadlock. Otherwise just return to avoid the
-		 * recursion and return - but flag the recursion so that
-		 * it can be printed at the next appropriate moment:
-		 */
-		if (!oops_in_progress) {
-			recursion_bug = 1;
-			goto out_restore_irqs;
-		}
-		zap_locks();
+/* Whether the oldest record is ready to be drained */
+static inline bool printk_rec_ready(void)
+{
+	unsigned head = ACCESS_ONCE(printk_rec_head);
+
+	return printk_rec_seq(head) == head + 1;
+}
+
+static void printk_rec_emit(const struct printk_info *info, const char *text);
+
+/*
+ * Move committed records into log_buf, called with logbuf_lock held.
+ * Stops at the first record that is not completely committed yet; its
+ * producer will drain it.
+ */
+static void printk_rec_drain(void)
+{
+	struct printk_record *rec, *first;
+	unsigned head, pos;
+	size_t len;
+
+	if (unlikely(atomic_read(&printk_rec_dropped))) {
+		unsigned dropped = atomic_xchg(&printk_rec_dropped, 0);
+		struct printk_info note = {
+			.level		= 4,
+			.cpu		= raw_smp_processor_id(),
+			.ts_nsec	= cpu_clock(raw_smp_processor_id()),
+		};
+
+		snprintf(printk_drain_buf, sizeof(printk_drain_buf),
+			 "printk: %u messages dropped\n", dropped);
+		printk_rec_emit(&note, printk_drain_buf);
 	}
 
-	lockdep_off();
-#ifdef CONFIG_MACH_PX
-	sec_debug_aux_log(SEC_DEBUG_AUXLOG_LOGBUF_LOCK_CHANGE,
-		"+ %s: spin_lock logbuf_lock", __func__);
-#endif
-	raw_spin_lock(&logbuf_lock);
-#ifdef CONFIG_MACH_PX
-	sec_debug_aux_log(SEC_DEBUG_AUXLOG_LOGBUF_LOCK_CHANGE,
-		"- %s: spin_lock logbuf_lock", __func__);
-#endif
-	printk_cpu = this_cpu;
+	for (;;) {
+		head = printk_rec_head;
+		first = &printk_rec[head & PRINTK_REC_MASK];
+		len = 0;
+		pos = head;
+		do {
+			if (printk_rec_seq(pos) != pos + 1)
+				return;
+			smp_rmb();
+			rec = &printk_rec[pos & PRINTK_REC_MASK];
+			memcpy(printk_drain_buf + len, rec->text, rec->len);
+			len += rec->len;
+			pos++;
+		} while (rec->flags & PRINTK_REC_MORE);
+		printk_drain_buf[len] = '\0';
+
+		printk_rec_emit(&first->info, printk_drain_buf);
+
+		/* hand the slots back to producers */
+		smp_mb();
+		for (; head != pos; head++)
+			printk_rec_set_seq(head, head + PRINTK_REC_SLOTS);
+		printk_rec_head = pos;
+	}
+}
 
-	if (recursion_bug) {
-		recursion_bug = 0;
-		strcpy(printk_buf, recursion_bug_msg);
-		printed_len = strlen(recursion_bug_msg);
+static void printk_info_init(struct printk_info *info, const char *buf,
+			     unsigned int cpu, unsigned long caller)
+{
+	unsigned int level = default_message_loglevel;
+	char special = 0;
+
+	info->prefix_len = log_prefix(buf, &level, &special);
+	info->level = level;
+	info->special = special;
+	info->cpu = cpu;
+	info->pid = current->pid;
+	info->ts_nsec = cpu_clock(cpu);
+	info->caller = caller;
+}
+
+/*
+ * Publish the message formatted in @buf. Called with interrupts off.
+ */
+static void printk_rec_store(const char *buf, size_t len,
+			     unsigned int cpu, unsigned long caller)
+{
+	struct printk_record *rec;
+	struct printk_info info;
+	unsigned pos, n, i;
+	size_t chunk;
+	int retry;
+
+	printk_info_init(&info, buf, cpu, caller);
+
+	n = max_t(unsigned, DIV_ROUND_UP(len, PRINTK_REC_TEXT), 1);
+	for (retry = 0; printk_rec_claim(n, &pos); retry++) {
+		/* full: make room ourselves */
+		if (retry == 1000) {
+			atomic_inc(&printk_rec_dropped);
+			return;
+		}
+		if (raw_spin_trylock(&logbuf_lock)) {
+			printk_rec_drain();
+			raw_spin_unlock(&logbuf_lock);
+		}
+		cpu_relax();
 	}
-	/* Emit the output into the temporary buffer */
-	printed_len += vscnprintf(printk_buf + printed_len,
-				  sizeof(printk_buf) - printed_len, fmt, args);
 
-#ifdef	CONFIG_DEBUG_LL
-	printascii(printk_buf);
-#endif
+	for (i = 0; i < n; i++) {
+		rec = &printk_rec[(pos + i) & PRINTK_REC_MASK];
+		chunk = min_t(size_t, len, PRINTK_REC_TEXT);
+		rec->info = info;
+		rec->flags = i + 1 < n ? PRINTK_REC_MORE : 0;
+		rec->len = chunk;
+		memcpy(rec->text, buf, chunk);
+		buf += chunk;
+		len -= chunk;
+	}
+	smp_wmb();
+	for (i = 0; i < n; i++)
+		printk_rec_set_seq(pos + i, pos + i + 1);
+}
 
-	p = printk_buf;
+static void emit_log_str(const char *s, unsigned len)
+{
+	while (len--)
+		emit_log_char(*s++);
+}
 
-	/* Read log level and handle special printk prefix */
-	plen = log_prefix(p, &current_log_level, &special);
-	if (plen) {
-		p += plen;
+/*
+ * Copy a record into log_buf. If the caller didn't provide the
+ * appropriate log prefix, we insert them here.
+ */
+static void printk_rec_emit(const struct printk_info *info, const char *text)
+{
+	char *tbuf = printk_prefix_buf;
+	const char *p = text + info->prefix_len;
+	size_t plen = info->prefix_len;
+	unsigned tlen;
 
-		switch (special) {
+	if (plen) {
+		switch (info->special) {
 		case 'c': /* Strip <c> KERN_CONT, continue line */
 			plen = 0;
 			break;
@@ -1068,69 +1247,48 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 		}
 	}
 
-	/*
-	 * Copy the output into log_buf. If the caller didn't provide
-	 * the appropriate log prefix, we insert them here
-	 */
 	for (; *p; p++) {
 		if (new_text_line) {
 			new_text_line = 0;
 
 			if (plen) {
 				/* Copy original log prefix */
-				int i;
-
-				for (i = 0; i < plen; i++)
-					emit_log_char(printk_buf[i]);
-				printed_len += plen;
+				emit_log_str(text, plen);
 			} else {
 				/* Add log prefix */
 				emit_log_char('<');
-				emit_log_char(current_log_level + '0');
+				emit_log_char(info->level + '0');
 				emit_log_char('>');
-				printed_len += 3;
 			}
 
 			if (printk_time) {
-				/* Add the current time stamp */
-				char tbuf[50], *tp;
-				unsigned tlen;
-				unsigned long long t;
+				/* Add the time stamp */
+				unsigned long long t = info->ts_nsec;
 				unsigned long nanosec_rem;
 
-				t = cpu_clock(printk_cpu);
 				nanosec_rem = do_div(t, 1000000000);
 				tlen = sprintf(tbuf, "[%5lu.%06lu] ",
 						(unsigned long) t,
 						nanosec_rem / 1000);
-
-				for (tp = tbuf; tp < tbuf + tlen; tp++)
-					emit_log_char(*tp);
-				printed_len += tlen;
+				emit_log_str(tbuf, tlen);
 			}
 
 			if (printk_cpu_id) {
 				/* Add the cpu id */
-				char tbuf[10], *tp;
-				unsigned tlen;
-
-				tlen = sprintf(tbuf, "c%u ", printk_cpu);
-
-				for (tp = tbuf; tp < tbuf + tlen; tp++)
-					emit_log_char(*tp);
-				printed_len += tlen;
+				tlen = sprintf(tbuf, "c%u ", info->cpu);
+				emit_log_str(tbuf, tlen);
 			}
 
 			if (printk_pid) {
-				/* Add the current process id */
-				char tbuf[10], *tp;
-				unsigned tlen;
-
-				tlen = sprintf(tbuf, "%6u ", current->pid);
+				/* Add the process id */
+				tlen = sprintf(tbuf, "%6u ", info->pid);
+				emit_log_str(tbuf, tlen);
+			}
 
-				for (tp = tbuf; tp < tbuf + tlen; tp++)
-					emit_log_char(*tp);
-				printed_len += tlen;
+			if (printk_caller && info->caller) {
+				/* Add the caller of printk */
+				tlen = sprintf(tbuf, "%pS ", (void *)info->caller);
+				emit_log_str(tbuf, tlen);
 			}
 
 			if (!*p)
@@ -1141,19 +1299,138 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 		if (*p == '\n')
 			new_text_line = 1;
 	}
+}
+
+int printk_delay_msec __read_mostly;
+
+static inline void printk_delay(void)
+{
+	if (unlikely(printk_delay_msec)) {
+		int m = printk_delay_msec;
+
+		while (m--) {
+			mdelay(1);
+			touch_nmi_watchdog();
+		}
+	}
+}
+
+/*
+ * Console output is left to the console thread once it runs, except
+ * while oopsing or going down, where it has to come out right away.
+ */
+static bool printk_synchronous;
+module_param_named(synchronous, printk_synchronous, bool, S_IRUGO | S_IWUSR);
+
+static struct task_struct *printk_console_task;
+
+/* Whether anything keeps the log in memory across a reset */
+static inline bool printk_memory_sinks(void)
+{
+#ifdef CONFIG_SEC_LOG
+	if (log_char_hook)
+		return true;
+#endif
+	return memory_consoles;
+}
+
+static inline bool printk_console_sync(void)
+{
+	return printk_synchronous || oops_in_progress ||
+	       !printk_console_task || system_state > SYSTEM_RUNNING;
+}
+
+static int vprintk_emit(const char *fmt, va_list args, unsigned long caller)
+{
+	int printed_len = 0;
+	unsigned long flags;
+	int this_cpu;
+	char *buf;
+
+	boot_delay_msec();
+	printk_delay();
+
+	preempt_disable();
+	/* This stops the holder of console_sem just where we want him */
+	raw_local_irq_save(flags);
+	this_cpu = smp_processor_id();
+
+	/*
+	 * Ouch, printk recursed into itself!
+	 */
+	if (unlikely(per_cpu(printk_nested, this_cpu))) {
+		/*
+		 * If a crash is occurring during printk() on this CPU,
+		 * then try to get the crash message out but make sure
+		 * we can't deadlock. Otherwise just return to avoid the
+		 * recursion and return - but flag the recursion so that
+		 * it can be printed at the next appropriate moment:
+		 */
+		if (!oops_in_progress) {
+			recursion_bug = 1;
+			goto out_restore_irqs;
+		}
+		zap_locks();
+	}
+
+	lockdep_off();
+	per_cpu(printk_nested, this_cpu) = 1;
+	buf = per_cpu(printk_buf, this_cpu);
+
+	if (recursion_bug) {
+		recursion_bug = 0;
+		strcpy(buf, recursion_bug_msg);
+		printed_len = strlen(recursion_bug_msg);
+	}
+	/* Emit the output into the temporary buffer */
+	printed_len += vscnprintf(buf + printed_len,
+				  PRINTK_LINE_MAX - printed_len, fmt, args);
+
+#ifdef	CONFIG_DEBUG_LL
+	printascii(buf);
+#endif
+
+	if (likely(!oops_in_progress)) {
+		printk_rec_store(buf, printed_len, this_cpu, caller);
+		per_cpu(printk_nested, this_cpu) = 0;
+	} else {
+		/*
+		 * Bypass the ring: a CPU stopped in the middle of
+		 * publishing a record must not hold back the oops.
+		 */
+		struct printk_info info;
+
+		printk_info_init(&info, buf, this_cpu, caller);
+		raw_spin_lock(&logbuf_lock);
+		printk_rec_drain();
+		printk_rec_emit(&info, buf);
+		raw_spin_unlock(&logbuf_lock);
+		per_cpu(printk_nested, this_cpu) = 0;
+	}
 
 	/*
 	 * Try to acquire and then immediately release the
 	 * console semaphore. The release will do all the
 	 * actual magic (print out buffers, wake up klogd,
-	 * etc). 
-	 *
-	 * The console_trylock_for_printk() function
-	 * will release 'logbuf_lock' regardless of whether it
-	 * actually gets the semaphore or not.
+	 * etc). Otherwise the console thread is kicked from
+	 * the next tick.
 	 */
-	if (console_trylock_for_printk(this_cpu))
-		console_unlock();
+	if (printk_console_sync()) {
+		if (console_trylock_for_printk(this_cpu))
+			console_unlock();
+	} else {
+		__this_cpu_or(printk_pending, PRINTK_PENDING_CONSOLE);
+		/*
+		 * Memory backed consoles and the log char hook are what is
+		 * left after a watchdog reset, they get the message right
+		 * away.
+		 */
+		if (printk_memory_sinks() &&
+		    console_trylock_for_printk(this_cpu)) {
+			console_memory_only = 1;
+			console_unlock();
+		}
+	}
 
 	lockdep_on();
 out_restore_irqs:
@@ -1162,13 +1439,59 @@ out_restore_irqs:
 	preempt_enable();
 	return printed_len;
 }
+
+asmlinkage int vprintk(const char *fmt, va_list args)
+{
+	return vprintk_emit(fmt, args, _RET_IP_);
+}
 EXPORT_SYMBOL(printk);
 EXPORT_SYMBOL(vprintk);
 
+static bool printk_console_pending(void)
+{
+	return !console_suspended &&
+	       (ACCESS_ONCE(con_start) != ACCESS_ONCE(log_end) ||
+		ACCESS_ONCE(memory_con_start) != ACCESS_ONCE(log_end) ||
+		printk_rec_ready());
+}
+
+static int printk_console_thread(void *unused)
+{
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(printk_console_wait,
+					 printk_console_pending() ||
+					 kthread_should_stop());
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static int __init printk_console_thread_init(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(printk_console_thread, NULL, "kconsole");
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	printk_console_task = task;
+	return 0;
+}
+early_initcall(printk_console_thread_init);
+
 #else
 
-static void call_console_drivers(unsigned start, unsigned end)
+static void call_console_drivers(unsigned start, unsigned end, bool memory)
+{
+}
+
+static void printk_rec_drain(void)
+{
+}
+
+static inline bool printk_rec_ready(void)
 {
+	return false;
 }
 
 #endif
@@ -1405,17 +1728,6 @@ int is_console_locked(void)
 	return console_locked;
 }
 
-/*
- * Delayed printk facility, for scheduler-internal messages:
- */
-#define PRINTK_BUF_SIZE		512
-
-#define PRINTK_PENDING_WAKEUP	0x01
-#define PRINTK_PENDING_SCHED	0x02
-
-static DEFINE_PER_CPU(int, printk_pending);
-static DEFINE_PER_CPU(char [PRINTK_BUF_SIZE], printk_sched_buf);
-
 void printk_tick(void)
 {
 	if (__this_cpu_read(printk_pending)) {
@@ -1426,6 +1738,8 @@ void printk_tick(void)
 		}
 		if (pending & PRINTK_PENDING_WAKEUP)
 			wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_CONSOLE)
+			wake_up_interruptible(&printk_console_wait);
 	}
 }
 
@@ -1461,6 +1775,7 @@ void console_unlock(void)
 	unsigned long flags;
 	unsigned _con_start, _log_end;
 	unsigned wake_klogd = 0, retry = 0;
+	bool memory, memory_only = console_memory_only;
 
 	if (console_suspended) {
 		up(&console_sem);
@@ -1480,19 +1795,35 @@ again:
 		sec_debug_aux_log(SEC_DEBUG_AUXLOG_LOGBUF_LOCK_CHANGE,
 			"- %s: spin_lock_irqsave logbuf_lock", __func__);
 #endif
+		printk_rec_drain();
 		wake_klogd |= log_start - log_end;
-		if (con_start == log_end)
-			break;			/* Nothing to print */
-		_con_start = con_start;
 		_log_end = log_end;
-		con_start = log_end;		/* Flush */
+		if (memory_con_start != log_end) {
+			/* CON_MEMORY consoles first, they are fast */
+			_con_start = memory_con_start;
+			memory_con_start = log_end;
+			memory = true;
+		} else if (con_start != log_end && !memory_only) {
+			_con_start = con_start;
+			/*
+			 * In bounded chunks, so that new messages reach the
+			 * CON_MEMORY consoles while a slow one is written.
+			 */
+			if (_log_end - _con_start > CONSOLE_CHUNK)
+				_log_end = _con_start + CONSOLE_CHUNK;
+			con_start = _log_end;
+			memory = false;
+		} else {
+			break;			/* Nothing to print */
+		}
 		raw_spin_unlock(&logbuf_lock);
 		stop_critical_timings();	/* don't trace print latency */
-		call_console_drivers(_con_start, _log_end);
+		call_console_drivers(_con_start, _log_end, memory);
 		start_critical_timings();
 		local_irq_restore(flags);
 	}
 	console_locked = 0;
+	console_memory_only = 0;
 
 	/* Release the exclusive_console once it is used */
 	if (unlikely(exclusive_console))
@@ -1509,11 +1840,14 @@ again:
 	 * flush, no worries.
 	 */
 	raw_spin_lock(&logbuf_lock);
-	if (con_start != log_end)
+	if (memory_con_start != log_end || printk_rec_ready() ||
+	    (con_start != log_end && !memory_only))
 		retry = 1;
 	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
-	if (retry && console_trylock())
+	if (retry && console_trylock()) {
+		console_memory_only = memory_only;
 		goto again;
+	}
 
 	if (wake_klogd)
 		wake_up_klogd();
@@ -1739,6 +2073,8 @@ void register_console(struct console *newcon)
 		newcon->next = console_drivers->next;
 		console_drivers->next = newcon;
 	}
+	if (newcon->flags & CON_MEMORY)
+		memory_consoles++;
 	if (newcon->flags & CON_PRINTBUFFER) {
 		/*
 		 * console_unlock(); will print out the buffered messages
@@ -1753,7 +2089,10 @@ void register_console(struct console *newcon)
 		sec_debug_aux_log(SEC_DEBUG_AUXLOG_LOGBUF_LOCK_CHANGE,
 			"- %s: spin_lock_irqsave logbuf_lock", __func__);
 #endif
-		con_start = log_start;
+		if (newcon->flags & CON_MEMORY)
+			memory_con_start = log_start;
+		else
+			con_start = log_start;
 		raw_spin_unlock_irqrestore(&logbuf_lock, flags);
 		/*
 		 * We're about to replay the log buffer.  Only do this to the
@@ -1815,6 +2154,8 @@ int unregister_console(struct console *console)
 			}
 		}
 	}
+	if (!res && (console->flags & CON_MEMORY))
+		memory_consoles--;
 
 	/*
 	 * If this isn't the last console and it has CON_CONSDEV set, we
@@ -1990,6 +2331,7 @@ void kmsg_dump(enum kmsg_dump_reason reason)
 	sec_debug_aux_log(SEC_DEBUG_AUXLOG_LOGBUF_LOCK_CHANGE,
 		"- %s: spin_lock_irqsave logbuf_lock", __func__);
 #endif
+	printk_rec_drain();
 	end = log_end & LOG_BUF_MASK;
 	chars = logged_chars;
 	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
@@ -73,6 +73,7 @@
 #include <linux/cpuacct.h>
 #include <linux/init_task.h>
 #include <linux/binfmts.h>
+#include <linux/uid_stat.h>
 
 #include <asm/switch_to.h>
 #include <asm/tlb.h>
@@ -3103,6 +3104,7 @@ need_resched:
 		rq->nr_switches++;
 		rq->curr = next;
 		++*switch_count;
+		uid_stat_task_switch(prev);
 
 		context_switch(rq, prev, next); /* unlocks the rq */
 		/*
@@ -7102,6 +7104,10 @@ void __init sched_init(void)
 	list_add(&root_task_group.list, &task_groups);
 	INIT_LIST_HEAD(&root_task_group.children);
 	INIT_LIST_HEAD(&root_task_group.siblings);
+#ifdef CONFIG_SCHEDSTATS
+	/* Too early, not expected to fail */
+	root_task_group.lat_hist = alloc_percpu(struct sched_lat_hist);
+#endif
 	autogroup_init(&init_task);
 
 #endif /* CONFIG_CGROUP_SCHED */
@@ -7395,6 +7401,9 @@ static void free_sched_group(struct task_group *tg)
 	free_fair_sched_group(tg);
 	free_rt_sched_group(tg);
 	autogroup_free(tg);
+#ifdef CONFIG_SCHEDSTATS
+	free_percpu(tg->lat_hist);
+#endif
 	kfree(tg);
 }
 
@@ -7413,6 +7422,12 @@ struct task_group *sched_create_group(struct task_group *parent)
 	if (!alloc_rt_sched_group(tg, parent))
 		goto err;
 
+#ifdef CONFIG_SCHEDSTATS
+	tg->lat_hist = alloc_percpu(struct sched_lat_hist);
+	if (!tg->lat_hist)
+		goto err;
+#endif
+
 	return tg;
 
 err:
@@ -8188,6 +8203,40 @@ static u64 cpu_rt_period_read_uint(struct cgroup *cgrp, struct cftype *cft)
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * Same format as /proc/<pid>/sched_latency, summed over the tasks that
+ * ran in this group or one of its children.
+ */
+static int cpu_latency_hist_show(struct cgroup *cgrp, struct cftype *cft,
+				 struct seq_file *m)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+	struct sched_lat_hist sum;
+	int cpu, i;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct sched_lat_hist *hist = per_cpu_ptr(tg->lat_hist, cpu);
+
+		for (i = 0; i < SCHED_LAT_BUCKETS; i++) {
+			sum.wakeup[i] += hist->wakeup[i];
+			sum.preempt[i] += hist->preempt[i];
+		}
+	}
+
+	seq_puts(m, "wakeup");
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		seq_printf(m, " %u", sum.wakeup[i]);
+	seq_puts(m, "\npreempt");
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		seq_printf(m, " %u", sum.preempt[i]);
+	seq_putc(m, '\n');
+
+	return 0;
+}
+#endif /* CONFIG_SCHEDSTATS */
+
 static struct cftype cpu_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -8223,6 +8272,12 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_rt_period_read_uint,
 		.write_u64 = cpu_rt_period_write_uint,
 	},
+#endif
+#ifdef CONFIG_SCHEDSTATS
+	{
+		.name = "latency_hist",
+		.read_seq_string = cpu_latency_hist_show,
+	},
 #endif
 	{ }	/* terminate */
 };
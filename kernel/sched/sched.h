@@ -136,6 +136,11 @@ struct task_group {
 	struct autogroup *autogroup;
 #endif
 
+#ifdef CONFIG_SCHEDSTATS
+	/* wait latencies of the group's tasks, children included */
+	struct sched_lat_hist __percpu *lat_hist;
+#endif
+
 	struct cfs_bandwidth cfs_bandwidth;
 };
 
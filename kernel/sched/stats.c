@@ -12,6 +12,44 @@
  */
 #define SCHEDSTAT_VERSION 15
 
+/*
+ * Account a task's wait from becoming runnable to getting a cpu, on the
+ * way to running it. The rq->lock of the task's cpu is held, which
+ * serialises against the other updates of the same per-cpu group
+ * histograms.
+ */
+void sched_lat_account(struct task_struct *t, unsigned long long delta)
+{
+	struct sched_info *si = &t->sched_info;
+	int bucket;
+#ifdef CONFIG_CGROUP_SCHED
+	struct task_group *tg;
+#endif
+
+	delta += si->wait_sum;
+	bucket = min_t(int, fls64(delta >> 10), SCHED_LAT_BUCKETS - 1);
+
+	if (si->preempted)
+		si->lat_hist.preempt[bucket]++;
+	else
+		si->lat_hist.wakeup[bucket]++;
+
+#ifdef CONFIG_CGROUP_SCHED
+	for (tg = task_group(t); tg; tg = tg->parent) {
+		struct sched_lat_hist *hist;
+
+		hist = per_cpu_ptr(tg->lat_hist, task_cpu(t));
+		if (si->preempted)
+			hist->preempt[bucket]++;
+		else
+			hist->wakeup[bucket]++;
+	}
+#endif
+
+	si->wait_sum = 0;
+	si->preempted = 0;
+}
+
 static int show_schedstat(struct seq_file *seq, void *v)
 {
 	int cpu;
@@ -32,6 +32,10 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 # define schedstat_inc(rq, field)	do { (rq)->field++; } while (0)
 # define schedstat_add(rq, field, amt)	do { (rq)->field += (amt); } while (0)
 # define schedstat_set(var, val)	do { var = (val); } while (0)
+
+extern void sched_lat_account(struct task_struct *t, unsigned long long delta);
+# define sched_lat_wait_add(t, delta)	do { (t)->sched_info.wait_sum += (delta); } while (0)
+# define sched_lat_preempted(t)		do { (t)->sched_info.preempted = 1; } while (0)
 #else /* !CONFIG_SCHEDSTATS */
 static inline void
 rq_sched_info_arrive(struct rq *rq, unsigned long long delta)
@@ -45,6 +49,11 @@ rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 # define schedstat_inc(rq, field)	do { } while (0)
 # define schedstat_add(rq, field, amt)	do { } while (0)
 # define schedstat_set(var, val)	do { } while (0)
+static inline void
+sched_lat_account(struct task_struct *t, unsigned long long delta)
+{}
+# define sched_lat_wait_add(t, delta)	do { } while (0)
+# define sched_lat_preempted(t)		do { } while (0)
 #endif
 
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
@@ -68,6 +77,7 @@ static inline void sched_info_dequeued(struct task_struct *t)
 			delta = now - t->sched_info.last_queued;
 	sched_info_reset_dequeued(t);
 	t->sched_info.run_delay += delta;
+	sched_lat_wait_add(t, delta);
 
 	rq_sched_info_dequeued(task_rq(t), delta);
 }
@@ -81,8 +91,10 @@ static void sched_info_arrive(struct task_struct *t)
 {
 	unsigned long long now = task_rq(t)->clock, delta = 0;
 
-	if (t->sched_info.last_queued)
+	if (t->sched_info.last_queued) {
 		delta = now - t->sched_info.last_queued;
+		sched_lat_account(t, delta);
+	}
 	sched_info_reset_dequeued(t);
 	t->sched_info.run_delay += delta;
 	t->sched_info.last_arrival = now;
@@ -117,8 +129,10 @@ static inline void sched_info_depart(struct task_struct *t)
 
 	rq_sched_info_depart(task_rq(t), delta);
 
-	if (t->state == TASK_RUNNING)
+	if (t->state == TASK_RUNNING) {
+		sched_lat_preempted(t);
 		sched_info_queued(t);
+	}
 }
 
 /*
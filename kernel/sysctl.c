@@ -325,6 +325,8 @@ static int max_sched_tunable_scaling = SCHED_TUNABLESCALING_END-1;
 #endif /* CONFIG_SMP */
 #endif /* CONFIG_SCHED_DEBUG */
 
+static int max_timer_coalesce_us = USEC_PER_SEC;
+
 #ifdef CONFIG_COMPACTION
 static int min_extfrag_threshold;
 static int max_extfrag_threshold = 1000;
@@ -459,6 +461,15 @@ static struct ctl_table kern_table[] = {
 	},
 #endif /* CONFIG_NUMA_BALANCING */
 #endif /* CONFIG_SCHED_DEBUG */
+	{
+		.procname	= "timer_coalesce_us",
+		.data		= &sysctl_timer_coalesce_us,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &max_timer_coalesce_us,
+	},
 	{
 		.procname	= "sched_rt_period_us",
 		.data		= &sysctl_sched_rt_period,
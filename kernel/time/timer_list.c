@@ -153,6 +153,9 @@ static void print_cpu(struct seq_file *m, int cpu, u64 now)
 	P(nr_retries);
 	P(nr_hangs);
 	P_ns(max_hang_time);
+	P(nr_idle_wakeups);
+	P(nr_idle_timers);
+	P(nr_coalesced);
 #endif
 #undef P
 #undef P_ns
@@ -259,7 +262,7 @@ static int timer_list_show(struct seq_file *m, void *v)
 	u64 now = ktime_to_ns(ktime_get());
 	int cpu;
 
-	SEQ_printf(m, "Timer List Version: v0.7\n");
+	SEQ_printf(m, "Timer List Version: v0.8\n");
 	SEQ_printf(m, "HRTIMER_MAX_CLOCK_BASES: %d\n", HRTIMER_MAX_CLOCK_BASES);
 	SEQ_printf(m, "now at %Ld nsecs\n", (unsigned long long)now);
 
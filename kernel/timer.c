@@ -801,6 +801,18 @@ unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
 	unsigned long expires_limit, mask;
 	int bit;
 
+	/*
+	 * Deferrable timers don't mind running late; with coalescing on,
+	 * round them up to the same boundaries on all cpus so that they
+	 * run together once a cpu is awake anyway.
+	 */
+	if (sysctl_timer_coalesce_us && tbase_get_deferrable(timer->base)) {
+		unsigned long granule = usecs_to_jiffies(sysctl_timer_coalesce_us);
+
+		if (granule > 1)
+			return roundup(expires, granule);
+	}
+
 	if (timer->slack >= 0) {
 		expires_limit = expires + timer->slack;
 	} else {
@@ -0,0 +1,713 @@
+/*
+ * In-kernel latency histograms
+ *
+ * Keeps log2 histograms of the time between a start and an end point,
+ * keyed by pid or comm, without writing anything to the ring buffer:
+ *
+ *   sched_wakeup	wakeup of a task until it is switched in
+ *   block_rq		issue of a block request until its completion
+ *   func:<symbol>	entry of a kernel function until it returns
+ *
+ * Histograms are added and removed through latency_hist_control:
+ *
+ *   echo 'sched_wakeup comm' > latency_hist_control
+ *   echo 'func:vfs_fsync pid' >> latency_hist_control
+ *   echo '!func:vfs_fsync' >> latency_hist_control
+ *
+ * The optional second word selects the key: "pid", "comm" or "none"
+ * (the default). Opening the file with O_TRUNC removes all histograms.
+ * The results are read from latency_hist; writing to it clears them.
+ *
+ * Start points and rows are kept per cpu and only added up on read, so
+ * the probes never share a lock between cpus.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/kallsyms.h>
+#include <linux/kprobes.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/sched.h>
+#include <trace/events/sched.h>
+#ifdef CONFIG_BLOCK
+#include <linux/blkdev.h>
+#include <trace/events/block.h>
+#endif
+
+#include "trace.h"
+
+#define LAT_HIST_BUCKETS	26	/* the last one is open ended */
+#define LAT_HIST_ROWS_BITS	7
+#define LAT_HIST_ROWS		(1 << LAT_HIST_ROWS_BITS)
+#define LAT_HIST_SETS_BITS	6
+#define LAT_HIST_SETS		(1 << LAT_HIST_SETS_BITS)
+#define LAT_HIST_WAYS		4
+/* kretprobe instances, i.e. concurrent calls of a traced function */
+#define LAT_HIST_MAXACTIVE	64
+
+enum lat_hist_key {
+	LAT_HIST_KEY_NONE,
+	LAT_HIST_KEY_PID,
+	LAT_HIST_KEY_COMM,
+};
+
+static const char *lat_hist_key_names[] = {
+	[LAT_HIST_KEY_NONE]	= "none",
+	[LAT_HIST_KEY_PID]	= "pid",
+	[LAT_HIST_KEY_COMM]	= "comm",
+};
+
+struct lat_hist_row {
+	pid_t			pid;
+	char			comm[TASK_COMM_LEN];
+	u64			count;
+	u64			total_ns;
+	u64			max_ns;
+	unsigned long		buckets[LAT_HIST_BUCKETS];
+};
+
+/*
+ * A start point waiting for its end point, free while id is 0. It is only
+ * filled in by one cpu at a time, and published by the store to id; the
+ * end point claims it by clearing id with cmpxchg(), so the common case of
+ * an end point without a start point takes no lock.
+ */
+struct lat_hist_start {
+	unsigned long		id;
+	u64			time;
+	pid_t			pid;
+	char			comm[TASK_COMM_LEN];
+};
+
+/* Per cpu, merged when latency_hist is read */
+struct lat_hist_cpu {
+	raw_spinlock_t		lock;		/* rows and dropped */
+	unsigned long		dropped;	/* events of keys that didn't fit */
+	unsigned long		missed;		/* start points that didn't fit */
+	/* set associative, indexed by a hash of the start point id */
+	struct lat_hist_start	starts[LAT_HIST_SETS][LAT_HIST_WAYS];
+	struct lat_hist_row	rows[LAT_HIST_ROWS];
+} ____cacheline_aligned_in_smp;
+
+struct lat_hist;
+
+struct lat_hist_type {
+	const char		*name;
+	int			(*reg)(struct lat_hist *hist);
+	void			(*unreg)(struct lat_hist *hist);
+};
+
+struct lat_hist {
+	struct list_head	list;
+	const struct lat_hist_type *type;
+	char			name[KSYM_NAME_LEN + 8];
+	enum lat_hist_key	key;
+#ifdef CONFIG_KRETPROBES
+	struct kretprobe	rp;
+#endif
+	struct lat_hist_cpu	cpus[0];	/* nr_cpu_ids of them */
+};
+
+static LIST_HEAD(lat_hist_list);
+static DEFINE_MUTEX(lat_hist_mutex);
+
+static struct lat_hist_row *
+lat_hist_find_row(enum lat_hist_key key, struct lat_hist_row *rows,
+		  pid_t pid, const char *comm)
+{
+	unsigned int hash, i;
+
+	switch (key) {
+	case LAT_HIST_KEY_PID:
+		hash = hash_32(pid, LAT_HIST_ROWS_BITS);
+		break;
+	case LAT_HIST_KEY_COMM:
+		hash = jhash(comm, strnlen(comm, TASK_COMM_LEN), 0);
+		break;
+	default:
+		return &rows[0];
+	}
+
+	for (i = 0; i < LAT_HIST_ROWS; i++) {
+		struct lat_hist_row *row =
+			&rows[(hash + i) & (LAT_HIST_ROWS - 1)];
+
+		if (!row->count) {
+			row->pid = pid;
+			strlcpy(row->comm, comm, TASK_COMM_LEN);
+			return row;
+		}
+		if (key == LAT_HIST_KEY_PID ? row->pid == pid :
+		    !strncmp(row->comm, comm, TASK_COMM_LEN))
+			return row;
+	}
+	return NULL;
+}
+
+/* into the rows of the current cpu */
+static void lat_hist_account(struct lat_hist *hist, u64 start,
+			     pid_t pid, const char *comm)
+{
+	struct lat_hist_cpu *hc;
+	struct lat_hist_row *row;
+	unsigned long flags;
+	u64 now, delta;
+	int bucket;
+
+	local_irq_save(flags);
+	hc = &hist->cpus[smp_processor_id()];
+	now = local_clock();
+	delta = now > start ? now - start : 0;
+
+	raw_spin_lock(&hc->lock);
+	row = lat_hist_find_row(hist->key, hc->rows, pid, comm);
+	if (!row) {
+		hc->dropped++;
+		goto out;
+	}
+
+	/* bucket n > 0 holds [2^(n-1), 2^n) usecs */
+	bucket = min(fls64(div_u64(delta, NSEC_PER_USEC)),
+		     LAT_HIST_BUCKETS - 1);
+	row->buckets[bucket]++;
+	row->count++;
+	row->total_ns += delta;
+	if (delta > row->max_ns)
+		row->max_ns = delta;
+out:
+	raw_spin_unlock(&hc->lock);
+	local_irq_restore(flags);
+}
+
+static struct lat_hist_start *
+lat_hist_set(struct lat_hist_cpu *hc, unsigned long id)
+{
+	return hc->starts[hash_long(id, LAT_HIST_SETS_BITS)];
+}
+
+/*
+ * Record a start point in the table of @cpu. Callers serialise the start
+ * points of a cpu: either @cpu is the current one and interrupts are off,
+ * or they hold its runqueue lock.
+ */
+static void lat_hist_begin(struct lat_hist *hist, int cpu, unsigned long id,
+			   struct task_struct *task)
+{
+	struct lat_hist_cpu *hc = &hist->cpus[cpu];
+	struct lat_hist_start *set, *start = NULL;
+	unsigned long old;
+	int i;
+
+	set = lat_hist_set(hc, id);
+	for (i = 0; i < LAT_HIST_WAYS; i++) {
+		old = ACCESS_ONCE(set[i].id);
+		if (old == id) {
+			start = &set[i];
+			break;
+		}
+		if (!start || (start->id && (!old ||
+					     set[i].time < start->time)))
+			start = &set[i];
+	}
+
+	/* take it from end points before rewriting it */
+	old = xchg(&start->id, 0);
+	/* evicted the oldest start point, the set is full */
+	if (old && old != id)
+		hc->missed++;
+
+	start->time = local_clock();
+	start->pid = task->pid;
+	memcpy(start->comm, task->comm, TASK_COMM_LEN);
+	smp_wmb();
+	ACCESS_ONCE(start->id) = id;
+}
+
+/* Look for the start point of @id in the table of @cpu, without a lock */
+static bool lat_hist_end_cpu(struct lat_hist *hist, int cpu,
+			     unsigned long id)
+{
+	struct lat_hist_start *set = lat_hist_set(&hist->cpus[cpu], id);
+	char comm[TASK_COMM_LEN];
+	u64 time;
+	pid_t pid;
+	int i;
+
+	for (i = 0; i < LAT_HIST_WAYS; i++) {
+		if (ACCESS_ONCE(set[i].id) != id)
+			continue;
+		smp_rmb();
+		time = set[i].time;
+		pid = set[i].pid;
+		memcpy(comm, set[i].comm, TASK_COMM_LEN);
+		/* lost it to another end point or to a new start point */
+		if (cmpxchg(&set[i].id, id, 0) != id)
+			continue;
+		lat_hist_account(hist, time, pid, comm);
+		return true;
+	}
+	return false;
+}
+
+/* Account the end point @id; @cpu is where it started, -1 if unknown */
+static void lat_hist_end(struct lat_hist *hist, int cpu, unsigned long id)
+{
+	if (cpu >= 0) {
+		lat_hist_end_cpu(hist, cpu, id);
+		return;
+	}
+	for_each_possible_cpu(cpu)
+		if (lat_hist_end_cpu(hist, cpu, id))
+			break;
+}
+
+/*
+ * Both run under the runqueue lock of the cpu of the task, which is where
+ * it gets switched in unless it is migrated meanwhile.
+ */
+static void lat_hist_probe_wakeup(void *data, struct task_struct *p,
+				  int success)
+{
+	if (success)
+		lat_hist_begin(data, task_cpu(p), p->pid, p);
+}
+
+static void lat_hist_probe_switch(void *data, struct task_struct *prev,
+				  struct task_struct *next)
+{
+	lat_hist_end(data, smp_processor_id(), next->pid);
+}
+
+static int lat_hist_sched_reg(struct lat_hist *hist)
+{
+	int ret;
+
+	ret = register_trace_sched_wakeup(lat_hist_probe_wakeup, hist);
+	if (ret)
+		return ret;
+	ret = register_trace_sched_wakeup_new(lat_hist_probe_wakeup, hist);
+	if (ret)
+		goto fail_wakeup;
+	ret = register_trace_sched_switch(lat_hist_probe_switch, hist);
+	if (ret)
+		goto fail_wakeup_new;
+	return 0;
+
+fail_wakeup_new:
+	unregister_trace_sched_wakeup_new(lat_hist_probe_wakeup, hist);
+fail_wakeup:
+	unregister_trace_sched_wakeup(lat_hist_probe_wakeup, hist);
+	return ret;
+}
+
+static void lat_hist_sched_unreg(struct lat_hist *hist)
+{
+	unregister_trace_sched_switch(lat_hist_probe_switch, hist);
+	unregister_trace_sched_wakeup_new(lat_hist_probe_wakeup, hist);
+	unregister_trace_sched_wakeup(lat_hist_probe_wakeup, hist);
+}
+
+#ifdef CONFIG_BLOCK
+static void lat_hist_probe_rq_issue(void *data, struct request_queue *q,
+				    struct request *rq)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	lat_hist_begin(data, smp_processor_id(), (unsigned long)rq, current);
+	local_irq_restore(flags);
+}
+
+/*
+ * Requests may complete on any cpu. Partial completions after the first
+ * one find no start point.
+ */
+static void lat_hist_probe_rq_complete(void *data, struct request_queue *q,
+				       struct request *rq)
+{
+	lat_hist_end(data, -1, (unsigned long)rq);
+}
+
+static int lat_hist_block_reg(struct lat_hist *hist)
+{
+	int ret;
+
+	ret = register_trace_block_rq_issue(lat_hist_probe_rq_issue, hist);
+	if (ret)
+		return ret;
+	ret = register_trace_block_rq_complete(lat_hist_probe_rq_complete,
+					       hist);
+	if (ret)
+		unregister_trace_block_rq_issue(lat_hist_probe_rq_issue, hist);
+	return ret;
+}
+
+static void lat_hist_block_unreg(struct lat_hist *hist)
+{
+	unregister_trace_block_rq_complete(lat_hist_probe_rq_complete, hist);
+	unregister_trace_block_rq_issue(lat_hist_probe_rq_issue, hist);
+}
+#endif
+
+#ifdef CONFIG_KRETPROBES
+static int lat_hist_func_entry(struct kretprobe_instance *ri,
+			       struct pt_regs *regs)
+{
+	*(u64 *)ri->data = local_clock();
+	return 0;
+}
+
+static int lat_hist_func_return(struct kretprobe_instance *ri,
+				struct pt_regs *regs)
+{
+	struct lat_hist *hist = container_of(ri->rp, struct lat_hist, rp);
+
+	lat_hist_account(hist, *(u64 *)ri->data, current->pid, current->comm);
+	return 0;
+}
+
+static int lat_hist_func_reg(struct lat_hist *hist)
+{
+	hist->rp.kp.symbol_name = hist->name + strlen(hist->type->name);
+	hist->rp.entry_handler = lat_hist_func_entry;
+	hist->rp.handler = lat_hist_func_return;
+	hist->rp.data_size = sizeof(u64);
+	hist->rp.maxactive = LAT_HIST_MAXACTIVE;
+	return register_kretprobe(&hist->rp);
+}
+
+static void lat_hist_func_unreg(struct lat_hist *hist)
+{
+	unregister_kretprobe(&hist->rp);
+}
+#endif
+
+static const struct lat_hist_type lat_hist_types[] = {
+	{ "sched_wakeup", lat_hist_sched_reg, lat_hist_sched_unreg },
+#ifdef CONFIG_BLOCK
+	{ "block_rq", lat_hist_block_reg, lat_hist_block_unreg },
+#endif
+#ifdef CONFIG_KRETPROBES
+	/* prefix, the symbol follows */
+	{ "func:", lat_hist_func_reg, lat_hist_func_unreg },
+#endif
+};
+
+static const struct lat_hist_type *lat_hist_find_type(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(lat_hist_types); i++) {
+		const char *type = lat_hist_types[i].name;
+		int len = strlen(type);
+
+		if (type[len - 1] == ':' ? !strncmp(name, type, len) &&
+					   name[len] : !strcmp(name, type))
+			return &lat_hist_types[i];
+	}
+	return NULL;
+}
+
+static struct lat_hist *lat_hist_find(const char *name)
+{
+	struct lat_hist *hist;
+
+	list_for_each_entry(hist, &lat_hist_list, list)
+		if (!strcmp(hist->name, name))
+			return hist;
+	return NULL;
+}
+
+static void lat_hist_free(struct lat_hist *hist)
+{
+	hist->type->unreg(hist);
+	/* wait for probes still running on other cpus */
+	tracepoint_synchronize_unregister();
+	vfree(hist);
+}
+
+/* called with lat_hist_mutex held */
+static int lat_hist_add(const char *name, const char *key)
+{
+	const struct lat_hist_type *type;
+	struct lat_hist *hist;
+	int i, ret;
+
+	type = lat_hist_find_type(name);
+	if (!type || strlen(name) >= sizeof(hist->name))
+		return -EINVAL;
+	if (lat_hist_find(name))
+		return -EBUSY;
+
+	hist = vzalloc(sizeof(*hist) + nr_cpu_ids * sizeof(hist->cpus[0]));
+	if (!hist)
+		return -ENOMEM;
+
+	hist->type = type;
+	strcpy(hist->name, name);
+	for (i = 0; i < nr_cpu_ids; i++)
+		raw_spin_lock_init(&hist->cpus[i].lock);
+	hist->key = LAT_HIST_KEY_NONE;
+	if (*key) {
+		for (i = 0; i < ARRAY_SIZE(lat_hist_key_names); i++)
+			if (!strcmp(key, lat_hist_key_names[i]))
+				break;
+		if (i == ARRAY_SIZE(lat_hist_key_names)) {
+			vfree(hist);
+			return -EINVAL;
+		}
+		hist->key = i;
+	}
+
+	ret = type->reg(hist);
+	if (ret) {
+		vfree(hist);
+		return ret;
+	}
+	list_add_tail(&hist->list, &lat_hist_list);
+	return 0;
+}
+
+/* called with lat_hist_mutex held */
+static int lat_hist_remove(const char *name)
+{
+	struct lat_hist *hist = lat_hist_find(name);
+
+	if (!hist)
+		return -ENOENT;
+	list_del(&hist->list);
+	lat_hist_free(hist);
+	return 0;
+}
+
+static void lat_hist_remove_all(void)
+{
+	struct lat_hist *hist, *n;
+
+	list_for_each_entry_safe(hist, n, &lat_hist_list, list) {
+		list_del(&hist->list);
+		lat_hist_free(hist);
+	}
+}
+
+static int lat_hist_control_show(struct seq_file *m, void *v)
+{
+	struct lat_hist *hist;
+
+	mutex_lock(&lat_hist_mutex);
+	list_for_each_entry(hist, &lat_hist_list, list)
+		seq_printf(m, "%s %s\n", hist->name,
+			   lat_hist_key_names[hist->key]);
+	mutex_unlock(&lat_hist_mutex);
+	return 0;
+}
+
+static int lat_hist_control_open(struct inode *inode, struct file *file)
+{
+	if ((file->f_mode & FMODE_WRITE) && (file->f_flags & O_TRUNC)) {
+		mutex_lock(&lat_hist_mutex);
+		lat_hist_remove_all();
+		mutex_unlock(&lat_hist_mutex);
+	}
+	return single_open(file, lat_hist_control_show, NULL);
+}
+
+static ssize_t lat_hist_control_write(struct file *file,
+				      const char __user *ubuf,
+				      size_t cnt, loff_t *ppos)
+{
+	char buf[KSYM_NAME_LEN + 32];
+	char *cmd, *name;
+	int ret;
+
+	if (cnt >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, cnt))
+		return -EFAULT;
+	buf[cnt] = '\0';
+
+	cmd = strim(buf);
+	if (!*cmd)
+		return cnt;
+
+	mutex_lock(&lat_hist_mutex);
+	if (*cmd == '!') {
+		ret = lat_hist_remove(strim(cmd + 1));
+	} else {
+		name = strsep(&cmd, " \t");
+		ret = lat_hist_add(name, cmd ? strim(cmd) : "");
+	}
+	mutex_unlock(&lat_hist_mutex);
+
+	return ret ? ret : cnt;
+}
+
+static const struct file_operations lat_hist_control_fops = {
+	.open		= lat_hist_control_open,
+	.read		= seq_read,
+	.write		= lat_hist_control_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void lat_hist_show_row(struct seq_file *m, struct lat_hist *hist,
+			      const struct lat_hist_row *row)
+{
+	int i;
+
+	switch (hist->key) {
+	case LAT_HIST_KEY_PID:
+		seq_printf(m, "pid: %d (%s)", row->pid, row->comm);
+		break;
+	case LAT_HIST_KEY_COMM:
+		seq_printf(m, "comm: %s", row->comm);
+		break;
+	default:
+		seq_puts(m, "all");
+		break;
+	}
+	seq_printf(m, "  count: %llu  avg: %llu us  max: %llu us\n",
+		   (unsigned long long)row->count,
+		   div_u64(div64_u64(row->total_ns, row->count),
+			   NSEC_PER_USEC),
+		   div_u64(row->max_ns, NSEC_PER_USEC));
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		if (!row->buckets[i])
+			continue;
+		seq_printf(m, "  %s%9lu us: %lu\n",
+			   i == LAT_HIST_BUCKETS - 1 ? ">=" : "  ",
+			   i ? 1UL << (i - 1) : 0, row->buckets[i]);
+	}
+}
+
+/* Add up the rows of every cpu into @rows */
+static void lat_hist_merge(struct lat_hist *hist,
+				    struct lat_hist_row *rows,
+				    unsigned long *dropped,
+				    unsigned long *missed)
+{
+	struct lat_hist_row *row, *sum;
+	unsigned long flags;
+	int cpu, i, j;
+
+	memset(rows, 0, sizeof(hist->cpus[0].rows));
+	*dropped = *missed = 0;
+	for_each_possible_cpu(cpu) {
+		struct lat_hist_cpu *hc = &hist->cpus[cpu];
+
+		raw_spin_lock_irqsave(&hc->lock, flags);
+		for (i = 0; i < LAT_HIST_ROWS; i++) {
+			row = &hc->rows[i];
+			if (!row->count)
+				continue;
+			sum = lat_hist_find_row(hist->key, rows, row->pid,
+						row->comm);
+			if (!sum) {
+				*dropped += row->count;
+				continue;
+			}
+			for (j = 0; j < LAT_HIST_BUCKETS; j++)
+				sum->buckets[j] += row->buckets[j];
+			sum->count += row->count;
+			sum->total_ns += row->total_ns;
+			if (row->max_ns > sum->max_ns)
+				sum->max_ns = row->max_ns;
+		}
+		*dropped += hc->dropped;
+		*missed += hc->missed;
+		raw_spin_unlock_irqrestore(&hc->lock, flags);
+	}
+}
+
+static int lat_hist_show(struct seq_file *m, void *v)
+{
+	struct lat_hist_row *rows;
+	struct lat_hist *hist;
+	unsigned long dropped, missed;
+	int i;
+
+	rows = vmalloc(sizeof(hist->cpus[0].rows));
+	if (!rows)
+		return -ENOMEM;
+
+	mutex_lock(&lat_hist_mutex);
+	list_for_each_entry(hist, &lat_hist_list, list) {
+		lat_hist_merge(hist, rows, &dropped, &missed);
+#ifdef CONFIG_KRETPROBES
+		missed += hist->rp.nmissed;
+#endif
+
+		seq_printf(m, "# %s, key: %s, dropped: %lu, missed: %lu\n",
+			   hist->name, lat_hist_key_names[hist->key],
+			   dropped, missed);
+		for (i = 0; i < LAT_HIST_ROWS; i++)
+			if (rows[i].count)
+				lat_hist_show_row(m, hist, &rows[i]);
+		seq_putc(m, '\n');
+	}
+	mutex_unlock(&lat_hist_mutex);
+
+	vfree(rows);
+	return 0;
+}
+
+static int lat_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lat_hist_show, NULL);
+}
+
+/* writing anything clears all histograms */
+static ssize_t lat_hist_write(struct file *file, const char __user *ubuf,
+			      size_t cnt, loff_t *ppos)
+{
+	struct lat_hist *hist;
+	unsigned long flags;
+	int cpu;
+
+	mutex_lock(&lat_hist_mutex);
+	list_for_each_entry(hist, &lat_hist_list, list) {
+		for_each_possible_cpu(cpu) {
+			struct lat_hist_cpu *hc = &hist->cpus[cpu];
+
+			raw_spin_lock_irqsave(&hc->lock, flags);
+			memset(hc->rows, 0, sizeof(hc->rows));
+			hc->dropped = 0;
+			hc->missed = 0;
+			raw_spin_unlock_irqrestore(&hc->lock, flags);
+		}
+	}
+	mutex_unlock(&lat_hist_mutex);
+
+	return cnt;
+}
+
+static const struct file_operations lat_hist_fops = {
+	.open		= lat_hist_open,
+	.read		= seq_read,
+	.write		= lat_hist_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static __init int lat_hist_init(void)
+{
+	struct dentry *d_tracer;
+
+	d_tracer = tracing_init_dentry();
+
+	trace_create_file("latency_hist_control", 0644, d_tracer,
+			  NULL, &lat_hist_control_fops);
+
+	trace_create_file("latency_hist", 0644, d_tracer,
+			  NULL, &lat_hist_fops);
+
+	return 0;
+}
+
+device_initcall(lat_hist_init);
@@ -43,6 +43,10 @@
 #include <linux/idr.h>
 #include <mach/sec_debug.h>
 #include <linux/hashtable.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
 
 #include "workqueue_internal.h"
 
@@ -154,6 +158,18 @@ struct worker_pool {
 	atomic_t		nr_running ____cacheline_aligned_in_smp;
 } ____cacheline_aligned_in_smp;
 
+#ifdef CONFIG_WORKQUEUE_STATS
+/* execution statistics of a pwq or of a work function */
+struct wq_stats {
+	u64			queued;
+	u64			executed;
+	u64			exec_total_ns;
+	u64			exec_max_ns;
+	u64			delay_total_ns;	/* queueing to execution */
+	u64			delay_max_ns;
+};
+#endif
+
 /*
  * The per-pool workqueue.  While queued, the lower WORK_STRUCT_FLAG_BITS
  * of work_struct->data are used for flags and the remaining high bits
@@ -170,6 +186,9 @@ struct pool_workqueue {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
+#ifdef CONFIG_WORKQUEUE_STATS
+	struct wq_stats		stats;		/* L: execution statistics */
+#endif
 };
 
 /*
@@ -1124,6 +1143,104 @@ fail:
 	return -EAGAIN;
 }
 
+#ifdef CONFIG_WORKQUEUE_STATS
+/*
+ * Work functions are accounted in small per-cpu tables indexed by a hash
+ * of the function.  A table is only updated by its own cpu with IRQs
+ * disabled, so no locking is needed; readers add them all up.
+ */
+#define WQ_FUNC_STATS_BITS	7
+#define WQ_FUNC_STATS_SIZE	(1 << WQ_FUNC_STATS_BITS)
+
+struct wq_func_stats {
+	work_func_t		func;
+	struct wq_stats		stats;
+};
+
+struct wq_func_table {
+	struct wq_func_stats	ent[WQ_FUNC_STATS_SIZE];
+	unsigned long		overflow;	/* functions which didn't fit */
+};
+
+static DEFINE_PER_CPU(struct wq_func_table, wq_func_tables);
+
+static struct wq_stats *wq_func_stats(work_func_t func)
+{
+	struct wq_func_table *table = &__get_cpu_var(wq_func_tables);
+	unsigned int hash = hash_ptr((void *)func, WQ_FUNC_STATS_BITS);
+	unsigned int i;
+
+	for (i = 0; i < WQ_FUNC_STATS_SIZE; i++) {
+		struct wq_func_stats *ent =
+			&table->ent[(hash + i) & (WQ_FUNC_STATS_SIZE - 1)];
+
+		if (!ent->func)
+			ent->func = func;
+		if (ent->func == func)
+			return &ent->stats;
+	}
+	table->overflow++;
+	return NULL;
+}
+
+static void wq_stats_add(struct wq_stats *stats, u64 delay, u64 exec)
+{
+	stats->executed++;
+	stats->delay_total_ns += delay;
+	stats->exec_total_ns += exec;
+	if (delay > stats->delay_max_ns)
+		stats->delay_max_ns = delay;
+	if (exec > stats->exec_max_ns)
+		stats->exec_max_ns = exec;
+}
+
+/* called with pool->lock held when @work is inserted for @pwq */
+static void wq_stats_queue(struct pool_workqueue *pwq,
+			   struct work_struct *work)
+{
+	struct wq_stats *fstats = wq_func_stats(work->func);
+
+	work->queued_at = local_clock();
+	pwq->stats.queued++;
+	if (fstats)
+		fstats->queued++;
+}
+
+/* called with pool->lock held right before @worker runs @work */
+static void wq_stats_exec_start(struct worker *worker,
+				struct work_struct *work)
+{
+	u64 now = local_clock();
+
+	/* unbound workers may compare clocks of different cpus */
+	worker->current_delay = now > work->queued_at ?
+				now - work->queued_at : 0;
+	worker->current_start = now;
+}
+
+/* called with pool->lock held after @worker's current work returned */
+static void wq_stats_exec_end(struct worker *worker)
+{
+	struct pool_workqueue *pwq = worker->current_pwq;
+	struct wq_stats *fstats = wq_func_stats(worker->current_func);
+	u64 now = local_clock();
+	u64 exec = now > worker->current_start ?
+		   now - worker->current_start : 0;
+
+	wq_stats_add(&pwq->stats, worker->current_delay, exec);
+	if (fstats)
+		wq_stats_add(fstats, worker->current_delay, exec);
+	trace_workqueue_execute_latency(pwq, worker->current_func,
+					worker->current_delay, exec);
+}
+#else
+static inline void wq_stats_queue(struct pool_workqueue *pwq,
+				  struct work_struct *work) { }
+static inline void wq_stats_exec_start(struct worker *worker,
+				       struct work_struct *work) { }
+static inline void wq_stats_exec_end(struct worker *worker) { }
+#endif
+
 /**
  * insert_work - insert a work into a pool
  * @pwq: pwq @work belongs to
@@ -1145,6 +1262,7 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 	/* we own @work, set data and link */
 	set_work_pwq(work, pwq, extra_flags);
 	list_add_tail(&work->entry, head);
+	wq_stats_queue(pwq, work);
 
 	/*
 	 * Ensure either worker_sched_deactivated() sees the above
@@ -2152,6 +2270,7 @@ __acquires(&pool->lock)
 	 */
 	set_work_pool_and_clear_pending(work, pool->id);
 
+	wq_stats_exec_start(worker, work);
 	spin_unlock_irq(&pool->lock);
 
 	lock_map_acquire_read(&pwq->wq->lockdep_map);
@@ -2179,6 +2298,8 @@ __acquires(&pool->lock)
 
 	spin_lock_irq(&pool->lock);
 
+	wq_stats_exec_end(worker);
+
 	/* clear cpu intensive status */
 	if (unlikely(cpu_intensive))
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
@@ -3588,6 +3709,201 @@ long work_on_cpu(unsigned int cpu, long (*fn)(void *), void *arg)
 EXPORT_SYMBOL_GPL(work_on_cpu);
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_WORKQUEUE_STATS
+static void wq_stats_sum(struct wq_stats *sum, const struct wq_stats *stats)
+{
+	sum->queued += stats->queued;
+	sum->executed += stats->executed;
+	sum->exec_total_ns += stats->exec_total_ns;
+	sum->delay_total_ns += stats->delay_total_ns;
+	sum->exec_max_ns = max(sum->exec_max_ns, stats->exec_max_ns);
+	sum->delay_max_ns = max(sum->delay_max_ns, stats->delay_max_ns);
+}
+
+static void wq_stats_show_one(struct seq_file *m, const struct wq_stats *stats)
+{
+	u64 executed = max_t(u64, stats->executed, 1);
+
+	seq_printf(m, " %10llu %10llu %10llu %10llu %10llu %10llu\n",
+		   (unsigned long long)stats->queued,
+		   (unsigned long long)stats->executed,
+		   div_u64(div64_u64(stats->exec_total_ns, executed),
+			   NSEC_PER_USEC),
+		   div_u64(stats->exec_max_ns, NSEC_PER_USEC),
+		   div_u64(div64_u64(stats->delay_total_ns, executed),
+			   NSEC_PER_USEC),
+		   div_u64(stats->delay_max_ns, NSEC_PER_USEC));
+}
+
+static void wq_stats_show_header(struct seq_file *m, const char *what)
+{
+	seq_printf(m, "%-32s %10s %10s %10s %10s %10s %10s\n", what,
+		   "queued", "executed", "exec_avg", "exec_max",
+		   "delay_avg", "delay_max");
+}
+
+static int wq_stats_workqueues_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+	unsigned int cpu;
+
+	wq_stats_show_header(m, "workqueue");
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list) {
+		struct wq_stats sum = { };
+
+		for_each_pwq_cpu(cpu, wq) {
+			struct pool_workqueue *pwq = get_pwq(cpu, wq);
+
+			spin_lock_irq(&pwq->pool->lock);
+			wq_stats_sum(&sum, &pwq->stats);
+			spin_unlock_irq(&pwq->pool->lock);
+		}
+
+		seq_printf(m, "%-32s", wq->name);
+		wq_stats_show_one(m, &sum);
+	}
+	spin_unlock(&workqueue_lock);
+
+	return 0;
+}
+
+static int wq_func_stats_cmp(const void *a, const void *b)
+{
+	const struct wq_func_stats *fa = a, *fb = b;
+
+	if (fa->stats.exec_max_ns == fb->stats.exec_max_ns)
+		return 0;
+	return fa->stats.exec_max_ns < fb->stats.exec_max_ns ? 1 : -1;
+}
+
+/* work functions from all cpus, slowest first */
+static int wq_stats_functions_show(struct seq_file *m, void *v)
+{
+	unsigned int size = nr_cpu_ids * WQ_FUNC_STATS_SIZE;
+	struct wq_func_stats *all;
+	unsigned long overflow = 0;
+	unsigned int i, j, n = 0;
+	int cpu;
+
+	all = vzalloc(size * sizeof(*all));
+	if (!all)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct wq_func_table *table = &per_cpu(wq_func_tables, cpu);
+
+		overflow += table->overflow;
+		for (i = 0; i < WQ_FUNC_STATS_SIZE; i++) {
+			const struct wq_func_stats *ent = &table->ent[i];
+
+			if (!ent->func)
+				continue;
+			for (j = 0; j < n; j++)
+				if (all[j].func == ent->func)
+					break;
+			if (j == n)
+				all[n++].func = ent->func;
+			wq_stats_sum(&all[j].stats, &ent->stats);
+		}
+	}
+
+	sort(all, n, sizeof(*all), wq_func_stats_cmp, NULL);
+
+	wq_stats_show_header(m, "function");
+	for (i = 0; i < n; i++) {
+		seq_printf(m, "%-32pf", all[i].func);
+		wq_stats_show_one(m, &all[i].stats);
+	}
+	if (overflow)
+		seq_printf(m, "%lu work items of functions not tracked\n",
+			   overflow);
+
+	vfree(all);
+	return 0;
+}
+
+static void wq_func_stats_reset(void *unused)
+{
+	memset(&__get_cpu_var(wq_func_tables), 0,
+	       sizeof(struct wq_func_table));
+}
+
+/* writing anything clears all statistics */
+static ssize_t wq_stats_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct workqueue_struct *wq;
+	unsigned int cpu;
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_pwq_cpu(cpu, wq) {
+			struct pool_workqueue *pwq = get_pwq(cpu, wq);
+
+			spin_lock_irq(&pwq->pool->lock);
+			memset(&pwq->stats, 0, sizeof(pwq->stats));
+			spin_unlock_irq(&pwq->pool->lock);
+		}
+	}
+	spin_unlock(&workqueue_lock);
+
+	/* the tables of online cpus must be cleared by their owners */
+	get_online_cpus();
+	on_each_cpu(wq_func_stats_reset, NULL, 1);
+	for_each_possible_cpu(cpu)
+		if (!cpu_online(cpu))
+			memset(&per_cpu(wq_func_tables, cpu), 0,
+			       sizeof(struct wq_func_table));
+	put_online_cpus();
+
+	return count;
+}
+
+static int wq_stats_workqueues_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_stats_workqueues_show, NULL);
+}
+
+static int wq_stats_functions_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_stats_functions_show, NULL);
+}
+
+static const struct file_operations wq_stats_workqueues_fops = {
+	.open		= wq_stats_workqueues_open,
+	.read		= seq_read,
+	.write		= wq_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static const struct file_operations wq_stats_functions_fops = {
+	.open		= wq_stats_functions_open,
+	.read		= seq_read,
+	.write		= wq_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_stats_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("workqueue", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	debugfs_create_file("workqueues", 0644, dir, NULL,
+			    &wq_stats_workqueues_fops);
+	debugfs_create_file("functions", 0644, dir, NULL,
+			    &wq_stats_functions_fops);
+	return 0;
+}
+late_initcall(wq_stats_init);
+#endif /* CONFIG_WORKQUEUE_STATS */
+
 #ifdef CONFIG_FREEZER
 
 /**
@@ -29,6 +29,10 @@ struct worker {
 	struct work_struct	*current_work;	/* L: work being processed */
 	work_func_t		current_func;	/* L: current_work's fn */
 	struct pool_workqueue	*current_pwq; /* L: current_work's pwq */
+#ifdef CONFIG_WORKQUEUE_STATS
+	u64			current_start;	/* L: current_work's start time */
+	u64			current_delay;	/* L: and its queueing delay */
+#endif
 	struct list_head	scheduled;	/* L: scheduled works */
 	struct task_struct	*task;		/* I: worker task */
 	struct worker_pool	*pool;		/* I: the associated pool */
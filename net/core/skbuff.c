@@ -333,13 +333,7 @@ static void skb_release_data(struct sk_buff *skb)
 		 * If skb buf is from userspace, we need to notify the caller
 		 * the lower device DMA has done;
 		 */
-		if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-			struct ubuf_info *uarg;
-
-			uarg = skb_shinfo(skb)->destructor_arg;
-			if (uarg->callback)
-				uarg->callback(uarg);
-		}
+		skb_zcopy_clear(skb, true);
 
 		if (skb_has_frag_list(skb))
 			skb_drop_fraglist(skb);
@@ -627,11 +621,19 @@ EXPORT_SYMBOL_GPL(skb_morph);
  */
 int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 {
-	int i;
-	int num_frags = skb_shinfo(skb)->nr_frags;
+	int i, num_frags;
 	struct page *page, *head = NULL;
-	struct ubuf_info *uarg = skb_shinfo(skb)->destructor_arg;
 
+	/* Clones share the frag array: give this skb its own first */
+	if (skb_cloned(skb)) {
+		if (skb_shared(skb) ||
+		    skb_zcopy_uarg(skb)->callback != sock_zerocopy_callback)
+			return -EINVAL;
+		if (pskb_expand_head(skb, 0, 0, gfp_mask))
+			return -ENOMEM;
+	}
+
+	num_frags = skb_shinfo(skb)->nr_frags;
 	for (i = 0; i < num_frags; i++) {
 		u8 *vaddr;
 		skb_frag_t *f = &skb_shinfo(skb)->frags[i];
@@ -657,7 +659,7 @@ int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 		put_page(skb_shinfo(skb)->frags[i].page);
 
-	uarg->callback(uarg);
+	skb_zcopy_clear(skb, false);
 
 	/* skb frags point to kernel buffers */
 	for (i = skb_shinfo(skb)->nr_frags; i > 0; i--) {
@@ -666,7 +668,6 @@ int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 		head = (struct page *)head->private;
 	}
 
-	skb_shinfo(skb)->tx_flags &= ~SKBTX_DEV_ZEROCOPY;
 	return 0;
 }
 
@@ -688,10 +689,8 @@ struct sk_buff *skb_clone(struct sk_buff *skb, gfp_t gfp_mask)
 {
 	struct sk_buff *n;
 
-	if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-		if (skb_copy_ubufs(skb, gfp_mask))
-			return NULL;
-	}
+	if (skb_orphan_frags(skb, gfp_mask))
+		return NULL;
 
 	n = skb + 1;
 	if (skb->fclone == SKB_FCLONE_ORIG &&
@@ -810,18 +809,17 @@ struct sk_buff *__pskb_copy(struct sk_buff *skb, int headroom, gfp_t gfp_mask)
 	if (skb_shinfo(skb)->nr_frags) {
 		int i;
 
-		if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-			if (skb_copy_ubufs(skb, gfp_mask)) {
-				kfree_skb(n);
-				n = NULL;
-				goto out;
-			}
+		if (skb_orphan_frags(skb, gfp_mask)) {
+			kfree_skb(n);
+			n = NULL;
+			goto out;
 		}
 		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
 			skb_shinfo(n)->frags[i] = skb_shinfo(skb)->frags[i];
 			get_page(skb_shinfo(n)->frags[i].page);
 		}
 		skb_shinfo(n)->nr_frags = i;
+		skb_zcopy_set(n, skb_zcopy_uarg(skb));
 	}
 
 	if (skb_has_frag_list(skb)) {
@@ -897,6 +895,10 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 	 */
 	memcpy(data + nhead, skb->head, skb_tail_pointer(skb) - skb->head);
 
+	/* copy this zero copy skb frags before they are duplicated */
+	if (!fastpath && skb_orphan_frags(skb, gfp_mask))
+		goto nofrags;
+
 	memcpy((struct skb_shared_info *)(data + size),
 	       skb_shinfo(skb),
 	       offsetof(struct skb_shared_info, frags[skb_shinfo(skb)->nr_frags]));
@@ -904,13 +906,11 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 	if (fastpath) {
 		kfree(skb->head);
 	} else {
-		/* copy this zero copy skb frags */
-		if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-			if (skb_copy_ubufs(skb, gfp_mask))
-				goto nofrags;
-		}
 		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 			get_page(skb_shinfo(skb)->frags[i].page);
+		/* the new head holds its own reference on the user pages */
+		if (skb_zcopy(skb))
+			atomic_inc(&skb_zcopy_uarg(skb)->refcnt);
 
 		if (skb_has_frag_list(skb))
 			skb_clone_fraglist(skb);
@@ -2175,6 +2175,7 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 {
 	int pos = skb_headlen(skb);
 
+	skb_zcopy_set(skb1, skb_zcopy_uarg(skb));
 	if (len < pos)	/* Split line is inside header. */
 		skb_split_inside_header(skb, skb1, len, pos);
 	else		/* Second chunk has no header, nothing to copy. */
@@ -2217,6 +2218,10 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 	BUG_ON(shiftlen > skb->len);
 	BUG_ON(skb_headlen(skb));	/* Would corrupt stream */
 
+	/* an skb head can only refer to one set of user buffers */
+	if (skb_zcopy(tgt) || skb_zcopy(skb))
+		return 0;
+
 	todo = shiftlen;
 	from = 0;
 	to = skb_shinfo(tgt)->nr_frags;
@@ -2690,6 +2695,7 @@ struct sk_buff *skb_segment(struct sk_buff *skb, u32 features)
 
 		skb_copy_from_linear_data_offset(skb, offset,
 						 skb_put(nskb, hsize), hsize);
+		skb_zcopy_set(nskb, skb_zcopy_uarg(skb));
 
 		while (pos < offset + len && i < nfrags) {
 			*frag = skb_shinfo(skb)->frags[i];
@@ -3100,6 +3106,178 @@ int sock_queue_err_skb(struct sock *sk, struct sk_buff *skb)
 }
 EXPORT_SYMBOL(sock_queue_err_skb);
 
+/*
+ * MSG_ZEROCOPY completions. The ubuf_info of a send lives in the cb of
+ * the skb that later carries its notification on the socket error queue,
+ * so completing a send never has to allocate.
+ */
+static inline struct sk_buff *skb_from_uarg(struct ubuf_info *uarg)
+{
+	return container_of((void *)uarg, struct sk_buff, cb);
+}
+
+struct ubuf_info *sock_zerocopy_alloc(struct sock *sk)
+{
+	struct ubuf_info *uarg;
+	struct sk_buff *skb;
+
+	BUILD_BUG_ON(sizeof(*uarg) > sizeof(skb->cb));
+
+	skb = alloc_skb(0, sk->sk_allocation);
+	if (!skb)
+		return NULL;
+
+	uarg = (void *)skb->cb;
+	uarg->callback = sock_zerocopy_callback;
+	uarg->ctx = sk;
+	uarg->desc = 0;
+	uarg->id = (u32)atomic_inc_return(&sk->sk_zckey) - 1;
+	uarg->zerocopy = 1;
+	atomic_set(&uarg->refcnt, 1);
+	sock_hold(sk);
+
+	return uarg;
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_alloc);
+
+/* Called when the last skb head referring to the user pages is gone */
+void sock_zerocopy_callback(struct ubuf_info *uarg, bool success)
+{
+	struct sk_buff *tail, *skb = skb_from_uarg(uarg);
+	struct sock *sk = uarg->ctx;
+	struct sock_exterr_skb *serr;
+	struct sk_buff_head *q;
+	unsigned long flags;
+	u32 id = uarg->id;
+	u8 code;
+
+	if (sock_flag(sk, SOCK_DEAD))
+		goto release;
+
+	code = success ? 0 : SO_EE_CODE_ZEROCOPY_COPIED;
+	serr = SKB_EXT_ERR(skb);
+	memset(serr, 0, sizeof(*serr));
+	serr->ee.ee_errno = 0;
+	serr->ee.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr->ee.ee_code = code;
+	serr->ee.ee_info = id;
+	serr->ee.ee_data = id;
+
+	/* extend the range of the last notification if it is contiguous */
+	q = &sk->sk_error_queue;
+	spin_lock_irqsave(&q->lock, flags);
+	tail = skb_peek_tail(q);
+	if (tail &&
+	    SKB_EXT_ERR(tail)->ee.ee_origin == SO_EE_ORIGIN_ZEROCOPY &&
+	    SKB_EXT_ERR(tail)->ee.ee_code == code &&
+	    SKB_EXT_ERR(tail)->ee.ee_data + 1 == id) {
+		SKB_EXT_ERR(tail)->ee.ee_data = id;
+	} else {
+		__skb_queue_tail(q, skb);
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	sk->sk_error_report(sk);
+
+release:
+	if (skb)
+		consume_skb(skb);
+	sock_put(sk);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_callback);
+
+void sock_zerocopy_put(struct ubuf_info *uarg)
+{
+	if (uarg && atomic_dec_and_test(&uarg->refcnt))
+		uarg->callback(uarg, uarg->zerocopy);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put);
+
+/* The send failed: if no skb took the user pages, drop the id silently */
+void sock_zerocopy_put_abort(struct ubuf_info *uarg)
+{
+	struct sock *sk;
+
+	if (!uarg)
+		return;
+
+	sk = uarg->ctx;
+	if (atomic_read(&uarg->refcnt) == 1) {
+		atomic_dec(&sk->sk_zckey);
+		consume_skb(skb_from_uarg(uarg));
+		sock_put(sk);
+	} else {
+		sock_zerocopy_put(uarg);
+	}
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put_abort);
+
+/**
+ *	skb_zerocopy_iter_stream - pin user pages into skb frags
+ *	@sk: socket the skb is charged to
+ *	@skb: skb to append to
+ *	@from: user buffer
+ *	@len: bytes to append
+ *	@uarg: completion of the send the pages belong to
+ *
+ *	Returns the number of bytes appended, -EMSGSIZE if the skb has no
+ *	frag slot left, -EEXIST if it already refers to another send, or
+ *	-EFAULT.
+ */
+int skb_zerocopy_iter_stream(struct sock *sk, struct sk_buff *skb,
+			     unsigned char __user *from, int len,
+			     struct ubuf_info *uarg)
+{
+	struct ubuf_info *orig_uarg = skb_zcopy_uarg(skb);
+	int frag = skb_shinfo(skb)->nr_frags;
+	struct page *pages[MAX_SKB_FRAGS];
+	int copied = 0;
+
+	if (orig_uarg && orig_uarg != uarg)
+		return -EEXIST;
+
+	while (copied < len && frag < MAX_SKB_FRAGS) {
+		unsigned long addr = (unsigned long)from + copied;
+		int off = addr & ~PAGE_MASK;
+		int npages, n, i;
+
+		npages = min_t(int, MAX_SKB_FRAGS - frag,
+			       DIV_ROUND_UP(off + len - copied, PAGE_SIZE));
+		n = get_user_pages_fast(addr & PAGE_MASK, npages, 0, pages);
+		if (n <= 0)
+			break;
+
+		for (i = 0; i < n; i++) {
+			int size = min_t(int, len - copied, PAGE_SIZE - off);
+
+			if (frag && skb_can_coalesce(skb, frag, pages[i], off)) {
+				put_page(pages[i]);
+				skb_shinfo(skb)->frags[frag - 1].size += size;
+			} else {
+				skb_fill_page_desc(skb, frag++, pages[i], off,
+						   size);
+			}
+			copied += size;
+			off = 0;
+		}
+	}
+
+	if (!copied)
+		return frag == MAX_SKB_FRAGS ? -EMSGSIZE : -EFAULT;
+
+	skb->len += copied;
+	skb->data_len += copied;
+	skb->truesize += copied;
+	sk->sk_wmem_queued += copied;
+	sk_mem_charge(sk, copied);
+
+	if (!orig_uarg)
+		skb_zcopy_set(skb, uarg);
+	return copied;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_iter_stream);
+
 void skb_tstamp_tx(struct sk_buff *orig_skb,
 		struct skb_shared_hwtstamps *hwtstamps)
 {
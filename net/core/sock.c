@@ -783,6 +783,17 @@ set_rcvbuf:
 		else
 			sock_reset_flag(sk, SOCK_RXQ_OVFL);
 		break;
+
+	case SO_ZEROCOPY:
+		if (sk->sk_family != PF_INET && sk->sk_family != PF_INET6)
+			ret = -ENOTSUPP;
+		else if (sk->sk_protocol != IPPROTO_TCP)
+			ret = -ENOTSUPP;
+		else if (valbool)
+			sock_set_flag(sk, SOCK_ZEROCOPY);
+		else
+			sock_reset_flag(sk, SOCK_ZEROCOPY);
+		break;
 	default:
 		ret = -ENOPROTOOPT;
 		break;
@@ -1004,6 +1015,10 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = !!sock_flag(sk, SOCK_RXQ_OVFL);
 		break;
 
+	case SO_ZEROCOPY:
+		v.val = !!sock_flag(sk, SOCK_ZEROCOPY);
+		break;
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1284,6 +1299,7 @@ struct sock *sk_clone(const struct sock *sk, const gfp_t priority)
 		 */
 		atomic_set(&newsk->sk_wmem_alloc, 1);
 		atomic_set(&newsk->sk_omem_alloc, 0);
+		atomic_set(&newsk->sk_zckey, 0);
 		skb_queue_head_init(&newsk->sk_receive_queue);
 		skb_queue_head_init(&newsk->sk_write_queue);
 #ifdef CONFIG_NET_DMA
@@ -2085,6 +2101,7 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 	smp_wmb();
 	atomic_set(&sk->sk_refcnt, 1);
 	atomic_set(&sk->sk_drops, 0);
+	atomic_set(&sk->sk_zckey, 0);
 }
 EXPORT_SYMBOL(sock_init_data);
 
@@ -1281,6 +1281,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, u32 features)
 	int proto;
 	int ihl;
 	int id;
+	int ufo;
 	unsigned int offset = 0;
 
 	if (!(features & NETIF_F_V4_CSUM))
@@ -1291,9 +1292,13 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, u32 features)
 		       SKB_GSO_UDP |
 		       SKB_GSO_DODGY |
 		       SKB_GSO_TCP_ECN |
+		       SKB_GSO_UDP_L4 |
 		       0)))
 		goto out;
 
+	/* UDP_L4 segments are complete datagrams, not IP fragments */
+	ufo = skb_shinfo(skb)->gso_type & SKB_GSO_UDP;
+
 	if (unlikely(!pskb_may_pull(skb, sizeof(*iph))))
 		goto out;
 
@@ -1324,7 +1329,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, u32 features)
 	skb = segs;
 	do {
 		iph = ip_hdr(skb);
-		if (proto == IPPROTO_UDP) {
+		if (proto == IPPROTO_UDP && ufo) {
 			iph->id = htons(id);
 			iph->frag_off = htons(offset >> 3);
 			if (skb->next != NULL)
@@ -1564,6 +1569,8 @@ static const struct net_protocol udp_protocol = {
 	.err_handler =	udp_err,
 	.gso_send_check = udp4_ufo_send_check,
 	.gso_segment = udp4_ufo_fragment,
+	.gro_receive = udp4_gro_receive,
+	.gro_complete = udp4_gro_complete,
 	.no_policy =	1,
 	.netns_ok =	1,
 };
@@ -185,6 +185,57 @@ int ip_call_ra_chain(struct sk_buff *skb)
 	return 0;
 }
 
+/*
+ * Hand @skb, pointing just past the IP header, to the handler of
+ * @protocol and of whatever protocol that one resubmits it as.
+ * Called under rcu_read_lock().
+ */
+void ip_protocol_deliver_rcu(struct net *net, struct sk_buff *skb,
+			     int protocol)
+{
+	const struct net_protocol *ipprot;
+	int hash, raw, ret;
+
+resubmit:
+	raw = raw_local_deliver(skb, protocol);
+
+	hash = protocol & (MAX_INET_PROTOS - 1);
+	ipprot = rcu_dereference(inet_protos[hash]);
+	if (ipprot != NULL) {
+		if (!net_eq(net, &init_net) && !ipprot->netns_ok) {
+			if (net_ratelimit())
+				printk("%s: proto %d isn't netns-ready\n",
+					__func__, protocol);
+			kfree_skb(skb);
+			return;
+		}
+
+		if (!ipprot->no_policy) {
+			if (!xfrm4_policy_check(NULL, XFRM_POLICY_IN, skb)) {
+				kfree_skb(skb);
+				return;
+			}
+			nf_reset(skb);
+		}
+		ret = ipprot->handler(skb);
+		if (ret < 0) {
+			protocol = -ret;
+			goto resubmit;
+		}
+		IP_INC_STATS_BH(net, IPSTATS_MIB_INDELIVERS);
+	} else {
+		if (!raw) {
+			if (xfrm4_policy_check(NULL, XFRM_POLICY_IN, skb)) {
+				IP_INC_STATS_BH(net, IPSTATS_MIB_INUNKNOWNPROTOS);
+				icmp_send(skb, ICMP_DEST_UNREACH,
+					  ICMP_PROT_UNREACH, 0);
+			}
+		} else
+			IP_INC_STATS_BH(net, IPSTATS_MIB_INDELIVERS);
+		kfree_skb(skb);
+	}
+}
+
 static int ip_local_deliver_finish(struct sk_buff *skb)
 {
 	struct net *net = dev_net(skb->dev);
@@ -195,53 +246,7 @@ static int ip_local_deliver_finish(struct sk_buff *skb)
 	skb_reset_transport_header(skb);
 
 	rcu_read_lock();
-	{
-		int protocol = ip_hdr(skb)->protocol;
-		int hash, raw;
-		const struct net_protocol *ipprot;
-
-	resubmit:
-		raw = raw_local_deliver(skb, protocol);
-
-		hash = protocol & (MAX_INET_PROTOS - 1);
-		ipprot = rcu_dereference(inet_protos[hash]);
-		if (ipprot != NULL) {
-			int ret;
-
-			if (!net_eq(net, &init_net) && !ipprot->netns_ok) {
-				if (net_ratelimit())
-					printk("%s: proto %d isn't netns-ready\n",
-						__func__, protocol);
-				kfree_skb(skb);
-				goto out;
-			}
-
-			if (!ipprot->no_policy) {
-				if (!xfrm4_policy_check(NULL, XFRM_POLICY_IN, skb)) {
-					kfree_skb(skb);
-					goto out;
-				}
-				nf_reset(skb);
-			}
-			ret = ipprot->handler(skb);
-			if (ret < 0) {
-				protocol = -ret;
-				goto resubmit;
-			}
-			IP_INC_STATS_BH(net, IPSTATS_MIB_INDELIVERS);
-		} else {
-			if (!raw) {
-				if (xfrm4_policy_check(NULL, XFRM_POLICY_IN, skb)) {
-					IP_INC_STATS_BH(net, IPSTATS_MIB_INUNKNOWNPROTOS);
-					icmp_send(skb, ICMP_DEST_UNREACH,
-						  ICMP_PROT_UNREACH, 0);
-				}
-			} else
-				IP_INC_STATS_BH(net, IPSTATS_MIB_INDELIVERS);
-			kfree_skb(skb);
-		}
-	}
- out:
+	ip_protocol_deliver_rcu(net, skb, ip_hdr(skb)->protocol);
 	rcu_read_unlock();
 
 	return 0;
@@ -817,7 +817,10 @@ static int __ip_append_data(struct sock *sk,
 	skb = skb_peek_tail(queue);
 
 	exthdrlen = !skb ? rt->dst.header_len : 0;
-	mtu = cork->fragsize;
+	/* With UDP_SEGMENT the whole train is built as one datagram and only
+	 * cut into MTU sized packets by GSO on its way to the device.
+	 */
+	mtu = cork->gso_size ? 0xFFFF : cork->fragsize;
 
 	hh_len = LL_RESERVED_SPACE(rt->dst.dev);
 
@@ -836,7 +839,7 @@ static int __ip_append_data(struct sock *sk,
 	 */
 	if (transhdrlen &&
 	    length + fragheaderlen <= mtu &&
-	    rt->dst.dev->features & NETIF_F_V4_CSUM &&
+	    (rt->dst.dev->features & NETIF_F_V4_CSUM || cork->gso_size) &&
 	    !exthdrlen)
 		csummode = CHECKSUM_PARTIAL;
 
@@ -1080,6 +1083,7 @@ static int ip_setup_cork(struct sock *sk, struct inet_cork *cork,
 	cork->dst = &rt->dst;
 	cork->length = 0;
 	cork->tx_flags = ipc->tx_flags;
+	cork->gso_size = 0;
 	cork->page = NULL;
 	cork->off = 0;
 
@@ -1324,7 +1328,7 @@ struct sk_buff *__ip_make_skb(struct sock *sk,
 	 * If local_df is set too, we still allow to fragment this frame
 	 * locally. */
 	if (inet->pmtudisc >= IP_PMTUDISC_DO ||
-	    (skb->len <= dst_mtu(&rt->dst) &&
+	    ((skb->len <= dst_mtu(&rt->dst) || cork->gso_size) &&
 	     ip_dont_fragment(sk, &rt->dst)))
 		df = htons(IP_DF);
 
@@ -1441,6 +1445,7 @@ struct sk_buff *ip_make_skb(struct sock *sk,
 	err = ip_setup_cork(sk, &cork, ipc, rtp);
 	if (err)
 		return ERR_PTR(err);
+	cork.gso_size = ipc->gso_size;
 
 	err = __ip_append_data(sk, fl4, &queue, &cork, getfrag,
 			       from, length, transhdrlen, flags);
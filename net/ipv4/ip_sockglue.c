@@ -404,7 +404,8 @@ int ip_recv_error(struct sock *sk, struct msghdr *msg, int len)
 	serr = SKB_EXT_ERR(skb);
 
 	sin = (struct sockaddr_in *)msg->msg_name;
-	if (sin) {
+	/* zerocopy completions carry no packet */
+	if (sin && serr->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
 		sin->sin_family = AF_INET;
 		sin->sin_addr.s_addr = *(__be32 *)(skb_network_header(skb) +
 						   serr->addr_offset);
@@ -433,6 +434,12 @@ int ip_recv_error(struct sock *sk, struct msghdr *msg, int len)
 	msg->msg_flags |= MSG_ERRQUEUE;
 	err = copied;
 
+	/* Zerocopy completions are not errors: leave sk_err alone, it may
+	 * hold a real TCP error.
+	 */
+	if (serr->ee.ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+		goto out_free_skb;
+
 	/* Reset and regenerate socket error */
 	spin_lock_bh(&sk->sk_error_queue.lock);
 	sk->sk_err = 0;
@@ -68,6 +68,27 @@ void *ipt_alloc_initial_table(const struct xt_table *info)
 }
 EXPORT_SYMBOL_GPL(ipt_alloc_initial_table);
 
+/*
+ * Skip steps: the fields a rule can fail on whose outcome only depends on
+ * the packet and on the field's value in the rule. If a rule fails on one
+ * of them, every following rule testing the very same value fails as
+ * well, so evaluation may jump past the whole run.
+ */
+enum ipt_skip_field {
+	IPT_SKIP_IN,
+	IPT_SKIP_OUT,
+	IPT_SKIP_PROTO,
+	IPT_SKIP_MATCH,		/* first match of the rule */
+	IPT_SKIP_MAX
+};
+
+struct ipt_skip {
+	/* offset of the next rule testing a different value */
+	unsigned int next[IPT_SKIP_MAX];
+	/* nfcache as userspace wrote it, the kernel copy holds the index */
+	unsigned int nfcache;
+};
+
 /* Returns whether matches rule or not. */
 /* Performance critical - called for every packet */
 static inline bool
@@ -75,10 +96,13 @@ ip_packet_match(const struct iphdr *ip,
 		const char *indev,
 		const char *outdev,
 		const struct ipt_ip *ipinfo,
-		int isfrag)
+		int isfrag,
+		unsigned int *field)
 {
 	unsigned long ret;
 
+	*field = IPT_SKIP_MAX;
+
 #define FWINV(bool, invflg) ((bool) ^ !!(ipinfo->invflags & (invflg)))
 
 	if (FWINV((ip->saddr&ipinfo->smsk.s_addr) != ipinfo->src.s_addr,
@@ -102,6 +126,7 @@ ip_packet_match(const struct iphdr *ip,
 		dprintf("VIA in mismatch (%s vs %s).%s\n",
 			indev, ipinfo->iniface,
 			ipinfo->invflags&IPT_INV_VIA_IN ?" (INV)":"");
+		*field = IPT_SKIP_IN;
 		return false;
 	}
 
@@ -111,6 +136,7 @@ ip_packet_match(const struct iphdr *ip,
 		dprintf("VIA out mismatch (%s vs %s).%s\n",
 			outdev, ipinfo->outiface,
 			ipinfo->invflags&IPT_INV_VIA_OUT ?" (INV)":"");
+		*field = IPT_SKIP_OUT;
 		return false;
 	}
 
@@ -120,6 +146,7 @@ ip_packet_match(const struct iphdr *ip,
 		dprintf("Packet protocol %hi does not match %hi.%s\n",
 			ip->protocol, ipinfo->proto,
 			ipinfo->invflags&IPT_INV_PROTO ? " (INV)":"");
+		*field = IPT_SKIP_PROTO;
 		return false;
 	}
 
@@ -284,6 +311,34 @@ struct ipt_entry *ipt_next_entry(const struct ipt_entry *entry)
 	return (void *)entry + entry->next_offset;
 }
 
+/* Next rule that can match after @e failed on @field */
+static inline struct ipt_entry *
+ipt_skip_entry(const struct xt_table_info *private, const void *table_base,
+	       const struct ipt_entry *e, unsigned int field)
+{
+#ifdef CONFIG_IP_NF_IPTABLES_SKIP
+	const struct ipt_skip *skip = private->compiled;
+
+	if (skip != NULL && field < IPT_SKIP_MAX)
+		return get_entry(table_base, skip[e->nfcache].next[field]);
+#endif
+	return ipt_next_entry(e);
+}
+
+/* nfcache of @e as it was loaded, which libiptc compares rules on */
+static inline unsigned int
+ipt_user_nfcache(const struct xt_table_info *private,
+		 const struct ipt_entry *e)
+{
+#ifdef CONFIG_IP_NF_IPTABLES_SKIP
+	const struct ipt_skip *skip = private->compiled;
+
+	if (skip != NULL)
+		return skip[e->nfcache].nfcache;
+#endif
+	return e->nfcache;
+}
+
 /* Returns one of the generic firewall policies, like NF_ACCEPT. */
 unsigned int
 ipt_do_table(struct sk_buff *skb,
@@ -302,7 +357,7 @@ ipt_do_table(struct sk_buff *skb,
 	unsigned int *stackptr, origptr, cpu;
 	const struct xt_table_info *private;
 	struct xt_action_param acpar;
-	unsigned int addend;
+	unsigned int addend, field;
 
 	/* Initialization */
 	ip = ip_hdr(skb);
@@ -344,17 +399,20 @@ ipt_do_table(struct sk_buff *skb,
 
 		IP_NF_ASSERT(e);
 		if (!ip_packet_match(ip, indev, outdev,
-		    &e->ip, acpar.fragoff)) {
+		    &e->ip, acpar.fragoff, &field)) {
  no_match:
-			e = ipt_next_entry(e);
+			e = ipt_skip_entry(private, table_base, e, field);
 			continue;
 		}
 
 		xt_ematch_foreach(ematch, e) {
 			acpar.match     = ematch->u.kernel.match;
 			acpar.matchinfo = ematch->data;
-			if (!acpar.match->match(skb, &acpar))
+			if (!acpar.match->match(skb, &acpar)) {
+				field = (void *)ematch == (void *)e->elems ?
+					IPT_SKIP_MATCH : IPT_SKIP_MAX;
 				goto no_match;
+			}
 		}
 
 		ADD_COUNTER(e->counters, skb->len, 1);
@@ -783,6 +841,119 @@ cleanup_entry(struct ipt_entry *e, struct net *net)
 	module_put(par.target->me);
 }
 
+#ifdef CONFIG_IP_NF_IPTABLES_SKIP
+/*
+ * First matches whose verdict is a pure function of the packet. Matches
+ * keeping state (quota, limit, recent, qtaguid accounting, ...) must be
+ * evaluated for every rule and never start a run.
+ */
+static const char *const ipt_skip_matches[] = {
+	"owner", "tcp", "udp", "icmp",
+};
+
+static const struct xt_entry_match *
+ipt_skip_first_match(const struct ipt_entry *e)
+{
+	const struct xt_entry_match *m = (const void *)e->elems;
+	unsigned int i;
+
+	if (e->target_offset == sizeof(struct ipt_entry))
+		return NULL;
+	for (i = 0; i < ARRAY_SIZE(ipt_skip_matches); i++)
+		if (strcmp(m->u.kernel.match->name, ipt_skip_matches[i]) == 0)
+			return m;
+	return NULL;
+}
+
+static bool ipt_skip_same(const struct ipt_entry *a, const struct ipt_entry *b,
+			  unsigned int field)
+{
+	const struct ipt_ip *x = &a->ip, *y = &b->ip;
+	const struct xt_entry_match *ma, *mb;
+
+	switch (field) {
+	case IPT_SKIP_IN:
+		return memcmp(x->iniface, y->iniface, IFNAMSIZ) == 0 &&
+		       memcmp(x->iniface_mask, y->iniface_mask, IFNAMSIZ) == 0 &&
+		       !((x->invflags ^ y->invflags) & IPT_INV_VIA_IN);
+	case IPT_SKIP_OUT:
+		return memcmp(x->outiface, y->outiface, IFNAMSIZ) == 0 &&
+		       memcmp(x->outiface_mask, y->outiface_mask, IFNAMSIZ) == 0 &&
+		       !((x->invflags ^ y->invflags) & IPT_INV_VIA_OUT);
+	case IPT_SKIP_PROTO:
+		return x->proto == y->proto &&
+		       !((x->invflags ^ y->invflags) & IPT_INV_PROTO);
+	case IPT_SKIP_MATCH:
+		ma = ipt_skip_first_match(a);
+		mb = ipt_skip_first_match(b);
+		return ma != NULL && mb != NULL &&
+		       ma->u.kernel.match == mb->u.kernel.match &&
+		       ma->u.match_size == mb->u.match_size &&
+		       memcmp(ma->data, mb->data,
+			      ma->u.match_size - sizeof(*ma)) == 0;
+	}
+	return false;
+}
+
+/*
+ * Precompute the skip steps of a checked ruleset. The kernel copy of each
+ * rule gets its index stored in the nfcache field, which selects its entry
+ * in newinfo->compiled; the value userspace wrote is kept there and put
+ * back by the copies to userspace. Must run before the per-cpu copies are
+ * made. On allocation failure the table is simply evaluated linearly.
+ */
+static void ipt_compile_table(struct xt_table_info *newinfo, void *entry0)
+{
+	unsigned int n = newinfo->number;
+	struct ipt_entry **rules, *iter;
+	struct ipt_skip *skip;
+	unsigned int i, f;
+	size_t sz;
+
+	if (n == 0)
+		return;
+
+	rules = vmalloc(n * sizeof(*rules));
+	if (rules == NULL)
+		return;
+
+	sz = n * sizeof(*skip);
+	if (sz <= PAGE_SIZE)
+		skip = kmalloc(sz, GFP_KERNEL);
+	else
+		skip = vmalloc(sz);
+	if (skip == NULL)
+		goto out;
+
+	i = 0;
+	xt_entry_foreach(iter, entry0, newinfo->size) {
+		skip[i].nfcache = iter->nfcache;
+		iter->nfcache = i;
+		rules[i++] = iter;
+	}
+
+	for (i = n; i-- > 0; ) {
+		unsigned int next = (void *)rules[i] - entry0 +
+				    rules[i]->next_offset;
+
+		for (f = 0; f < IPT_SKIP_MAX; f++) {
+			if (i + 1 < n && ipt_skip_same(rules[i], rules[i + 1], f))
+				skip[i].next[f] = skip[i + 1].next[f];
+			else
+				skip[i].next[f] = next;
+		}
+	}
+	newinfo->compiled = skip;
+out:
+	vfree(rules);
+}
+#else
+static inline void ipt_compile_table(struct xt_table_info *newinfo,
+				     void *entry0)
+{
+}
+#endif
+
 /* Checks and translates the user-supplied table segment (held in
    newinfo) */
 static int
@@ -863,6 +1034,8 @@ translate_table(struct net *net, struct xt_table_info *newinfo, void *entry0,
 		return ret;
 	}
 
+	ipt_compile_table(newinfo, entry0);
+
 	/* And one copy for every other CPU */
 	for_each_possible_cpu(i) {
 		if (newinfo->entries[i] && newinfo->entries[i] != entry0)
@@ -957,7 +1130,10 @@ copy_entries_to_user(unsigned int total_size,
 		if (copy_to_user(userptr + off
 				 + offsetof(struct ipt_entry, counters),
 				 &counters[num],
-				 sizeof(counters[num])) != 0) {
+				 sizeof(counters[num])) != 0 ||
+		    put_user(ipt_user_nfcache(private, e),
+			     (unsigned int __user *)(userptr + off
+				+ offsetof(struct ipt_entry, nfcache))) != 0) {
 			ret = -EFAULT;
 			goto free_counters;
 		}
@@ -1396,7 +1572,7 @@ struct compat_ipt_replace {
 static int
 compat_copy_entry_to_user(struct ipt_entry *e, void __user **dstptr,
 			  unsigned int *size, struct xt_counters *counters,
-			  unsigned int i)
+			  unsigned int i, unsigned int nfcache)
 {
 	struct xt_entry_target *t;
 	struct compat_ipt_entry __user *ce;
@@ -1409,7 +1585,8 @@ compat_copy_entry_to_user(struct ipt_entry *e, void __user **dstptr,
 	ce = (struct compat_ipt_entry __user *)*dstptr;
 	if (copy_to_user(ce, e, sizeof(struct ipt_entry)) != 0 ||
 	    copy_to_user(&ce->counters, &counters[i],
-	    sizeof(counters[i])) != 0)
+	    sizeof(counters[i])) != 0 ||
+	    put_user(nfcache, &ce->nfcache) != 0)
 		return -EFAULT;
 
 	*dstptr += sizeof(struct compat_ipt_entry);
@@ -1762,6 +1939,8 @@ translate_compat_table(struct net *net,
 		return ret;
 	}
 
+	ipt_compile_table(newinfo, entry1);
+
 	/* And one copy for every other CPU */
 	for_each_possible_cpu(i)
 		if (newinfo->entries[i] && newinfo->entries[i] != entry1)
@@ -1898,8 +2077,9 @@ compat_copy_entries_to_user(unsigned int total_size, struct xt_table *table,
 	pos = userptr;
 	size = total_size;
 	xt_entry_foreach(iter, loc_cpu_entry, total_size) {
-		ret = compat_copy_entry_to_user(iter, &pos,
-						&size, counters, i++);
+		ret = compat_copy_entry_to_user(iter, &pos, &size, counters,
+						i++,
+						ipt_user_nfcache(private, iter));
 		if (ret != 0)
 			break;
 	}
@@ -0,0 +1,277 @@
+/*
+ * IPv4 fast path for the software flow table
+ *
+ * Packets of an offloaded flow are caught in PRE_ROUTING before defrag
+ * and conntrack, get the NAT mangling of their conntrack applied, and are
+ * sent to the cached neighbour of the output route. Anything unusual
+ * (options, fragments, TTL expiry, oversized packets, TCP FIN/RST) is
+ * left to the regular forwarding path.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4.h>
+#include <net/ip.h>
+#include <net/dst.h>
+#include <net/neighbour.h>
+#include <net/checksum.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_acct.h>
+#include <net/netfilter/nf_flow_table.h>
+
+static int nf_flow_tuple_ip(struct sk_buff *skb, const struct net_device *dev,
+			    struct flow_offload_tuple *tuple)
+{
+	const struct iphdr *iph;
+	const __be16 *ports;
+	unsigned int thoff;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		return -1;
+
+	iph = ip_hdr(skb);
+	if (iph->ihl * 4 != sizeof(*iph) ||
+	    iph->frag_off & htons(IP_MF | IP_OFFSET) ||
+	    iph->ttl <= 1)
+		return -1;
+
+	thoff = sizeof(*iph);
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		if (!pskb_may_pull(skb, thoff + sizeof(struct tcphdr)))
+			return -1;
+		break;
+	case IPPROTO_UDP:
+		if (!pskb_may_pull(skb, thoff + sizeof(struct udphdr)))
+			return -1;
+		break;
+	default:
+		return -1;
+	}
+
+	iph = ip_hdr(skb);
+	ports = (const __be16 *)(skb_network_header(skb) + thoff);
+
+	memset(tuple, 0, sizeof(*tuple));
+	tuple->src_v4	= iph->saddr;
+	tuple->dst_v4	= iph->daddr;
+	tuple->src_port	= ports[0];
+	tuple->dst_port	= ports[1];
+	tuple->l3proto	= AF_INET;
+	tuple->l4proto	= iph->protocol;
+	tuple->iifidx	= dev->ifindex;
+
+	return 0;
+}
+
+static void nf_flow_nat_port(struct sk_buff *skb, struct iphdr *iph,
+			     __be16 *port, __be16 new, __be32 oldip,
+			     __be32 newip)
+{
+	__sum16 *check;
+
+	if (iph->protocol == IPPROTO_TCP) {
+		check = &((struct tcphdr *)(iph + 1))->check;
+	} else {
+		check = &((struct udphdr *)(iph + 1))->check;
+		/* UDP checksum is optional */
+		if (!*check && skb->ip_summed != CHECKSUM_PARTIAL)
+			goto out;
+	}
+
+	inet_proto_csum_replace4(check, skb, oldip, newip, 1);
+	inet_proto_csum_replace2(check, skb, *port, new, 0);
+	if (iph->protocol == IPPROTO_UDP && !*check)
+		*check = CSUM_MANGLED_0;
+out:
+	*port = new;
+}
+
+/*
+ * Rewrite the packet so it leaves looking like the inverse of the other
+ * direction's tuple; this covers SNAT, DNAT and no NAT alike.
+ */
+static void nf_flow_nat_ip(const struct flow_offload *flow,
+			   struct sk_buff *skb, enum flow_offload_tuple_dir dir)
+{
+	const struct nf_conntrack_tuple *other =
+		&flow->ct->tuplehash[!dir].tuple;
+	struct iphdr *iph = ip_hdr(skb);
+	__be16 *ports = (__be16 *)(iph + 1);
+	__be32 addr;
+
+	if (iph->saddr != other->dst.u3.ip) {
+		addr = iph->saddr;
+		iph->saddr = other->dst.u3.ip;
+		csum_replace4(&iph->check, addr, iph->saddr);
+		nf_flow_nat_port(skb, iph, &ports[0], other->dst.u.all,
+				 addr, iph->saddr);
+	} else if (ports[0] != other->dst.u.all) {
+		nf_flow_nat_port(skb, iph, &ports[0], other->dst.u.all, 0, 0);
+	}
+
+	if (iph->daddr != other->src.u3.ip) {
+		addr = iph->daddr;
+		iph->daddr = other->src.u3.ip;
+		csum_replace4(&iph->check, addr, iph->daddr);
+		nf_flow_nat_port(skb, iph, &ports[1], other->src.u.all,
+				 addr, iph->daddr);
+	} else if (ports[1] != other->src.u.all) {
+		nf_flow_nat_port(skb, iph, &ports[1], other->src.u.all, 0, 0);
+	}
+}
+
+static void nf_flow_acct(struct nf_conn *ct, enum flow_offload_tuple_dir dir,
+			 unsigned int len)
+{
+	struct nf_conn_counter *acct = nf_conn_acct_find(ct);
+
+	if (!acct)
+		return;
+
+	spin_lock(&ct->lock);
+	acct[dir].packets++;
+	acct[dir].bytes += len;
+	spin_unlock(&ct->lock);
+}
+
+/* Same as the tail of ip_finish_output2() */
+static int nf_flow_xmit(struct sk_buff *skb)
+{
+	struct dst_entry *dst = skb_dst(skb);
+	struct net_device *dev = dst->dev;
+	unsigned int hh_len = LL_RESERVED_SPACE(dev);
+	struct neighbour *neigh;
+
+	if (unlikely(skb_headroom(skb) < hh_len && dev->header_ops)) {
+		struct sk_buff *skb2;
+
+		skb2 = skb_realloc_headroom(skb, hh_len);
+		kfree_skb(skb);
+		if (!skb2)
+			return -ENOMEM;
+		skb = skb2;
+	}
+
+	if (dst->hh)
+		return neigh_hh_output(dst->hh, skb);
+
+	neigh = dst_get_neighbour(dst);
+	if (neigh)
+		return neigh->output(skb);
+
+	kfree_skb(skb);
+	return -EINVAL;
+}
+
+static unsigned int
+nf_flow_offload_ip_hook(unsigned int hooknum, struct sk_buff *skb,
+			const struct net_device *in,
+			const struct net_device *out,
+			int (*okfn)(struct sk_buff *))
+{
+	struct flow_offload_tuple_hash *th;
+	struct flow_offload_tuple tuple;
+	enum flow_offload_tuple_dir dir;
+	struct flow_offload *flow;
+	struct dst_entry *dst;
+	struct iphdr *iph;
+	unsigned int thoff;
+
+	if (skb->nfct || skb->pkt_type != PACKET_HOST)
+		return NF_ACCEPT;
+
+	if (nf_flow_tuple_ip(skb, in, &tuple) < 0)
+		return NF_ACCEPT;
+
+	th = flow_offload_lookup(dev_net(in), &tuple);
+	if (!th)
+		return NF_ACCEPT;
+
+	dir = th->dir;
+	flow = flow_offload_from_tuplehash(th);
+	if (unlikely(flow->flags || nf_ct_is_dying(flow->ct)))
+		goto slowpath;
+
+	dst = dst_check(th->dst, 0);
+	if (unlikely(!dst)) {
+		flow_offload_teardown(flow);
+		goto slowpath;
+	}
+
+	/* let the slow path fragment or send ICMP_FRAG_NEEDED */
+	if (skb->len > th->mtu && !skb_is_gso(skb))
+		goto slowpath;
+
+	thoff = sizeof(struct iphdr);
+	if (tuple.l4proto == IPPROTO_TCP) {
+		const struct tcphdr *tcph;
+
+		tcph = (const struct tcphdr *)(skb_network_header(skb) + thoff);
+		if (unlikely(tcph->fin || tcph->rst)) {
+			flow_offload_teardown(flow);
+			goto slowpath;
+		}
+		thoff += sizeof(struct tcphdr);
+	} else {
+		thoff += sizeof(struct udphdr);
+	}
+
+	if (!skb_make_writable(skb, thoff))
+		return NF_DROP;
+
+	nf_flow_nat_ip(flow, skb, dir);
+	iph = ip_hdr(skb);
+	ip_decrease_ttl(iph);
+
+	flow_offload_refresh(flow);
+	nf_flow_acct(flow->ct, dir, skb->len);
+	NF_FLOW_STAT_INC(found);
+	IP_INC_STATS_BH(dev_net(in), IPSTATS_MIB_OUTFORWDATAGRAMS);
+
+	skb_forward_csum(skb);
+	skb_dst_drop(skb);
+	skb_dst_set(skb, dst_clone(dst));
+	skb->dev = dst->dev;
+	nf_flow_xmit(skb);
+
+	return NF_STOLEN;
+
+slowpath:
+	NF_FLOW_STAT_INC(slowpath);
+	return NF_ACCEPT;
+}
+
+static struct nf_hook_ops nf_flow_offload_ip_ops __read_mostly = {
+	.hook		= nf_flow_offload_ip_hook,
+	.owner		= THIS_MODULE,
+	.pf		= PF_INET,
+	.hooknum	= NF_INET_PRE_ROUTING,
+	/* ahead of defrag and conntrack */
+	.priority	= NF_IP_PRI_CONNTRACK_DEFRAG - 1,
+};
+
+static int __init nf_flow_ipv4_init(void)
+{
+	return nf_register_hook(&nf_flow_offload_ip_ops);
+}
+
+static void __exit nf_flow_ipv4_fini(void)
+{
+	nf_unregister_hook(&nf_flow_offload_ip_ops);
+}
+
+module_init(nf_flow_ipv4_init);
+module_exit(nf_flow_ipv4_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("IPv4 fast path for the software flow table");
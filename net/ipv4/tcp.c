@@ -461,7 +461,7 @@ unsigned int tcp_poll(struct file *file, struct socket *sock, poll_table *wait)
 	}
 	/* This barrier is coupled with smp_wmb() in tcp_reset() */
 	smp_rmb();
-	if (sk->sk_err)
+	if (sk->sk_err || !skb_queue_empty(&sk->sk_error_queue))
 		mask |= POLLERR;
 
 	return mask;
@@ -916,10 +916,11 @@ int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 {
 	struct iovec *iov;
 	struct tcp_sock *tp = tcp_sk(sk);
+	struct ubuf_info *uarg = NULL;
 	struct sk_buff *skb;
 	int iovlen, flags;
 	int mss_now, size_goal;
-	int sg, err, copied;
+	int sg, zc = 0, err, copied;
 	long timeo;
 
 	lock_sock(sk);
@@ -948,6 +949,22 @@ int tcp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	sg = sk->sk_route_caps & NETIF_F_SG;
 
+	if ((flags & MSG_ZEROCOPY) && size && sock_flag(sk, SOCK_ZEROCOPY)) {
+		uarg = sock_zerocopy_alloc(sk);
+		if (!uarg) {
+			err = -ENOBUFS;
+			goto out_err;
+		}
+
+		/* Pinned pages are checksummed by the device; small sends
+		 * are cheaper to copy. Either way a notification is queued.
+		 */
+		zc = sg && (sk->sk_route_caps & NETIF_F_ALL_CSUM) &&
+		     size >= TCP_ZEROCOPY_MIN_SIZE;
+		if (!zc)
+			uarg->zerocopy = 0;
+	}
+
 	while (--iovlen >= 0) {
 		size_t seglen = iov->iov_len;
 		unsigned char __user *from = iov->iov_base;
@@ -974,7 +991,7 @@ new_segment:
 					goto wait_for_sndbuf;
 
 				skb = sk_stream_alloc_skb(sk,
-							  select_size(sk, sg),
+							  zc ? 0 : select_size(sk, sg),
 							  sk->sk_allocation);
 				if (!skb)
 					goto wait_for_memory;
@@ -995,7 +1012,20 @@ new_segment:
 				copy = seglen;
 
 			/* Where to copy to? */
-			if (skb_tailroom(skb) > 0) {
+			if (zc) {
+				if (!sk_wmem_schedule(sk, copy))
+					goto wait_for_memory;
+
+				err = skb_zerocopy_iter_stream(sk, skb, from,
+							       copy, uarg);
+				if (err == -EMSGSIZE || err == -EEXIST) {
+					tcp_mark_push(tp, skb);
+					goto new_segment;
+				}
+				if (err < 0)
+					goto do_fault;
+				copy = err;
+			} else if (skb_tailroom(skb) > 0) {
 				/* We have some space in skb head. Superb! */
 				if (copy > skb_tailroom(skb))
 					copy = skb_tailroom(skb);
@@ -1111,6 +1141,7 @@ wait_for_memory:
 out:
 	if (copied)
 		tcp_push(sk, flags, mss_now, tp->nonagle);
+	sock_zerocopy_put(uarg);
 	release_sock(sk);
 
 	if (copied > 0)
@@ -1131,6 +1162,7 @@ do_error:
 	if (copied)
 		goto out;
 out_err:
+	sock_zerocopy_put_abort(uarg);
 	err = sk_stream_error(sk, flags, err);
 	release_sock(sk);
 	return err;
@@ -1424,6 +1456,10 @@ int tcp_recvmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	struct sk_buff *skb;
 	u32 urg_hole = 0;
 
+	/* MSG_ZEROCOPY completions */
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return ip_recv_error(sk, msg, len);
+
 	lock_sock(sk);
 
 	err = -ENOTCONN;
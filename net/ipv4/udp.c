@@ -762,6 +762,33 @@ send:
 	return err;
 }
 
+/*
+ * Turn a datagram built for UDP_SEGMENT into a GSO packet, so that it is
+ * cut into gso_size sized datagrams just before it reaches the device.
+ */
+static int udp_set_gso(struct sk_buff *skb, unsigned int gso_size)
+{
+	unsigned int datalen = skb->len - skb_transport_offset(skb) -
+			       sizeof(struct udphdr);
+
+	if (!gso_size || datalen <= gso_size)
+		return 0;
+
+	if (datalen > gso_size * UDP_MAX_SEGMENTS)
+		return -EINVAL;
+
+	/* Every segment gets its own checksum, so the stack must be free to
+	 * compute it per segment.
+	 */
+	if (skb->ip_summed != CHECKSUM_PARTIAL)
+		return -EIO;
+
+	skb_shinfo(skb)->gso_size = gso_size;
+	skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+	skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(datalen, gso_size);
+	return 0;
+}
+
 /*
  * Push out all pending data as one UDP datagram. Socket is locked.
  */
@@ -818,6 +845,7 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	ipc.opt = NULL;
 	ipc.tx_flags = 0;
+	ipc.gso_size = up->gso_size;
 
 	getfrag = is_udplite ? udplite_getfrag : ip_generic_getfrag;
 
@@ -955,14 +983,33 @@ back_from_confirm:
 	if (!ipc.addr)
 		daddr = ipc.addr = fl4->daddr;
 
+	if (ipc.gso_size) {
+		int hlen = sizeof(struct iphdr) + sizeof(struct udphdr) +
+			   (ipc.opt ? ipc.opt->opt.optlen : 0);
+
+		/* Segmentation is only done on the lockless path, and every
+		 * segment has to fit the route MTU on its own.
+		 */
+		err = -EINVAL;
+		if (corkreq || is_udplite ||
+		    sk->sk_no_check == UDP_CSUM_NOXMIT ||
+		    hlen + ipc.gso_size > dst_mtu(&rt->dst))
+			goto out;
+	}
+
 	/* Lockless fast path for the non-corking case. */
 	if (!corkreq) {
 		skb = ip_make_skb(sk, fl4, getfrag, msg->msg_iov, ulen,
 				  sizeof(struct udphdr), &ipc, &rt,
 				  msg->msg_flags);
 		err = PTR_ERR(skb);
-		if (skb && !IS_ERR(skb))
-			err = udp_send_skb(skb, fl4);
+		if (skb && !IS_ERR(skb)) {
+			err = udp_set_gso(skb, ipc.gso_size);
+			if (!err)
+				err = udp_send_skb(skb, fl4);
+			else
+				kfree_skb(skb);
+		}
 		goto out;
 	}
 
@@ -1231,6 +1278,11 @@ try_again:
 	}
 	if (inet->cmsg_flags)
 		ip_cmsg_recv(msg, skb);
+	if (udp_sk(sk)->gro_enabled && skb_is_gso(skb)) {
+		int gso_size = skb_shinfo(skb)->gso_size;
+
+		put_cmsg(msg, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+	}
 
 	err = len;
 	if (flags & MSG_TRUNC)
@@ -1373,6 +1425,51 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 }
 
+/*
+ * Split a GRO coalesced datagram back into the datagrams it was built from.
+ * skb->data points at the UDP header, as in udp_queue_rcv_skb().
+ */
+static int udp_queue_rcv_segments(struct sock *sk, struct sk_buff *skb)
+{
+	struct sk_buff *segs, *next;
+	struct iphdr *iph;
+	struct udphdr *uh;
+	unsigned int len;
+	int ret;
+
+	__skb_pull(skb, sizeof(struct udphdr));
+	segs = skb_segment(skb, NETIF_F_SG);
+	if (IS_ERR_OR_NULL(segs)) {
+		UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS, 0);
+		kfree_skb(skb);
+		return -1;
+	}
+	consume_skb(skb);
+
+	for (; segs; segs = next) {
+		next = segs->next;
+		segs->next = NULL;
+
+		__skb_pull(segs, skb_transport_offset(segs));
+		len = segs->len;
+		uh = udp_hdr(segs);
+		uh->len = htons(len);
+		iph = ip_hdr(segs);
+		iph->tot_len = htons(len + skb_network_header_len(segs));
+		iph->check = 0;
+		iph->check = ip_fast_csum((u8 *)iph, iph->ihl);
+		segs->ip_summed = CHECKSUM_UNNECESSARY;
+
+		/* resubmit what the encap handler passes on, as
+		 * ip_local_deliver_finish() does for a whole datagram
+		 */
+		ret = udp_queue_rcv_skb(sk, segs);
+		if (ret > 0)
+			ip_protocol_deliver_rcu(dev_net(segs->dev), segs, ret);
+	}
+	return 0;
+}
+
 /* returns:
  *  -1: error
  *   0: success
@@ -1387,6 +1484,12 @@ int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 	int rc;
 	int is_udplite = IS_UDPLITE(sk);
 
+	/* GRO only coalesces for sockets with UDP_GRO set; if the option was
+	 * cleared meanwhile, hand the datagrams over one by one.
+	 */
+	if (unlikely(skb_is_gso(skb) && !up->gro_enabled))
+		return udp_queue_rcv_segments(sk, skb);
+
 	/*
 	 *	Charge it to the socket, dropping if the queue is full.
 	 */
@@ -1797,6 +1900,21 @@ int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 		up->pcflag |= UDPLITE_RECV_CC;
 		break;
 
+	/* segmentation and GRO are only implemented for IPv4 */
+	case UDP_SEGMENT:
+		if (sk->sk_family == AF_INET6)
+			return -ENOPROTOOPT;
+		if (val < 0 || val > USHRT_MAX)
+			return -EINVAL;
+		up->gso_size = val;
+		break;
+
+	case UDP_GRO:
+		if (sk->sk_family == AF_INET6)
+			return -ENOPROTOOPT;
+		up->gro_enabled = val ? 1 : 0;
+		break;
+
 	default:
 		err = -ENOPROTOOPT;
 		break;
@@ -1859,6 +1977,18 @@ int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 		val = up->pcrlen;
 		break;
 
+	case UDP_SEGMENT:
+		if (sk->sk_family == AF_INET6)
+			return -ENOPROTOOPT;
+		val = up->gso_size;
+		break;
+
+	case UDP_GRO:
+		if (sk->sk_family == AF_INET6)
+			return -ENOPROTOOPT;
+		val = up->gro_enabled;
+		break;
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -2231,6 +2361,64 @@ int udp4_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+/*
+ * Cut a UDP_SEGMENT datagram into gso_size sized datagrams, each with its
+ * own UDP header and checksum. The IP headers are fixed up by
+ * inet_gso_segment().
+ */
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb, u32 features)
+{
+	struct sk_buff *segs, *seg;
+	unsigned int mss = skb_shinfo(skb)->gso_size;
+	const struct iphdr *iph;
+	struct udphdr *uh;
+	unsigned int len;
+	__wsum csum;
+
+	if (unlikely(skb->len <= sizeof(*uh) + mss))
+		return ERR_PTR(-EINVAL);
+
+	if (!pskb_may_pull(skb, sizeof(*uh)))
+		return ERR_PTR(-EINVAL);
+
+	if (skb_gso_ok(skb, features | NETIF_F_GSO_ROBUST)) {
+		/* Packet is from an untrusted source, reset gso_segs. */
+		skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(skb->len - sizeof(*uh),
+							 mss);
+		return NULL;
+	}
+
+	__skb_pull(skb, sizeof(*uh));
+	segs = skb_segment(skb, features);
+	__skb_push(skb, sizeof(*uh));
+	if (IS_ERR(segs))
+		return segs;
+
+	for (seg = segs; seg; seg = seg->next) {
+		iph = ip_hdr(seg);
+		uh = udp_hdr(seg);
+		len = seg->len - skb_transport_offset(seg);
+		uh->len = htons(len);
+
+		if (seg->ip_summed == CHECKSUM_PARTIAL) {
+			uh->check = ~csum_tcpudp_magic(iph->saddr, iph->daddr,
+						       len, IPPROTO_UDP, 0);
+			seg->csum_start = skb_transport_header(seg) - seg->head;
+			seg->csum_offset = offsetof(struct udphdr, check);
+		} else {
+			/* skb_segment() already summed the payload */
+			uh->check = 0;
+			csum = csum_partial(uh, sizeof(*uh), seg->csum);
+			uh->check = csum_tcpudp_magic(iph->saddr, iph->daddr,
+						      len, IPPROTO_UDP, csum);
+			if (uh->check == 0)
+				uh->check = CSUM_MANGLED_0;
+		}
+	}
+
+	return segs;
+}
+
 struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features)
 {
 	struct sk_buff *segs = ERR_PTR(-EINVAL);
@@ -2238,6 +2426,9 @@ struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features)
 	int offset;
 	__wsum csum;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return udp4_gso_segment(skb, features);
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
@@ -2273,3 +2464,114 @@ out:
 	return segs;
 }
 
+/*
+ * Coalesce back-to-back datagrams of one flow, but only when the flow ends
+ * at a local socket which asked for it with UDP_GRO. The train ends with
+ * the first datagram shorter than the ones before it.
+ */
+struct sk_buff **udp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	const struct iphdr *iph = skb_gro_network_header(skb);
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	struct udphdr *uh;
+	struct udphdr *uh2;
+	struct sock *sk;
+	unsigned int mss = 1;
+	unsigned int hlen;
+	unsigned int off;
+	unsigned int len;
+	int flush = 1;
+	int gro;
+
+	off = skb_gro_offset(skb);
+	hlen = off + sizeof(*uh);
+	uh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		uh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!uh))
+			goto out;
+	}
+
+	if (ntohs(uh->len) != skb_gro_len(skb) ||
+	    ipv4_is_multicast(iph->daddr) || ipv4_is_lbcast(iph->daddr))
+		goto out;
+
+	switch (skb->ip_summed) {
+	case CHECKSUM_COMPLETE:
+		if (!uh->check ||
+		    !csum_tcpudp_magic(iph->saddr, iph->daddr,
+				       skb_gro_len(skb), IPPROTO_UDP,
+				       skb->csum)) {
+			skb->ip_summed = CHECKSUM_UNNECESSARY;
+			break;
+		}
+		goto out;
+	case CHECKSUM_NONE:
+		if (uh->check)
+			goto out;
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+		break;
+	}
+
+	sk = __udp4_lib_lookup(dev_net(skb->dev), iph->saddr, uh->source,
+			       iph->daddr, uh->dest, skb->dev->ifindex,
+			       &udp_table);
+	if (!sk)
+		goto out;
+	gro = udp_sk(sk)->gro_enabled;
+	sock_put(sk);
+	if (!gro)
+		goto out;
+
+	skb_gro_pull(skb, sizeof(*uh));
+	len = skb_gro_len(skb);
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = udp_hdr(p);
+
+		if (*(u32 *)&uh->source ^ *(u32 *)&uh2->source) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		goto found;
+	}
+
+	goto out_check_final;
+
+found:
+	flush = NAPI_GRO_CB(p)->flush;
+	mss = skb_shinfo(p)->gso_size;
+	flush |= (len - 1) >= mss;
+	flush |= NAPI_GRO_CB(p)->count >= UDP_MAX_SEGMENTS;
+
+	if (flush || skb_gro_receive(head, skb))
+		mss = 1;
+
+out_check_final:
+	flush = len < mss;
+
+	if (p && (!NAPI_GRO_CB(skb)->same_flow || flush))
+		pp = head;
+
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+
+	return pp;
+}
+
+int udp4_gro_complete(struct sk_buff *skb)
+{
+	struct udphdr *uh = udp_hdr(skb);
+
+	uh->len = htons(skb->len - skb_transport_offset(skb));
+	skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+	skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+
+	return 0;
+}
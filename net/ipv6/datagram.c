@@ -344,7 +344,8 @@ int ipv6_recv_error(struct sock *sk, struct msghdr *msg, int len)
 	serr = SKB_EXT_ERR(skb);
 
 	sin = (struct sockaddr_in6 *)msg->msg_name;
-	if (sin) {
+	/* zerocopy completions carry no packet */
+	if (sin && serr->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
 		const unsigned char *nh = skb_network_header(skb);
 		sin->sin6_family = AF_INET6;
 		sin->sin6_flowinfo = 0;
@@ -368,7 +369,8 @@ int ipv6_recv_error(struct sock *sk, struct msghdr *msg, int len)
 	memcpy(&errhdr.ee, &serr->ee, sizeof(struct sock_extended_err));
 	sin = &errhdr.offender;
 	sin->sin6_family = AF_UNSPEC;
-	if (serr->ee.ee_origin != SO_EE_ORIGIN_LOCAL) {
+	if (serr->ee.ee_origin != SO_EE_ORIGIN_LOCAL &&
+	    serr->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
 		sin->sin6_family = AF_INET6;
 		sin->sin6_flowinfo = 0;
 		sin->sin6_scope_id = 0;
@@ -395,6 +397,10 @@ int ipv6_recv_error(struct sock *sk, struct msghdr *msg, int len)
 	msg->msg_flags |= MSG_ERRQUEUE;
 	err = copied;
 
+	/* Zerocopy completions are not errors: leave sk_err alone */
+	if (serr->ee.ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+		goto out_free_skb;
+
 	/* Reset and regenerate socket error */
 	spin_lock_bh(&sk->sk_error_queue.lock);
 	sk->sk_err = 0;
@@ -57,6 +57,89 @@ EXPORT_SYMBOL_GPL(nfnetlink_parse_nat_setup_hook);
 DEFINE_SPINLOCK(nf_conntrack_lock);
 EXPORT_SYMBOL_GPL(nf_conntrack_lock);
 
+__cacheline_aligned_in_smp spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
+EXPORT_SYMBOL_GPL(nf_conntrack_locks);
+
+static __cacheline_aligned_in_smp DEFINE_SPINLOCK(nf_conntrack_locks_all_lock);
+static bool nf_conntrack_locks_all;
+
+seqcount_t nf_conntrack_generation __read_mostly;
+EXPORT_SYMBOL_GPL(nf_conntrack_generation);
+
+/* Take one hash chain lock, waiting for a resize in progress to finish */
+void nf_conntrack_bucket_lock(spinlock_t *lock) __acquires(lock)
+{
+	spin_lock(lock);
+	/* pairs with the barrier in nf_conntrack_all_unlock() */
+	smp_mb();
+	if (likely(!ACCESS_ONCE(nf_conntrack_locks_all)))
+		return;
+
+	/* a resize is running: queue up behind it */
+	spin_unlock(lock);
+	spin_lock(&nf_conntrack_locks_all_lock);
+	spin_lock(lock);
+	spin_unlock(&nf_conntrack_locks_all_lock);
+}
+EXPORT_SYMBOL_GPL(nf_conntrack_bucket_lock);
+
+static void nf_conntrack_double_unlock(unsigned int h1, unsigned int h2)
+{
+	h1 %= CONNTRACK_LOCKS;
+	h2 %= CONNTRACK_LOCKS;
+	spin_unlock(&nf_conntrack_locks[h1]);
+	if (h1 != h2)
+		spin_unlock(&nf_conntrack_locks[h2]);
+}
+
+/* Returns true if the table was resized meanwhile and the buckets have to
+ * be recomputed. */
+static bool nf_conntrack_double_lock(unsigned int h1, unsigned int h2,
+				     unsigned int sequence)
+{
+	h1 %= CONNTRACK_LOCKS;
+	h2 %= CONNTRACK_LOCKS;
+	if (h1 <= h2) {
+		nf_conntrack_bucket_lock(&nf_conntrack_locks[h1]);
+		if (h1 != h2)
+			spin_lock_nested(&nf_conntrack_locks[h2],
+					 SINGLE_DEPTH_NESTING);
+	} else {
+		nf_conntrack_bucket_lock(&nf_conntrack_locks[h2]);
+		spin_lock_nested(&nf_conntrack_locks[h1],
+				 SINGLE_DEPTH_NESTING);
+	}
+	if (read_seqcount_retry(&nf_conntrack_generation, sequence)) {
+		nf_conntrack_double_unlock(h1, h2);
+		return true;
+	}
+	return false;
+}
+
+/* Stop every hash chain writer, used while the table is resized */
+static void nf_conntrack_all_lock(void)
+{
+	int i;
+
+	spin_lock(&nf_conntrack_locks_all_lock);
+	nf_conntrack_locks_all = true;
+	smp_mb();
+
+	/* wait for the current holder of every chain lock to go away */
+	for (i = 0; i < CONNTRACK_LOCKS; i++) {
+		spin_lock(&nf_conntrack_locks[i]);
+		spin_unlock(&nf_conntrack_locks[i]);
+	}
+}
+
+static void nf_conntrack_all_unlock(void)
+{
+	/* make the resize visible before letting the writers back in */
+	smp_mb();
+	ACCESS_ONCE(nf_conntrack_locks_all) = false;
+	spin_unlock(&nf_conntrack_locks_all_lock);
+}
+
 unsigned int nf_conntrack_htable_size __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_htable_size);
 
@@ -180,9 +263,33 @@ clean_from_lists(struct nf_conn *ct)
 	pr_debug("clean_from_lists(%p)\n", ct);
 	hlist_nulls_del_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
 	hlist_nulls_del_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode);
+}
 
-	/* Destroy all pending expectations */
-	nf_ct_remove_expectations(ct);
+/* The unconfirmed and dying lists of a conntrack are the ones of the cpu
+ * that created it.  Must be called with BHs disabled. */
+static void nf_ct_add_to_unconfirmed_list(struct nf_conn *ct)
+{
+	struct ct_pcpu *pcpu;
+
+	ct->cpu = smp_processor_id();
+	pcpu = per_cpu_ptr(nf_ct_net(ct)->ct.pcpu_lists, ct->cpu);
+
+	spin_lock(&pcpu->lock);
+	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
+				 &pcpu->unconfirmed);
+	spin_unlock(&pcpu->lock);
+}
+
+static void nf_ct_del_from_pcpu_list(struct nf_conn *ct)
+{
+	struct ct_pcpu *pcpu;
+
+	pcpu = per_cpu_ptr(nf_ct_net(ct)->ct.pcpu_lists, ct->cpu);
+
+	spin_lock(&pcpu->lock);
+	BUG_ON(hlist_nulls_unhashed(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode));
+	hlist_nulls_del_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
+	spin_unlock(&pcpu->lock);
 }
 
 static void
@@ -206,21 +313,21 @@ destroy_conntrack(struct nf_conntrack *nfct)
 
 	rcu_read_unlock();
 
-	spin_lock_bh(&nf_conntrack_lock);
-	/* Expectations will have been removed in clean_from_lists,
+	local_bh_disable();
+	spin_lock(&nf_conntrack_lock);
+	/* Expectations will have been removed in nf_ct_delete_from_lists,
 	 * except TFTP can create an expectation on the first packet,
 	 * before connection is in the list, so we need to clean here,
 	 * too. */
 	nf_ct_remove_expectations(ct);
+	spin_unlock(&nf_conntrack_lock);
 
 	/* We overload first tuple to link into unconfirmed list. */
-	if (!nf_ct_is_confirmed(ct)) {
-		BUG_ON(hlist_nulls_unhashed(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode));
-		hlist_nulls_del_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
-	}
+	if (!nf_ct_is_confirmed(ct))
+		nf_ct_del_from_pcpu_list(ct);
 
 	NF_CT_STAT_INC(net, delete);
-	spin_unlock_bh(&nf_conntrack_lock);
+	local_bh_enable();
 
 	if (ct->master)
 		nf_ct_put(ct->master);
@@ -232,14 +339,30 @@ destroy_conntrack(struct nf_conntrack *nfct)
 void nf_ct_delete_from_lists(struct nf_conn *ct)
 {
 	struct net *net = nf_ct_net(ct);
+	unsigned int hash, repl_hash, sequence;
+	u16 zone = nf_ct_zone(ct);
 
 	nf_ct_helper_destroy(ct);
-	spin_lock_bh(&nf_conntrack_lock);
+
+	local_bh_disable();
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		hash = hash_conntrack(net, zone,
+				      &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+		repl_hash = hash_conntrack(net, zone,
+					   &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	} while (nf_conntrack_double_lock(hash, repl_hash, sequence));
 	/* Inside lock so preempt is disabled on module removal path.
 	 * Otherwise we can get spurious warnings. */
 	NF_CT_STAT_INC(net, delete_list);
 	clean_from_lists(ct);
-	spin_unlock_bh(&nf_conntrack_lock);
+	nf_conntrack_double_unlock(hash, repl_hash);
+
+	/* Destroy all pending expectations */
+	spin_lock(&nf_conntrack_lock);
+	nf_ct_remove_expectations(ct);
+	spin_unlock(&nf_conntrack_lock);
+	local_bh_enable();
 }
 EXPORT_SYMBOL_GPL(nf_ct_delete_from_lists);
 
@@ -260,9 +383,7 @@ static void death_by_event(unsigned long ul_conntrack)
 	}
 	/* we've got the event delivered, now it's dying */
 	set_bit(IPS_DYING_BIT, &ct->status);
-	spin_lock(&nf_conntrack_lock);
-	hlist_nulls_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
-	spin_unlock(&nf_conntrack_lock);
+	nf_ct_del_from_pcpu_list(ct);
 	nf_ct_put(ct);
 }
 
@@ -270,14 +391,16 @@ void nf_ct_insert_dying_list(struct nf_conn *ct)
 {
 	struct net *net = nf_ct_net(ct);
 	struct nf_conntrack_ecache *ecache = nf_ct_ecache_find(ct);
+	struct ct_pcpu *pcpu;
 
 	BUG_ON(ecache == NULL);
 
 	/* add this conntrack to the dying list */
-	spin_lock_bh(&nf_conntrack_lock);
+	pcpu = per_cpu_ptr(net->ct.pcpu_lists, ct->cpu);
+	spin_lock_bh(&pcpu->lock);
 	hlist_nulls_add_head(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
-			     &net->ct.dying);
-	spin_unlock_bh(&nf_conntrack_lock);
+			     &pcpu->dying);
+	spin_unlock_bh(&pcpu->lock);
 	/* set a new timer to retry event delivery */
 	setup_timer(&ecache->timeout, death_by_event, (unsigned long)ct);
 	ecache->timeout.expires = jiffies +
@@ -320,8 +443,9 @@ ____nf_conntrack_find(struct net *net, u16 zone,
 		      const struct nf_conntrack_tuple *tuple, u32 hash)
 {
 	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_head *ct_hash;
 	struct hlist_nulls_node *n;
-	unsigned int bucket = hash_bucket(hash, net);
+	unsigned int bucket, sequence;
 #ifdef CONFIG_MACH_P4NOTE
 	unsigned long start_tick = jiffies;
 #endif
@@ -331,7 +455,13 @@ ____nf_conntrack_find(struct net *net, u16 zone,
 	 */
 	local_bh_disable();
 begin:
-	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[bucket], hnnode) {
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		ct_hash = net->ct.hash;
+		bucket = hash_bucket(hash, net);
+	} while (read_seqcount_retry(&nf_conntrack_generation, sequence));
+
+	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[bucket], hnnode) {
 		if (nf_ct_tuple_equal(tuple, &h->tuple) &&
 		    nf_ct_zone(nf_ct_tuplehash_to_ctrack(h)) == zone) {
 			NF_CT_STAT_INC(net, found);
@@ -353,6 +483,9 @@ begin:
 #endif
 		goto begin;
 	}
+	/* The table was resized under us, the entry may have moved. */
+	if (read_seqcount_retry(&nf_conntrack_generation, sequence))
+		goto begin;
 	local_bh_enable();
 
 	return NULL;
@@ -417,19 +550,53 @@ static void __nf_conntrack_hash_insert(struct nf_conn *ct,
 			   &net->ct.hash[repl_hash]);
 }
 
-void nf_conntrack_hash_insert(struct nf_conn *ct)
+/* Insert a conntrack built outside the packet path, unless it clashes
+ * with an existing entry. Starts its timer on success. */
+int nf_conntrack_hash_check_insert(struct nf_conn *ct)
 {
 	struct net *net = nf_ct_net(ct);
-	unsigned int hash, repl_hash;
+	unsigned int hash, repl_hash, sequence;
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
 	u16 zone;
 
 	zone = nf_ct_zone(ct);
-	hash = hash_conntrack(net, zone, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-	repl_hash = hash_conntrack(net, zone, &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
 
+	local_bh_disable();
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		hash = hash_conntrack(net, zone,
+				      &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+		repl_hash = hash_conntrack(net, zone,
+					   &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	} while (nf_conntrack_double_lock(hash, repl_hash, sequence));
+
+	/* See if there's one in the list already, including reverse */
+	hlist_nulls_for_each_entry(h, n, &net->ct.hash[hash], hnnode)
+		if (nf_ct_tuple_equal(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
+				      &h->tuple) &&
+		    zone == nf_ct_zone(nf_ct_tuplehash_to_ctrack(h)))
+			goto out;
+	hlist_nulls_for_each_entry(h, n, &net->ct.hash[repl_hash], hnnode)
+		if (nf_ct_tuple_equal(&ct->tuplehash[IP_CT_DIR_REPLY].tuple,
+				      &h->tuple) &&
+		    zone == nf_ct_zone(nf_ct_tuplehash_to_ctrack(h)))
+			goto out;
+
+	add_timer(&ct->timeout);
 	__nf_conntrack_hash_insert(ct, hash, repl_hash);
+	NF_CT_STAT_INC(net, insert);
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
+	return 0;
+
+out:
+	NF_CT_STAT_INC(net, insert_failed);
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
+	return -EEXIST;
 }
-EXPORT_SYMBOL_GPL(nf_conntrack_hash_insert);
+EXPORT_SYMBOL_GPL(nf_conntrack_hash_check_insert);
 
 /* Confirm a connection given skb; places it in hash table */
 int
@@ -443,6 +610,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	struct hlist_nulls_node *n;
 	enum ip_conntrack_info ctinfo;
 	struct net *net;
+	unsigned int sequence;
 	u16 zone;
 
 	ct = nf_ct_get(skb, &ctinfo);
@@ -456,11 +624,15 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 		return NF_ACCEPT;
 
 	zone = nf_ct_zone(ct);
-	/* reuse the hash saved before */
-	hash = *(unsigned long *)&ct->tuplehash[IP_CT_DIR_REPLY].hnnode.pprev;
-	hash = hash_bucket(hash, net);
-	repl_hash = hash_conntrack(net, zone,
-				   &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	local_bh_disable();
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		/* reuse the hash saved before */
+		hash = *(unsigned long *)&ct->tuplehash[IP_CT_DIR_REPLY].hnnode.pprev;
+		hash = hash_bucket(hash, net);
+		repl_hash = hash_conntrack(net, zone,
+					   &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	} while (nf_conntrack_double_lock(hash, repl_hash, sequence));
 
 	/* We're not in hash table, and we refuse to set up related
 	   connections for unconfirmed conns.  But packet copies and
@@ -472,15 +644,14 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	NF_CT_ASSERT(!nf_ct_is_confirmed(ct));
 	pr_debug("Confirming conntrack %p\n", ct);
 
-	spin_lock_bh(&nf_conntrack_lock);
-
 	/* We have to check the DYING flag inside the lock to prevent
 	   a race against nf_ct_get_next_corpse() possibly called from
 	   user context, else we insert an already 'dead' hash, blocking
 	   further use of that particular connection -JM */
 
 	if (unlikely(nf_ct_is_dying(ct))) {
-		spin_unlock_bh(&nf_conntrack_lock);
+		nf_conntrack_double_unlock(hash, repl_hash);
+		local_bh_enable();
 		return NF_ACCEPT;
 	}
 
@@ -499,7 +670,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 			goto out;
 
 	/* Remove from unconfirmed list */
-	hlist_nulls_del_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode);
+	nf_ct_del_from_pcpu_list(ct);
 
 	/* Timer relative to confirmation time, not original
 	   setting time, otherwise we'd get timer wrap in
@@ -524,7 +695,8 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	 */
 	__nf_conntrack_hash_insert(ct, hash, repl_hash);
 	NF_CT_STAT_INC(net, insert);
-	spin_unlock_bh(&nf_conntrack_lock);
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
 
 	help = nfct_help(ct);
 	if (help && help->helper)
@@ -536,7 +708,8 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 
 out:
 	NF_CT_STAT_INC(net, insert_failed);
-	spin_unlock_bh(&nf_conntrack_lock);
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
 	return NF_DROP;
 }
 EXPORT_SYMBOL_GPL(__nf_conntrack_confirm);
@@ -551,14 +724,21 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 	struct nf_conntrack_tuple_hash *h;
 	struct hlist_nulls_node *n;
 	struct nf_conn *ct;
+	struct hlist_nulls_head *ct_hash;
 	u16 zone = nf_ct_zone(ignored_conntrack);
-	unsigned int hash = hash_conntrack(net, zone, tuple);
+	unsigned int hash, sequence;
 
 	/* Disable BHs the entire time since we need to disable them at
 	 * least once for the stats anyway.
 	 */
 	rcu_read_lock_bh();
-	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash], hnnode) {
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		ct_hash = net->ct.hash;
+		hash = hash_conntrack(net, zone, tuple);
+	} while (read_seqcount_retry(&nf_conntrack_generation, sequence));
+
+	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[hash], hnnode) {
 		ct = nf_ct_tuplehash_to_ctrack(h);
 		if (ct != ignored_conntrack &&
 		    nf_ct_tuple_equal(tuple, &h->tuple) &&
@@ -579,18 +759,26 @@ EXPORT_SYMBOL_GPL(nf_conntrack_tuple_taken);
 
 /* There's a small race here where we may free a just-assured
    connection.  Too bad: we're in trouble anyway. */
-static noinline int early_drop(struct net *net, unsigned int hash)
+static noinline int early_drop(struct net *net, unsigned int _hash)
 {
 	/* Use oldest entry, which is roughly LRU */
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct = NULL, *tmp;
+	struct hlist_nulls_head *ct_hash;
 	struct hlist_nulls_node *n;
-	unsigned int i, cnt = 0;
+	unsigned int i, cnt = 0, hash, size, sequence;
 	int dropped = 0;
 
 	rcu_read_lock();
-	for (i = 0; i < net->ct.htable_size; i++) {
-		hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash],
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		ct_hash = net->ct.hash;
+		size = net->ct.htable_size;
+	} while (read_seqcount_retry(&nf_conntrack_generation, sequence));
+
+	hash = __hash_bucket(_hash, size);
+	for (i = 0; i < size; i++) {
+		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[hash],
 					 hnnode) {
 			tmp = nf_ct_tuplehash_to_ctrack(h);
 			if (!test_bit(IPS_ASSURED_BIT, &tmp->status))
@@ -609,7 +797,7 @@ static noinline int early_drop(struct net *net, unsigned int hash)
 		if (cnt >= NF_CT_EVICTION_RANGE)
 			break;
 
-		hash = (hash + 1) % net->ct.htable_size;
+		hash = (hash + 1) % size;
 	}
 	rcu_read_unlock();
 
@@ -659,7 +847,7 @@ __nf_conntrack_alloc(struct net *net, u16 zone,
 
 	if (nf_conntrack_max &&
 	    unlikely(atomic_read(&net->ct.count) > nf_conntrack_max)) {
-		if (!early_drop(net, hash_bucket(hash, net))) {
+		if (!early_drop(net, hash)) {
 			atomic_dec(&net->ct.count);
 			if (net_ratelimit())
 				printk(KERN_WARNING
@@ -687,6 +875,12 @@ __nf_conntrack_alloc(struct net *net, u16 zone,
 	       offsetof(struct nf_conn, proto) -
 	       offsetof(struct nf_conn, tuplehash[IP_CT_DIR_MAX]));
 	spin_lock_init(&ct->lock);
+	/*
+	 * Not covered by the memset above. Conntracks inserted by ctnetlink
+	 * never go through the unconfirmed list, but may end up on the
+	 * dying list of this cpu.
+	 */
+	ct->cpu = raw_smp_processor_id();
 	ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple = *orig;
 	ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode.pprev = NULL;
 	ct->tuplehash[IP_CT_DIR_REPLY].tuple = *repl;
@@ -783,7 +977,8 @@ init_conntrack(struct net *net, struct nf_conn *tmpl,
 				 ecache ? ecache->expmask : 0,
 			     GFP_ATOMIC);
 
-	spin_lock_bh(&nf_conntrack_lock);
+	local_bh_disable();
+	spin_lock(&nf_conntrack_lock);
 	exp = nf_ct_find_expectation(net, zone, tuple);
 	if (exp) {
 		pr_debug("conntrack: expectation arrives ct=%p exp=%p\n",
@@ -810,11 +1005,11 @@ init_conntrack(struct net *net, struct nf_conn *tmpl,
 		NF_CT_STAT_INC(net, new);
 	}
 
-	/* Overload tuple linked list to put us in unconfirmed list. */
-	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
-		       &net->ct.unconfirmed);
+	spin_unlock(&nf_conntrack_lock);
 
-	spin_unlock_bh(&nf_conntrack_lock);
+	/* Overload tuple linked list to put us in unconfirmed list. */
+	nf_ct_add_to_unconfirmed_list(ct);
+	local_bh_enable();
 
 	if (exp) {
 		if (exp->expectfn)
@@ -825,6 +1020,104 @@ init_conntrack(struct net *net, struct nf_conn *tmpl,
 	return &ct->tuplehash[IP_CT_DIR_ORIGINAL];
 }
 
+/*
+ * Last conntrack found by each cpu. Packet trains of one flow (forwarding,
+ * tethering) then skip the chain walk. The slot holds a reference to the
+ * conntrack, dropped when the slot is replaced or flushed, so the cached
+ * entry stays allocated; it is still validated against the tuple, as it
+ * may have died or left the hash table since.
+ *
+ * The slot is only filled by its own cpu with BHs disabled, but it may be
+ * emptied from any cpu, so whoever takes the pointer out of it with
+ * xchg()/cmpxchg() owns the reference.
+ */
+struct nf_ct_flow_cache {
+	struct nf_conntrack_tuple_hash *h;
+	u32 hash;
+};
+
+static DEFINE_PER_CPU(struct nf_ct_flow_cache, nf_ct_flow_cache);
+
+static void nf_ct_flow_cache_evict(struct nf_ct_flow_cache *fc,
+				   struct nf_conntrack_tuple_hash *h)
+{
+	if (cmpxchg(&fc->h, h, NULL) == h)
+		nf_ct_put(nf_ct_tuplehash_to_ctrack(h));
+}
+
+/* Called under rcu_read_lock() */
+static struct nf_conntrack_tuple_hash *
+nf_ct_flow_cache_get(struct net *net, u16 zone,
+		     const struct nf_conntrack_tuple *tuple, u32 hash)
+{
+	struct nf_ct_flow_cache *fc;
+	struct nf_conntrack_tuple_hash *h;
+	struct nf_conn *ct;
+
+	local_bh_disable();
+	fc = &__get_cpu_var(nf_ct_flow_cache);
+	h = ACCESS_ONCE(fc->h);
+	if (!h || fc->hash != hash)
+		goto miss;
+
+	ct = nf_ct_tuplehash_to_ctrack(h);
+	if (unlikely(nf_ct_is_dying(ct))) {
+		nf_ct_flow_cache_evict(fc, h);
+		goto miss;
+	}
+	if (unlikely(!atomic_inc_not_zero(&ct->ct_general.use)))
+		goto miss;
+	if (unlikely(!nf_ct_is_confirmed(ct) ||
+		     !nf_ct_tuple_equal(tuple, &h->tuple) ||
+		     nf_ct_zone(ct) != zone ||
+		     !net_eq(nf_ct_net(ct), net))) {
+		nf_ct_put(ct);
+		goto miss;
+	}
+	local_bh_enable();
+
+	NF_CT_STAT_INC(net, found);
+	return h;
+
+miss:
+	local_bh_enable();
+	return NULL;
+}
+
+/* @h is referenced by the caller, the slot takes a reference of its own */
+static void nf_ct_flow_cache_set(struct nf_conntrack_tuple_hash *h, u32 hash)
+{
+	struct nf_ct_flow_cache *fc;
+	struct nf_conntrack_tuple_hash *old;
+
+	nf_conntrack_get(&nf_ct_tuplehash_to_ctrack(h)->ct_general);
+
+	local_bh_disable();
+	fc = &__get_cpu_var(nf_ct_flow_cache);
+	fc->hash = hash;
+	old = xchg(&fc->h, h);
+	if (old)
+		nf_ct_put(nf_ct_tuplehash_to_ctrack(old));
+	local_bh_enable();
+}
+
+/* Drop the references the slots hold on conntracks of @net */
+static void nf_ct_flow_cache_flush(struct net *net)
+{
+	int cpu;
+
+	rcu_read_lock();
+	for_each_possible_cpu(cpu) {
+		struct nf_ct_flow_cache *fc = &per_cpu(nf_ct_flow_cache, cpu);
+		struct nf_conntrack_tuple_hash *h = ACCESS_ONCE(fc->h);
+
+		/* the conntrack slab is type stable under RCU */
+		if (h && net_eq(nf_ct_net(nf_ct_tuplehash_to_ctrack(h)), net))
+			nf_ct_flow_cache_evict(fc, h);
+	}
+	rcu_read_unlock();
+}
+
 /* On success, returns conntrack ptr, sets skb->nfct and ctinfo */
 static inline struct nf_conn *
 resolve_normal_ct(struct net *net, struct nf_conn *tmpl,
@@ -852,7 +1145,12 @@ resolve_normal_ct(struct net *net, struct nf_conn *tmpl,
 
 	/* look for tuple match */
 	hash = hash_conntrack_raw(&tuple, zone);
-	h = __nf_conntrack_find_get(net, zone, &tuple, hash);
+	h = nf_ct_flow_cache_get(net, zone, &tuple, hash);
+	if (!h) {
+		h = __nf_conntrack_find_get(net, zone, &tuple, hash);
+		if (h)
+			nf_ct_flow_cache_set(h, hash);
+	}
 	if (!h) {
 		h = init_conntrack(net, tmpl, &tuple, l3proto, l4proto,
 				   skb, dataoff, hash);
@@ -1179,25 +1477,42 @@ get_next_corpse(struct net *net, int (*iter)(struct nf_conn *i, void *data),
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct;
 	struct hlist_nulls_node *n;
+	struct ct_pcpu *pcpu;
+	spinlock_t *lockp;
+	int cpu;
 
-	spin_lock_bh(&nf_conntrack_lock);
 	for (; *bucket < net->ct.htable_size; (*bucket)++) {
-		hlist_nulls_for_each_entry(h, n, &net->ct.hash[*bucket], hnnode) {
+		lockp = &nf_conntrack_locks[*bucket % CONNTRACK_LOCKS];
+		local_bh_disable();
+		nf_conntrack_bucket_lock(lockp);
+		if (*bucket < net->ct.htable_size) {
+			hlist_nulls_for_each_entry(h, n, &net->ct.hash[*bucket],
+						   hnnode) {
+				ct = nf_ct_tuplehash_to_ctrack(h);
+				if (iter(ct, data))
+					goto found;
+			}
+		}
+		spin_unlock(lockp);
+		local_bh_enable();
+	}
+
+	for_each_possible_cpu(cpu) {
+		pcpu = per_cpu_ptr(net->ct.pcpu_lists, cpu);
+
+		spin_lock_bh(&pcpu->lock);
+		hlist_nulls_for_each_entry(h, n, &pcpu->unconfirmed, hnnode) {
 			ct = nf_ct_tuplehash_to_ctrack(h);
 			if (iter(ct, data))
-				goto found;
+				set_bit(IPS_DYING_BIT, &ct->status);
 		}
+		spin_unlock_bh(&pcpu->lock);
 	}
-	hlist_nulls_for_each_entry(h, n, &net->ct.unconfirmed, hnnode) {
-		ct = nf_ct_tuplehash_to_ctrack(h);
-		if (iter(ct, data))
-			set_bit(IPS_DYING_BIT, &ct->status);
-	}
-	spin_unlock_bh(&nf_conntrack_lock);
 	return NULL;
 found:
 	atomic_inc(&ct->ct_general.use);
-	spin_unlock_bh(&nf_conntrack_lock);
+	spin_unlock(lockp);
+	local_bh_enable();
 	return ct;
 }
 
@@ -1273,14 +1588,20 @@ static void nf_ct_release_dying_list(struct net *net)
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct;
 	struct hlist_nulls_node *n;
+	struct ct_pcpu *pcpu;
+	int cpu;
 
-	spin_lock_bh(&nf_conntrack_lock);
-	hlist_nulls_for_each_entry(h, n, &net->ct.dying, hnnode) {
-		ct = nf_ct_tuplehash_to_ctrack(h);
-		/* never fails to remove them, no listeners at this point */
-		nf_ct_kill(ct);
+	for_each_possible_cpu(cpu) {
+		pcpu = per_cpu_ptr(net->ct.pcpu_lists, cpu);
+
+		spin_lock_bh(&pcpu->lock);
+		hlist_nulls_for_each_entry(h, n, &pcpu->dying, hnnode) {
+			ct = nf_ct_tuplehash_to_ctrack(h);
+			/* never fails to remove them, no listeners at this point */
+			nf_ct_kill(ct);
+		}
+		spin_unlock_bh(&pcpu->lock);
 	}
-	spin_unlock_bh(&nf_conntrack_lock);
 }
 
 static int untrack_refs(void)
@@ -1312,6 +1633,7 @@ static void nf_conntrack_cleanup_net(struct net *net)
  i_see_dead_people:
 	nf_ct_iterate_cleanup(net, kill_all, NULL);
 	nf_ct_release_dying_list(net);
+	nf_ct_flow_cache_flush(net);
 	if (atomic_read(&net->ct.count) != 0) {
 		schedule();
 		goto i_see_dead_people;
@@ -1325,6 +1647,7 @@ static void nf_conntrack_cleanup_net(struct net *net)
 	kmem_cache_destroy(net->ct.nf_conntrack_cachep);
 	kfree(net->ct.slabname);
 	free_percpu(net->ct.stat);
+	free_percpu(net->ct.pcpu_lists);
 }
 
 /* Mishearing the voices in his head, our hero wonders how he's
@@ -1395,12 +1718,13 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 	if (!hash)
 		return -ENOMEM;
 
-	/* Lookups in the old hash might happen in parallel, which means we
-	 * might get false negatives during connection lookup. New connections
-	 * created because of a false negative won't make it into the hash
-	 * though since that required taking the lock.
+	/* Lookups in the old hash might happen in parallel; they notice the
+	 * generation change and restart in the new table. Insertions and
+	 * deletions are held off by the chain locks for the whole move.
 	 */
-	spin_lock_bh(&nf_conntrack_lock);
+	local_bh_disable();
+	nf_conntrack_all_lock();
+	write_seqcount_begin(&nf_conntrack_generation);
 	for (i = 0; i < init_net.ct.htable_size; i++) {
 		while (!hlist_nulls_empty(&init_net.ct.hash[i])) {
 			h = hlist_nulls_entry(init_net.ct.hash[i].first,
@@ -1417,8 +1741,13 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 
 	init_net.ct.htable_size = nf_conntrack_htable_size = hashsize;
 	init_net.ct.hash = hash;
-	spin_unlock_bh(&nf_conntrack_lock);
 
+	write_seqcount_end(&nf_conntrack_generation);
+	nf_conntrack_all_unlock();
+	local_bh_enable();
+
+	/* Wait for lockless readers still walking the old table */
+	synchronize_net();
 	nf_ct_free_hashtable(old_hash, old_size);
 	return 0;
 }
@@ -1439,7 +1768,10 @@ EXPORT_SYMBOL_GPL(nf_ct_untracked_status_or);
 static int nf_conntrack_init_init_net(void)
 {
 	int max_factor = 8;
-	int ret, cpu;
+	int i, ret, cpu;
+
+	for (i = 0; i < CONNTRACK_LOCKS; i++)
+		spin_lock_init(&nf_conntrack_locks[i]);
 
 	/* Idea from tcp.c: use 1/16384 of memory.  On i386: 32MB
 	 * machine has 512 buckets. >= 1GB machines have 16384 buckets. */
@@ -1505,11 +1837,23 @@ err_proto:
 
 static int nf_conntrack_init_net(struct net *net)
 {
-	int ret;
+	int ret, cpu;
 
 	atomic_set(&net->ct.count, 0);
-	INIT_HLIST_NULLS_HEAD(&net->ct.unconfirmed, UNCONFIRMED_NULLS_VAL);
-	INIT_HLIST_NULLS_HEAD(&net->ct.dying, DYING_NULLS_VAL);
+
+	net->ct.pcpu_lists = alloc_percpu(struct ct_pcpu);
+	if (!net->ct.pcpu_lists) {
+		ret = -ENOMEM;
+		goto err_pcpu_lists;
+	}
+	for_each_possible_cpu(cpu) {
+		struct ct_pcpu *pcpu = per_cpu_ptr(net->ct.pcpu_lists, cpu);
+
+		spin_lock_init(&pcpu->lock);
+		INIT_HLIST_NULLS_HEAD(&pcpu->unconfirmed, UNCONFIRMED_NULLS_VAL);
+		INIT_HLIST_NULLS_HEAD(&pcpu->dying, DYING_NULLS_VAL);
+	}
+
 	net->ct.stat = alloc_percpu(struct ip_conntrack_stat);
 	if (!net->ct.stat) {
 		ret = -ENOMEM;
@@ -1568,6 +1912,8 @@ err_cache:
 err_slabname:
 	free_percpu(net->ct.stat);
 err_stat:
+	free_percpu(net->ct.pcpu_lists);
+err_pcpu_lists:
 	return ret;
 }
 
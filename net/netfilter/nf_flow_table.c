@@ -0,0 +1,429 @@
+/*
+ * Software flow table for established connections
+ *
+ * Flows are added for established conntracks by the FLOWOFFLOAD target
+ * and looked up by the per-family PRE_ROUTING hooks, which forward the
+ * matching packets themselves. A flow holds a reference on its conntrack
+ * and on the output route of both directions. Flows are torn down when
+ * they go idle, when the conntrack dies, when TCP sees FIN/RST, or when
+ * one of their devices goes away; the conntrack then continues on the
+ * regular path.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/netdevice.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <net/net_namespace.h>
+#include <net/netns/hash.h>
+#include <net/dst.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_core.h>
+#include <net/netfilter/nf_conntrack_tuple.h>
+#include <net/netfilter/nf_flow_table.h>
+
+static unsigned int nf_flow_hash_size __read_mostly = 1024;
+module_param_named(hashsize, nf_flow_hash_size, uint, 0400);
+MODULE_PARM_DESC(hashsize, "number of flow table buckets");
+
+static struct hlist_head *nf_flow_hash __read_mostly;
+static u32 nf_flow_hash_rnd __read_mostly;
+static unsigned int nf_flow_count;
+static DEFINE_SPINLOCK(nf_flow_lock);
+
+static void nf_flow_gc_work(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(nf_flow_gc, nf_flow_gc_work);
+
+DEFINE_PER_CPU(struct nf_flow_table_stat, nf_flow_table_stat);
+EXPORT_PER_CPU_SYMBOL_GPL(nf_flow_table_stat);
+
+/*
+ * The table is shared by all network namespaces: a flow is identified by
+ * its tuple and the namespace of its conntrack.
+ */
+static u32 flow_offload_hash(struct net *net,
+			     const struct flow_offload_tuple *tuple)
+{
+	return jhash2((const u32 *)tuple, sizeof(*tuple) / sizeof(u32),
+		      nf_flow_hash_rnd ^ net_hash_mix(net)) % nf_flow_hash_size;
+}
+
+static bool flow_offload_match(struct flow_offload_tuple_hash *th,
+			       struct net *net,
+			       const struct flow_offload_tuple *tuple)
+{
+	return !memcmp(&th->tuple, tuple, sizeof(*tuple)) &&
+	       net_eq(nf_ct_net(flow_offload_from_tuplehash(th)->ct), net);
+}
+
+static void flow_offload_fill_dir(struct flow_offload *flow,
+				  struct nf_conn *ct, struct dst_entry *dst,
+				  int iifidx, enum flow_offload_tuple_dir dir)
+{
+	struct flow_offload_tuple_hash *th = &flow->tuplehash[dir];
+	struct flow_offload_tuple *ft = &th->tuple;
+	const struct nf_conntrack_tuple *ctt = &ct->tuplehash[dir].tuple;
+
+	ft->src_v4 = ctt->src.u3.ip;
+	ft->dst_v4 = ctt->dst.u3.ip;
+	ft->src_port = ctt->src.u.all;
+	ft->dst_port = ctt->dst.u.all;
+	ft->l3proto = ctt->src.l3num;
+	ft->l4proto = ctt->dst.protonum;
+	ft->iifidx = iifidx;
+
+	th->dir = dir;
+	th->mtu = dst_mtu(dst);
+	th->dst = dst;
+}
+
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+				struct dst_entry *dst[FLOW_OFFLOAD_DIR_MAX],
+				const int iifidx[FLOW_OFFLOAD_DIR_MAX])
+{
+	struct flow_offload *flow;
+
+	flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+	if (!flow)
+		return NULL;
+
+	nf_conntrack_get(&ct->ct_general);
+	flow->ct = ct;
+
+	dst_hold(dst[FLOW_OFFLOAD_DIR_ORIGINAL]);
+	dst_hold(dst[FLOW_OFFLOAD_DIR_REPLY]);
+	flow_offload_fill_dir(flow, ct, dst[FLOW_OFFLOAD_DIR_ORIGINAL],
+			      iifidx[FLOW_OFFLOAD_DIR_ORIGINAL],
+			      FLOW_OFFLOAD_DIR_ORIGINAL);
+	flow_offload_fill_dir(flow, ct, dst[FLOW_OFFLOAD_DIR_REPLY],
+			      iifidx[FLOW_OFFLOAD_DIR_REPLY],
+			      FLOW_OFFLOAD_DIR_REPLY);
+
+	flow_offload_refresh(flow);
+	return flow;
+}
+EXPORT_SYMBOL_GPL(flow_offload_alloc);
+
+/* Hand the conntrack back to the slow path */
+static void flow_offload_fixup_ct(struct nf_conn *ct)
+{
+	if (nf_ct_protonum(ct) == IPPROTO_TCP) {
+		/* window tracking did not see the offloaded segments */
+		spin_lock_bh(&ct->lock);
+		ct->proto.tcp.seen[0].td_maxwin = 0;
+		ct->proto.tcp.seen[1].td_maxwin = 0;
+		spin_unlock_bh(&ct->lock);
+	}
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+}
+
+void flow_offload_free(struct flow_offload *flow)
+{
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].dst);
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].dst);
+	nf_ct_put(flow->ct);
+	kfree(flow);
+}
+EXPORT_SYMBOL_GPL(flow_offload_free);
+
+static void flow_offload_free_rcu(struct rcu_head *head)
+{
+	flow_offload_free(container_of(head, struct flow_offload, rcu_head));
+}
+
+int flow_offload_add(struct flow_offload *flow)
+{
+	struct net *net = nf_ct_net(flow->ct);
+	struct flow_offload_tuple_hash *th;
+	struct hlist_node *n;
+	u32 h[FLOW_OFFLOAD_DIR_MAX];
+	int dir;
+
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++)
+		h[dir] = flow_offload_hash(net, &flow->tuplehash[dir].tuple);
+
+	spin_lock_bh(&nf_flow_lock);
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++) {
+		hlist_for_each_entry(th, n, &nf_flow_hash[h[dir]], node) {
+			if (flow_offload_match(th, net,
+					       &flow->tuplehash[dir].tuple))
+				goto clash;
+		}
+	}
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++)
+		hlist_add_head_rcu(&flow->tuplehash[dir].node,
+				   &nf_flow_hash[h[dir]]);
+	nf_flow_count++;
+	spin_unlock_bh(&nf_flow_lock);
+
+	NF_FLOW_STAT_INC(added);
+	return 0;
+
+clash:
+	spin_unlock_bh(&nf_flow_lock);
+	NF_FLOW_STAT_INC(add_failed);
+	return -EEXIST;
+}
+EXPORT_SYMBOL_GPL(flow_offload_add);
+
+/* Called with nf_flow_lock held */
+static void flow_offload_del(struct flow_offload *flow)
+{
+	if (test_and_set_bit(FLOW_OFFLOAD_DYING_BIT, &flow->flags))
+		return;
+
+	hlist_del_rcu(&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].node);
+	hlist_del_rcu(&flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node);
+	nf_flow_count--;
+
+	flow_offload_fixup_ct(flow->ct);
+	NF_FLOW_STAT_INC(removed);
+	call_rcu(&flow->rcu_head, flow_offload_free_rcu);
+}
+
+/* Stop fast-forwarding; the flow is unlinked by the next gc run */
+void flow_offload_teardown(struct flow_offload *flow)
+{
+	if (!test_and_set_bit(FLOW_OFFLOAD_TEARDOWN_BIT, &flow->flags))
+		NF_FLOW_STAT_INC(teardown);
+}
+EXPORT_SYMBOL_GPL(flow_offload_teardown);
+
+struct flow_offload_tuple_hash *
+flow_offload_lookup(struct net *net, const struct flow_offload_tuple *tuple)
+{
+	struct flow_offload_tuple_hash *th;
+	struct hlist_node *n;
+
+	hlist_for_each_entry_rcu(th, n,
+				 &nf_flow_hash[flow_offload_hash(net, tuple)],
+				 node) {
+		if (flow_offload_match(th, net, tuple))
+			return th;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(flow_offload_lookup);
+
+/* Keep the conntrack from timing out while the fast path owns it */
+static void flow_offload_extend_ct(struct nf_conn *ct)
+{
+	unsigned long newtime = jiffies + NF_FLOW_TIMEOUT;
+
+	if ((long)(newtime - ct->timeout.expires) >= HZ)
+		mod_timer_pending(&ct->timeout, newtime);
+}
+
+static bool flow_offload_expired(const struct flow_offload *flow)
+{
+	return test_bit(FLOW_OFFLOAD_TEARDOWN_BIT, &flow->flags) ||
+	       nf_ct_is_dying(flow->ct) ||
+	       time_after(jiffies, flow->timeout);
+}
+
+static void nf_flow_gc_work(struct work_struct *work)
+{
+	struct flow_offload_tuple_hash *th;
+	struct flow_offload *flow;
+	struct hlist_node *n, *next;
+	unsigned int i;
+
+	for (i = 0; i < nf_flow_hash_size; i++) {
+		spin_lock_bh(&nf_flow_lock);
+		hlist_for_each_entry_safe(th, n, next, &nf_flow_hash[i], node) {
+			/* visit every flow once, through its original tuple */
+			if (th->dir != FLOW_OFFLOAD_DIR_ORIGINAL)
+				continue;
+			flow = flow_offload_from_tuplehash(th);
+			if (flow_offload_expired(flow))
+				flow_offload_del(flow);
+			else
+				flow_offload_extend_ct(flow->ct);
+		}
+		spin_unlock_bh(&nf_flow_lock);
+	}
+
+	schedule_delayed_work(&nf_flow_gc, HZ);
+}
+
+static bool flow_offload_uses_dev(const struct flow_offload *flow,
+				  const struct net_device *dev)
+{
+	int dir;
+
+	if (!dev)
+		return true;
+
+	for (dir = 0; dir < FLOW_OFFLOAD_DIR_MAX; dir++) {
+		const struct flow_offload_tuple_hash *th = &flow->tuplehash[dir];
+
+		if (th->tuple.iifidx == dev->ifindex &&
+		    net_eq(dev_net(dev), nf_ct_net(flow->ct)))
+			return true;
+		if (th->dst->dev == dev)
+			return true;
+	}
+	return false;
+}
+
+/* Remove the flows going through @dev, or all of them if @dev is NULL */
+static void nf_flow_table_flush(const struct net_device *dev)
+{
+	struct flow_offload_tuple_hash *th;
+	struct flow_offload *flow;
+	struct hlist_node *n, *next;
+	unsigned int i;
+
+	spin_lock_bh(&nf_flow_lock);
+	for (i = 0; i < nf_flow_hash_size; i++) {
+		hlist_for_each_entry_safe(th, n, next, &nf_flow_hash[i], node) {
+			if (th->dir != FLOW_OFFLOAD_DIR_ORIGINAL)
+				continue;
+			flow = flow_offload_from_tuplehash(th);
+			if (flow_offload_uses_dev(flow, dev))
+				flow_offload_del(flow);
+		}
+	}
+	spin_unlock_bh(&nf_flow_lock);
+}
+
+static int nf_flow_netdev_event(struct notifier_block *this,
+				unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+
+	if (event == NETDEV_DOWN || event == NETDEV_UNREGISTER)
+		nf_flow_table_flush(dev);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block nf_flow_netdev_notifier = {
+	.notifier_call	= nf_flow_netdev_event,
+};
+
+#ifdef CONFIG_PROC_FS
+static int nf_flow_stat_show(struct seq_file *seq, void *v)
+{
+	struct nf_flow_table_stat sum;
+	int cpu;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		const struct nf_flow_table_stat *st =
+			&per_cpu(nf_flow_table_stat, cpu);
+
+		sum.found	+= st->found;
+		sum.added	+= st->added;
+		sum.add_failed	+= st->add_failed;
+		sum.removed	+= st->removed;
+		sum.teardown	+= st->teardown;
+		sum.slowpath	+= st->slowpath;
+	}
+
+	seq_printf(seq, "entries:    %u\n", ACCESS_ONCE(nf_flow_count));
+	seq_printf(seq, "found:      %u\n", sum.found);
+	seq_printf(seq, "slowpath:   %u\n", sum.slowpath);
+	seq_printf(seq, "added:      %u\n", sum.added);
+	seq_printf(seq, "add_failed: %u\n", sum.add_failed);
+	seq_printf(seq, "removed:    %u\n", sum.removed);
+	seq_printf(seq, "teardown:   %u\n", sum.teardown);
+	return 0;
+}
+
+static int nf_flow_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nf_flow_stat_show, NULL);
+}
+
+static const struct file_operations nf_flow_stat_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = nf_flow_stat_open,
+	.read	 = seq_read,
+	.llseek	 = seq_lseek,
+	.release = single_release,
+};
+
+static int __init nf_flow_table_init_proc(void)
+{
+	if (!proc_create("nf_flow_table", S_IRUGO, init_net.proc_net_stat,
+			 &nf_flow_stat_fops))
+		return -ENOMEM;
+	return 0;
+}
+
+static void nf_flow_table_fini_proc(void)
+{
+	remove_proc_entry("nf_flow_table", init_net.proc_net_stat);
+}
+#else
+static int __init nf_flow_table_init_proc(void)
+{
+	return 0;
+}
+
+static void nf_flow_table_fini_proc(void)
+{
+}
+#endif /* CONFIG_PROC_FS */
+
+static int __init nf_flow_table_init(void)
+{
+	unsigned int i;
+	int ret;
+
+	if (!nf_flow_hash_size)
+		nf_flow_hash_size = 1;
+
+	nf_flow_hash = kcalloc(nf_flow_hash_size, sizeof(struct hlist_head),
+			       GFP_KERNEL);
+	if (!nf_flow_hash)
+		return -ENOMEM;
+	for (i = 0; i < nf_flow_hash_size; i++)
+		INIT_HLIST_HEAD(&nf_flow_hash[i]);
+	get_random_bytes(&nf_flow_hash_rnd, sizeof(nf_flow_hash_rnd));
+
+	ret = nf_flow_table_init_proc();
+	if (ret < 0)
+		goto err_proc;
+
+	ret = register_netdevice_notifier(&nf_flow_netdev_notifier);
+	if (ret < 0)
+		goto err_notifier;
+
+	schedule_delayed_work(&nf_flow_gc, HZ);
+	return 0;
+
+err_notifier:
+	nf_flow_table_fini_proc();
+err_proc:
+	kfree(nf_flow_hash);
+	return ret;
+}
+
+static void __exit nf_flow_table_fini(void)
+{
+	cancel_delayed_work_sync(&nf_flow_gc);
+	unregister_netdevice_notifier(&nf_flow_netdev_notifier);
+	nf_flow_table_flush(NULL);
+	rcu_barrier();
+	nf_flow_table_fini_proc();
+	kfree(nf_flow_hash);
+}
+
+module_init(nf_flow_table_init);
+module_exit(nf_flow_table_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Software flow table for established connections");
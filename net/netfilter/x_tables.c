@@ -721,6 +721,11 @@ void xt_free_table_info(struct xt_table_info *info)
 
 	free_percpu(info->stackptr);
 
+	if (is_vmalloc_addr(info->compiled))
+		vfree(info->compiled);
+	else
+		kfree(info->compiled);
+
 	kfree(info);
 }
 EXPORT_SYMBOL(xt_free_table_info);
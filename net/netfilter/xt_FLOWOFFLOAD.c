@@ -0,0 +1,135 @@
+/*
+ * xt_FLOWOFFLOAD - move established connections to the flow table
+ *
+ * Used in the FORWARD chain, typically as
+ *	iptables -A FORWARD -m conntrack --ctstate ESTABLISHED -j FLOWOFFLOAD
+ * Once both directions of a TCP or UDP connection have been seen, its
+ * packets are forwarded by the flow table PRE_ROUTING hook and no longer
+ * traverse routing, ip_tables or NAT.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/x_tables.h>
+#include <net/route.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_flow_table.h>
+
+MODULE_DESCRIPTION("Xtables: move established connections to the flow table");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS("ipt_FLOWOFFLOAD");
+
+static bool flowoffload_ct_ok(struct nf_conn *ct)
+{
+	if (nf_ct_is_untracked(ct) || nf_ct_is_dying(ct))
+		return false;
+	if (!test_bit(IPS_SEEN_REPLY_BIT, &ct->status) ||
+	    test_bit(IPS_SEQ_ADJUST_BIT, &ct->status))
+		return false;
+	/* helpers need to see every packet */
+	if (nfct_help(ct))
+		return false;
+
+	switch (nf_ct_protonum(ct)) {
+	case IPPROTO_TCP:
+		return ct->proto.tcp.state == TCP_CONNTRACK_ESTABLISHED;
+	case IPPROTO_UDP:
+		return true;
+	}
+	return false;
+}
+
+/* Route of the other direction, which leaves through our input device */
+static struct dst_entry *flowoffload_reverse_route(struct net *net,
+						   const struct nf_conn *ct,
+						   enum ip_conntrack_dir dir,
+						   const struct net_device *in)
+{
+	struct flowi4 fl4 = {
+		.daddr		= ct->tuplehash[dir].tuple.src.u3.ip,
+		.flowi4_oif	= in->ifindex,
+	};
+	struct rtable *rt;
+
+	rt = ip_route_output_key(net, &fl4);
+	if (IS_ERR(rt))
+		return NULL;
+	if (rt->dst.dev != in) {
+		ip_rt_put(rt);
+		return NULL;
+	}
+	return &rt->dst;
+}
+
+static unsigned int
+flowoffload_tg(struct sk_buff *skb, const struct xt_action_param *par)
+{
+	struct dst_entry *dst[FLOW_OFFLOAD_DIR_MAX];
+	int iifidx[FLOW_OFFLOAD_DIR_MAX];
+	enum ip_conntrack_info ctinfo;
+	enum ip_conntrack_dir dir;
+	struct flow_offload *flow;
+	struct dst_entry *rdst;
+	struct nf_conn *ct;
+
+	ct = nf_ct_get(skb, &ctinfo);
+	if (ct == NULL || !flowoffload_ct_ok(ct) || !skb_dst(skb))
+		return XT_CONTINUE;
+
+	if (test_and_set_bit(IPS_OFFLOAD_BIT, &ct->status))
+		return XT_CONTINUE;
+
+	dir = CTINFO2DIR(ctinfo);
+	rdst = flowoffload_reverse_route(dev_net(par->in), ct, dir, par->in);
+	if (!rdst)
+		goto err;
+
+	dst[dir] = skb_dst(skb);
+	dst[!dir] = rdst;
+	iifidx[dir] = par->in->ifindex;
+	iifidx[!dir] = par->out->ifindex;
+
+	flow = flow_offload_alloc(ct, dst, iifidx);
+	dst_release(rdst);
+	if (!flow)
+		goto err;
+
+	if (flow_offload_add(flow) < 0) {
+		flow_offload_free(flow);
+		goto err;
+	}
+	return XT_CONTINUE;
+
+err:
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+	return XT_CONTINUE;
+}
+
+static struct xt_target flowoffload_tg_reg __read_mostly = {
+	.name		= "FLOWOFFLOAD",
+	.revision	= 0,
+	.family		= NFPROTO_IPV4,
+	.table		= "filter",
+	.hooks		= 1 << NF_INET_FORWARD,
+	.target		= flowoffload_tg,
+	.me		= THIS_MODULE,
+};
+
+static int __init flowoffload_tg_init(void)
+{
+	return xt_register_target(&flowoffload_tg_reg);
+}
+
+static void __exit flowoffload_tg_exit(void)
+{
+	xt_unregister_target(&flowoffload_tg_reg);
+}
+
+module_init(flowoffload_tg_init);
+module_exit(flowoffload_tg_exit);
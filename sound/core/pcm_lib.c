@@ -23,6 +23,7 @@
 #include <linux/slab.h>
 #include <linux/time.h>
 #include <linux/math64.h>
+#include <linux/moduleparam.h>
 #include <sound/core.h>
 #include <sound/control.h>
 #include <sound/info.h>
@@ -1742,6 +1743,92 @@ void snd_pcm_period_elapsed(struct snd_pcm_substream *substream)
 
 EXPORT_SYMBOL(snd_pcm_period_elapsed);
 
+/*
+ * Wakeups between period interrupts
+ *
+ * When user space asks to be woken up before a whole period is available
+ * (avail_min below period_size), hardware that reports an accurate
+ * position is polled with an hrtimer every avail_min frames. Sleepers and
+ * poll() then see the new hw_ptr without waiting for the next period
+ * interrupt, so small latencies don't require small periods.
+ */
+static unsigned int wakeup_min_us = 1000;
+module_param(wakeup_min_us, uint, 0644);
+MODULE_PARM_DESC(wakeup_min_us, "Shortest wakeup interval for avail_min below the period size in usecs (0 = period interrupts only).");
+
+static enum hrtimer_restart snd_pcm_wakeup_timer_func(struct hrtimer *timer)
+{
+	struct snd_pcm_substream *substream =
+		container_of(timer, struct snd_pcm_substream, wakeup_timer);
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	unsigned long flags;
+
+	snd_pcm_stream_lock_irqsave(substream, flags);
+	/*
+	 * The timer may have been restarted while we waited for the lock,
+	 * it then must not be forwarded again: the new expiry stands.
+	 */
+	if (hrtimer_is_queued(timer))
+		goto unlock;
+	if (substream->runtime && substream->wakeup_interval.tv64 &&
+	    snd_pcm_running(substream) &&
+	    snd_pcm_update_hw_ptr(substream) >= 0) {
+		hrtimer_forward_now(timer, substream->wakeup_interval);
+		ret = HRTIMER_RESTART;
+	}
+ unlock:
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
+	return ret;
+}
+
+void snd_pcm_wakeup_timer_init(struct snd_pcm_substream *substream)
+{
+	hrtimer_init(&substream->wakeup_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	substream->wakeup_timer.function = snd_pcm_wakeup_timer_func;
+}
+
+/*
+ * Compute the wakeup interval from the current sw params and apply it to
+ * a running stream. Call with the stream lock held.
+ */
+void snd_pcm_wakeup_timer_setup(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_uframes_t avail_min = runtime->control->avail_min;
+	u64 ns = 0;
+
+	if (wakeup_min_us && runtime->rate &&
+	    avail_min < runtime->period_size &&
+	    !(runtime->info & SNDRV_PCM_INFO_BATCH)) {
+		ns = div_u64((u64)avail_min * NSEC_PER_SEC, runtime->rate);
+		ns = max_t(u64, ns, (u64)wakeup_min_us * NSEC_PER_USEC);
+	}
+	substream->wakeup_interval = ns_to_ktime(ns);
+
+	if (snd_pcm_running(substream)) {
+		snd_pcm_wakeup_timer_stop(substream);
+		snd_pcm_wakeup_timer_start(substream);
+	}
+}
+
+/* Both are called with the stream lock held */
+void snd_pcm_wakeup_timer_start(struct snd_pcm_substream *substream)
+{
+	if (substream->wakeup_interval.tv64)
+		hrtimer_start(&substream->wakeup_timer,
+			      substream->wakeup_interval, HRTIMER_MODE_REL);
+}
+
+void snd_pcm_wakeup_timer_stop(struct snd_pcm_substream *substream)
+{
+	/*
+	 * A handler already waiting for the lock stops by itself, or leaves
+	 * the timer alone if it has been started again meanwhile.
+	 */
+	hrtimer_try_to_cancel(&substream->wakeup_timer);
+}
+
 /*
  * Wait until avail_min data becomes available
  * Returns a negative error code if any error occurs during operation.
@@ -450,6 +450,7 @@ static int snd_pcm_hw_params(struct snd_pcm_substream *substream,
 	runtime->tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
 	runtime->period_step = 1;
 	runtime->control->avail_min = runtime->period_size;
+	substream->wakeup_interval = ktime_set(0, 0);
 	runtime->start_threshold = 1;
 	runtime->stop_threshold = runtime->buffer_size;
 	runtime->silence_threshold = 0;
@@ -563,6 +564,7 @@ static int snd_pcm_sw_params(struct snd_pcm_substream *substream,
 	runtime->silence_threshold = params->silence_threshold;
 	runtime->silence_size = params->silence_size;
         params->boundary = runtime->boundary;
+	snd_pcm_wakeup_timer_setup(substream);
 	if (snd_pcm_running(substream)) {
 		if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK &&
 		    runtime->silence_size > 0)
@@ -885,6 +887,7 @@ static void snd_pcm_post_start(struct snd_pcm_substream *substream, int state)
 	if (substream->timer)
 		snd_timer_notify(substream->timer, SNDRV_TIMER_EVENT_MSTART,
 				 &runtime->trigger_tstamp);
+	snd_pcm_wakeup_timer_start(substream);
 }
 
 static struct action_ops snd_pcm_action_start = {
@@ -927,6 +930,7 @@ static int snd_pcm_do_stop(struct snd_pcm_substream *substream, int state)
 static void snd_pcm_post_stop(struct snd_pcm_substream *substream, int state)
 {
 	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_wakeup_timer_stop(substream);
 	if (runtime->status->state != state) {
 		snd_pcm_trigger_tstamp(substream);
 		if (substream->timer)
@@ -1020,6 +1024,7 @@ static void snd_pcm_post_pause(struct snd_pcm_substream *substream, int push)
 	snd_pcm_trigger_tstamp(substream);
 	if (push) {
 		runtime->status->state = SNDRV_PCM_STATE_PAUSED;
+		snd_pcm_wakeup_timer_stop(substream);
 		if (substream->timer)
 			snd_timer_notify(substream->timer,
 					 SNDRV_TIMER_EVENT_MPAUSE,
@@ -1032,6 +1037,7 @@ static void snd_pcm_post_pause(struct snd_pcm_substream *substream, int push)
 			snd_timer_notify(substream->timer,
 					 SNDRV_TIMER_EVENT_MCONTINUE,
 					 &runtime->trigger_tstamp);
+		snd_pcm_wakeup_timer_start(substream);
 	}
 }
 
@@ -1080,6 +1086,7 @@ static void snd_pcm_post_suspend(struct snd_pcm_substream *substream, int state)
 	if (substream->timer)
 		snd_timer_notify(substream->timer, SNDRV_TIMER_EVENT_MSUSPEND,
 				 &runtime->trigger_tstamp);
+	snd_pcm_wakeup_timer_stop(substream);
 	runtime->status->suspended_state = runtime->status->state;
 	runtime->status->state = SNDRV_PCM_STATE_SUSPENDED;
 	wake_up(&runtime->sleep);
@@ -1183,6 +1190,8 @@ static void snd_pcm_post_resume(struct snd_pcm_substream *substream, int state)
 		snd_timer_notify(substream->timer, SNDRV_TIMER_EVENT_MRESUME,
 				 &runtime->trigger_tstamp);
 	runtime->status->state = runtime->status->suspended_state;
+	if (snd_pcm_running(substream))
+		snd_pcm_wakeup_timer_start(substream);
 }
 
 static struct action_ops snd_pcm_action_resume = {
@@ -2012,6 +2021,7 @@ void snd_pcm_release_substream(struct snd_pcm_substream *substream)
 		return;
 
 	snd_pcm_drop(substream);
+	hrtimer_cancel(&substream->wakeup_timer);
 	if (substream->hw_opened) {
 		if (substream->ops->hw_free != NULL)
 			substream->ops->hw_free(substream);
@@ -3018,8 +3028,22 @@ static unsigned int snd_pcm_capture_poll(struct file *file, poll_table * wait)
 /*
  * Only on coherent architectures, we can mmap the status and the control records
  * for effcient data transfer.  On others, we have to use HWSYNC ioctl...
+ *
+ * On ARM the user mapping shares the page with the kernel's lowmem
+ * mapping, which is coherent as long as the data cache can't alias (always
+ * the case from ARMv7 on). User space then reads hw_ptr and writes appl_ptr
+ * without SNDRV_PCM_IOCTL_SYNC_PTR.
  */
-#if defined(CONFIG_X86) || defined(CONFIG_PPC) || defined(CONFIG_ALPHA)
+#if defined(CONFIG_X86) || defined(CONFIG_PPC) || defined(CONFIG_ALPHA) || \
+	defined(CONFIG_ARM)
+#ifdef CONFIG_ARM
+#include <asm/cachetype.h>
+#define pcm_status_mmap_coherent() \
+	(!cache_is_vivt() && !cache_is_vipt_aliasing())
+#else
+#define pcm_status_mmap_coherent()	1
+#endif
+
 /*
  * mmap status record
  */
@@ -3046,6 +3070,8 @@ static int snd_pcm_mmap_status(struct snd_pcm_substream *substream, struct file
 			       struct vm_area_struct *area)
 {
 	long size;
+	if (!pcm_status_mmap_coherent())
+		return -ENXIO;
 	if (!(area->vm_flags & VM_READ))
 		return -EINVAL;
 	size = area->vm_end - area->vm_start;
@@ -3083,6 +3109,8 @@ static int snd_pcm_mmap_control(struct snd_pcm_substream *substream, struct file
 				struct vm_area_struct *area)
 {
 	long size;
+	if (!pcm_status_mmap_coherent())
+		return -ENXIO;
 	if (!(area->vm_flags & VM_READ))
 		return -EINVAL;
 	size = area->vm_end - area->vm_start;
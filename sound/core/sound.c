@@ -231,6 +231,10 @@ static int snd_kernel_minor(int type, struct snd_card *card, int dev)
 			return -EINVAL;
 		minor = SNDRV_MINOR(card->number, type);
 		break;
+	case SNDRV_DEVICE_TYPE_COMPRESS:
+		if (snd_BUG_ON(dev >= SNDRV_MINOR_COMPRESSES))
+			return -EINVAL;
+		/* fall through */
 	case SNDRV_DEVICE_TYPE_HWDEP:
 	case SNDRV_DEVICE_TYPE_RAWMIDI:
 	case SNDRV_DEVICE_TYPE_PCM_PLAYBACK:
@@ -403,6 +407,8 @@ static const char *snd_device_type_name(int type)
 		return "sequencer";
 	case SNDRV_DEVICE_TYPE_TIMER:
 		return "timer";
+	case SNDRV_DEVICE_TYPE_COMPRESS:
+		return "compressed audio";
 	default:
 		return "?";
 	}
@@ -35,6 +35,9 @@
 #include <sound/rawmidi.h>
 #include <sound/info.h>
 #include <sound/initval.h>
+#ifdef CONFIG_SND_DUMMY_COMPRESS
+#include <sound/compress_driver.h>
+#endif
 
 MODULE_AUTHOR("Jaroslav Kysela <perex@perex.cz>");
 MODULE_DESCRIPTION("Dummy soundcard (/dev/null)");
@@ -135,6 +138,9 @@ struct snd_dummy {
 	int mixer_volume[MIXER_ADDR_LAST+1][2];
 	int capture_source[MIXER_ADDR_LAST+1][2];
 	const struct dummy_timer_ops *timer_ops;
+#ifdef CONFIG_SND_DUMMY_COMPRESS
+	struct snd_compr compr;
+#endif
 };
 
 /*
@@ -715,6 +721,333 @@ static int __devinit snd_card_dummy_pcm(struct snd_dummy *dummy, int device,
 	return 0;
 }
 
+#ifdef CONFIG_SND_DUMMY_COMPRESS
+/*
+ * compressed offload playback
+ *
+ * A software reference for the compressed stream API: the "DSP" renders
+ * S16_LE PCM in real time from the ring buffer, but only looks at it once
+ * per batch of half the buffer, like an offload DSP that decodes in large
+ * blocks. The writer is woken up at the same rate, so with a buffer of
+ * several seconds the CPU sleeps between refills.
+ */
+
+#define DUMMY_COMPR_FRAGMENT_MIN	1024
+#define DUMMY_COMPR_FRAGMENT_MAX	(64*1024)
+#define DUMMY_COMPR_FRAGMENTS_MIN	2
+#define DUMMY_COMPR_FRAGMENTS_MAX	32
+
+struct dummy_compr_stream {
+	struct snd_compr_stream *stream;
+	spinlock_t lock;
+	struct hrtimer timer;
+	struct snd_codec codec;
+	unsigned int byte_rate;		/* rendering speed in bytes/s */
+	ktime_t batch_time;		/* time to render one batch */
+	u64 written;			/* bytes queued by the application */
+	u64 base_bytes;			/* rendered up to base_time */
+	ktime_t base_time;
+	bool running;
+	bool draining;
+	u32 encoder_delay;
+	u32 encoder_padding;
+};
+
+/* Call with dcs->lock held */
+static u64 dummy_compr_rendered(struct dummy_compr_stream *dcs)
+{
+	u64 pos = dcs->base_bytes;
+
+	if (dcs->running) {
+		u64 ns = ktime_to_ns(ktime_sub(ktime_get(), dcs->base_time));
+
+		pos += div_u64(ns * dcs->byte_rate, NSEC_PER_SEC);
+	}
+	return min(pos, dcs->written);
+}
+
+/* Call with dcs->lock held */
+static void dummy_compr_rebase(struct dummy_compr_stream *dcs)
+{
+	dcs->base_bytes = dummy_compr_rendered(dcs);
+	dcs->base_time = ktime_get();
+}
+
+/* Call with dcs->lock held */
+static ktime_t dummy_compr_time_left(struct dummy_compr_stream *dcs)
+{
+	u64 bytes = dcs->written - dummy_compr_rendered(dcs);
+
+	return ns_to_ktime(div_u64(bytes * NSEC_PER_SEC, dcs->byte_rate) + 1);
+}
+
+static enum hrtimer_restart dummy_compr_timer(struct hrtimer *timer)
+{
+	struct dummy_compr_stream *dcs =
+		container_of(timer, struct dummy_compr_stream, timer);
+	unsigned long flags;
+	ktime_t next = dcs->batch_time;
+	bool drained = false;
+
+	spin_lock_irqsave(&dcs->lock, flags);
+	if (!dcs->running) {
+		spin_unlock_irqrestore(&dcs->lock, flags);
+		return HRTIMER_NORESTART;
+	}
+	if (dcs->draining) {
+		/* wake up exactly when the last byte has been rendered */
+		if (dummy_compr_rendered(dcs) == dcs->written) {
+			dcs->running = false;
+			drained = true;
+		} else if (dummy_compr_time_left(dcs).tv64 < next.tv64) {
+			next = dummy_compr_time_left(dcs);
+		}
+	}
+	spin_unlock_irqrestore(&dcs->lock, flags);
+
+	if (drained) {
+		snd_compr_drain_notify(dcs->stream);
+		return HRTIMER_NORESTART;
+	}
+	snd_compr_fragment_elapsed(dcs->stream);
+	hrtimer_forward_now(timer, next);
+	return HRTIMER_RESTART;
+}
+
+static int dummy_compr_open(struct snd_compr_stream *stream)
+{
+	struct dummy_compr_stream *dcs;
+
+	dcs = kzalloc(sizeof(*dcs), GFP_KERNEL);
+	if (!dcs)
+		return -ENOMEM;
+	dcs->stream = stream;
+	spin_lock_init(&dcs->lock);
+	hrtimer_init(&dcs->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	dcs->timer.function = dummy_compr_timer;
+	stream->runtime->private_data = dcs;
+	return 0;
+}
+
+static int dummy_compr_free(struct snd_compr_stream *stream)
+{
+	struct dummy_compr_stream *dcs = stream->runtime->private_data;
+
+	hrtimer_cancel(&dcs->timer);
+	kfree(dcs);
+	return 0;
+}
+
+static int dummy_compr_set_params(struct snd_compr_stream *stream,
+				  struct snd_compr_params *params)
+{
+	struct dummy_compr_stream *dcs = stream->runtime->private_data;
+	struct snd_codec *codec = &params->codec;
+	u64 batch;
+
+	if (codec->id != SND_AUDIOCODEC_PCM ||
+	    codec->ch_in > USE_CHANNELS_MAX ||
+	    codec->sample_rate < USE_RATE_MIN ||
+	    codec->sample_rate > USE_RATE_MAX)
+		return -EINVAL;
+	if (params->buffer.fragment_size < DUMMY_COMPR_FRAGMENT_MIN ||
+	    params->buffer.fragment_size > DUMMY_COMPR_FRAGMENT_MAX ||
+	    params->buffer.fragments < DUMMY_COMPR_FRAGMENTS_MIN ||
+	    params->buffer.fragments > DUMMY_COMPR_FRAGMENTS_MAX)
+		return -EINVAL;
+
+	dcs->codec = *codec;
+	dcs->codec.format = SNDRV_PCM_FORMAT_S16_LE;
+	dcs->byte_rate = codec->sample_rate * codec->ch_in * 2;
+	/* half the buffer, in whole fragments */
+	batch = (u64)params->buffer.fragment_size *
+		max(params->buffer.fragments / 2, 1U);
+	dcs->batch_time = ns_to_ktime(div_u64(batch * NSEC_PER_SEC,
+					      dcs->byte_rate));
+	return 0;
+}
+
+static int dummy_compr_get_params(struct snd_compr_stream *stream,
+				  struct snd_codec *params)
+{
+	struct dummy_compr_stream *dcs = stream->runtime->private_data;
+
+	*params = dcs->codec;
+	return 0;
+}
+
+static int dummy_compr_set_metadata(struct snd_compr_stream *stream,
+				    struct snd_compr_metadata *metadata)
+{
+	struct dummy_compr_stream *dcs = stream->runtime->private_data;
+
+	switch (metadata->key) {
+	case SNDRV_COMPRESS_ENCODER_DELAY:
+		dcs->encoder_delay = metadata->value[0];
+		return 0;
+	case SNDRV_COMPRESS_ENCODER_PADDING:
+		dcs->encoder_padding = metadata->value[0];
+		return 0;
+	}
+	return -EINVAL;
+}
+
+static int dummy_compr_get_metadata(struct snd_compr_stream *stream,
+				    struct snd_compr_metadata *metadata)
+{
+	struct dummy_compr_stream *dcs = stream->runtime->private_data;
+
+	switch (metadata->key) {
+	case SNDRV_COMPRESS_ENCODER_DELAY:
+		metadata->value[0] = dcs->encoder_delay;
+		return 0;
+	case SNDRV_COMPRESS_ENCODER_PADDING:
+		metadata->value[0] = dcs->encoder_padding;
+		return 0;
+	}
+	return -EINVAL;
+}
+
+static int dummy_compr_trigger(struct snd_compr_stream *stream, int cmd)
+{
+	struct dummy_compr_stream *dcs = stream->runtime->private_data;
+	ktime_t timeout = dcs->batch_time;
+	unsigned long flags;
+	bool start = false;
+
+	spin_lock_irqsave(&dcs->lock, flags);
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+		dcs->base_time = ktime_get();
+		dcs->running = true;
+		start = true;
+		break;
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		dummy_compr_rebase(dcs);
+		dcs->running = false;
+		break;
+	case SNDRV_PCM_TRIGGER_STOP:
+		dcs->running = false;
+		dcs->draining = false;
+		dcs->written = 0;
+		dcs->base_bytes = 0;
+		break;
+	case SND_COMPR_TRIGGER_DRAIN:
+		dcs->draining = true;
+		if (dcs->running) {
+			timeout = dummy_compr_time_left(dcs);
+			start = true;
+		}
+		break;
+	default:
+		spin_unlock_irqrestore(&dcs->lock, flags);
+		return -EINVAL;
+	}
+	spin_unlock_irqrestore(&dcs->lock, flags);
+
+	/*
+	 * The timer may be running, e.g. when a drain starts: it has to be
+	 * stopped before being armed again. The callback takes no lock held
+	 * on this path.
+	 */
+	if (start || cmd != SND_COMPR_TRIGGER_DRAIN)
+		hrtimer_cancel(&dcs->timer);
+	if (start)
+		hrtimer_start(&dcs->timer, timeout, HRTIMER_MODE_REL);
+	return 0;
+}
+
+static int dummy_compr_pointer(struct snd_compr_stream *stream,
+			       struct snd_compr_tstamp *tstamp)
+{
+	struct dummy_compr_stream *dcs = stream->runtime->private_data;
+	unsigned int frame_bytes = dcs->codec.ch_in * 2;
+	unsigned long flags;
+	u64 pos;
+
+	spin_lock_irqsave(&dcs->lock, flags);
+	pos = dummy_compr_rendered(dcs);
+	spin_unlock_irqrestore(&dcs->lock, flags);
+
+	tstamp->copied_total = pos;
+	tstamp->byte_offset = div64_u64(pos, stream->runtime->buffer_size);
+	tstamp->byte_offset = pos - (u64)tstamp->byte_offset *
+				    stream->runtime->buffer_size;
+	tstamp->pcm_frames = div_u64(pos, frame_bytes);
+	tstamp->pcm_io_frames = tstamp->pcm_frames;
+	tstamp->sampling_rate = dcs->codec.sample_rate;
+	return 0;
+}
+
+static int dummy_compr_ack(struct snd_compr_stream *stream, size_t bytes)
+{
+	struct dummy_compr_stream *dcs = stream->runtime->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dcs->lock, flags);
+	/* after an underrun, rendering resumes from now */
+	if (dummy_compr_rendered(dcs) == dcs->written)
+		dummy_compr_rebase(dcs);
+	dcs->written += bytes;
+	spin_unlock_irqrestore(&dcs->lock, flags);
+	return 0;
+}
+
+static int dummy_compr_get_caps(struct snd_compr_stream *stream,
+				struct snd_compr_caps *caps)
+{
+	caps->direction = SND_COMPRESS_PLAYBACK;
+	caps->min_fragment_size = DUMMY_COMPR_FRAGMENT_MIN;
+	caps->max_fragment_size = DUMMY_COMPR_FRAGMENT_MAX;
+	caps->min_fragments = DUMMY_COMPR_FRAGMENTS_MIN;
+	caps->max_fragments = DUMMY_COMPR_FRAGMENTS_MAX;
+	caps->num_codecs = 1;
+	caps->codecs[0] = SND_AUDIOCODEC_PCM;
+	return 0;
+}
+
+static int dummy_compr_get_codec_caps(struct snd_compr_stream *stream,
+				      struct snd_compr_codec_caps *codec)
+{
+	static const u32 rates[] = { 8000, 11025, 16000, 22050, 32000,
+				     44100, 48000 };
+	struct snd_codec_desc *desc = &codec->descriptor[0];
+
+	if (codec->codec != SND_AUDIOCODEC_PCM)
+		return -EINVAL;
+	codec->num_descriptors = 1;
+	desc->max_ch = USE_CHANNELS_MAX;
+	memcpy(desc->sample_rates, rates, sizeof(rates));
+	desc->formats = 1 << SNDRV_PCM_FORMAT_S16_LE;
+	return 0;
+}
+
+static struct snd_compr_ops dummy_compr_ops = {
+	.open =		dummy_compr_open,
+	.free =		dummy_compr_free,
+	.set_params =	dummy_compr_set_params,
+	.get_params =	dummy_compr_get_params,
+	.set_metadata =	dummy_compr_set_metadata,
+	.get_metadata =	dummy_compr_get_metadata,
+	.trigger =	dummy_compr_trigger,
+	.pointer =	dummy_compr_pointer,
+	.ack =		dummy_compr_ack,
+	.get_caps =	dummy_compr_get_caps,
+	.get_codec_caps = dummy_compr_get_codec_caps,
+};
+
+static int __devinit snd_card_dummy_compr(struct snd_dummy *dummy)
+{
+	struct snd_compr *compr = &dummy->compr;
+
+	compr->name = "Dummy Compress";
+	compr->ops = &dummy_compr_ops;
+	compr->private_data = dummy;
+	return snd_compress_new(dummy->card, 0, SND_COMPRESS_PLAYBACK, compr);
+}
+#endif /* CONFIG_SND_DUMMY_COMPRESS */
+
 /*
  * mixer interface
  */
@@ -1009,6 +1342,11 @@ static int __devinit snd_dummy_probe(struct platform_device *devptr)
 		if (err < 0)
 			goto __nodev;
 	}
+#ifdef CONFIG_SND_DUMMY_COMPRESS
+	err = snd_card_dummy_compr(dummy);
+	if (err < 0)
+		goto __nodev;
+#endif
 
 	dummy->pcm_hw = dummy_pcm_hardware;
 	if (m) {
@@ -4,6 +4,10 @@
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_epoll_wait(int argc, const char **argv, const char *prefix);
+extern int bench_fs_pipe(int argc, const char **argv, const char *prefix);
+extern int bench_net_udp(int argc, const char **argv, const char *prefix);
+extern int bench_net_zerocopy(int argc, const char **argv, const char *prefix);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,195 @@
+/*
+ *
+ * epoll-wait.c
+ *
+ * wait: Benchmark for epoll_wait() with many producers
+ *
+ * A number of producer threads, each with an eventfd of its own, keep
+ * signalling while a single consumer harvests the events with
+ * epoll_wait(), like an event loop fed from many cpus.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+
+static unsigned int nr_producers = 16;
+static unsigned int loops = 100000;
+static unsigned int max_events = 64;
+static bool edge_triggered;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nr_producers,
+		     "Specify number of producer threads"),
+	OPT_UINTEGER('l', "loop", &loops,
+		     "Specify number of writes per producer"),
+	OPT_UINTEGER('b', "batch", &max_events,
+		     "Specify maxevents of epoll_wait()"),
+	OPT_BOOLEAN('E', "edge", &edge_triggered,
+		    "Use edge triggered events"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+struct producer {
+	pthread_t		thread;
+	int			fd;
+};
+
+static pthread_barrier_t start_barrier;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void *producer(void *arg)
+{
+	struct producer *p = arg;
+	uint64_t one = 1;
+	unsigned int i;
+
+	pthread_barrier_wait(&start_barrier);
+	for (i = 0; i < loops; i++)
+		if (write(p->fd, &one, sizeof(one)) != sizeof(one))
+			barf("write");
+	return NULL;
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct producer *producers;
+	struct epoll_event ev, *events;
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total, got = 0;
+	unsigned long calls = 0, harvested = 0;
+	uint64_t cnt;
+	unsigned int i;
+	int epfd, n;
+
+	argc = parse_options(argc, argv, options,
+			     bench_epoll_wait_usage, 0);
+	if (!nr_producers || !loops || !max_events)
+		usage_with_options(bench_epoll_wait_usage, options);
+
+	producers = calloc(nr_producers, sizeof(*producers));
+	events = calloc(max_events, sizeof(*events));
+	if (!producers || !events)
+		barf("calloc");
+
+	epfd = epoll_create(nr_producers);
+	if (epfd < 0)
+		barf("epoll_create");
+
+	for (i = 0; i < nr_producers; i++) {
+		producers[i].fd = eventfd(0, EFD_NONBLOCK);
+		if (producers[i].fd < 0)
+			barf("eventfd");
+		ev.events = EPOLLIN | (edge_triggered ? EPOLLET : 0);
+		ev.data.ptr = &producers[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, producers[i].fd, &ev))
+			barf("epoll_ctl");
+	}
+
+	if (pthread_barrier_init(&start_barrier, NULL, nr_producers + 1))
+		barf("pthread_barrier_init");
+	for (i = 0; i < nr_producers; i++)
+		if (pthread_create(&producers[i].thread, NULL, producer,
+				   &producers[i]))
+			barf("pthread_create");
+
+	total = (unsigned long long)nr_producers * loops;
+	pthread_barrier_wait(&start_barrier);
+	gettimeofday(&start, NULL);
+
+	while (got < total) {
+		n = epoll_wait(epfd, events, max_events, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			barf("epoll_wait");
+		}
+		calls++;
+		harvested += n;
+		while (n--) {
+			struct producer *p = events[n].data.ptr;
+
+			if (read(p->fd, &cnt, sizeof(cnt)) == sizeof(cnt))
+				got += cnt;
+			else if (errno != EAGAIN)
+				barf("read");
+		}
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	for (i = 0; i < nr_producers; i++) {
+		pthread_join(producers[i].thread, NULL);
+		close(producers[i].fd);
+	}
+	pthread_barrier_destroy(&start_barrier);
+	close(epfd);
+	free(events);
+	free(producers);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u producers, %u writes each, %s triggered,"
+		       " up to %u events per epoll_wait()\n\n",
+		       nr_producers, loops,
+		       edge_triggered ? "edge" : "level", max_events);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/write\n",
+		       (double)result_usec / (double)total);
+		printf(" %14llu writes/sec\n",
+		       total * 1000000ULL / result_usec);
+		printf(" %14lu epoll_wait() calls\n", calls);
+		printf(" %14lf events/epoll_wait()\n",
+		       (double)harvested / (double)calls);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ *
+ * fs-pipe.c
+ *
+ * pipe: Benchmark for pipe throughput
+ *
+ * Moves a fixed amount of data from one process to another through a
+ * pipe, with write() and read(), with splice() into /dev/null on the
+ * reading side or with vmsplice() on the writing side, at several
+ * write sizes.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#undef _GNU_SOURCE
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#define PIPE_READ_MAX	65536
+
+static const char	*length_str	= "64MB";
+static const char	*sizes_str	= "64,512,4096,65536";
+static const char	*mode_str	= "all";
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "64MB",
+		    "Specify amount of data to move per run. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('s', "sizes", &sizes_str, "64,512,4096,65536",
+		    "Specify comma separated sizes of each write"),
+	OPT_STRING('m', "mode", &mode_str, "all",
+		    "Specify mode: write, splice, vmsplice or all"),
+	OPT_END()
+};
+
+static const char * const bench_fs_pipe_usage[] = {
+	"perf bench fs pipe <options>",
+	NULL
+};
+
+enum pipe_mode {
+	PIPE_MODE_WRITE,	/* write() and read() */
+	PIPE_MODE_SPLICE,	/* write() and splice() to /dev/null */
+	PIPE_MODE_VMSPLICE,	/* vmsplice() and read() */
+	PIPE_MODE_MAX,
+};
+
+static const char * const mode_names[PIPE_MODE_MAX] = {
+	[PIPE_MODE_WRITE]	= "write",
+	[PIPE_MODE_SPLICE]	= "splice",
+	[PIPE_MODE_VMSPLICE]	= "vmsplice",
+};
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void pipe_reader(int fd, enum pipe_mode mode, char *buf)
+{
+	ssize_t ret;
+	int null_fd = -1;
+
+	if (mode == PIPE_MODE_SPLICE) {
+		null_fd = open("/dev/null", O_WRONLY);
+		if (null_fd < 0)
+			barf("open /dev/null");
+	}
+
+	do {
+		if (mode == PIPE_MODE_SPLICE)
+			ret = splice(fd, NULL, null_fd, NULL, PIPE_READ_MAX,
+				     SPLICE_F_MOVE);
+		else
+			ret = read(fd, buf, PIPE_READ_MAX);
+	} while (ret > 0);
+
+	if (ret < 0)
+		barf(mode == PIPE_MODE_SPLICE ? "splice" : "read");
+	exit(0);
+}
+
+static void pipe_writer(int fd, enum pipe_mode mode, char *buf,
+			size_t size, u64 length)
+{
+	struct iovec iov;
+	ssize_t ret;
+	u64 done;
+
+	for (done = 0; done < length; done += size) {
+		iov.iov_base = buf;
+		iov.iov_len = size;
+		while (iov.iov_len) {
+			if (mode == PIPE_MODE_VMSPLICE)
+				ret = vmsplice(fd, &iov, 1, 0);
+			else
+				ret = write(fd, iov.iov_base, iov.iov_len);
+			if (ret <= 0)
+				barf(mode == PIPE_MODE_VMSPLICE ?
+				     "vmsplice" : "write");
+			iov.iov_base = (char *)iov.iov_base + ret;
+			iov.iov_len -= ret;
+		}
+	}
+}
+
+/* Returns the elapsed time in usecs */
+static u64 run_pipe(enum pipe_mode mode, size_t size, u64 length)
+{
+	struct timeval start, stop, diff;
+	int fds[2], wait_stat;
+	char *buf;
+	pid_t pid;
+
+	if (posix_memalign((void **)&buf, getpagesize(),
+			   size > PIPE_READ_MAX ? size : PIPE_READ_MAX))
+		barf("posix_memalign");
+	memset(buf, 0x5a, size);
+
+	if (pipe(fds))
+		barf("pipe");
+
+	/* or the reader prints what is buffered again when it exits */
+	fflush(stdout);
+	gettimeofday(&start, NULL);
+
+	pid = fork();
+	if (pid < 0)
+		barf("fork");
+	if (!pid) {
+		close(fds[1]);
+		pipe_reader(fds[0], mode, buf);
+	}
+
+	close(fds[0]);
+	pipe_writer(fds[1], mode, buf, size, length);
+	close(fds[1]);
+
+	if (waitpid(pid, &wait_stat, 0) != pid || !WIFEXITED(wait_stat) ||
+	    WEXITSTATUS(wait_stat))
+		die("reader failed\n");
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	free(buf);
+
+	return (u64)diff.tv_sec * 1000000 + diff.tv_usec;
+}
+
+static void print_result(enum pipe_mode mode, size_t size, u64 length,
+			 u64 usecs)
+{
+	double secs = (double)(usecs ? usecs : 1) / 1000000;
+	double mb = (double)length / (1 << 20);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %8s %8zu bytes: %10.1lf MB/sec %12.0lf ops/sec\n",
+		       mode_names[mode], size, mb / secs,
+		       (double)(length / size) / secs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %zu %.1lf\n", mode_names[mode], size, mb / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
+
+int bench_fs_pipe(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	enum pipe_mode mode;
+	const char *p;
+	char *end;
+	size_t size;
+	s64 length;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_pipe_usage, 0);
+
+	length = perf_atoll((char *)length_str);
+	if (length <= 0) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+
+	for (i = 0; i < PIPE_MODE_MAX; i++)
+		if (!strcmp(mode_str, mode_names[i]))
+			break;
+	if (i == PIPE_MODE_MAX && strcmp(mode_str, "all")) {
+		fprintf(stderr, "Unknown mode:%s\n", mode_str);
+		return 1;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Moving %" PRIu64 " bytes through a pipe per run\n\n",
+		       (u64)length);
+
+	for (mode = 0; mode < PIPE_MODE_MAX; mode++) {
+		if (i != PIPE_MODE_MAX && mode != (enum pipe_mode)i)
+			continue;
+		for (p = sizes_str; *p; p = end + (*end == ',')) {
+			size = strtoul(p, &end, 0);
+			if (end == p || !size || (*end && *end != ',')) {
+				fprintf(stderr, "Invalid sizes:%s\n",
+					sizes_str);
+				return 1;
+			}
+			print_result(mode, size, length,
+				     run_pipe(mode, size, length));
+		}
+	}
+
+	return 0;
+}
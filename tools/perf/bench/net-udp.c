@@ -0,0 +1,316 @@
+/*
+ *
+ * net-udp.c
+ *
+ * udp: Benchmark for UDP datagram throughput over loopback
+ *
+ * A sender streams datagrams to a receiving process for a while, either
+ * one per sendto() or in batches with sendmmsg(), and optionally builds
+ * UDP_SEGMENT (GSO) sends of several datagrams each. The receiver reads
+ * them with recvmmsg(), optionally with UDP_GRO set.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#undef _GNU_SOURCE
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
+#define UDP_BATCH_MAX	64
+
+static unsigned int length = 1400;
+static unsigned int duration = 5;
+static unsigned int batch = 1;
+static unsigned int gso_segs;
+static bool use_gro;
+
+static const struct option options[] = {
+	OPT_UINTEGER('l', "length", &length,
+		     "Specify payload length of each datagram"),
+	OPT_UINTEGER('d', "duration", &duration,
+		     "Specify seconds to send for"),
+	OPT_UINTEGER('b', "batch", &batch,
+		     "Specify messages per sendmmsg()/recvmmsg() call"),
+	OPT_UINTEGER('g', "gso", &gso_segs,
+		     "Send UDP_SEGMENT messages of this many datagrams"),
+	OPT_BOOLEAN('G', "gro", &use_gro,
+		    "Receive with UDP_GRO set"),
+	OPT_END()
+};
+
+static const char * const bench_net_udp_usage[] = {
+	"perf bench net udp <options>",
+	NULL
+};
+
+struct udp_result {
+	u64			bytes;
+	u64			datagrams;
+	u64			calls;
+};
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+/* Datagrams in a received message: more than one when coalesced */
+static u64 udp_count(struct msghdr *msg, size_t len)
+{
+	struct cmsghdr *cmsg;
+	int gso_size;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_UDP || cmsg->cmsg_type != UDP_GRO)
+			continue;
+		memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+		if (gso_size > 0)
+			return (len + gso_size - 1) / gso_size;
+	}
+	return 1;
+}
+
+static void udp_receiver(int fd, int ctl)
+{
+	static char bufs[UDP_BATCH_MAX][65536];
+	static char cbufs[UDP_BATCH_MAX][CMSG_SPACE(sizeof(int))];
+	struct mmsghdr msgs[UDP_BATCH_MAX];
+	struct iovec iovs[UDP_BATCH_MAX];
+	struct udp_result res;
+	struct pollfd pfd[2];
+	bool stopping = false;
+	int i, n;
+
+	memset(&res, 0, sizeof(res));
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < UDP_BATCH_MAX; i++) {
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = sizeof(bufs[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = ctl;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		/* once the sender is done, drain what is queued and stop */
+		if (poll(pfd, stopping ? 1 : 2, stopping ? 0 : -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			barf("poll");
+		}
+		if (pfd[1].revents)
+			stopping = true;
+		if (!(pfd[0].revents & POLLIN)) {
+			if (stopping)
+				break;
+			continue;
+		}
+
+		for (i = 0; i < (int)batch; i++) {
+			msgs[i].msg_hdr.msg_control = cbufs[i];
+			msgs[i].msg_hdr.msg_controllen = sizeof(cbufs[i]);
+		}
+		n = recvmmsg(fd, msgs, batch, MSG_DONTWAIT, NULL);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			barf("recvmmsg");
+		}
+		res.calls++;
+		for (i = 0; i < n; i++) {
+			res.bytes += msgs[i].msg_len;
+			res.datagrams += udp_count(&msgs[i].msg_hdr,
+						   msgs[i].msg_len);
+		}
+	}
+
+	if (write(ctl, &res, sizeof(res)) != sizeof(res))
+		barf("write");
+	exit(0);
+}
+
+static void udp_sender(int fd, struct udp_result *res, struct timeval *diff)
+{
+	struct mmsghdr msgs[UDP_BATCH_MAX];
+	struct timeval start, now;
+	struct iovec iov;
+	size_t size;
+	char *buf;
+	int i, n;
+
+	size = length * (gso_segs ? gso_segs : 1);
+	buf = calloc(1, size);
+	if (!buf)
+		barf("calloc");
+
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < (int)batch; i++) {
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	memset(res, 0, sizeof(*res));
+	gettimeofday(&start, NULL);
+	do {
+		if (batch == 1)
+			n = send(fd, buf, size, 0) < 0 ? -1 : 1;
+		else
+			n = sendmmsg(fd, msgs, batch, 0);
+		if (n < 0) {
+			/* the receiver falls behind on loopback */
+			if (errno != ENOBUFS && errno != EAGAIN &&
+			    errno != ECONNREFUSED)
+				barf(batch == 1 ? "send" : "sendmmsg");
+			n = 0;
+		}
+		res->calls++;
+		res->bytes += (u64)n * size;
+		res->datagrams += (u64)n * (gso_segs ? gso_segs : 1);
+
+		gettimeofday(&now, NULL);
+		timersub(&now, &start, diff);
+	} while (diff->tv_sec < (time_t)duration);
+
+	free(buf);
+}
+
+static void print_result(const char *name, struct udp_result *res,
+			 double secs)
+{
+	printf(" %14s: %12.0lf datagrams/sec %10.1lf MB/sec"
+	       " %12.0lf calls/sec\n", name,
+	       (double)res->datagrams / secs,
+	       (double)res->bytes / secs / (1 << 20),
+	       (double)res->calls / secs);
+}
+
+int bench_net_udp(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	struct udp_result sent, rcvd;
+	struct timeval diff;
+	int rx, tx, ctl[2], wait_stat, val;
+	double secs;
+	pid_t pid;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_udp_usage, 0);
+	if (!length || !duration || !batch || batch > UDP_BATCH_MAX ||
+	    length * (gso_segs ? gso_segs : 1) > 65507)
+		usage_with_options(bench_net_udp_usage, options);
+
+	rx = socket(AF_INET, SOCK_DGRAM, 0);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rx < 0 || tx < 0)
+		barf("socket");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rx, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(rx, (struct sockaddr *)&addr, &addrlen))
+		barf("bind");
+	if (connect(tx, (struct sockaddr *)&addr, sizeof(addr)))
+		barf("connect");
+
+	val = 4 << 20;
+	setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val));
+	val = 1;
+	if (use_gro && setsockopt(rx, SOL_UDP, UDP_GRO, &val, sizeof(val)))
+		barf("setsockopt UDP_GRO");
+	val = length;
+	if (gso_segs &&
+	    setsockopt(tx, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)))
+		barf("setsockopt UDP_SEGMENT");
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, ctl))
+		barf("socketpair");
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+		barf("fork");
+	if (!pid) {
+		close(tx);
+		close(ctl[0]);
+		udp_receiver(rx, ctl[1]);
+	}
+	close(rx);
+	close(ctl[1]);
+
+	udp_sender(tx, &sent, &diff);
+
+	/* tell the receiver to stop, and collect what it got */
+	shutdown(ctl[0], SHUT_WR);
+	if (read(ctl[0], &rcvd, sizeof(rcvd)) != sizeof(rcvd))
+		barf("read");
+	if (waitpid(pid, &wait_stat, 0) != pid || !WIFEXITED(wait_stat))
+		die("receiver failed\n");
+	close(ctl[0]);
+	close(tx);
+
+	secs = diff.tv_sec + (double)diff.tv_usec / 1000000;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u byte datagrams over loopback, %u messages per"
+		       " %s, %u datagrams per message%s\n\n",
+		       length, batch, batch > 1 ? "sendmmsg()" : "send()",
+		       gso_segs ? gso_segs : 1,
+		       use_gro ? ", UDP_GRO" : "");
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+		print_result("sent", &sent, secs);
+		print_result("received", &rcvd, secs);
+		printf(" %14s: %.2lf%%\n", "lost",
+		       sent.datagrams ? 100.0 - 100.0 *
+		       (double)rcvd.datagrams / (double)sent.datagrams : 0);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", (double)rcvd.datagrams / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
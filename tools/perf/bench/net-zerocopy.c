@@ -0,0 +1,283 @@
+/*
+ *
+ * net-zerocopy.c
+ *
+ * zerocopy: Benchmark for MSG_ZEROCOPY TCP transmit over loopback
+ *
+ * Streams a fixed amount of data over a loopback TCP connection to a
+ * receiving process, with plain send() or with MSG_ZEROCOPY, and reports
+ * the cpu time each side spent per GB moved. Zerocopy completions are
+ * read from the error queue as they arrive.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <linux/errqueue.h>
+
+#undef _GNU_SOURCE
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY			60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY			0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+static const char	*length_str	= "1GB";
+static unsigned int	send_size	= 65536;
+static bool		use_zerocopy;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "1GB",
+		    "Specify amount of data to send. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_UINTEGER('s', "size", &send_size,
+		     "Specify bytes per send()"),
+	OPT_BOOLEAN('z', "zerocopy", &use_zerocopy,
+		    "Send with MSG_ZEROCOPY"),
+	OPT_END()
+};
+
+static const char * const bench_net_zerocopy_usage[] = {
+	"perf bench net zerocopy <options>",
+	NULL
+};
+
+struct zc_stat {
+	u64			sends;
+	u64			completed;	/* sends reported done */
+	u64			notifications;
+	u64			copied;		/* notifications that copied */
+};
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void zc_receiver(int fd)
+{
+	static char buf[1 << 18];
+	ssize_t ret;
+
+	while ((ret = read(fd, buf, sizeof(buf))) > 0)
+		;
+	if (ret < 0)
+		barf("read");
+	exit(0);
+}
+
+/* Read the completions queued so far, or wait for one if @block */
+static void zc_reap(int fd, struct zc_stat *st, bool block)
+{
+	struct sock_extended_err *serr;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	char control[128];
+	struct pollfd pfd;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			if (errno != EAGAIN)
+				barf("recvmsg MSG_ERRQUEUE");
+			if (!block)
+				return;
+			pfd.fd = fd;
+			pfd.events = 0;
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+				barf("poll");
+			continue;
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_IP ||
+			    cmsg->cmsg_type != IP_RECVERR)
+				continue;
+			serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			st->completed += serr->ee_data - serr->ee_info + 1;
+			st->notifications++;
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				st->copied++;
+		}
+		block = false;
+	}
+}
+
+static void zc_sender(int fd, char *buf, u64 length, struct zc_stat *st)
+{
+	int flags = use_zerocopy ? MSG_ZEROCOPY : 0;
+	u64 done = 0;
+	ssize_t ret;
+	size_t len;
+
+	while (done < length) {
+		len = length - done < send_size ? length - done : send_size;
+		ret = send(fd, buf, len, flags);
+		if (ret < 0) {
+			/* out of optmem for notifications: reap some */
+			if (errno == ENOBUFS && use_zerocopy) {
+				zc_reap(fd, st, true);
+				continue;
+			}
+			barf("send");
+		}
+		done += ret;
+		if (use_zerocopy) {
+			st->sends++;
+			zc_reap(fd, st, false);
+		}
+	}
+
+	while (st->completed < st->sends)
+		zc_reap(fd, st, true);
+}
+
+static double rusage_msecs(struct rusage *ru)
+{
+	return ru->ru_utime.tv_sec * 1000.0 + ru->ru_utime.tv_usec / 1000.0 +
+	       ru->ru_stime.tv_sec * 1000.0 + ru->ru_stime.tv_usec / 1000.0;
+}
+
+int bench_net_zerocopy(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	struct timeval start, stop, diff;
+	struct rusage ru_start, ru_stop, ru_child;
+	struct zc_stat st;
+	int lfd, fd, val = 1, wait_stat;
+	double secs, gb, sender_ms, receiver_ms;
+	s64 length;
+	char *buf;
+	pid_t pid;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_zerocopy_usage, 0);
+
+	length = perf_atoll((char *)length_str);
+	if (length <= 0 || !send_size) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+
+	if (posix_memalign((void **)&buf, getpagesize(), send_size))
+		barf("posix_memalign");
+	memset(buf, 0x5a, send_size);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		barf("socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &addrlen) ||
+	    listen(lfd, 1))
+		barf("bind");
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+		barf("fork");
+	if (!pid) {
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			barf("accept");
+		close(lfd);
+		zc_receiver(fd);
+	}
+	close(lfd);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		barf("socket");
+	if (use_zerocopy &&
+	    setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)))
+		barf("setsockopt SO_ZEROCOPY");
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		barf("connect");
+
+	memset(&st, 0, sizeof(st));
+	getrusage(RUSAGE_SELF, &ru_start);
+	gettimeofday(&start, NULL);
+
+	zc_sender(fd, buf, length, &st);
+	close(fd);
+	if (waitpid(pid, &wait_stat, 0) != pid || !WIFEXITED(wait_stat) ||
+	    WEXITSTATUS(wait_stat))
+		die("receiver failed\n");
+
+	gettimeofday(&stop, NULL);
+	getrusage(RUSAGE_SELF, &ru_stop);
+	getrusage(RUSAGE_CHILDREN, &ru_child);
+	timersub(&stop, &start, &diff);
+	free(buf);
+
+	secs = diff.tv_sec + (double)diff.tv_usec / 1000000;
+	if (secs <= 0)
+		secs = 1e-6;
+	gb = (double)length / (1 << 30);
+	sender_ms = rusage_msecs(&ru_stop) - rusage_msecs(&ru_start);
+	receiver_ms = rusage_msecs(&ru_child);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Sending %" PRIu64 " bytes over loopback TCP,"
+		       " %u bytes per send()%s\n\n", (u64)length, send_size,
+		       use_zerocopy ? " with MSG_ZEROCOPY" : "");
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+		printf(" %14.1lf MB/sec\n", (double)length / secs / (1 << 20));
+		printf(" %14.1lf msecs sender cpu/GB\n", sender_ms / gb);
+		printf(" %14.1lf msecs receiver cpu/GB\n", receiver_ms / gb);
+		if (use_zerocopy)
+			printf(" %14" PRIu64 " completions in %" PRIu64
+			       " notifications, %" PRIu64 " copied\n",
+			       st.completed, st.notifications, st.copied);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.1lf\n", sender_ms / gb);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -13,6 +13,9 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  epoll ... event polling scalability
+ *  fs    ... file and pipe I/O throughput
+ *  net   ... networking stack throughput
  *
  */
 
@@ -58,6 +61,39 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite epoll_suites[] = {
+	{ "wait",
+	  "Many producers signalling one epoll_wait() consumer",
+	  bench_epoll_wait },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite fs_suites[] = {
+	{ "pipe",
+	  "Pipe throughput with write, splice and vmsplice",
+	  bench_fs_pipe },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL          }
+};
+
+static struct bench_suite net_suites[] = {
+	{ "udp",
+	  "UDP datagram throughput over loopback",
+	  bench_net_udp },
+	{ "zerocopy",
+	  "TCP send cpu cost with and without MSG_ZEROCOPY",
+	  bench_net_zerocopy },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL          }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +107,15 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "epoll",
+	  "event polling scalability",
+	  epoll_suites },
+	{ "fs",
+	  "file and pipe I/O throughput",
+	  fs_suites },
+	{ "net",
+	  "networking stack throughput",
+	  net_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
@@ -1767,9 +1767,273 @@ static void __cmd_replay(void)
 		run_one_test();
 }
 
+/*
+ * 'perf sched hist': summarise the wait latency histograms the kernel
+ * keeps with CONFIG_SCHEDSTATS in /proc/<pid>/task/<tid>/sched_latency
+ * and in the cpu cgroup's cpu.latency_hist, without recording anything.
+ */
+
+#define LAT_BUCKETS		20	/* SCHED_LAT_BUCKETS */
+
+struct lat_hist {
+	pid_t		pid;
+	char		comm[COMM_LEN];
+	unsigned int	wakeup[LAT_BUCKETS];
+	unsigned int	preempt[LAT_BUCKETS];
+	u64		nr_wakeup;
+	u64		nr_preempt;
+};
+
+static pid_t			hist_pid = -1;
+static const char		*hist_cgroup;
+static int			hist_nr_lines;
+
+static struct lat_hist		*lat_hists;
+static unsigned long		nr_lat_hists;
+
+static int read_lat_hist(const char *path, struct lat_hist *h)
+{
+	unsigned int *buckets;
+	char name[16];
+	int i, ret = -1;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	while (fscanf(f, "%15s", name) == 1) {
+		if (!strcmp(name, "wakeup"))
+			buckets = h->wakeup;
+		else if (!strcmp(name, "preempt"))
+			buckets = h->preempt;
+		else
+			continue;
+
+		for (i = 0; i < LAT_BUCKETS; i++) {
+			if (fscanf(f, "%u", &buckets[i]) != 1) {
+				ret = -1;
+				goto out;
+			}
+		}
+		ret = 0;
+	}
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		h->nr_wakeup += h->wakeup[i];
+		h->nr_preempt += h->preempt[i];
+	}
+out:
+	fclose(f);
+	return ret;
+}
+
+/* index of the bucket holding the given fraction of the samples */
+static int lat_hist_pct(const unsigned int *buckets, u64 total, double pct)
+{
+	u64 sum = 0;
+	int i;
+
+	if (!total)
+		return -1;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		sum += buckets[i];
+		if (sum >= total * pct)
+			return i;
+	}
+	return LAT_BUCKETS - 1;
+}
+
+static int lat_hist_max(const unsigned int *buckets)
+{
+	int i;
+
+	for (i = LAT_BUCKETS - 1; i >= 0; i--)
+		if (buckets[i])
+			return i;
+	return -1;
+}
+
+/* upper bound of a bucket in usecs, the last one is open ended */
+static void print_lat_bucket(int bucket)
+{
+	double usecs;
+
+	if (bucket < 0) {
+		printf(" %12s |", "-");
+		return;
+	}
+
+	usecs = (double)(1ULL << (bucket + 10)) / 1e3;
+	if (bucket == LAT_BUCKETS - 1)
+		printf(" >%11.3f |", usecs / 2);
+	else
+		printf(" <%11.3f |", usecs);
+}
+
+static void print_lat_hist_line(const char *name, const struct lat_hist *h)
+{
+	printf("  %-22s|%9" PRIu64 " |", name, h->nr_wakeup);
+	print_lat_bucket(lat_hist_pct(h->wakeup, h->nr_wakeup, 0.5));
+	print_lat_bucket(lat_hist_pct(h->wakeup, h->nr_wakeup, 0.99));
+	print_lat_bucket(lat_hist_max(h->wakeup));
+	printf("%9" PRIu64 " |", h->nr_preempt);
+	print_lat_bucket(lat_hist_pct(h->preempt, h->nr_preempt, 0.99));
+	print_lat_bucket(lat_hist_max(h->preempt));
+	printf("\n");
+}
+
+static void add_task_lat_hist(pid_t pid, pid_t tid)
+{
+	char path[PATH_MAX];
+	struct lat_hist *h;
+	FILE *f;
+
+	/* grow by doubling, nr_lat_hists hitting a power of two */
+	if (!(nr_lat_hists & (nr_lat_hists - 1))) {
+		lat_hists = realloc(lat_hists, sizeof(*lat_hists) *
+				    (nr_lat_hists ? nr_lat_hists * 2 : 1));
+		if (!lat_hists)
+			die("No memory");
+	}
+
+	h = &lat_hists[nr_lat_hists];
+	memset(h, 0, sizeof(*h));
+	h->pid = tid;
+
+	snprintf(path, PATH_MAX, "/proc/%d/task/%d/sched_latency", pid, tid);
+	if (read_lat_hist(path, h) < 0)
+		return;
+
+	snprintf(path, PATH_MAX, "/proc/%d/task/%d/comm", pid, tid);
+	f = fopen(path, "r");
+	if (f) {
+		if (fgets(h->comm, sizeof(h->comm), f))
+			h->comm[strcspn(h->comm, "\n")] = '\0';
+		fclose(f);
+	}
+
+	if (h->nr_wakeup || h->nr_preempt)
+		nr_lat_hists++;
+}
+
+static void read_task_lat_hists(void)
+{
+	struct dirent *dent1, *dent2;
+	DIR *dir1, *dir2;
+	char path[PATH_MAX];
+	pid_t pid, tid;
+
+	dir1 = opendir("/proc");
+	if (!dir1)
+		die("Can't open /proc: %s\n", strerror(errno));
+
+	while ((dent1 = readdir(dir1)) != NULL) {
+		if (sscanf(dent1->d_name, "%d", &pid) < 1)
+			continue;
+		if (hist_pid != -1 && pid != hist_pid)
+			continue;
+
+		snprintf(path, PATH_MAX, "/proc/%d/task", pid);
+		dir2 = opendir(path);
+		if (!dir2)
+			continue;
+		while ((dent2 = readdir(dir2)) != NULL) {
+			if (sscanf(dent2->d_name, "%d", &tid) < 1)
+				continue;
+			add_task_lat_hist(pid, tid);
+		}
+		closedir(dir2);
+	}
+	closedir(dir1);
+}
+
+/* worst p99 wakeup latency first */
+static int lat_hist_cmp(const void *a, const void *b)
+{
+	const struct lat_hist *l = a, *r = b;
+	int lp, rp;
+
+	lp = lat_hist_pct(l->wakeup, l->nr_wakeup, 0.99);
+	rp = lat_hist_pct(r->wakeup, r->nr_wakeup, 0.99);
+	if (lp != rp)
+		return rp - lp;
+
+	lp = lat_hist_max(l->wakeup);
+	rp = lat_hist_max(r->wakeup);
+	if (lp != rp)
+		return rp - lp;
+
+	if (l->nr_wakeup != r->nr_wakeup)
+		return r->nr_wakeup > l->nr_wakeup ? 1 : -1;
+	return 0;
+}
+
+static void print_lat_hist_header(void)
+{
+	printf("\n ---------------------------------------------------------------------------------------------------------------------\n");
+	printf("  Task                  |  Wakeups |  p50 wait us |  p99 wait us |  max wait us | Preempts |  p99 wait us |  max wait us |\n");
+	printf(" ---------------------------------------------------------------------------------------------------------------------\n");
+}
+
+static void __cmd_hist(void)
+{
+	struct lat_hist group;
+	char path[PATH_MAX];
+	unsigned long i;
+	int b;
+
+	if (hist_cgroup) {
+		memset(&group, 0, sizeof(group));
+		snprintf(path, PATH_MAX, "%s/cpu.latency_hist", hist_cgroup);
+		if (read_lat_hist(path, &group) < 0)
+			die("Can't read %s: needs CONFIG_SCHEDSTATS and the cpu cgroup\n",
+			    path);
+
+		print_lat_hist_header();
+		print_lat_hist_line(hist_cgroup, &group);
+
+		printf("\n %12s |%9s |%10s |\n", "wait us", "Wakeups", "Preempts");
+		printf(" ------------------------------------------\n");
+		for (b = 0; b < LAT_BUCKETS; b++) {
+			if (!group.wakeup[b] && !group.preempt[b])
+				continue;
+			print_lat_bucket(b);
+			printf("%9u |%10u |\n", group.wakeup[b], group.preempt[b]);
+		}
+		printf("\n");
+		return;
+	}
+
+	read_task_lat_hists();
+	if (!nr_lat_hists) {
+		if (access("/proc/self/sched_latency", R_OK))
+			die("No /proc/<pid>/sched_latency: needs CONFIG_SCHEDSTATS\n");
+		return;
+	}
+
+	setup_pager();
+	qsort(lat_hists, nr_lat_hists, sizeof(*lat_hists), lat_hist_cmp);
+
+	print_lat_hist_header();
+	for (i = 0; i < nr_lat_hists; i++) {
+		char name[COMM_LEN + 16];
+
+		if (hist_nr_lines > 0 && i >= (unsigned long)hist_nr_lines)
+			break;
+		snprintf(name, sizeof(name), "%s:%d",
+			 lat_hists[i].comm, lat_hists[i].pid);
+		print_lat_hist_line(name, &lat_hists[i]);
+	}
+	printf(" ---------------------------------------------------------------------------------------------------------------------\n\n");
+
+	free(lat_hists);
+}
+
 
 static const char * const sched_usage[] = {
-	"perf sched [<options>] {record|latency|map|replay|trace}",
+	"perf sched [<options>] {record|latency|map|replay|trace|hist}",
 	NULL
 };
 
@@ -1815,6 +2079,21 @@ static const struct option replay_options[] = {
 	OPT_END()
 };
 
+static const char * const hist_usage[] = {
+	"perf sched hist [<options>]",
+	NULL
+};
+
+static const struct option hist_options[] = {
+	OPT_INTEGER('p', "pid", &hist_pid,
+		    "only show the threads of this process"),
+	OPT_STRING('G', "cgroup", &hist_cgroup, "path",
+		   "show the histogram of a cpu cgroup directory instead"),
+	OPT_INTEGER('n', "lines", &hist_nr_lines,
+		    "only show the N worst threads"),
+	OPT_END()
+};
+
 static void setup_sorting(void)
 {
 	char *tmp, *tok, *str = strdup(sort_order);
@@ -1909,6 +2188,13 @@ int cmd_sched(int argc, const char **argv, const char *prefix __used)
 				usage_with_options(replay_usage, replay_options);
 		}
 		__cmd_replay();
+	} else if (!strcmp(argv[0], "hist")) {
+		if (argc) {
+			argc = parse_options(argc, argv, hist_options, hist_usage, 0);
+			if (argc)
+				usage_with_options(hist_usage, hist_options);
+		}
+		__cmd_hist();
 	} else {
 		usage_with_options(sched_usage, sched_options);
 	}
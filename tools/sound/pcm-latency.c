@@ -0,0 +1,425 @@
+/*
+ * pcm-latency.c -- round trip latency of PCM streams through snd-aloop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -g -o pcm-latency pcm-latency.c */
+
+/*
+ * Plays silence with a periodic click into device 0 of a Loopback card
+ * and captures device 1, which carries the same samples, and reports
+ * how many frames each click took to come back.  The playback side is
+ * topped up by what was captured, so the queued playback data stays at
+ * the prefill level and the rest of the round trip is wakeup delay.
+ *
+ * The capture side sets avail_min, which may be below the period size
+ * so that the pcm core's wakeup timer runs, and records how many frames
+ * were ready at each wakeup.  The ALSA calls are made with the kernel
+ * ioctls directly, so no alsa-lib is needed, and the hw_ptr is read
+ * from the mmapped status record when the kernel allows that.
+ *
+ * With -w only the capture side runs, which also works with snd-dummy
+ * (hrtimer=1) to look at wakeups alone.
+ *
+ *   modprobe snd-aloop
+ *   pcm-latency -p 1024 -a 64 -d 256
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sound/asound.h>
+
+
+/* the offsets this kernel knows, newer headers may pick others */
+#define PCM_MMAP_OFFSET_STATUS		0x80000000
+#define PCM_MMAP_OFFSET_CONTROL		0x81000000
+
+#define CHANNELS	2
+#define CLICK		0x4000
+#define THRESHOLD	0x2000
+
+static unsigned	card = ~0U;
+static unsigned	rate = 48000;
+static unsigned	period = 1024;
+static unsigned	periods = 4;
+static unsigned	avail_min = 64;
+static unsigned	prefill = 256;
+static unsigned	clicks = 50;
+static int	wakeup_only;
+
+struct pcm {
+	int				fd;
+	const char			*name;
+	snd_pcm_uframes_t		buffer_size;
+	snd_pcm_uframes_t		boundary;
+	volatile struct snd_pcm_mmap_status	*status;
+	volatile struct snd_pcm_mmap_control	*control;
+};
+
+
+/******************** Helpers ***********************************************/
+
+static void die(const char *what)
+{
+	fprintf(stderr, "pcm-latency: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static struct snd_mask *param_mask(struct snd_pcm_hw_params *p, int n)
+{
+	return &p->masks[n - SNDRV_PCM_HW_PARAM_FIRST_MASK];
+}
+
+static struct snd_interval *param_interval(struct snd_pcm_hw_params *p, int n)
+{
+	return &p->intervals[n - SNDRV_PCM_HW_PARAM_FIRST_INTERVAL];
+}
+
+static void param_init(struct snd_pcm_hw_params *p)
+{
+	int n;
+
+	memset(p, 0, sizeof(*p));
+	for (n = SNDRV_PCM_HW_PARAM_FIRST_MASK;
+	     n <= SNDRV_PCM_HW_PARAM_LAST_MASK; n++)
+		memset(param_mask(p, n)->bits, 0xff,
+		       sizeof(param_mask(p, n)->bits));
+	for (n = SNDRV_PCM_HW_PARAM_FIRST_INTERVAL;
+	     n <= SNDRV_PCM_HW_PARAM_LAST_INTERVAL; n++)
+		param_interval(p, n)->max = ~0U;
+	p->rmask = ~0U;
+	p->info = ~0U;
+}
+
+static void param_set_mask(struct snd_pcm_hw_params *p, int n, unsigned bit)
+{
+	struct snd_mask *m = param_mask(p, n);
+
+	memset(m->bits, 0, sizeof(m->bits));
+	m->bits[bit >> 5] = 1U << (bit & 31);
+}
+
+static void param_set_int(struct snd_pcm_hw_params *p, int n, unsigned val)
+{
+	struct snd_interval *i = param_interval(p, n);
+
+	i->min = i->max = val;
+	i->integer = 1;
+}
+
+/* Frames between a and b, modulo the ring boundary */
+static snd_pcm_uframes_t frames_between(struct pcm *pcm,
+					snd_pcm_uframes_t a,
+					snd_pcm_uframes_t b)
+{
+	return b >= a ? b - a : b + pcm->boundary - a;
+}
+
+
+/******************** PCM setup *********************************************/
+
+static void pcm_open(struct pcm *pcm, unsigned device, int capture,
+		     snd_pcm_uframes_t start_threshold)
+{
+	static char names[2][32];
+	struct snd_pcm_hw_params hw;
+	struct snd_pcm_sw_params sw;
+	long page = sysconf(_SC_PAGESIZE);
+	void *p;
+
+	pcm->name = names[capture];
+	snprintf(names[capture], sizeof(names[capture]),
+		 "/dev/snd/pcmC%uD%u%c", card, device, capture ? 'c' : 'p');
+	pcm->fd = open(pcm->name, O_RDWR | O_NONBLOCK);
+	if (pcm->fd < 0)
+		die(pcm->name);
+
+	param_init(&hw);
+	param_set_mask(&hw, SNDRV_PCM_HW_PARAM_ACCESS,
+		       SNDRV_PCM_ACCESS_RW_INTERLEAVED);
+	param_set_mask(&hw, SNDRV_PCM_HW_PARAM_FORMAT,
+		       SNDRV_PCM_FORMAT_S16_LE);
+	param_set_mask(&hw, SNDRV_PCM_HW_PARAM_SUBFORMAT,
+		       SNDRV_PCM_SUBFORMAT_STD);
+	param_set_int(&hw, SNDRV_PCM_HW_PARAM_CHANNELS, CHANNELS);
+	param_set_int(&hw, SNDRV_PCM_HW_PARAM_RATE, rate);
+	param_set_int(&hw, SNDRV_PCM_HW_PARAM_PERIOD_SIZE, period);
+	param_set_int(&hw, SNDRV_PCM_HW_PARAM_PERIODS, periods);
+	if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_HW_PARAMS, &hw) < 0)
+		die("SNDRV_PCM_IOCTL_HW_PARAMS");
+	pcm->buffer_size =
+		param_interval(&hw, SNDRV_PCM_HW_PARAM_BUFFER_SIZE)->max;
+
+	memset(&sw, 0, sizeof(sw));
+	sw.tstamp_mode = SNDRV_PCM_TSTAMP_NONE;
+	sw.period_step = 1;
+	sw.avail_min = avail_min;
+	sw.xfer_align = 1;
+	sw.start_threshold = start_threshold;
+	sw.stop_threshold = pcm->buffer_size;
+	if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_SW_PARAMS, &sw) < 0)
+		die("SNDRV_PCM_IOCTL_SW_PARAMS");
+	pcm->boundary = sw.boundary;
+
+	p = mmap(NULL, page, PROT_READ, MAP_SHARED, pcm->fd,
+		 PCM_MMAP_OFFSET_STATUS);
+	pcm->status = p == MAP_FAILED ? NULL : p;
+	p = mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, pcm->fd,
+		 PCM_MMAP_OFFSET_CONTROL);
+	pcm->control = p == MAP_FAILED ? NULL : p;
+
+	if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_PREPARE) < 0)
+		die("SNDRV_PCM_IOCTL_PREPARE");
+}
+
+/* Frames ready to read, from the status record or with SYNC_PTR */
+static snd_pcm_uframes_t pcm_capture_avail(struct pcm *pcm)
+{
+	struct snd_pcm_sync_ptr sp;
+
+	if (pcm->status && pcm->control)
+		return frames_between(pcm, pcm->control->appl_ptr,
+				      pcm->status->hw_ptr);
+
+	memset(&sp, 0, sizeof(sp));
+	sp.flags = SNDRV_PCM_SYNC_PTR_APPL | SNDRV_PCM_SYNC_PTR_AVAIL_MIN;
+	if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_SYNC_PTR, &sp) < 0)
+		die("SNDRV_PCM_IOCTL_SYNC_PTR");
+	return frames_between(pcm, sp.c.control.appl_ptr, sp.s.status.hw_ptr);
+}
+
+static void pcm_transfer(struct pcm *pcm, int capture, short *buf,
+			 snd_pcm_uframes_t frames)
+{
+	struct snd_xferi x;
+
+	while (frames) {
+		x.result = 0;
+		x.buf = buf;
+		x.frames = frames;
+		if (ioctl(pcm->fd, capture ? SNDRV_PCM_IOCTL_READI_FRAMES
+					   : SNDRV_PCM_IOCTL_WRITEI_FRAMES,
+			  &x) < 0) {
+			if (errno == EPIPE) {
+				fprintf(stderr, "pcm-latency: %s: xrun, try a"
+					" larger prefill\n", pcm->name);
+				exit(1);
+			}
+			if (errno != EAGAIN)
+				die(capture ? "READI_FRAMES" : "WRITEI_FRAMES");
+			continue;
+		}
+		buf += x.result * CHANNELS;
+		frames -= x.result;
+	}
+}
+
+
+/******************** Measurement *******************************************/
+
+struct stats {
+	unsigned long	count;
+	unsigned long	min;
+	unsigned long	max;
+	double		sum;
+};
+
+static void stats_add(struct stats *s, unsigned long v)
+{
+	if (!s->count || v < s->min)
+		s->min = v;
+	if (v > s->max)
+		s->max = v;
+	s->sum += v;
+	s->count++;
+}
+
+static void stats_print(const char *what, struct stats *s)
+{
+	double avg = s->count ? s->sum / s->count : 0;
+
+	printf("%-20s %6lu %8lu %8.1f %8lu frames  (%.2f / %.2f / %.2f ms)\n",
+	       what, s->count, s->min, avg, s->max,
+	       s->min * 1000.0 / rate, avg * 1000.0 / rate,
+	       s->max * 1000.0 / rate);
+}
+
+static void find_loopback(void)
+{
+	char line[256], id[64];
+	unsigned n;
+	FILE *f;
+
+	f = fopen("/proc/asound/cards", "r");
+	if (!f)
+		die("/proc/asound/cards");
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, " %u [%63[^] ]", &n, id) == 2 &&
+		    !strcmp(id, "Loopback")) {
+			card = n;
+			break;
+		}
+	fclose(f);
+	if (card == ~0U) {
+		fprintf(stderr, "pcm-latency: no Loopback card, load snd-aloop"
+			" or pass -c\n");
+		exit(1);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: pcm-latency [-c card] [-r rate] [-p period_size]"
+		" [-n periods]\n"
+		"                   [-a avail_min] [-d prefill] [-i clicks]"
+		" [-w]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct pcm play, cap;
+	struct stats latency, wakeup;
+	struct pollfd pfd;
+	unsigned long long written = 0, captured = 0, click_at = 0;
+	unsigned long long spacing, limit;
+	int waiting = 0, c;
+	snd_pcm_uframes_t avail, i;
+	short *buf;
+
+	while ((c = getopt(argc, argv, "c:r:p:n:a:d:i:w")) != -1) {
+		switch (c) {
+		case 'c':
+			card = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'p':
+			period = atoi(optarg);
+			break;
+		case 'n':
+			periods = atoi(optarg);
+			break;
+		case 'a':
+			avail_min = atoi(optarg);
+			break;
+		case 'd':
+			prefill = atoi(optarg);
+			break;
+		case 'i':
+			clicks = atoi(optarg);
+			break;
+		case 'w':
+			wakeup_only = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || !rate || !period || periods < 2 ||
+	    !avail_min || !clicks || prefill >= period * periods)
+		usage();
+	if (card == ~0U)
+		find_loopback();
+
+	pcm_open(&cap, wakeup_only ? 0 : 1, 1, ~0UL);
+	if (!wakeup_only)
+		pcm_open(&play, 0, 0, prefill ? prefill : 1);
+
+	buf = calloc(cap.buffer_size, CHANNELS * sizeof(short));
+	if (!buf)
+		die("calloc");
+	memset(&latency, 0, sizeof(latency));
+	memset(&wakeup, 0, sizeof(wakeup));
+
+	/* a click every quarter second, but never two in flight */
+	spacing = rate / 4 > 2 * cap.buffer_size ? rate / 4
+						 : 2 * cap.buffer_size;
+	limit = (clicks + 2) * spacing;
+
+	printf("card %u, %u Hz, period %u x %u, avail_min %u, prefill %u\n",
+	       card, rate, period, periods, avail_min, prefill);
+	printf("status record: %s, control record: %s\n",
+	       cap.status ? "mmapped" : "SYNC_PTR",
+	       cap.control ? "mmapped" : "SYNC_PTR");
+
+	if (ioctl(cap.fd, SNDRV_PCM_IOCTL_START) < 0)
+		die("SNDRV_PCM_IOCTL_START");
+	if (!wakeup_only && prefill)
+		pcm_transfer(&play, 0, buf, prefill);
+
+	pfd.fd = cap.fd;
+	pfd.events = POLLIN;
+	while (captured < limit && (wakeup_only || latency.count < clicks)) {
+		c = poll(&pfd, 1, 1000);
+		if (c < 0 && errno == EINTR)
+			continue;
+		if (c < 0)
+			die("poll");
+		if (!c) {
+			fprintf(stderr, "pcm-latency: no capture wakeup\n");
+			return 1;
+		}
+		avail = pcm_capture_avail(&cap);
+		if (avail > cap.buffer_size)
+			avail = cap.buffer_size;
+		if (!avail)
+			continue;
+		stats_add(&wakeup, avail);
+
+		pcm_transfer(&cap, 1, buf, avail);
+		for (i = 0; waiting && i < avail; i++)
+			if (buf[i * CHANNELS] > THRESHOLD) {
+				stats_add(&latency,
+					  captured + i - click_at);
+				waiting = 0;
+			}
+		captured += avail;
+		if (wakeup_only)
+			continue;
+
+		/* give back what was taken, with a click now and then */
+		memset(buf, 0, avail * CHANNELS * sizeof(short));
+		if (!waiting && written + avail > click_at + spacing) {
+			click_at = written;
+			buf[0] = buf[1] = CLICK;
+			waiting = 1;
+		}
+		pcm_transfer(&play, 0, buf, avail);
+		written += avail;
+	}
+
+	printf("\n%-20s %6s %8s %8s %8s\n", "", "count", "min", "avg", "max");
+	stats_print("frames per wakeup", &wakeup);
+	if (!wakeup_only) {
+		stats_print("round trip", &latency);
+		if (latency.count < clicks) {
+			fprintf(stderr, "pcm-latency: only %lu of %u clicks"
+				" came back\n", latency.count, clicks);
+			return 1;
+		}
+	}
+	return 0;
+}
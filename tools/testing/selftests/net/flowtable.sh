@@ -0,0 +1,125 @@
+#!/bin/sh
+#
+# Check the software flow table (nf_flow_table, xt_FLOWOFFLOAD) with veth
+# pairs and network namespaces.
+#
+# Two identical tethering setups are built, each a client, a NAT router
+# and a server namespace:
+#
+#   c<N> 10.0.1.2 --- 10.0.1.1 r<N> 10.0.2.1 --- 10.0.2.2 s<N>
+#
+# The routers masquerade towards the server and offload established
+# connections. A TCP transfer with the same addresses and ports is run
+# through both at once, so both routers offload the same tuple. Both
+# flows must be added, the fast path must be used and the data must
+# arrive intact in both.
+#
+# Needs root, ip, nc and an iptables that knows the FLOWOFFLOAD target.
+# Counters are read from /proc/net/stat/nf_flow_table.
+
+ret=0
+size_mb=16
+port=8080
+sport=40000
+stat=/proc/net/stat/nf_flow_table
+tmp=$(mktemp -d)
+
+counter()
+{
+	awk -v k="$1:" '$1 == k { print $2 }' $stat
+}
+
+cleanup()
+{
+	for n in 1 2; do
+		ip netns del c$n 2>/dev/null
+		ip netns del r$n 2>/dev/null
+		ip netns del s$n 2>/dev/null
+	done
+	rm -rf $tmp
+}
+
+setup()
+{
+	n=$1
+
+	ip netns add c$n || return 1
+	ip netns add r$n || return 1
+	ip netns add s$n || return 1
+
+	ip link add veth0 netns c$n type veth peer name veth0 netns r$n || return 1
+	ip link add veth1 netns r$n type veth peer name veth0 netns s$n || return 1
+
+	ip -net c$n addr add 10.0.1.2/24 dev veth0
+	ip -net r$n addr add 10.0.1.1/24 dev veth0
+	ip -net r$n addr add 10.0.2.1/24 dev veth1
+	ip -net s$n addr add 10.0.2.2/24 dev veth0
+	for ns in c$n r$n s$n; do
+		ip -net $ns link set lo up
+		ip -net $ns link set veth0 up
+	done
+	ip -net r$n link set veth1 up
+	ip -net c$n route add default via 10.0.1.1
+	ip netns exec r$n sysctl -q -w net.ipv4.ip_forward=1
+
+	ip netns exec r$n iptables -t nat -A POSTROUTING -o veth1 \
+		-j MASQUERADE || return 1
+	ip netns exec r$n iptables -A FORWARD -m conntrack \
+		--ctstate ESTABLISHED -j FLOWOFFLOAD || return 1
+}
+
+if [ "$(id -u)" != 0 ]; then
+	echo "SKIP: must be run as root"
+	exit 0
+fi
+if [ ! -r $stat ]; then
+	echo "SKIP: no $stat, nf_flow_table is not loaded"
+	exit 0
+fi
+
+trap cleanup EXIT
+
+for n in 1 2; do
+	if ! setup $n; then
+		echo "SKIP: could not set up namespaces, veth or FLOWOFFLOAD"
+		exit 0
+	fi
+done
+
+dd if=/dev/urandom of=$tmp/in bs=1M count=$size_mb 2>/dev/null
+
+added=$(counter added)
+failed=$(counter add_failed)
+found=$(counter found)
+
+for n in 1 2; do
+	timeout 60 ip netns exec s$n nc -l -p $port > $tmp/out$n &
+done
+sleep 1
+for n in 1 2; do
+	timeout 60 ip netns exec c$n nc -w 5 -p $sport 10.0.2.2 $port < $tmp/in &
+done
+wait
+
+for n in 1 2; do
+	if ! cmp -s $tmp/in $tmp/out$n; then
+		echo "FAIL: data corrupted or lost through r$n"
+		ret=1
+	fi
+done
+
+added=$(($(counter added) - added))
+failed=$(($(counter add_failed) - failed))
+found=$(($(counter found) - found))
+
+if [ $added -lt 2 ] || [ $failed -ne 0 ]; then
+	echo "FAIL: $added flows added, $failed clashed, expected 2 and 0"
+	ret=1
+fi
+if [ $found -eq 0 ]; then
+	echo "FAIL: no packet took the fast path"
+	ret=1
+fi
+
+[ $ret -eq 0 ] && echo "PASS: $added flows, $found packets fast forwarded"
+exit $ret
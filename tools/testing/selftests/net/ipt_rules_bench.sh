@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# Rule count scaling benchmark for ip_tables.
+#
+# Loads per-application owner rules into the OUTPUT chain of a fresh
+# network namespace, the way Android's bandwidth and firewall chains
+# look, and measures small UDP datagrams over loopback with
+# "perf bench net udp" for a growing number of rules. Two shapes are
+# measured:
+#
+#   other-if	-o <unused interface> -m owner --uid-owner <uid>
+#		Every rule fails on the interface, so with
+#		CONFIG_IP_NF_IPTABLES_SKIP the whole run is skipped at once.
+#   same-if	-o lo -m owner --uid-owner <uid>
+#		Every rule tests a different uid and is evaluated in turn.
+#
+# Usage: ipt_rules_bench.sh [rule counts...]
+#
+# Needs root, ip, iptables-restore and a perf with "bench net udp"
+# ($PERF, default perf). This is a benchmark, not a pass/fail test, so
+# it is not run by "make run_tests".
+
+PERF=${PERF:-perf}
+counts=${*:-0 100 500 1000 2000}
+ns=iptbench
+tmp=$(mktemp)
+
+cleanup()
+{
+	ip netns del $ns 2>/dev/null
+	rm -f $tmp
+}
+
+# load_rules <count> <interface>
+load_rules()
+{
+	{
+		echo "*filter"
+		echo ":OUTPUT ACCEPT [0:0]"
+		i=0
+		while [ $i -lt $1 ]; do
+			echo "-A OUTPUT -o $2 -m owner" \
+			     "--uid-owner $((10000 + i)) -j RETURN"
+			i=$((i + 1))
+		done
+		echo "COMMIT"
+	} > $tmp
+	ip netns exec $ns iptables-restore < $tmp
+}
+
+# print received datagrams/s
+measure()
+{
+	ip netns exec $ns $PERF bench -f simple net udp -d 3 -l 64 -b 32
+}
+
+if [ "$(id -u)" != 0 ]; then
+	echo "SKIP: must be run as root"
+	exit 0
+fi
+if ! $PERF bench net 2>/dev/null | grep -q udp; then
+	echo "SKIP: $PERF has no \"bench net udp\""
+	exit 0
+fi
+
+trap cleanup EXIT
+
+if ! ip netns add $ns; then
+	echo "SKIP: could not create a network namespace"
+	exit 0
+fi
+ip -net $ns link set lo up
+ip -net $ns link add dummy0 type dummy 2>/dev/null
+
+if ! load_rules 1 dummy0; then
+	echo "SKIP: could not load owner rules"
+	exit 0
+fi
+
+echo "# 64 byte UDP datagrams over loopback, received datagrams/s"
+echo
+printf "%8s %12s %12s\n" rules other-if same-if
+for n in $counts; do
+	load_rules $n dummy0 || exit 1
+	other=$(measure)
+	load_rules $n lo || exit 1
+	same=$(measure)
+	printf "%8d %12s %12s\n" $n "$other" "$same"
+done
+exit 0
@@ -0,0 +1,131 @@
+#!/bin/sh
+#
+# Forwarding benchmark for conntrack and NAT, as used for tethering.
+#
+# A client, a router and a server namespace are joined with veth pairs:
+#
+#   c 10.0.1.2 --- 10.0.1.1 r 10.0.2.1 --- 10.0.2.2 s
+#
+# Parallel TCP streams are pushed from the client to the server, first
+# routed only, then with the router masquerading towards the server so
+# that every packet goes through a conntrack lookup. The aggregate
+# throughput of each run is printed. For the NAT run, the conntrack
+# statistics show how many lookups found their conntrack, how many chain
+# entries were walked for them (the per-cpu flow cache skips the walk)
+# and how many lookups restarted because of a concurrent hash resize.
+#
+# Usage: nat_forward_bench.sh [streams] [MB per stream]
+#
+# Needs root, ip, nc, dd and iptables. This is a benchmark, not a
+# pass/fail test, so it is not run by "make run_tests".
+
+streams=${1:-4}
+size_mb=${2:-256}
+port=9000
+stat=/proc/net/stat/nf_conntrack
+
+# sum a column of $stat over all cpus, the values are in hex
+ct_stat()
+{
+	sum=0
+	for v in $(awk -v c="$1" 'NR > 1 { print $c }' $stat); do
+		sum=$((sum + 0x$v))
+	done
+	echo $sum
+}
+
+cleanup()
+{
+	ip netns del c 2>/dev/null
+	ip netns del r 2>/dev/null
+	ip netns del s 2>/dev/null
+}
+
+setup()
+{
+	ip netns add c || return 1
+	ip netns add r || return 1
+	ip netns add s || return 1
+
+	ip link add veth0 netns c type veth peer name veth0 netns r || return 1
+	ip link add veth1 netns r type veth peer name veth0 netns s || return 1
+
+	ip -net c addr add 10.0.1.2/24 dev veth0
+	ip -net r addr add 10.0.1.1/24 dev veth0
+	ip -net r addr add 10.0.2.1/24 dev veth1
+	ip -net s addr add 10.0.2.2/24 dev veth0
+	for ns in c r s; do
+		ip -net $ns link set lo up
+		ip -net $ns link set veth0 up
+	done
+	ip -net r link set veth1 up
+	ip -net c route add default via 10.0.1.1
+	ip -net s route add 10.0.1.0/24 via 10.0.2.1
+	ip netns exec r sysctl -q -w net.ipv4.ip_forward=1
+}
+
+# run the streams, print the aggregate MB/s
+run()
+{
+	i=0
+	while [ $i -lt $streams ]; do
+		timeout 120 ip netns exec s nc -l -p $((port + i)) > /dev/null &
+		i=$((i + 1))
+	done
+	sleep 1
+
+	start=$(date +%s%N)
+	i=0
+	while [ $i -lt $streams ]; do
+		dd if=/dev/zero bs=1M count=$size_mb 2>/dev/null |
+			timeout 120 ip netns exec c nc -w 5 10.0.2.2 \
+				$((port + i)) &
+		i=$((i + 1))
+	done
+	wait
+	end=$(date +%s%N)
+
+	echo $((streams * size_mb * 1000000000 / (end - start)))
+}
+
+if [ "$(id -u)" != 0 ]; then
+	echo "SKIP: must be run as root"
+	exit 0
+fi
+
+if ! command -v nc > /dev/null; then
+	echo "SKIP: nc not found"
+	exit 0
+fi
+
+trap cleanup EXIT
+
+if ! setup; then
+	echo "SKIP: could not set up namespaces or veth"
+	exit 0
+fi
+
+echo "# $streams streams of $size_mb MB through a router namespace"
+echo
+
+echo "routed:    $(run) MB/s"
+
+if ! ip netns exec r iptables -t nat -A POSTROUTING -o veth1 \
+		-j MASQUERADE; then
+	echo "SKIP: no iptables NAT support"
+	exit 0
+fi
+if [ ! -r $stat ]; then
+	echo "SKIP: no $stat, nf_conntrack is not loaded"
+	exit 0
+fi
+
+searched=$(ct_stat 2)
+found=$(ct_stat 3)
+restart=$(ct_stat 17)
+
+echo "NAT:       $(run) MB/s"
+echo "conntrack: $(($(ct_stat 3) - found)) found," \
+	"$(($(ct_stat 2) - searched)) entries searched," \
+	"$(($(ct_stat 17) - restart)) restarted"
+exit 0
@@ -0,0 +1,115 @@
+#!/bin/sh
+#
+# Check and time the mass storage gadget over dummy_hcd.
+#
+# A loop device backed by a scratch image is exported as the LUN of
+# g_mass_storage, and the disk dummy_hcd enumerates on the host side is
+# written and read back with direct IO.  The data read back, and the
+# data that reached the loop device, must match what was written.  Each
+# pass prints the host side rates and the LUN's "stats" attribute, once
+# with write-behind disabled and once with the default chunk size.
+#
+# Usage: mass-storage-test.sh [MB]
+#
+# Needs root, losetup, dd and cmp, and dummy_hcd and g_mass_storage as
+# modules.  Nothing else may use dummy_hcd while it runs.
+
+SIZE_MB=${1:-64}
+PARAMS=/sys/module/g_mass_storage/parameters
+
+TMP=$(mktemp -d)
+LOOP=''
+
+cleanup ()
+{
+    rmmod g_mass_storage 2>/dev/null
+    rmmod dummy_hcd 2>/dev/null
+    [ -n "$LOOP" ] && losetup -d $LOOP
+    rm -rf $TMP
+}
+
+skip ()
+{
+    echo "SKIP: $*"
+    exit 0
+}
+
+fail ()
+{
+    echo "FAIL: $*"
+    exit 1
+}
+
+# print the host side disk of the gadget, once it shows up
+find_disk ()
+{
+    for try in 1 2 3 4 5 6 7 8 9 10; do
+	for d in /sys/block/sd*; do
+	    [ -e $d/device ] || continue
+	    case $(readlink -f $d/device) in
+	    */dummy_hcd*)
+		echo /dev/${d##*/}
+		return 0
+		;;
+	    esac
+	done
+	sleep 1
+    done
+    return 1
+}
+
+# print MB/s for SIZE_MB moved between start and now
+rate ()
+{
+    end=$(date +%s%N)
+    echo $((SIZE_MB * 1000000000 / (end - $1))) MB/s
+}
+
+run ()
+{
+    echo "write_behind_kb=$1"
+    echo $1 > $PARAMS/write_behind_kb
+    echo 0 > $STATS
+
+    start=$(date +%s%N)
+    dd if=$TMP/data of=$DISK bs=1M oflag=direct 2>/dev/null ||
+	fail "write to $DISK"
+    echo "  write: $(rate $start)"
+
+    start=$(date +%s%N)
+    dd if=$DISK of=$TMP/back bs=1M count=$SIZE_MB iflag=direct \
+	2>/dev/null || fail "read from $DISK"
+    echo "  read:  $(rate $start)"
+
+    cmp -s $TMP/data $TMP/back || fail "data read back differs"
+    cmp -s -n $((SIZE_MB << 20)) $TMP/data $LOOP ||
+	fail "data on $LOOP differs"
+
+    sed 's/^/  /' $STATS
+}
+
+if [ "$(id -u)" != 0 ]; then
+    skip "must be run as root"
+fi
+
+trap cleanup EXIT
+
+dd if=/dev/zero of=$TMP/image bs=1M count=$SIZE_MB 2>/dev/null ||
+    skip "no room for a $SIZE_MB MB image"
+dd if=/dev/urandom of=$TMP/data bs=1M count=$SIZE_MB 2>/dev/null
+LOOP=$(losetup -f --show $TMP/image) || skip "no loop device"
+
+modprobe dummy_hcd || skip "dummy_hcd not available"
+modprobe g_mass_storage file=$LOOP removable=1 ||
+    skip "g_mass_storage not available"
+
+DISK=$(find_disk) || fail "no disk appeared on dummy_hcd"
+STATS=$(echo /sys/devices/platform/dummy_udc*/gadget/lun0/stats)
+[ -e "$STATS" ] || fail "no LUN stats attribute"
+
+WB_KB=$(cat $PARAMS/write_behind_kb)
+
+echo "$SIZE_MB MB through $DISK, backed by $LOOP"
+run 0
+run $WB_KB
+echo "PASS"
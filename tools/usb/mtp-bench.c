@@ -0,0 +1,403 @@
+/*
+ * mtp-bench.c -- throughput benchmark for the MTP gadget function
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* $(CROSS_COMPILE)cc -Wall -Wextra -g -o mtp-bench mtp-bench.c */
+
+/*
+ * Times file transfers through f_mtp without an MTP stack on either
+ * side.  On the gadget, the MTP_SEND_FILE and MTP_RECEIVE_FILE ioctls
+ * of /dev/mtp_usb are issued directly, the way MtpServer does for the
+ * data phase of GetObject and SendObject.  On the host, the bulk
+ * endpoints of the vendor specific MTP interface are driven through
+ * usbfs with several URBs in flight, the way libmtp streams data.
+ *
+ * With dummy_hcd both sides run on one machine:
+ *
+ *   modprobe dummy_hcd
+ *   echo 0 > /sys/class/android_usb/android0/enable
+ *   echo mtp > /sys/class/android_usb/android0/functions
+ *   echo 1 > /sys/class/android_usb/android0/enable
+ *
+ *   mtp-bench -g send -f <file> -l 256M &	# GetObject
+ *   mtp-bench -H in -l 256M
+ *
+ *   mtp-bench -g receive -f <file> -l 256M &	# SendObject
+ *   mtp-bench -H out -l 256M
+ *
+ * Each side prints its own time and rate; the host side is the one a
+ * user sees.  Stop MtpServer first, /dev/mtp_usb has a single opener.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <linux/usbdevice_fs.h>
+
+#include "../../include/linux/usb/f_mtp.h"
+
+
+#define MTP_DEV		"/dev/mtp_usb"
+#define USB_DIR		"/dev/bus/usb"
+
+/* usbfs limits a single URB to this in this kernel */
+#define URB_LEN		16384
+#define URB_MAX		64
+
+#define USB_DT_INTERFACE		0x04
+#define USB_DT_ENDPOINT			0x05
+#define USB_CLASS_VENDOR_SPEC		0xff
+#define USB_SUBCLASS_VENDOR_SPEC	0xff
+#define USB_ENDPOINT_XFER_BULK		2
+#define USB_DIR_IN			0x80
+
+static int queue_depth = 8;
+
+
+/******************** Helpers ***********************************************/
+
+static void die(const char *fmt, ...)
+{
+	int err = errno;
+	va_list ap;
+
+	fputs("mtp-bench: ", stderr);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, ": %s\n", strerror(err));
+	exit(1);
+}
+
+static long long parse_size(const char *s)
+{
+	char *end;
+	long long v = strtoll(s, &end, 0);
+
+	switch (*end) {
+	case 'g': case 'G':
+		v <<= 10;
+		/* fall through */
+	case 'm': case 'M':
+		v <<= 10;
+		/* fall through */
+	case 'k': case 'K':
+		v <<= 10;
+		end++;
+	}
+	if (*end || v <= 0) {
+		fprintf(stderr, "mtp-bench: bad size '%s'\n", s);
+		exit(2);
+	}
+	return v;
+}
+
+static double elapsed(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) +
+		(now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void report(const char *what, long long bytes, double secs)
+{
+	printf("%s: %lld bytes in %.3f s, %.1f MB/s\n", what, bytes, secs,
+	       secs > 0 ? bytes / secs / (1 << 20) : 0.0);
+}
+
+
+/******************** Gadget side *******************************************/
+
+static void gadget(const char *mode, const char *path, long long length)
+{
+	struct mtp_file_range mfr;
+	struct timeval start;
+	int send = !strcmp(mode, "send");
+	int mtp, fd;
+
+	if (!send && strcmp(mode, "receive")) {
+		fprintf(stderr, "mtp-bench: -g takes send or receive\n");
+		exit(2);
+	}
+	if (!path)
+		path = send ? "/dev/zero" : "/dev/null";
+
+	fd = send ? open(path, O_RDONLY)
+		  : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die("%s", path);
+	mtp = open(MTP_DEV, O_RDWR);
+	if (mtp < 0)
+		die("%s", MTP_DEV);
+
+	memset(&mfr, 0, sizeof(mfr));
+	mfr.fd = fd;
+	mfr.offset = 0;
+	mfr.length = length;
+
+	gettimeofday(&start, NULL);
+	if (ioctl(mtp, send ? MTP_SEND_FILE : MTP_RECEIVE_FILE, &mfr) < 0)
+		die(send ? "MTP_SEND_FILE" : "MTP_RECEIVE_FILE");
+	if (!send && fsync(fd) < 0 && errno != EINVAL)
+		die("fsync");
+	report(send ? "gadget send" : "gadget receive", length,
+	       elapsed(&start));
+
+	close(mtp);
+	close(fd);
+}
+
+
+/******************** Host side *********************************************/
+
+struct mtp_intf {
+	char		path[PATH_MAX];
+	unsigned	number;
+	unsigned char	ep_in;
+	unsigned char	ep_out;
+	unsigned	maxpacket;	/* of ep_in */
+};
+
+/* Look for a vendor specific interface with a bulk pair in @path */
+static int find_intf(const char *path, struct mtp_intf *intf)
+{
+	unsigned char desc[4096], *p;
+	int fd, len, in_intf = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	len = read(fd, desc, sizeof(desc));
+	close(fd);
+
+	memset(intf, 0, sizeof(*intf));
+	for (p = desc; len > 1 && p + p[0] <= desc + len && p[0] >= 2;
+	     p += p[0]) {
+		if (p[1] == USB_DT_INTERFACE && p[0] >= 9) {
+			if (intf->ep_in && intf->ep_out)
+				break;
+			in_intf = p[5] == USB_CLASS_VENDOR_SPEC &&
+				  p[6] == USB_SUBCLASS_VENDOR_SPEC;
+			intf->number = p[2];
+			intf->ep_in = intf->ep_out = 0;
+		} else if (p[1] == USB_DT_ENDPOINT && p[0] >= 7 && in_intf &&
+			   (p[3] & 3) == USB_ENDPOINT_XFER_BULK) {
+			if (p[2] & USB_DIR_IN) {
+				intf->ep_in = p[2];
+				intf->maxpacket = (p[4] | p[5] << 8) & 0x7ff;
+			} else
+				intf->ep_out = p[2];
+		}
+	}
+	if (!intf->ep_in || !intf->ep_out)
+		return 0;
+	snprintf(intf->path, sizeof(intf->path), "%s", path);
+	return 1;
+}
+
+static int scan_devices(struct mtp_intf *intf)
+{
+	char path[PATH_MAX];
+	struct dirent *bus, *dev;
+	DIR *bd, *dd;
+	int found = 0;
+
+	bd = opendir(USB_DIR);
+	if (!bd)
+		die("%s", USB_DIR);
+	while (!found && (bus = readdir(bd))) {
+		if (bus->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), USB_DIR "/%s", bus->d_name);
+		dd = opendir(path);
+		if (!dd)
+			continue;
+		while (!found && (dev = readdir(dd))) {
+			if (dev->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), USB_DIR "/%s/%s",
+				 bus->d_name, dev->d_name);
+			found = find_intf(path, intf);
+		}
+		closedir(dd);
+	}
+	closedir(bd);
+	return found;
+}
+
+static void host(const char *mode, const char *path, long long length)
+{
+	static unsigned char bufs[URB_MAX][URB_LEN];
+	struct usbdevfs_urb urbs[URB_MAX], *urb;
+	struct usbdevfs_ioctl cmd;
+	struct mtp_intf intf;
+	struct timeval start;
+	long long queued = 0, done = 0;
+	int in = !strcmp(mode, "in");
+	int fd, i, pending = 0;
+
+	if (!in && strcmp(mode, "out")) {
+		fprintf(stderr, "mtp-bench: -H takes in or out\n");
+		exit(2);
+	}
+	if (path ? !find_intf(path, &intf) : !scan_devices(&intf)) {
+		fprintf(stderr, "mtp-bench: no MTP interface found\n");
+		exit(1);
+	}
+
+	fd = open(intf.path, O_RDWR);
+	if (fd < 0)
+		die("%s", intf.path);
+
+	/* take the interface from whatever driver holds it */
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.ifno = intf.number;
+	cmd.ioctl_code = USBDEVFS_DISCONNECT;
+	ioctl(fd, USBDEVFS_IOCTL, &cmd);
+	if (ioctl(fd, USBDEVFS_CLAIMINTERFACE, &intf.number) < 0)
+		die("claim interface %u", intf.number);
+
+	memset(urbs, 0, sizeof(urbs));
+	if (!in)
+		memset(bufs, 0x5a, sizeof(bufs));
+
+	gettimeofday(&start, NULL);
+	for (;;) {
+		/* keep queue_depth URBs in flight until all are queued */
+		for (i = 0; i < queue_depth && queued < length; i++) {
+			urb = &urbs[i];
+			if (urb->usercontext)
+				continue;
+			urb->type = USBDEVFS_URB_TYPE_BULK;
+			urb->endpoint = in ? intf.ep_in : intf.ep_out;
+			urb->buffer = bufs[i];
+			urb->buffer_length = length - queued < URB_LEN ?
+					     length - queued : URB_LEN;
+			urb->usercontext = urb;
+			if (ioctl(fd, USBDEVFS_SUBMITURB, urb) < 0)
+				die("submit urb");
+			queued += urb->buffer_length;
+			pending++;
+		}
+		if (!pending)
+			break;
+
+		if (ioctl(fd, USBDEVFS_REAPURB, &urb) < 0)
+			die("reap urb");
+		urb->usercontext = NULL;
+		pending--;
+		if (urb->status) {
+			errno = -urb->status;
+			die("urb on ep %02x", urb->endpoint);
+		}
+		done += urb->actual_length;
+
+		/* the gadget ended the transfer with a short packet */
+		if (in && urb->actual_length < urb->buffer_length) {
+			for (i = 0; i < queue_depth; i++)
+				if (urbs[i].usercontext)
+					ioctl(fd, USBDEVFS_DISCARDURB,
+					      &urbs[i]);
+			while (pending && !ioctl(fd, USBDEVFS_REAPURB, &urb)) {
+				if (!urb->status)
+					done += urb->actual_length;
+				pending--;
+			}
+			break;
+		}
+	}
+	/* f_mtp ends a transfer of whole packets with a zero length one */
+	if (in && done == length && intf.maxpacket &&
+	    !(length % intf.maxpacket)) {
+		urb = &urbs[0];
+		urb->buffer_length = intf.maxpacket;
+		if (ioctl(fd, USBDEVFS_SUBMITURB, urb) < 0 ||
+		    ioctl(fd, USBDEVFS_REAPURB, &urb) < 0)
+			die("zero length packet");
+	}
+	report(in ? "host in" : "host out", done, elapsed(&start));
+
+	ioctl(fd, USBDEVFS_RELEASEINTERFACE, &intf.number);
+	close(fd);
+}
+
+
+/******************** Main **************************************************/
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: mtp-bench -g send|receive [-f file] [-l length]\n"
+		"       mtp-bench -H in|out [-D /dev/bus/usb/BBB/DDD]"
+		" [-l length] [-q urbs]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *gadget_mode = NULL, *host_mode = NULL;
+	const char *file = NULL, *device = NULL;
+	long long length = 64 << 20;
+	int c;
+
+	while ((c = getopt(argc, argv, "g:H:f:D:l:q:")) != -1) {
+		switch (c) {
+		case 'g':
+			gadget_mode = optarg;
+			break;
+		case 'H':
+			host_mode = optarg;
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 'D':
+			device = optarg;
+			break;
+		case 'l':
+			length = parse_size(optarg);
+			break;
+		case 'q':
+			queue_depth = atoi(optarg);
+			if (queue_depth < 1 || queue_depth > URB_MAX)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || !gadget_mode == !host_mode)
+		usage();
+
+	if (gadget_mode)
+		gadget(gadget_mode, file, length);
+	else
+		host(host_mode, device, length);
+	return 0;
+}